@@ -0,0 +1,426 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Usage: Leyden_Jar_Analyzer [-j threads] [--json file] [--csv file] [--grid [grid options]] recording...
+// Analyses level recordings made by Leyden Jar Diagnostic Tool, optionally searching the best thresholds and debounce settings.
+// JSON report goes to standard output unless a file is given, summary and errors go to standard error.
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <json/json.h>
+
+#include "LeydenJarTaskPool.h"
+#include "LeydenJarSessionAnalysis.h"
+#include "LeydenJarGridSearch.h"
+#include "LeydenJarLevelCompare.h"
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: Leyden_Jar_Analyzer [-j threads] [--json file] [--csv file] [--grid [grid options]] recording...\n");
+    fprintf(stderr, "  -j threads    number of worker threads, default is one per hardware thread\n");
+    fprintf(stderr, "  --json file   writes the JSON report to file instead of standard output\n");
+    fprintf(stderr, "  --csv file    writes a CSV report with one line per key and recording\n");
+    fprintf(stderr, "  --grid        replays recordings through a grid of thresholds and debounce settings\n");
+    fprintf(stderr, "Grid options:\n");
+    fprintf(stderr, "  --grid-thresholds min:max:step   threshold offsets to the recorded bin thresholds, default -40:40:4\n");
+    fprintf(stderr, "  --grid-debounce min:max:step     debounce times in ms, default 0:20:1\n");
+    fprintf(stderr, "  --grid-window ms                 match window around reference presses, default 30\n");
+    fprintf(stderr, "  --grid-top n                     number of ranked settings in the report, default 10\n");
+}
+
+static bool ParseRange(const char* pText, float& min, float& max, float& step)
+{
+    return sscanf(pText, "%f:%f:%f", &min, &max, &step) == 3 && min <= max && step > 0.f;
+}
+
+static Json::Value GridResultToJson(const LeydenJarGridSearch::LeydenJarGridResult& result, const LeydenJarRecordingHeader& header, bool hasDebounce)
+{
+    Json::Value value(Json::objectValue);
+
+    if (hasDebounce)
+    {
+        value["debounce"] = LeydenJarGridSearch::GetDebounceModelName(result.debounceModel);
+        value["debounce_ms"] = result.debounceMs;
+    }
+    value["false_presses"] = Json::UInt64(result.nbFalsePresses);
+    value["missed_presses"] = Json::UInt64(result.nbMissedPresses);
+
+    // Only bins with used keys are listed
+    Json::Value thresholds(Json::arrayValue);
+    for (int bin = 0; bin < header.nbBins && bin < 16; bin++)
+    {
+        bool isUsed = false;
+        for (int col = 0; col < header.nbPhysicalCols; col++)
+            for (int row = 0; row < header.nbPhysicalRows; row++)
+                isUsed |= header.binningMap[col][row] == bin;
+        if (isUsed == false)
+            continue;
+
+        Json::Value binValue(Json::objectValue);
+        binValue["bin"] = bin;
+        binValue["threshold"] = result.thresholds[bin];
+        thresholds.append(binValue);
+    }
+    value["thresholds"] = thresholds;
+
+    return value;
+}
+
+static Json::Value GridSearchToJson(LeydenJarGridSearch& gridSearch, const LeydenJarRecordingHeader& header, int nbTopResults)
+{
+    const std::vector<LeydenJarGridSearch::LeydenJarGridResult>& results = gridSearch.GetRankedResults();
+    Json::Value value(Json::objectValue);
+
+    value["frames"] = Json::UInt64(gridSearch.GetNbFrames());
+    value["reference_presses"] = Json::UInt64(gridSearch.GetNbReferencePresses());
+    value["threshold_candidates"] = gridSearch.GetNbThresholdCandidates();
+    value["debounce_settings"] = gridSearch.GetNbDebounceSettings();
+    value["baseline"] = GridResultToJson(gridSearch.GetBaselineResult(), header, false);
+
+    Json::Value ranking(Json::arrayValue);
+    for (size_t i = 0; i < results.size() && int(i) < nbTopResults; i++)
+        ranking.append(GridResultToJson(results[i], header, true));
+    value["ranking"] = ranking;
+
+    return value;
+}
+
+static Json::Value PopulationToJson(const LeydenJarThresholdAdvisor::LeydenJarLevelPopulation& population)
+{
+    Json::Value value(Json::objectValue);
+
+    value["samples"] = Json::UInt64(population.nbSamples);
+    if (population.nbSamples != 0)
+    {
+        value["mean"] = population.mean;
+        value["std_dev"] = population.stdDev;
+        value["worst"] = population.worstLevel;
+    }
+
+    return value;
+}
+
+static Json::Value ChatterToJson(const LeydenJarChatterDetector::LeydenJarKeyChatterCounters& counters)
+{
+    Json::Value value(Json::objectValue);
+
+    value["presses"] = counters.nbPresses;
+    value["bounces"] = counters.nbBounces;
+    value["oscillations"] = counters.nbOscillations;
+    if (counters.minEdgeIntervalUs != 0xFFFFFFFF)
+        value["min_edge_interval_us"] = counters.minEdgeIntervalUs;
+
+    return value;
+}
+
+static Json::Value SessionToJson(LeydenJarSessionAnalysis& session)
+{
+    const LeydenJarRecordingHeader& header = session.GetHeader();
+    Json::Value value(Json::objectValue);
+
+    value["file"] = session.GetFileName();
+    value["switch_technology"] = header.switchTechnology == SwitchTechnologyBeamSpring ? "beam_spring" : "model_f";
+    value["physical_cols"] = header.nbPhysicalCols;
+    value["physical_rows"] = header.nbPhysicalRows;
+    value["duration_s"] = session.GetDurationNs() / 1e9;
+    value["level_records"] = Json::UInt64(session.GetNbRecords(LeydenJarRecordLevels));
+    value["physical_records"] = Json::UInt64(session.GetNbRecords(LeydenJarRecordPhysical));
+    value["logical_records"] = Json::UInt64(session.GetNbRecords(LeydenJarRecordLogical));
+    value["corrupted_chunks"] = session.GetNbCorruptedChunks();
+    value["truncated"] = session.IsTruncated();
+
+    Json::Value keys(Json::arrayValue);
+    for (int col = 0; col < header.nbPhysicalCols; col++)
+    {
+        for (int row = 0; row < header.nbPhysicalRows; row++)
+        {
+            const LeydenJarSessionAnalysis::LeydenJarKeyReport& report = session.GetKeyReport(col, row);
+            if (report.isUsed == false)
+                continue;
+
+            Json::Value key(Json::objectValue);
+            key["col"] = col;
+            key["row"] = row;
+            key["bin"] = report.bin;
+            key["threshold"] = report.threshold;
+            key["samples"] = Json::UInt64(report.nbSamples);
+            if (report.nbSamples != 0)
+            {
+                key["mean"] = report.mean;
+                key["std_dev"] = report.stdDev;
+                key["min"] = report.min;
+                key["max"] = report.max;
+            }
+            key["unpressed"] = PopulationToJson(report.unpressed);
+            key["pressed"] = PopulationToJson(report.pressed);
+            if (report.unpressed.nbSamples != 0)
+                key["unpressed_margin"] = report.unpressedMargin;
+            if (report.pressed.nbSamples != 0)
+                key["pressed_margin"] = report.pressedMargin;
+            key["physical_chatter"] = ChatterToJson(report.chatter[LeydenJarChatterDetector::ChatterSourcePhysical]);
+            key["level_chatter"] = ChatterToJson(report.chatter[LeydenJarChatterDetector::ChatterSourceLevels]);
+            keys.append(key);
+        }
+    }
+    value["keys"] = keys;
+
+    Json::Value bins(Json::arrayValue);
+    for (int bin = 0; bin < header.nbBins && bin < LeydenJarThresholdAdvisor::kNbBins; bin++)
+    {
+        const LeydenJarThresholdAdvisor::LeydenJarBinRecommendation& recommendation = session.GetBinRecommendation(bin);
+        if (recommendation.nbKeys == 0)
+            continue;
+
+        Json::Value binValue(Json::objectValue);
+        binValue["bin"] = bin;
+        binValue["keys"] = recommendation.nbKeys;
+        binValue["current_threshold"] = recommendation.currentThreshold;
+        binValue["unpressed"] = PopulationToJson(recommendation.unpressed);
+        binValue["pressed"] = PopulationToJson(recommendation.pressed);
+        if (recommendation.isValid)
+        {
+            binValue["recommended_threshold"] = recommendation.recommendedThreshold;
+            binValue["margin_sigma"] = recommendation.marginSigma;
+            binValue["current_false_press_rate"] = recommendation.currentFalsePressRate;
+            binValue["current_missed_press_rate"] = recommendation.currentMissedPressRate;
+            binValue["false_press_rate"] = recommendation.falsePressRate;
+            binValue["missed_press_rate"] = recommendation.missedPressRate;
+        }
+        bins.append(binValue);
+    }
+    value["bins"] = bins;
+
+    return value;
+}
+
+static bool WriteCsv(const char* pFileName, std::vector< std::unique_ptr<LeydenJarSessionAnalysis> >& sessions)
+{
+    FILE* pFile = fopen(pFileName, "w");
+    if (pFile == nullptr)
+        return false;
+
+    fprintf(pFile, "file,col,row,bin,threshold,samples,mean,std_dev,min,max,unpressed_samples,unpressed_worst,unpressed_margin,pressed_samples,pressed_worst,pressed_margin,physical_presses,physical_bounces,physical_min_edge_interval_us,level_presses,level_bounces,level_oscillations,level_min_edge_interval_us\n");
+
+    for (size_t i = 0; i < sessions.size(); i++)
+    {
+        LeydenJarSessionAnalysis& session = *sessions[i];
+        const LeydenJarRecordingHeader& header = session.GetHeader();
+
+        for (int col = 0; col < header.nbPhysicalCols; col++)
+        {
+            for (int row = 0; row < header.nbPhysicalRows; row++)
+            {
+                const LeydenJarSessionAnalysis::LeydenJarKeyReport& report = session.GetKeyReport(col, row);
+                if (report.isUsed == false)
+                    continue;
+
+                // Values that could not be measured are left empty
+                fprintf(pFile, "\"%s\",%d,%d,%d,%d,%llu,", session.GetFileName().c_str(), col, row, report.bin, report.threshold, (unsigned long long)report.nbSamples);
+                if (report.nbSamples != 0)
+                    fprintf(pFile, "%.2f,%.2f,%d,%d,", report.mean, report.stdDev, report.min, report.max);
+                else
+                    fprintf(pFile, ",,,,");
+                fprintf(pFile, "%llu,", (unsigned long long)report.unpressed.nbSamples);
+                if (report.unpressed.nbSamples != 0)
+                    fprintf(pFile, "%d,%d,", report.unpressed.worstLevel, report.unpressedMargin);
+                else
+                    fprintf(pFile, ",,");
+                fprintf(pFile, "%llu,", (unsigned long long)report.pressed.nbSamples);
+                if (report.pressed.nbSamples != 0)
+                    fprintf(pFile, "%d,%d,", report.pressed.worstLevel, report.pressedMargin);
+                else
+                    fprintf(pFile, ",,");
+                const LeydenJarChatterDetector::LeydenJarKeyChatterCounters& physical = report.chatter[LeydenJarChatterDetector::ChatterSourcePhysical];
+                const LeydenJarChatterDetector::LeydenJarKeyChatterCounters& level = report.chatter[LeydenJarChatterDetector::ChatterSourceLevels];
+                fprintf(pFile, "%u,%u,", physical.nbPresses, physical.nbBounces);
+                if (physical.minEdgeIntervalUs != 0xFFFFFFFF)
+                    fprintf(pFile, "%u,", physical.minEdgeIntervalUs);
+                else
+                    fprintf(pFile, ",");
+                fprintf(pFile, "%u,%u,%u,", level.nbPresses, level.nbBounces, level.nbOscillations);
+                if (level.minEdgeIntervalUs != 0xFFFFFFFF)
+                    fprintf(pFile, "%u\n", level.minEdgeIntervalUs);
+                else
+                    fprintf(pFile, "\n");
+            }
+        }
+    }
+
+    bool isSuccess = ferror(pFile) == 0;
+    fclose(pFile);
+
+    return isSuccess;
+}
+
+int main(int argc, char** argv)
+{
+    int nbThreads = 0;
+    const char* pJsonFileName = nullptr;
+    const char* pCsvFileName = nullptr;
+    bool isGridSearch = false;
+    int nbTopResults = 10;
+    LeydenJarGridSearch::LeydenJarGridConfig gridConfig = LeydenJarGridSearch().GetConfig();
+    std::vector<const char*> fileNames;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            nbThreads = atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            pJsonFileName = argv[++i];
+        else if (std::strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+            pCsvFileName = argv[++i];
+        else if (std::strcmp(argv[i], "--grid") == 0)
+            isGridSearch = true;
+        else if (std::strcmp(argv[i], "--grid-thresholds") == 0 && i + 1 < argc)
+        {
+            float min, max, step;
+            if (ParseRange(argv[++i], min, max, step) == false)
+            {
+                PrintUsage();
+                return 1;
+            }
+            gridConfig.minThresholdOffset = int(min);
+            gridConfig.maxThresholdOffset = int(max);
+            gridConfig.thresholdStep = std::max(1, int(step));
+        }
+        else if (std::strcmp(argv[i], "--grid-debounce") == 0 && i + 1 < argc)
+        {
+            if (ParseRange(argv[++i], gridConfig.minDebounceMs, gridConfig.maxDebounceMs, gridConfig.debounceStepMs) == false)
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--grid-window") == 0 && i + 1 < argc)
+            gridConfig.matchWindowMs = float(atof(argv[++i]));
+        else if (std::strcmp(argv[i], "--grid-top") == 0 && i + 1 < argc)
+            nbTopResults = atoi(argv[++i]);
+        else if (argv[i][0] == '-')
+        {
+            PrintUsage();
+            return 1;
+        }
+        else
+            fileNames.push_back(argv[i]);
+    }
+
+    if (fileNames.empty())
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    LeydenJarTaskPool pool(nbThreads);
+    std::vector< std::unique_ptr<LeydenJarSessionAnalysis> > sessions;
+    int result = 0;
+
+    // Chunks of all files are queued before waiting on any of them so that files are analysed in parallel too
+    for (size_t i = 0; i < fileNames.size(); i++)
+    {
+        std::unique_ptr<LeydenJarSessionAnalysis> pSession(new LeydenJarSessionAnalysis());
+        std::string error;
+
+        if (pSession->Open(fileNames[i], error) == false)
+        {
+            fprintf(stderr, "%s: %s\n", fileNames[i], error.c_str());
+            result = 1;
+            continue;
+        }
+        pSession->Submit(pool);
+        sessions.push_back(std::move(pSession));
+    }
+
+    Json::Value root(Json::objectValue);
+    Json::Value recordings(Json::arrayValue);
+    uint64_t nbLevelRecords = 0;
+
+    for (size_t i = 0; i < sessions.size(); i++)
+    {
+        LeydenJarSessionAnalysis& session = *sessions[i];
+
+        session.Finish(pool);
+        recordings.append(SessionToJson(session));
+        nbLevelRecords += session.GetNbRecords(LeydenJarRecordLevels);
+
+        if (session.GetNbCorruptedChunks() != 0 || session.IsTruncated())
+        {
+            fprintf(stderr, "%s: %d corrupted chunks%s\n", session.GetFileName().c_str(), session.GetNbCorruptedChunks(),
+                session.IsTruncated() ? ", truncated" : "");
+        }
+    }
+
+    // Grid searches need the key populations of the finished sessions, all of them are queued before waiting
+    if (isGridSearch)
+    {
+        std::vector< std::unique_ptr<LeydenJarGridSearch> > gridSearches;
+
+        for (size_t i = 0; i < sessions.size(); i++)
+        {
+            std::unique_ptr<LeydenJarGridSearch> pGridSearch(new LeydenJarGridSearch());
+            pGridSearch->SetConfig(gridConfig);
+            pGridSearch->Submit(pool, *sessions[i]);
+            gridSearches.push_back(std::move(pGridSearch));
+        }
+
+        for (size_t i = 0; i < sessions.size(); i++)
+        {
+            LeydenJarGridSearch& gridSearch = *gridSearches[i];
+
+            gridSearch.Finish(pool);
+            recordings[Json::ArrayIndex(i)]["grid_search"] = GridSearchToJson(gridSearch, sessions[i]->GetHeader(), nbTopResults);
+
+            const LeydenJarGridSearch::LeydenJarGridResult& baseline = gridSearch.GetBaselineResult();
+            const LeydenJarGridSearch::LeydenJarGridResult& best = gridSearch.GetRankedResults().front();
+            fprintf(stderr, "%s: %llu reference presses, recorded thresholds %llu false %llu missed, best %s %.1f ms %llu false %llu missed\n",
+                sessions[i]->GetFileName().c_str(), (unsigned long long)gridSearch.GetNbReferencePresses(),
+                (unsigned long long)baseline.nbFalsePresses, (unsigned long long)baseline.nbMissedPresses,
+                LeydenJarGridSearch::GetDebounceModelName(best.debounceModel), best.debounceMs,
+                (unsigned long long)best.nbFalsePresses, (unsigned long long)best.nbMissedPresses);
+        }
+    }
+    root["recordings"] = recordings;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    std::unique_ptr<Json::StreamWriter> pWriter(builder.newStreamWriter());
+
+    if (pJsonFileName != nullptr)
+    {
+        std::ofstream jsonFile(pJsonFileName);
+        pWriter->write(root, &jsonFile);
+        jsonFile << "\n";
+        if (!jsonFile)
+        {
+            fprintf(stderr, "Cannot write JSON report to %s\n", pJsonFileName);
+            result = 1;
+        }
+    }
+    else
+    {
+        pWriter->write(root, &std::cout);
+        std::cout << "\n";
+    }
+
+    if (pCsvFileName != nullptr && WriteCsv(pCsvFileName, sessions) == false)
+    {
+        fprintf(stderr, "Cannot write CSV report to %s\n", pCsvFileName);
+        result = 1;
+    }
+
+    double elapsedS = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    fprintf(stderr, "Analysed %d recordings, %llu level records in %.3f s with %d threads\n", int(sessions.size()),
+        (unsigned long long)nbLevelRecords, elapsedS, pool.GetNbWorkers());
+
+    return result;
+}
@@ -0,0 +1,629 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "LeydenJarGridSearch.h"
+#include "LeydenJarLevelCompare.h"
+
+LeydenJarGridSearch::LeydenJarGridSearch()
+    : m_pSession(nullptr)
+    , m_NbReferencePresses(0)
+{
+    LeydenJarGridConfig config;
+
+    config.minThresholdOffset = -40;
+    config.maxThresholdOffset = 40;
+    config.thresholdStep = 4;
+    config.minDebounceMs = 0.f;
+    config.maxDebounceMs = 20.f;
+    config.debounceStepMs = 1.f;
+    config.matchWindowMs = 30.f;
+    SetConfig(config);
+
+    std::memset(m_KeyReferencePresses, 0, sizeof(m_KeyReferencePresses));
+    std::memset(&m_BaselineResult, 0, sizeof(m_BaselineResult));
+}
+
+LeydenJarGridSearch::~LeydenJarGridSearch()
+{
+    // Tasks reference this object, they must be done before it goes away
+    m_TaskGroup.Wait();
+}
+
+const char* LeydenJarGridSearch::GetDebounceModelName(int debounceModel)
+{
+    switch (debounceModel)
+    {
+        case DebounceSymDefer:
+            return "sym_defer_pk";
+        case DebounceSymEager:
+            return "sym_eager_pk";
+        case DebounceAsymEagerDefer:
+            return "asym_eager_defer_pk";
+        default:
+            return "unknown";
+    }
+}
+
+void LeydenJarGridSearch::SetConfig(const LeydenJarGridConfig& config)
+{
+    m_Config = config;
+
+    if (m_Config.thresholdStep < 1)
+        m_Config.thresholdStep = 1;
+    if (m_Config.maxThresholdOffset < m_Config.minThresholdOffset)
+        m_Config.maxThresholdOffset = m_Config.minThresholdOffset;
+    if (m_Config.minDebounceMs < 0.f)
+        m_Config.minDebounceMs = 0.f;
+    if (m_Config.maxDebounceMs < m_Config.minDebounceMs)
+        m_Config.maxDebounceMs = m_Config.minDebounceMs;
+    if (m_Config.debounceStepMs <= 0.f)
+        m_Config.debounceStepMs = 1.f;
+    if (m_Config.matchWindowMs < 0.f)
+        m_Config.matchWindowMs = 0.f;
+
+    m_ThresholdOffsets.clear();
+    for (int offset = m_Config.minThresholdOffset; offset <= m_Config.maxThresholdOffset; offset += m_Config.thresholdStep)
+        m_ThresholdOffsets.push_back(offset);
+    if (std::find(m_ThresholdOffsets.begin(), m_ThresholdOffsets.end(), 0) == m_ThresholdOffsets.end())
+    {
+        m_ThresholdOffsets.push_back(0);
+        std::sort(m_ThresholdOffsets.begin(), m_ThresholdOffsets.end());
+    }
+
+    // All models behave the same without debounce time, it is only evaluated once
+    std::vector<float> debounceTimesMs;
+    int nbSteps = int(std::floor((m_Config.maxDebounceMs - m_Config.minDebounceMs) / m_Config.debounceStepMs + 1e-3f));
+    for (int step = 0; step <= nbSteps; step++)
+        debounceTimesMs.push_back(m_Config.minDebounceMs + step * m_Config.debounceStepMs);
+    if (debounceTimesMs.front() != 0.f)
+        debounceTimesMs.insert(debounceTimesMs.begin(), 0.f);
+
+    m_DebounceSettings.clear();
+    for (size_t i = 0; i < debounceTimesMs.size(); i++)
+    {
+        for (int model = 0; model < DebounceModelCount; model++)
+        {
+            if (debounceTimesMs[i] == 0.f && model != DebounceSymDefer)
+                continue;
+
+            LeydenJarDebounceSetting setting;
+            setting.model = model;
+            setting.debounceMs = debounceTimesMs[i];
+            setting.debounceNs = uint64_t(debounceTimesMs[i] * 1000000.0);
+            m_DebounceSettings.push_back(setting);
+        }
+    }
+}
+
+const LeydenJarGridSearch::LeydenJarGridConfig& LeydenJarGridSearch::GetConfig()
+{
+    return m_Config;
+}
+
+void LeydenJarGridSearch::Submit(LeydenJarTaskPool& pool, LeydenJarSessionAnalysis& session)
+{
+    const LeydenJarRecordingHeader& header = session.GetHeader();
+    size_t nbFrames = 0;
+
+    m_pSession = &session;
+    m_LevelChunks.clear();
+    m_FirstFrames.clear();
+    m_IsChunkCorrupted.clear();
+
+    for (size_t chunkIdx = 0; chunkIdx < session.GetNbChunks(); chunkIdx++)
+    {
+        LeydenJarChunkHeader chunkHeader;
+        session.GetChunkHeader(chunkIdx, chunkHeader);
+        if (chunkHeader.stream != LeydenJarRecordLevels)
+            continue;
+
+        // Buffers are sized from record counts, a chunk with an invalid header gets no frames and is never decoded
+        bool isHeaderValid = IsChunkHeaderValid(chunkHeader);
+        m_LevelChunks.push_back(chunkIdx);
+        m_FirstFrames.push_back(nbFrames);
+        m_IsChunkCorrupted.push_back(isHeaderValid ? 0 : 1);
+        if (isHeaderValid)
+            nbFrames += chunkHeader.nbRecords;
+    }
+
+    m_Timestamps.assign(nbFrames, 0);
+    for (int col = 0; col < 18; col++)
+    {
+        for (int row = 0; row < 8; row++)
+        {
+            m_Traces[col * 8 + row].clear();
+            if (col < header.nbPhysicalCols && row < header.nbPhysicalRows && header.binningMap[col][row] < 16)
+                m_Traces[col * 8 + row].resize(nbFrames);
+        }
+    }
+
+    // Every chunk writes its own range of the traces
+    for (size_t i = 0; i < m_LevelChunks.size(); i++)
+        if (m_IsChunkCorrupted[i] == 0)
+            pool.Submit(m_TaskGroup, [this, i] { DecodeChunk(i); });
+}
+
+void LeydenJarGridSearch::DecodeChunk(size_t chunkIdx)
+{
+    LeydenJarChunkHeader chunkHeader;
+    std::vector<uint64_t> timestamps;
+    std::vector<uint8_t> records;
+
+    m_pSession->GetChunkHeader(m_LevelChunks[chunkIdx], chunkHeader);
+    if (m_pSession->DecodeChunk(m_LevelChunks[chunkIdx], timestamps, records) == false)
+    {
+        m_IsChunkCorrupted[chunkIdx] = 1;
+        return;
+    }
+
+    const uint16_t (*levels)[18][8] = reinterpret_cast<const uint16_t (*)[18][8]>(records.data());
+    size_t firstFrame = m_FirstFrames[chunkIdx];
+
+    std::memcpy(&m_Timestamps[firstFrame], timestamps.data(), chunkHeader.nbRecords * sizeof(uint64_t));
+    for (int key = 0; key < 18 * 8; key++)
+    {
+        if (m_Traces[key].empty())
+            continue;
+
+        uint16_t* pTrace = &m_Traces[key][firstFrame];
+        for (uint32_t record = 0; record < chunkHeader.nbRecords; record++)
+            pTrace[record] = levels[record][key / 8][key % 8];
+    }
+}
+
+void LeydenJarGridSearch::CompactCorruptedChunks()
+{
+    // Frames of decoded chunks are moved down over the ones of corrupted chunks in one pass, every gap starts a new segment
+    size_t nbFrames = 0;
+    bool isAfterGap = true;
+
+    m_SegmentFirstFrames.clear();
+    for (size_t i = 0; i < m_LevelChunks.size(); i++)
+    {
+        if (m_IsChunkCorrupted[i] != 0)
+        {
+            isAfterGap = true;
+            continue;
+        }
+
+        size_t firstFrame = m_FirstFrames[i];
+        size_t endFrame = (i + 1 < m_FirstFrames.size()) ? m_FirstFrames[i + 1] : m_Timestamps.size();
+        if (firstFrame == endFrame)
+            continue;
+
+        if (isAfterGap)
+            m_SegmentFirstFrames.push_back(nbFrames);
+        isAfterGap = false;
+
+        if (firstFrame != nbFrames)
+        {
+            std::copy(m_Timestamps.begin() + firstFrame, m_Timestamps.begin() + endFrame, m_Timestamps.begin() + nbFrames);
+            for (int key = 0; key < 18 * 8; key++)
+                if (m_Traces[key].empty() == false)
+                    std::copy(m_Traces[key].begin() + firstFrame, m_Traces[key].begin() + endFrame, m_Traces[key].begin() + nbFrames);
+        }
+        nbFrames += endFrame - firstFrame;
+    }
+
+    m_Timestamps.resize(nbFrames);
+    for (int key = 0; key < 18 * 8; key++)
+        if (m_Traces[key].empty() == false)
+            m_Traces[key].resize(nbFrames);
+}
+
+uint16_t LeydenJarGridSearch::GetCandidateThreshold(int bin, int thresholdIdx)
+{
+    int threshold = int(m_pSession->GetHeader().dacThreshold[bin]) + m_ThresholdOffsets[thresholdIdx];
+    return uint16_t(std::min(std::max(threshold, 0), 65535));
+}
+
+void LeydenJarGridSearch::Finish(LeydenJarTaskPool& pool)
+{
+    pool.Wait(m_TaskGroup);
+
+    CompactCorruptedChunks();
+
+    const LeydenJarRecordingHeader& header = m_pSession->GetHeader();
+
+    for (int col = 0; col < header.nbPhysicalCols; col++)
+        for (int row = 0; row < header.nbPhysicalRows; row++)
+            if (m_Traces[col * 8 + row].empty() == false)
+                pool.Submit(m_TaskGroup, [this, col, row] { EvaluateKey(col, row); });
+    pool.Wait(m_TaskGroup);
+
+    // Counts of the keys of every bin, a bin only depends on its own threshold
+    size_t nbThresholds = m_ThresholdOffsets.size();
+    size_t nbSettings = m_DebounceSettings.size();
+    std::vector<uint64_t> binCounts[16];
+    bool hasKeys[16] = {};
+
+    m_NbReferencePresses = 0;
+    for (int key = 0; key < 18 * 8; key++)
+    {
+        if (m_Traces[key].empty())
+            continue;
+
+        int bin = header.binningMap[key / 8][key % 8];
+        if (hasKeys[bin] == false)
+            binCounts[bin].assign(nbThresholds * nbSettings * 2, 0);
+        hasKeys[bin] = true;
+        for (size_t i = 0; i < binCounts[bin].size(); i++)
+            binCounts[bin][i] += m_KeyCounts[key][i];
+        m_NbReferencePresses += m_KeyReferencePresses[key];
+    }
+
+    size_t baselineThreshold = std::find(m_ThresholdOffsets.begin(), m_ThresholdOffsets.end(), 0) - m_ThresholdOffsets.begin();
+
+    std::memset(&m_BaselineResult, 0, sizeof(m_BaselineResult));
+    m_BaselineResult.debounceModel = DebounceSymDefer;
+    std::memcpy(m_BaselineResult.thresholds, header.dacThreshold, sizeof(m_BaselineResult.thresholds));
+    m_RankedResults.clear();
+
+    for (size_t setting = 0; setting < nbSettings; setting++)
+    {
+        LeydenJarGridResult result;
+
+        std::memset(&result, 0, sizeof(result));
+        result.debounceModel = m_DebounceSettings[setting].model;
+        result.debounceMs = m_DebounceSettings[setting].debounceMs;
+
+        for (int bin = 0; bin < 16; bin++)
+        {
+            result.thresholds[bin] = header.dacThreshold[bin];
+            if (hasKeys[bin] == false)
+                continue;
+
+            // Fewest errors, then closest to the recorded threshold
+            size_t bestThreshold = baselineThreshold;
+            for (size_t threshold = 0; threshold < nbThresholds; threshold++)
+            {
+                const uint64_t* pCounts = &binCounts[bin][(threshold * nbSettings + setting) * 2];
+                const uint64_t* pBestCounts = &binCounts[bin][(bestThreshold * nbSettings + setting) * 2];
+                uint64_t nbErrors = pCounts[0] + pCounts[1];
+                uint64_t nbBestErrors = pBestCounts[0] + pBestCounts[1];
+
+                if (nbErrors < nbBestErrors || (nbErrors == nbBestErrors && std::abs(m_ThresholdOffsets[threshold]) < std::abs(m_ThresholdOffsets[bestThreshold])))
+                    bestThreshold = threshold;
+            }
+
+            result.thresholds[bin] = GetCandidateThreshold(bin, int(bestThreshold));
+            result.nbFalsePresses += binCounts[bin][(bestThreshold * nbSettings + setting) * 2];
+            result.nbMissedPresses += binCounts[bin][(bestThreshold * nbSettings + setting) * 2 + 1];
+
+            // Debounce setting 0 is always the one without debounce time
+            if (setting == 0)
+            {
+                m_BaselineResult.nbFalsePresses += binCounts[bin][(baselineThreshold * nbSettings) * 2];
+                m_BaselineResult.nbMissedPresses += binCounts[bin][(baselineThreshold * nbSettings) * 2 + 1];
+            }
+        }
+
+        m_RankedResults.push_back(result);
+    }
+
+    // Shorter debounce times first on equal errors, they add less latency
+    std::stable_sort(m_RankedResults.begin(), m_RankedResults.end(), [](const LeydenJarGridResult& result0, const LeydenJarGridResult& result1)
+    {
+        uint64_t nbErrors0 = result0.nbFalsePresses + result0.nbMissedPresses;
+        uint64_t nbErrors1 = result1.nbFalsePresses + result1.nbMissedPresses;
+        if (nbErrors0 != nbErrors1)
+            return nbErrors0 < nbErrors1;
+        return result0.debounceMs < result1.debounceMs;
+    });
+
+    for (int key = 0; key < 18 * 8; key++)
+    {
+        std::vector<uint16_t>().swap(m_Traces[key]);
+        std::vector<uint32_t>().swap(m_KeyCounts[key]);
+    }
+}
+
+void LeydenJarGridSearch::FindReferencePresses(int col, int row, size_t firstFrame, size_t endFrame, std::vector<LeydenJarReferencePress>& presses)
+{
+    const LeydenJarSessionAnalysis::LeydenJarKeyReport& report = m_pSession->GetKeyReport(col, row);
+    const std::vector<uint16_t>& trace = m_Traces[col * 8 + row];
+    double polarity = m_pSession->GetHeader().switchTechnology == SwitchTechnologyBeamSpring ? -1.0 : 1.0;
+    double gap = polarity * (report.pressed.mean - report.unpressed.mean);
+
+    presses.clear();
+
+    // A key never pressed during the recording has no reference press, all its debounced presses are false
+    if (report.unpressed.nbSamples == 0 || report.pressed.nbSamples == 0 || gap <= 0.0 || endFrame - firstFrame < 3)
+        return;
+
+    uint64_t windowNs = uint64_t(m_Config.matchWindowMs * 1000000.0);
+    bool isPressed = false;
+
+    for (size_t frame = firstFrame + 2; frame < endFrame; frame++)
+    {
+        uint16_t level0 = trace[frame - 2];
+        uint16_t level1 = trace[frame - 1];
+        uint16_t level2 = trace[frame];
+        uint16_t median = std::max(std::min(level0, level1), std::min(std::max(level0, level1), level2));
+        double depth = polarity * (median - report.unpressed.mean);
+
+        // The median is centered on the previous frame
+        uint64_t timeNs = m_Timestamps[frame - 1];
+
+        if (isPressed == false && depth >= gap * 2.0 / 3.0)
+        {
+            LeydenJarReferencePress press;
+            press.isInitial = frame == firstFrame + 2;
+            press.windowStartNs = press.isInitial ? m_Timestamps[firstFrame] : (timeNs > windowNs ? timeNs - windowNs : 0);
+            press.windowEndNs = 0;
+            presses.push_back(press);
+            isPressed = true;
+        }
+        else if (isPressed && depth <= gap / 3.0)
+        {
+            presses.back().windowEndNs = timeNs + windowNs;
+            isPressed = false;
+        }
+    }
+
+    if (isPressed)
+        presses.back().windowEndNs = m_Timestamps[endFrame - 1] + windowNs;
+}
+
+void LeydenJarGridSearch::FindCrossings(const uint16_t* pLevels, size_t nbFrames, uint16_t minThreshold, uint16_t maxThreshold, std::vector<LeydenJarCrossing>& crossings)
+{
+    // A level change from lo to hi can only change the key state of thresholds in [lo, hi] (]lo, hi] for capacitive keys,
+    // [lo, hi[ for beam spring keys), so it is kept if lo <= max and hi >= min
+    size_t frame = 1;
+
+    crossings.clear();
+
+#ifdef LEYDEN_JAR_HAS_SSE2
+    const __m128i minThresholds = _mm_set1_epi16(short(minThreshold));
+    const __m128i maxThresholds = _mm_set1_epi16(short(maxThreshold));
+
+    // 8 frames per iteration, the level of the previous frame is an unaligned load shifted by one frame
+    for (; frame + 8 <= nbFrames; frame += 8)
+    {
+        __m128i level = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pLevels + frame));
+        __m128i levelPrev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pLevels + frame - 1));
+        __m128i lo = MinU16(level, levelPrev);
+        __m128i hi = MaxU16(level, levelPrev);
+
+        __m128i isCrossing = _mm_and_si128(CmpGeU16(maxThresholds, lo), CmpGeU16(hi, minThresholds));
+        isCrossing = _mm_andnot_si128(_mm_cmpeq_epi16(lo, hi), isCrossing);
+
+        // Most of the trace is noise far from the thresholds, blocks without crossings are skipped
+        int mask = _mm_movemask_epi8(isCrossing);
+        if (mask == 0)
+            continue;
+
+        for (int i = 0; i < 8; i++)
+        {
+            if ((mask & (1 << (i * 2))) == 0)
+                continue;
+
+            LeydenJarCrossing crossing;
+            crossing.frame = uint32_t(frame + i);
+            crossings.push_back(crossing);
+        }
+    }
+#endif
+
+    for (; frame < nbFrames; frame++)
+    {
+        uint16_t lo = std::min(pLevels[frame], pLevels[frame - 1]);
+        uint16_t hi = std::max(pLevels[frame], pLevels[frame - 1]);
+
+        if (lo <= maxThreshold && hi >= minThreshold && lo != hi)
+        {
+            LeydenJarCrossing crossing;
+            crossing.frame = uint32_t(frame);
+            crossings.push_back(crossing);
+        }
+    }
+}
+
+void LeydenJarGridSearch::Debounce(const LeydenJarDebounceSetting& setting, bool isPressed, const std::vector<LeydenJarTransition>& transitions, uint64_t endNs, std::vector<uint64_t>& pressTimes)
+{
+    uint64_t debounceNs = setting.debounceNs;
+    // Raw state before the current transition, and end of the eager lockout
+    bool isRawPressed = isPressed;
+    uint64_t lockoutEndNs = 0;
+    bool isLockedOut = false;
+
+    pressTimes.clear();
+
+    for (size_t i = 0; i < transitions.size(); i++)
+    {
+        const LeydenJarTransition& transition = transitions[i];
+        uint64_t stableEndNs = (i + 1 < transitions.size()) ? transitions[i + 1].timeNs : endNs;
+        bool isStable = stableEndNs - transition.timeNs >= debounceNs;
+
+        switch (setting.model)
+        {
+            case DebounceSymDefer:
+                if (transition.isPressed != isPressed && isStable)
+                {
+                    isPressed = transition.isPressed;
+                    if (isPressed)
+                        pressTimes.push_back(transition.timeNs + debounceNs);
+                }
+                break;
+
+            case DebounceSymEager:
+                // Once the lockout is over the raw state is taken again at the next scan
+                if (isLockedOut && lockoutEndNs <= transition.timeNs)
+                {
+                    isLockedOut = false;
+                    if (isRawPressed != isPressed)
+                    {
+                        isPressed = isRawPressed;
+                        if (isPressed)
+                            pressTimes.push_back(lockoutEndNs);
+                        lockoutEndNs += debounceNs;
+                        isLockedOut = lockoutEndNs > transition.timeNs;
+                    }
+                }
+                if (isLockedOut == false && transition.isPressed != isPressed)
+                {
+                    isPressed = transition.isPressed;
+                    if (isPressed)
+                        pressTimes.push_back(transition.timeNs);
+                    lockoutEndNs = transition.timeNs + debounceNs;
+                    isLockedOut = true;
+                }
+                break;
+
+            case DebounceAsymEagerDefer:
+                if (transition.isPressed && isPressed == false)
+                {
+                    isPressed = true;
+                    pressTimes.push_back(transition.timeNs);
+                }
+                else if (transition.isPressed == false && isPressed && isStable)
+                    isPressed = false;
+                break;
+        }
+
+        isRawPressed = transition.isPressed;
+    }
+
+    if (setting.model == DebounceSymEager && isLockedOut && lockoutEndNs <= endNs && isRawPressed && isPressed == false)
+        pressTimes.push_back(lockoutEndNs);
+}
+
+void LeydenJarGridSearch::MatchPresses(const std::vector<uint64_t>& pressTimes, const std::vector<LeydenJarReferencePress>& references, std::vector<uint8_t>& isMatched, uint32_t& nbFalsePresses, uint32_t& nbMissedPresses)
+{
+    isMatched.assign(references.size(), 0);
+    nbFalsePresses = 0;
+    nbMissedPresses = 0;
+
+    for (size_t i = 0; i < pressTimes.size(); i++)
+    {
+        uint64_t timeNs = pressTimes[i];
+        bool isGoodPress = false;
+
+        // Windows are sorted and their ends increase, extended windows of close presses can overlap
+        std::vector<LeydenJarReferencePress>::const_iterator it = std::lower_bound(references.begin(), references.end(), timeNs,
+            [](const LeydenJarReferencePress& reference, uint64_t time) { return reference.windowEndNs < time; });
+        for (; it != references.end() && it->windowStartNs <= timeNs; ++it)
+        {
+            size_t referenceIdx = it - references.begin();
+            if (isMatched[referenceIdx] == 0)
+            {
+                isMatched[referenceIdx] = 1;
+                isGoodPress = true;
+                break;
+            }
+        }
+
+        if (isGoodPress == false)
+            nbFalsePresses++;
+    }
+
+    for (size_t i = 0; i < references.size(); i++)
+        if (isMatched[i] == 0 && references[i].isInitial == false)
+            nbMissedPresses++;
+}
+
+void LeydenJarGridSearch::EvaluateKey(int col, int row)
+{
+    int key = col * 8 + row;
+    int bin = m_pSession->GetHeader().binningMap[col][row];
+    bool isBeamSpring = m_pSession->GetHeader().switchTechnology == SwitchTechnologyBeamSpring;
+    const std::vector<uint16_t>& trace = m_Traces[key];
+    size_t nbThresholds = m_ThresholdOffsets.size();
+    size_t nbSettings = m_DebounceSettings.size();
+
+    m_KeyCounts[key].assign(nbThresholds * nbSettings * 2, 0);
+    m_KeyReferencePresses[key] = 0;
+
+    // Thresholds only go up with their index
+    uint16_t minThreshold = GetCandidateThreshold(bin, 0);
+    uint16_t maxThreshold = GetCandidateThreshold(bin, int(nbThresholds - 1));
+
+    std::vector<LeydenJarReferencePress> references;
+    std::vector<LeydenJarCrossing> crossings;
+    std::vector<LeydenJarTransition> transitions;
+    std::vector<uint64_t> pressTimes;
+    std::vector<uint8_t> isMatched;
+
+    for (size_t segment = 0; segment < m_SegmentFirstFrames.size(); segment++)
+    {
+        size_t firstFrame = m_SegmentFirstFrames[segment];
+        size_t endFrame = (segment + 1 < m_SegmentFirstFrames.size()) ? m_SegmentFirstFrames[segment + 1] : trace.size();
+        uint64_t endNs = m_Timestamps[endFrame - 1];
+
+        FindReferencePresses(col, row, firstFrame, endFrame, references);
+        for (size_t i = 0; i < references.size(); i++)
+            if (references[i].isInitial == false)
+                m_KeyReferencePresses[key]++;
+
+        // Crossing frames are relative to the segment
+        FindCrossings(&trace[firstFrame], endFrame - firstFrame, minThreshold, maxThreshold, crossings);
+
+        for (size_t threshold = 0; threshold < nbThresholds; threshold++)
+        {
+            uint16_t candidateThreshold = GetCandidateThreshold(bin, int(threshold));
+            bool isInitialPressed = IsLevelPressed(trace[firstFrame], candidateThreshold, isBeamSpring);
+
+            // Every crossing of this threshold toggles the raw key state
+            transitions.clear();
+            for (size_t i = 0; i < crossings.size(); i++)
+            {
+                size_t frame = firstFrame + crossings[i].frame;
+                bool isPressed = IsLevelPressed(trace[frame], candidateThreshold, isBeamSpring);
+                if (isPressed != IsLevelPressed(trace[frame - 1], candidateThreshold, isBeamSpring))
+                {
+                    LeydenJarTransition transition;
+                    transition.timeNs = m_Timestamps[frame];
+                    transition.isPressed = isPressed;
+                    transitions.push_back(transition);
+                }
+            }
+
+            for (size_t setting = 0; setting < nbSettings; setting++)
+            {
+                uint32_t* pCounts = &m_KeyCounts[key][(threshold * nbSettings + setting) * 2];
+                uint32_t nbFalsePresses;
+                uint32_t nbMissedPresses;
+
+                Debounce(m_DebounceSettings[setting], isInitialPressed, transitions, endNs, pressTimes);
+                MatchPresses(pressTimes, references, isMatched, nbFalsePresses, nbMissedPresses);
+                pCounts[0] += nbFalsePresses;
+                pCounts[1] += nbMissedPresses;
+            }
+        }
+    }
+}
+
+uint64_t LeydenJarGridSearch::GetNbFrames()
+{
+    return m_Timestamps.size();
+}
+
+uint64_t LeydenJarGridSearch::GetNbReferencePresses()
+{
+    return m_NbReferencePresses;
+}
+
+int LeydenJarGridSearch::GetNbThresholdCandidates()
+{
+    return int(m_ThresholdOffsets.size());
+}
+
+int LeydenJarGridSearch::GetNbDebounceSettings()
+{
+    return int(m_DebounceSettings.size());
+}
+
+const LeydenJarGridSearch::LeydenJarGridResult& LeydenJarGridSearch::GetBaselineResult()
+{
+    return m_BaselineResult;
+}
+
+const std::vector<LeydenJarGridSearch::LeydenJarGridResult>& LeydenJarGridSearch::GetRankedResults()
+{
+    return m_RankedResults;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <vector>
+
+#include "LeydenJarTaskPool.h"
+#include "LeydenJarSessionAnalysis.h"
+
+// This class replays the level traces of an analysed recording through a grid of per bin DAC thresholds and
+// firmware-like debounce models, and ranks the settings by false and missed presses.
+// Candidate key states use the classification of the level monitor: a capacitive key is pressed when its level is at or
+// above the threshold, a beam spring key when it is at or below. Debounced presses are then compared to reference presses:
+// a reference press starts when the median of 3 levels goes past 2/3 of the way from the unpressed population mean to the
+// pressed one and ends when it comes back within 1/3, populations are the ones of the session analysis.
+// A debounced press within the match window of an unmatched reference press is a good press, any other one is false, a
+// reference press without debounced press is missed. Debounce times are applied to recorded frame times, so they are only
+// resolved to the recording frame period.
+// Keys are independent and a key only depends on the threshold of its bin, so every key is evaluated for all thresholds and
+// debounce settings by its own task, then the best threshold of every bin is picked for each debounce setting.
+// Frames crossing at least one candidate threshold are found by a vectorised pass over the trace, thresholds and debounce
+// settings are then evaluated on these sparse crossings only.
+// Corrupted chunks are removed from the traces and split them into segments of consecutive frames. Segments are evaluated
+// independently: no crossing is taken across a gap, and debounce and reference press states restart at every segment.
+
+class LeydenJarGridSearch
+{
+public:
+
+	// Debounce algorithms of QMK, per key variants
+	enum LeydenJarDebounceModel
+	{
+		// State changes are reported once the key was stable for the debounce time
+		DebounceSymDefer = 0,
+		// State changes are reported at once, following changes are ignored for the debounce time
+		DebounceSymEager,
+		// Presses are reported at once, releases once the key was stable for the debounce time
+		DebounceAsymEagerDefer,
+		DebounceModelCount
+	};
+
+	struct LeydenJarGridConfig
+	{
+		// Threshold candidates, relative to the recorded threshold of every bin
+		int		minThresholdOffset;
+		int		maxThresholdOffset;
+		int		thresholdStep;
+		float	minDebounceMs;
+		float	maxDebounceMs;
+		float	debounceStepMs;
+		// A debounced press this close to a reference press is matched with it
+		float	matchWindowMs;
+	};
+
+	struct LeydenJarGridResult
+	{
+		int			debounceModel;
+		float		debounceMs;
+		// Best threshold of every bin for this debounce setting
+		uint16_t	thresholds[16];
+		uint64_t	nbFalsePresses;
+		uint64_t	nbMissedPresses;
+	};
+
+public:
+
+	LeydenJarGridSearch();
+	~LeydenJarGridSearch();
+
+	static const char* GetDebounceModelName(int debounceModel);
+
+	// The grid always contains the recorded thresholds without debounce, that is the baseline result
+	void SetConfig(const LeydenJarGridConfig& config);
+	const LeydenJarGridConfig& GetConfig();
+
+	// Queues the decoding of the level chunks of a finished session analysis, the session must live until Finish() returns
+	void Submit(LeydenJarTaskPool& pool, LeydenJarSessionAnalysis& session);
+	// Evaluates all keys on the pool and ranks the debounce settings
+	void Finish(LeydenJarTaskPool& pool);
+
+	uint64_t GetNbFrames();
+	uint64_t GetNbReferencePresses();
+	int GetNbThresholdCandidates();
+	int GetNbDebounceSettings();
+	const LeydenJarGridResult& GetBaselineResult();
+	// One result per debounce setting, fewest false and missed presses first
+	const std::vector<LeydenJarGridResult>& GetRankedResults();
+
+private:
+
+	struct LeydenJarDebounceSetting
+	{
+		int			model;
+		float		debounceMs;
+		uint64_t	debounceNs;
+	};
+
+	// Frame whose level change may change the key state of at least one candidate threshold
+	struct LeydenJarCrossing
+	{
+		uint32_t	frame;
+	};
+
+	struct LeydenJarTransition
+	{
+		uint64_t	timeNs;
+		bool		isPressed;
+	};
+
+	struct LeydenJarReferencePress
+	{
+		uint64_t	windowStartNs;
+		uint64_t	windowEndNs;
+		// Press already going on at the start of the recording, it can be matched but is never missed
+		bool		isInitial;
+	};
+
+	void DecodeChunk(size_t chunkIdx);
+	void CompactCorruptedChunks();
+	void EvaluateKey(int col, int row);
+	void FindReferencePresses(int col, int row, size_t firstFrame, size_t endFrame, std::vector<LeydenJarReferencePress>& presses);
+	static void Debounce(const LeydenJarDebounceSetting& setting, bool isPressed, const std::vector<LeydenJarTransition>& transitions, uint64_t endNs, std::vector<uint64_t>& pressTimes);
+	void MatchPresses(const std::vector<uint64_t>& pressTimes, const std::vector<LeydenJarReferencePress>& references, std::vector<uint8_t>& isMatched, uint32_t& nbFalsePresses, uint32_t& nbMissedPresses);
+	static void FindCrossings(const uint16_t* pLevels, size_t nbFrames, uint16_t minThreshold, uint16_t maxThreshold, std::vector<LeydenJarCrossing>& crossings);
+	uint16_t GetCandidateThreshold(int bin, int thresholdIdx);
+
+private:
+
+	LeydenJarGridConfig		m_Config;
+	std::vector<int>		m_ThresholdOffsets;
+	std::vector<LeydenJarDebounceSetting> m_DebounceSettings;
+	LeydenJarSessionAnalysis* m_pSession;
+	LeydenJarTaskGroup		m_TaskGroup;
+
+	// Level chunks in recording order, with the first frame of each one
+	std::vector<size_t>		m_LevelChunks;
+	std::vector<size_t>		m_FirstFrames;
+	std::vector<uint8_t>	m_IsChunkCorrupted;
+	std::vector<uint64_t>	m_Timestamps;
+	// Level trace of every key, unused keys have no trace
+	std::vector<uint16_t>	m_Traces[18 * 8];
+	// First frame of every segment of the compacted traces, a segment ends where the next one starts
+	std::vector<size_t>		m_SegmentFirstFrames;
+
+	// Per key counts of every threshold and debounce setting: false presses then missed presses
+	std::vector<uint32_t>	m_KeyCounts[18 * 8];
+	uint32_t				m_KeyReferencePresses[18 * 8];
+
+	uint64_t				m_NbReferencePresses;
+	LeydenJarGridResult		m_BaselineResult;
+	std::vector<LeydenJarGridResult> m_RankedResults;
+};
@@ -0,0 +1,316 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "LeydenJarSessionAnalysis.h"
+#include "LeydenJarLevelCompare.h"
+
+LeydenJarSessionAnalysis::LeydenJarSessionAnalysis()
+    : m_IsTruncated(false)
+    , m_DurationNs(0)
+    , m_NbCorruptedChunks(0)
+{
+    std::memset(&m_Header, 0, sizeof(m_Header));
+    std::memset(m_Thresholds, 0, sizeof(m_Thresholds));
+    std::memset(m_NbRecords, 0, sizeof(m_NbRecords));
+    std::memset(m_KeyReports, 0, sizeof(m_KeyReports));
+    std::memset(m_BinRecommendations, 0, sizeof(m_BinRecommendations));
+}
+
+LeydenJarSessionAnalysis::~LeydenJarSessionAnalysis()
+{
+    // Tasks reference this object, they must be done before it goes away
+    m_TaskGroup.Wait();
+}
+
+bool LeydenJarSessionAnalysis::Open(const char* pFileName, std::string& error)
+{
+    m_FileName = pFileName;
+
+    if (m_File.Open(pFileName) == false)
+    {
+        error = "cannot open file";
+        return false;
+    }
+
+    const uint8_t* pData = m_File.GetData();
+    size_t size = m_File.GetSize();
+
+    if (size < sizeof(m_Header))
+    {
+        error = "file too small";
+        return false;
+    }
+    std::memcpy(&m_Header, pData, sizeof(m_Header));
+    if (IsRecordingHeaderValid(m_Header) == false)
+    {
+        error = "not a Leyden Jar recording";
+        return false;
+    }
+
+    // Unused matrix positions have no bin (255), first bin threshold is used for them
+    for (int col = 0; col < 18; col++)
+        for (int row = 0; row < 8; row++)
+            m_Thresholds[col][row] = m_Header.dacThreshold[m_Header.binningMap[col][row] < 16 ? m_Header.binningMap[col][row] : 0];
+
+    // Only chunk headers are read here, payloads are touched by the analysis tasks.
+    // A recording interrupted while writing ends with a partial chunk that is ignored
+    size_t offset = sizeof(m_Header);
+    while (offset + sizeof(LeydenJarChunkHeader) <= size)
+    {
+        LeydenJarChunkHeader chunkHeader;
+        std::memcpy(&chunkHeader, pData + offset, sizeof(chunkHeader));
+
+        if (std::memcmp(chunkHeader.magic, "CHNK", 4) != 0 || chunkHeader.payloadSize > size - offset - sizeof(chunkHeader))
+            break;
+
+        m_ChunkOffsets.push_back(offset);
+        offset += sizeof(chunkHeader) + chunkHeader.payloadSize;
+    }
+    m_IsTruncated = offset != size;
+
+    return true;
+}
+
+void LeydenJarSessionAnalysis::Submit(LeydenJarTaskPool& pool)
+{
+    m_ChunkResults.resize(m_ChunkOffsets.size());
+
+    for (size_t chunkIdx = 0; chunkIdx < m_ChunkOffsets.size(); chunkIdx++)
+        pool.Submit(m_TaskGroup, [this, chunkIdx] { AnalyseChunk(chunkIdx); });
+}
+
+void LeydenJarSessionAnalysis::MergeMoments(LeydenJarLevelMoments& merged, const LeydenJarLevelMoments& moments)
+{
+    if (moments.nbSamples == 0)
+        return;
+
+    if (merged.nbSamples == 0)
+    {
+        merged = moments;
+        return;
+    }
+
+    uint64_t nbSamples = merged.nbSamples + moments.nbSamples;
+    double delta = moments.mean - merged.mean;
+
+    merged.mean += delta * moments.nbSamples / nbSamples;
+    merged.m2 += moments.m2 + delta * delta * (double(merged.nbSamples) * moments.nbSamples / nbSamples);
+    merged.nbSamples = nbSamples;
+    merged.min = std::min(merged.min, moments.min);
+    merged.max = std::max(merged.max, moments.max);
+}
+
+void LeydenJarSessionAnalysis::AnalyseChunk(size_t chunkIdx)
+{
+    std::unique_ptr<LeydenJarChunkResult> pResult(new LeydenJarChunkResult());
+    LeydenJarChunkHeader chunkHeader;
+
+    GetChunkHeader(chunkIdx, chunkHeader);
+    std::memset(pResult->moments, 0, sizeof(pResult->moments));
+    pResult->nbRecords = chunkHeader.nbRecords;
+    pResult->firstTimestampNs = 0;
+    pResult->lastTimestampNs = 0;
+    pResult->advisor.SetLayout(m_Header.switchTechnology == SwitchTechnologyBeamSpring, m_Thresholds, m_Header.binningMap);
+    pResult->chatterDetector.SetLayout(m_Header.nbPhysicalCols, m_Header.nbPhysicalRows, m_Header.switchTechnology, m_Header.dacThreshold, m_Header.binningMap);
+
+    std::vector<uint64_t> timestamps;
+    std::vector<uint8_t> records;
+
+    pResult->isCorrupted = DecodeChunk(chunkIdx, timestamps, records) == false;
+    if (pResult->isCorrupted == false && chunkHeader.nbRecords != 0)
+    {
+        pResult->firstTimestampNs = timestamps.front();
+        pResult->lastTimestampNs = timestamps.back();
+    }
+
+    if (pResult->isCorrupted == false && chunkHeader.stream == LeydenJarRecordPhysical)
+    {
+        size_t recordSize = GetRecordSize(LeydenJarRecordPhysical);
+
+        for (uint32_t record = 0; record < chunkHeader.nbRecords; record++)
+            pResult->chatterDetector.OnPhysicalScan(&records[record * recordSize], timestamps[record]);
+    }
+
+    if (pResult->isCorrupted == false && chunkHeader.stream == LeydenJarRecordLevels)
+    {
+        const uint16_t (*levels)[18][8] = reinterpret_cast<const uint16_t (*)[18][8]>(records.data());
+        uint64_t colTimeNs[18];
+
+        for (uint32_t record = 0; record < chunkHeader.nbRecords; record++)
+        {
+            // Column reception times are not recorded, the frame time is used for all columns
+            for (int col = 0; col < 18; col++)
+                colTimeNs[col] = timestamps[record];
+            pResult->chatterDetector.OnLevels(levels[record], colTimeNs);
+
+            for (int col = 0; col < m_Header.nbPhysicalCols; col++)
+            {
+                for (int row = 0; row < m_Header.nbPhysicalRows; row++)
+                {
+                    uint16_t level = levels[record][col][row];
+                    LeydenJarLevelMoments& moments = pResult->moments[col * 8 + row];
+
+                    if (moments.nbSamples == 0)
+                        moments.min = moments.max = level;
+                    moments.min = std::min(moments.min, level);
+                    moments.max = std::max(moments.max, level);
+                    moments.nbSamples++;
+                    double delta = level - moments.mean;
+                    moments.mean += delta / moments.nbSamples;
+                    moments.m2 += delta * (level - moments.mean);
+
+                    if (record >= 2)
+                        pResult->advisor.AddSample(col, row, level, levels[record - 1][col][row], levels[record - 2][col][row]);
+                }
+            }
+        }
+    }
+
+    m_ChunkResults[chunkIdx] = std::move(pResult);
+}
+
+void LeydenJarSessionAnalysis::Finish(LeydenJarTaskPool& pool)
+{
+    pool.Wait(m_TaskGroup);
+
+    LeydenJarLevelMoments moments[18 * 8];
+    LeydenJarThresholdAdvisor advisor;
+    uint64_t firstTimestampNs = 0;
+    uint64_t lastTimestampNs = 0;
+
+    std::memset(moments, 0, sizeof(moments));
+    std::memset(m_KeyReports, 0, sizeof(m_KeyReports));
+    advisor.SetLayout(m_Header.switchTechnology == SwitchTechnologyBeamSpring, m_Thresholds, m_Header.binningMap);
+    m_ChatterDetector.SetLayout(m_Header.nbPhysicalCols, m_Header.nbPhysicalRows, m_Header.switchTechnology, m_Header.dacThreshold, m_Header.binningMap);
+
+    for (size_t chunkIdx = 0; chunkIdx < m_ChunkResults.size(); chunkIdx++)
+    {
+        LeydenJarChunkResult& result = *m_ChunkResults[chunkIdx];
+        LeydenJarChunkHeader chunkHeader;
+        GetChunkHeader(chunkIdx, chunkHeader);
+
+        // Scans of a corrupted chunk are missing, edges are not looked for across them
+        if (result.isCorrupted)
+        {
+            m_NbCorruptedChunks++;
+            if (chunkHeader.stream == LeydenJarRecordPhysical)
+                m_ChatterDetector.ClearKeyStates(LeydenJarChatterDetector::ChatterSourcePhysical);
+            else if (chunkHeader.stream == LeydenJarRecordLevels)
+                m_ChatterDetector.ClearKeyStates(LeydenJarChatterDetector::ChatterSourceLevels);
+            continue;
+        }
+
+        m_NbRecords[chunkHeader.stream] += result.nbRecords;
+        if (result.nbRecords != 0)
+        {
+            if (firstTimestampNs == 0 || result.firstTimestampNs < firstTimestampNs)
+                firstTimestampNs = result.firstTimestampNs;
+            lastTimestampNs = std::max(lastTimestampNs, result.lastTimestampNs);
+        }
+
+        advisor.Merge(result.advisor);
+        m_ChatterDetector.Append(result.chatterDetector);
+
+        for (int col = 0; col < 18; col++)
+            for (int row = 0; row < 8; row++)
+                MergeMoments(moments[col * 8 + row], result.moments[col * 8 + row]);
+    }
+    m_ChunkResults.clear();
+
+    for (int col = 0; col < 18; col++)
+        for (int row = 0; row < 8; row++)
+            for (int source = 0; source < LeydenJarChatterDetector::ChatterSourceCount; source++)
+                m_KeyReports[col][row].chatter[source] = m_ChatterDetector.GetCounters(source)[col * 8 + row];
+
+    m_DurationNs = lastTimestampNs - firstTimestampNs;
+    advisor.ComputeRecommendations(m_Header.nbPhysicalCols, m_Header.nbPhysicalRows, m_BinRecommendations);
+
+    bool isBeamSpring = m_Header.switchTechnology == SwitchTechnologyBeamSpring;
+
+    for (int col = 0; col < m_Header.nbPhysicalCols; col++)
+    {
+        for (int row = 0; row < m_Header.nbPhysicalRows; row++)
+        {
+            LeydenJarKeyReport& report = m_KeyReports[col][row];
+            const LeydenJarLevelMoments& keyMoments = moments[col * 8 + row];
+
+            report.isUsed = m_Header.binningMap[col][row] < 16;
+            report.bin = m_Header.binningMap[col][row];
+            report.threshold = m_Thresholds[col][row];
+            report.nbSamples = keyMoments.nbSamples;
+            report.mean = keyMoments.mean;
+            report.stdDev = keyMoments.nbSamples > 1 ? std::sqrt(keyMoments.m2 / (keyMoments.nbSamples - 1)) : 0.0;
+            report.min = keyMoments.min;
+            report.max = keyMoments.max;
+
+            advisor.GetKeyPopulations(col, row, report.unpressed, report.pressed);
+
+            // Capacitive keys levels go up when pressed, beam spring keys levels go down
+            int polarity = isBeamSpring ? -1 : 1;
+            report.unpressedMargin = polarity * (int(report.threshold) - int(report.unpressed.worstLevel));
+            report.pressedMargin = polarity * (int(report.pressed.worstLevel) - int(report.threshold));
+        }
+    }
+}
+
+const std::string& LeydenJarSessionAnalysis::GetFileName()
+{
+    return m_FileName;
+}
+
+const LeydenJarRecordingHeader& LeydenJarSessionAnalysis::GetHeader()
+{
+    return m_Header;
+}
+
+uint64_t LeydenJarSessionAnalysis::GetNbRecords(int stream)
+{
+    return m_NbRecords[stream];
+}
+
+uint64_t LeydenJarSessionAnalysis::GetDurationNs()
+{
+    return m_DurationNs;
+}
+
+int LeydenJarSessionAnalysis::GetNbCorruptedChunks()
+{
+    return m_NbCorruptedChunks;
+}
+
+bool LeydenJarSessionAnalysis::IsTruncated()
+{
+    return m_IsTruncated;
+}
+
+const LeydenJarSessionAnalysis::LeydenJarKeyReport& LeydenJarSessionAnalysis::GetKeyReport(int col, int row)
+{
+    return m_KeyReports[col][row];
+}
+
+const LeydenJarThresholdAdvisor::LeydenJarBinRecommendation& LeydenJarSessionAnalysis::GetBinRecommendation(int bin)
+{
+    return m_BinRecommendations[bin];
+}
+
+size_t LeydenJarSessionAnalysis::GetNbChunks()
+{
+    return m_ChunkOffsets.size();
+}
+
+void LeydenJarSessionAnalysis::GetChunkHeader(size_t chunkIdx, LeydenJarChunkHeader& chunkHeader)
+{
+    std::memcpy(&chunkHeader, m_File.GetData() + m_ChunkOffsets[chunkIdx], sizeof(chunkHeader));
+}
+
+bool LeydenJarSessionAnalysis::DecodeChunk(size_t chunkIdx, std::vector<uint64_t>& timestamps, std::vector<uint8_t>& records)
+{
+    LeydenJarChunkHeader chunkHeader;
+
+    GetChunkHeader(chunkIdx, chunkHeader);
+    return DecodeRecordingChunk(m_Header, chunkHeader, m_File.GetData() + m_ChunkOffsets[chunkIdx] + sizeof(chunkHeader), timestamps, records);
+}
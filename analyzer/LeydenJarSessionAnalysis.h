@@ -0,0 +1,117 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "LeydenJarMappedFile.h"
+#include "LeydenJarRecordingCodec.h"
+#include "LeydenJarTaskPool.h"
+#include "LeydenJarThresholdAdvisor.h"
+#include "LeydenJarChatterDetector.h"
+
+// This class analyses one recording file made by LeydenJarRecorder.
+// The file is memory mapped and indexed, then every chunk is decoded and analysed by its own task of a LeydenJarTaskPool.
+// Chunk results are merged once all tasks are done: per key level statistics, threshold margins, chatter counters
+// and per bin threshold recommendations.
+// Chunks are analysed independently: the first 2 level frames of a chunk only serve as history for threshold populations.
+// Chatter is detected per chunk too, each chunk detector starting from its first scan. Detectors are appended in recording
+// order when merging, which accounts for the edges and crossings that span chunk boundaries.
+
+class LeydenJarSessionAnalysis
+{
+public:
+
+	struct LeydenJarKeyReport
+	{
+		bool		isUsed;
+		uint8_t		bin;
+		uint16_t	threshold;
+		uint64_t	nbSamples;
+		double		mean;
+		double		stdDev;
+		uint16_t	min;
+		uint16_t	max;
+		LeydenJarThresholdAdvisor::LeydenJarLevelPopulation unpressed;
+		LeydenJarThresholdAdvisor::LeydenJarLevelPopulation pressed;
+		// Levels between the worst sample of a population and the threshold, only valid when the population has samples
+		int			unpressedMargin;
+		int			pressedMargin;
+		// Chatter of physical scans and of level scans
+		LeydenJarChatterDetector::LeydenJarKeyChatterCounters chatter[LeydenJarChatterDetector::ChatterSourceCount];
+	};
+
+public:
+
+	LeydenJarSessionAnalysis();
+	~LeydenJarSessionAnalysis();
+
+	// Maps the file and indexes its chunks, returns false with an error message if it is not a valid recording
+	bool Open(const char* pFileName, std::string& error);
+	// Queues the analysis of every chunk
+	void Submit(LeydenJarTaskPool& pool);
+	// Waits for all chunks and merges their results
+	void Finish(LeydenJarTaskPool& pool);
+
+	const std::string& GetFileName();
+	const LeydenJarRecordingHeader& GetHeader();
+	uint64_t GetNbRecords(int stream);
+	uint64_t GetDurationNs();
+	int GetNbCorruptedChunks();
+	bool IsTruncated();
+	const LeydenJarKeyReport& GetKeyReport(int col, int row);
+	const LeydenJarThresholdAdvisor::LeydenJarBinRecommendation& GetBinRecommendation(int bin);
+	// Raw access to the indexed chunks, chunks can be decoded from any thread once the file is opened
+	size_t GetNbChunks();
+	void GetChunkHeader(size_t chunkIdx, LeydenJarChunkHeader& chunkHeader);
+	// Returns false on corrupted chunk
+	bool DecodeChunk(size_t chunkIdx, std::vector<uint64_t>& timestamps, std::vector<uint8_t>& records);
+
+private:
+
+	struct LeydenJarLevelMoments
+	{
+		uint64_t	nbSamples;
+		double		mean;
+		double		m2;
+		uint16_t	min;
+		uint16_t	max;
+	};
+
+	struct LeydenJarChunkResult
+	{
+		bool						isCorrupted;
+		uint64_t					nbRecords;
+		uint64_t					firstTimestampNs;
+		uint64_t					lastTimestampNs;
+		LeydenJarLevelMoments		moments[18 * 8];
+		LeydenJarThresholdAdvisor	advisor;
+		LeydenJarChatterDetector	chatterDetector;
+	};
+
+	void AnalyseChunk(size_t chunkIdx);
+	static void MergeMoments(LeydenJarLevelMoments& merged, const LeydenJarLevelMoments& moments);
+
+private:
+
+	std::string					m_FileName;
+	LeydenJarMappedFile			m_File;
+	LeydenJarRecordingHeader	m_Header;
+	uint16_t					m_Thresholds[18][8];
+	bool						m_IsTruncated;
+	std::vector<size_t>			m_ChunkOffsets;
+	std::vector< std::unique_ptr<LeydenJarChunkResult> > m_ChunkResults;
+	LeydenJarTaskGroup			m_TaskGroup;
+	// Chunk detectors appended in recording order
+	LeydenJarChatterDetector	m_ChatterDetector;
+
+	uint64_t					m_NbRecords[LeydenJarRecordStreamCount];
+	uint64_t					m_DurationNs;
+	int							m_NbCorruptedChunks;
+	LeydenJarKeyReport			m_KeyReports[18][8];
+	LeydenJarThresholdAdvisor::LeydenJarBinRecommendation m_BinRecommendations[LeydenJarThresholdAdvisor::kNbBins];
+};
@@ -0,0 +1,124 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Scaling benchmark of the level analysis task pool.
+// Simulated devices feed random level frames to their own LeydenJarLevelAnalysis, all sharing a single pool.
+// Each device count from 1 to 64 is run on a pool without workers, where the main thread runs every task, and on a pool with
+// one worker per hardware thread. Speedup between both is reported, the number of workers stays the same for all counts.
+//
+// Arguments: [nbFrames] [nbColumnsPerTask]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "LeydenJarTaskPool.h"
+#include "LeydenJarLevelAnalysis.h"
+#include "LeydenJarBenchmarks.h"
+
+static const int s_NbFramesInBank = 64;
+
+static void FillLayout(LeydenJarLevelAnalysis::LeydenJarLevelLayout& layout)
+{
+    std::memset(&layout, 0, sizeof(layout));
+    layout.nbCols = 18;
+    layout.nbRows = 8;
+    layout.switchTechnology = 0;
+    layout.dacThreshold[0] = 150;
+    layout.dacThreshold[1] = 170;
+
+    for (int col = 0; col < 18; col++)
+        for (int row = 0; row < 8; row++)
+            layout.binningMap[col][row] = uint8_t((col + row) & 1);
+}
+
+static void FillFrameBank(std::vector<uint16_t>& frameBank, unsigned int seed)
+{
+    frameBank.resize(s_NbFramesInBank * 18 * 8);
+    std::srand(seed);
+
+    for (size_t i = 0; i < frameBank.size(); i++)
+    {
+        // Mostly unpressed keys with some noise, a few keys well above threshold
+        if (std::rand() % 16 == 0)
+            frameBank[i] = uint16_t(180 + std::rand() % 40);
+        else
+            frameBank[i] = uint16_t(90 + std::rand() % 20);
+    }
+}
+
+// Returns the run duration in seconds
+static double RunDevices(int nbWorkers, int nbDevices, int nbFrames, int nbColumnsPerTask, const std::vector<uint16_t>& frameBank)
+{
+    LeydenJarTaskPool pool(nbWorkers);
+    LeydenJarLevelAnalysis::LeydenJarLevelLayout layout;
+    std::vector< std::unique_ptr<LeydenJarLevelAnalysis> > devices;
+
+    FillLayout(layout);
+    for (int i = 0; i < nbDevices; i++)
+    {
+        devices.push_back(std::unique_ptr<LeydenJarLevelAnalysis>(new LeydenJarLevelAnalysis()));
+        devices[i]->SetColumnsPerTask(nbColumnsPerTask);
+        devices[i]->Reset(pool, layout);
+    }
+
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    for (int frame = 0; frame < nbFrames; frame++)
+    {
+        for (int i = 0; i < nbDevices; i++)
+        {
+            const uint16_t (*levels)[8] = reinterpret_cast<const uint16_t (*)[8]>(&frameBank[((frame + i) % s_NbFramesInBank) * 18 * 8]);
+            devices[i]->SubmitFrame(pool, levels, uint64_t(frame + 1) * 1000000);
+        }
+    }
+
+    for (int i = 0; i < nbDevices; i++)
+        devices[i]->Wait(pool);
+
+    std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(endTime - startTime).count();
+}
+
+int RunAnalysisBenchmark(int argc, char** argv)
+{
+    int nbFrames = (argc > 1) ? std::atoi(argv[1]) : 2000;
+    int nbColumnsPerTask = (argc > 2) ? std::atoi(argv[2]) : 6;
+    if (nbFrames <= 0)
+        nbFrames = 2000;
+
+    std::vector<uint16_t> frameBank;
+    FillFrameBank(frameBank, 1234);
+
+    int nbWorkers = LeydenJarTaskPool().GetNbWorkers();
+
+    printf("Level analysis scaling, %d frames per device, %d columns per task, %d workers\n", nbFrames, nbColumnsPerTask, nbWorkers);
+    printf("%8s %14s %14s %14s %10s %10s\n", "devices", "1 thread fps", "pool fps", "us/frame", "speedup", "efficiency");
+
+    const int deviceCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+    for (size_t i = 0; i < sizeof(deviceCounts) / sizeof(deviceCounts[0]); i++)
+    {
+        int nbDevices = deviceCounts[i];
+
+        // Warm-up run so that thread creation and first touch of memory are not measured
+        RunDevices(nbWorkers, nbDevices, std::max(nbFrames / 10, 1), nbColumnsPerTask, frameBank);
+
+        double serialTime = RunDevices(LeydenJarTaskPool::kNoWorkers, nbDevices, nbFrames, nbColumnsPerTask, frameBank);
+        double poolTime = RunDevices(nbWorkers, nbDevices, nbFrames, nbColumnsPerTask, frameBank);
+
+        double nbDeviceFrames = double(nbDevices) * nbFrames;
+        double speedup = serialTime / poolTime;
+        double efficiency = speedup / std::min(nbDevices * ((18 + nbColumnsPerTask - 1) / nbColumnsPerTask), nbWorkers);
+
+        printf("%8d %14.0f %14.0f %14.2f %10.2f %9.0f%%\n", nbDevices, nbDeviceFrames / serialTime, nbDeviceFrames / poolTime,
+            poolTime * 1000000.0 / nbDeviceFrames, speedup, efficiency * 100.0);
+    }
+
+    return 0;
+}
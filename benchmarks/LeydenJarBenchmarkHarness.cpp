@@ -0,0 +1,126 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <algorithm>
+
+#include "json/json.h"
+
+#include "LeydenJarBenchmarkHarness.h"
+
+LeydenJarBenchmarkHarness::LeydenJarBenchmarkConfig LeydenJarBenchmarkHarness::s_Config = { 3, 15, 10.0 };
+std::vector<LeydenJarBenchmarkHarness::LeydenJarBenchmarkResult> LeydenJarBenchmarkHarness::s_Results;
+
+static volatile uint64_t s_Sink = 0;
+
+void LeydenJarBenchmarkHarness::SetConfig(const LeydenJarBenchmarkConfig& config)
+{
+    s_Config = config;
+
+    if (s_Config.nbWarmupRuns < 0)
+        s_Config.nbWarmupRuns = 0;
+    if (s_Config.nbRuns < 1)
+        s_Config.nbRuns = 1;
+    if (s_Config.minRunTimeMs < 0.0)
+        s_Config.minRunTimeMs = 0.0;
+}
+
+const LeydenJarBenchmarkHarness::LeydenJarBenchmarkConfig& LeydenJarBenchmarkHarness::GetConfig()
+{
+    return s_Config;
+}
+
+void LeydenJarBenchmarkHarness::PrintHeader(const char* suite)
+{
+    printf("%s, %d runs after %d warm-up runs, times in ns per iteration\n", suite, s_Config.nbRuns, s_Config.nbWarmupRuns);
+    printf("%-36s %12s %10s %10s %10s %10s %10s %10s\n", "benchmark", "iterations", "min", "mean", "p50", "p90", "p99", "max");
+}
+
+void LeydenJarBenchmarkHarness::Consume(uint64_t value)
+{
+    s_Sink = s_Sink + value;
+}
+
+void LeydenJarBenchmarkHarness::AddResult(const char* suite, const char* name, uint64_t nbIterations, std::vector<double>& iterationNs)
+{
+    LeydenJarBenchmarkResult result;
+
+    std::sort(iterationNs.begin(), iterationNs.end());
+
+    double sumNs = 0.0;
+    for (size_t i = 0; i < iterationNs.size(); i++)
+        sumNs += iterationNs[i];
+
+    // Nearest rank percentile: smallest time with at least p% of the runs at or below it
+    size_t nbRuns = iterationNs.size();
+    size_t p50Rank = std::max<size_t>(1, size_t(std::ceil(nbRuns * 0.50)));
+    size_t p90Rank = std::max<size_t>(1, size_t(std::ceil(nbRuns * 0.90)));
+    size_t p99Rank = std::max<size_t>(1, size_t(std::ceil(nbRuns * 0.99)));
+
+    result.suite = suite;
+    result.name = name;
+    result.nbIterations = nbIterations;
+    result.nbRuns = int(nbRuns);
+    result.minNs = iterationNs.front();
+    result.meanNs = sumNs / nbRuns;
+    result.p50Ns = iterationNs[p50Rank - 1];
+    result.p90Ns = iterationNs[p90Rank - 1];
+    result.p99Ns = iterationNs[p99Rank - 1];
+    result.maxNs = iterationNs.back();
+    s_Results.push_back(result);
+
+    printf("%-36s %12llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, (unsigned long long)nbIterations,
+           result.minNs, result.meanNs, result.p50Ns, result.p90Ns, result.p99Ns, result.maxNs);
+}
+
+const std::vector<LeydenJarBenchmarkHarness::LeydenJarBenchmarkResult>& LeydenJarBenchmarkHarness::GetResults()
+{
+    return s_Results;
+}
+
+bool LeydenJarBenchmarkHarness::WriteJson(const char* fileName)
+{
+    Json::Value root(Json::objectValue);
+
+    root["warmupRuns"] = s_Config.nbWarmupRuns;
+    root["runs"] = s_Config.nbRuns;
+    root["minRunTimeMs"] = s_Config.minRunTimeMs;
+
+    Json::Value benchmarks(Json::arrayValue);
+    for (size_t i = 0; i < s_Results.size(); i++)
+    {
+        const LeydenJarBenchmarkResult& result = s_Results[i];
+        Json::Value benchmark(Json::objectValue);
+
+        benchmark["suite"] = result.suite;
+        benchmark["name"] = result.name;
+        benchmark["iterations"] = Json::UInt64(result.nbIterations);
+        benchmark["runs"] = result.nbRuns;
+        benchmark["minNs"] = result.minNs;
+        benchmark["meanNs"] = result.meanNs;
+        benchmark["p50Ns"] = result.p50Ns;
+        benchmark["p90Ns"] = result.p90Ns;
+        benchmark["p99Ns"] = result.p99Ns;
+        benchmark["maxNs"] = result.maxNs;
+        benchmarks.append(benchmark);
+    }
+    root["benchmarks"] = benchmarks;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    std::unique_ptr<Json::StreamWriter> pWriter(builder.newStreamWriter());
+
+    std::ofstream jsonFile(fileName);
+    pWriter->write(root, &jsonFile);
+    jsonFile << "\n";
+    if (!jsonFile)
+    {
+        fprintf(stderr, "Cannot write JSON report to %s\n", fileName);
+        return false;
+    }
+
+    return true;
+}
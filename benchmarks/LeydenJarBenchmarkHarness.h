@@ -0,0 +1,90 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Timing harness of the microbenchmarks.
+// A benchmark is a function running the measured code a given number of iterations. The iteration count is doubled until
+// a run lasts the minimum run time, then warm-up runs are done and discarded, and timed runs give per iteration times.
+// Results are printed as they come and kept for the JSON report written at the end of the program.
+
+class LeydenJarBenchmarkHarness
+{
+public:
+
+	struct LeydenJarBenchmarkConfig
+	{
+		int		nbWarmupRuns;
+		int		nbRuns;
+		double	minRunTimeMs;
+	};
+
+	struct LeydenJarBenchmarkResult
+	{
+		std::string	suite;
+		std::string	name;
+		uint64_t	nbIterations;
+		int			nbRuns;
+		// Per iteration times over the runs, percentiles are nearest rank
+		double		minNs;
+		double		meanNs;
+		double		p50Ns;
+		double		p90Ns;
+		double		p99Ns;
+		double		maxNs;
+	};
+
+public:
+
+	static void SetConfig(const LeydenJarBenchmarkConfig& config);
+	static const LeydenJarBenchmarkConfig& GetConfig();
+
+	static void PrintHeader(const char* suite);
+
+	// function(nbIterations) runs the measured code nbIterations times
+	template<typename Function>
+	static void Run(const char* suite, const char* name, Function function)
+	{
+		uint64_t nbIterations = 1;
+		double minRunTimeNs = s_Config.minRunTimeMs * 1e6;
+		while (TimeRun(function, nbIterations) < minRunTimeNs && nbIterations < (uint64_t(1) << 32))
+			nbIterations *= 2;
+
+		for (int run = 0; run < s_Config.nbWarmupRuns; run++)
+			TimeRun(function, nbIterations);
+
+		std::vector<double> iterationNs;
+		for (int run = 0; run < s_Config.nbRuns; run++)
+			iterationNs.push_back(TimeRun(function, nbIterations) / double(nbIterations));
+
+		AddResult(suite, name, nbIterations, iterationNs);
+	}
+
+	// Keeps the compiler from removing computations whose results are not used
+	static void Consume(uint64_t value);
+
+	static const std::vector<LeydenJarBenchmarkResult>& GetResults();
+	static bool WriteJson(const char* fileName);
+
+private:
+
+	template<typename Function>
+	static double TimeRun(Function& function, uint64_t nbIterations)
+	{
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		function(nbIterations);
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+	}
+
+	static void AddResult(const char* suite, const char* name, uint64_t nbIterations, std::vector<double>& iterationNs);
+
+private:
+
+	static LeydenJarBenchmarkConfig					s_Config;
+	static std::vector<LeydenJarBenchmarkResult>	s_Results;
+};
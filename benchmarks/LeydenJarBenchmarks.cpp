@@ -0,0 +1,103 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Usage: Leyden_Jar_Benchmarks [options] [suite] [suite arguments]
+// Without suite name all suites are run with their default arguments.
+// Options, they apply to the microbenchmark suites:
+//   --warmup N     warm-up runs discarded before timing (3)
+//   --runs N       timed runs, percentiles are computed over them (15)
+//   --min-time MS  minimum duration of a run, the iteration count is doubled until it is reached (10)
+//   --json FILE    writes all microbenchmark results to FILE
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "LeydenJarBenchmarkHarness.h"
+#include "LeydenJarBenchmarks.h"
+
+struct LeydenJarBenchmarkSuite
+{
+    const char* name;
+    int (*pRun)(int argc, char** argv);
+};
+
+static const LeydenJarBenchmarkSuite s_Suites[] =
+{
+    { "analysis", RunAnalysisBenchmark },
+    { "kernels", RunKernelBenchmark },
+    { "protocol", RunProtocolBenchmark },
+    { "layout", RunLayoutBenchmark },
+    { "levels", RunLevelsBenchmark },
+    { "drawkey", RunDrawKeyBenchmark },
+};
+
+static const int s_NbSuites = int(sizeof(s_Suites) / sizeof(s_Suites[0]));
+
+static int RunSuites(int argc, char** argv)
+{
+    if (argc < 1)
+    {
+        int result = 0;
+        for (int i = 0; i < s_NbSuites; i++)
+        {
+            char* suiteArgv[] = { const_cast<char*>(s_Suites[i].name), nullptr };
+            result |= s_Suites[i].pRun(1, suiteArgv);
+            printf("\n");
+        }
+        return result;
+    }
+
+    for (int i = 0; i < s_NbSuites; i++)
+    {
+        if (std::strcmp(argv[0], s_Suites[i].name) == 0)
+            return s_Suites[i].pRun(argc, argv);
+    }
+
+    printf("Unknown benchmark suite '%s', available suites:", argv[0]);
+    for (int i = 0; i < s_NbSuites; i++)
+        printf(" %s", s_Suites[i].name);
+    printf("\n");
+
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    LeydenJarBenchmarkHarness::LeydenJarBenchmarkConfig config = LeydenJarBenchmarkHarness::GetConfig();
+    const char* pJsonFileName = nullptr;
+
+    // Options come before the suite name, anything after it belongs to the suite
+    int argIdx = 1;
+    while (argIdx < argc && std::strncmp(argv[argIdx], "--", 2) == 0)
+    {
+        if (argIdx + 1 >= argc)
+        {
+            printf("Missing value of option '%s'\n", argv[argIdx]);
+            return 1;
+        }
+
+        if (std::strcmp(argv[argIdx], "--warmup") == 0)
+            config.nbWarmupRuns = std::atoi(argv[argIdx + 1]);
+        else if (std::strcmp(argv[argIdx], "--runs") == 0)
+            config.nbRuns = std::atoi(argv[argIdx + 1]);
+        else if (std::strcmp(argv[argIdx], "--min-time") == 0)
+            config.minRunTimeMs = std::atof(argv[argIdx + 1]);
+        else if (std::strcmp(argv[argIdx], "--json") == 0)
+            pJsonFileName = argv[argIdx + 1];
+        else
+        {
+            printf("Unknown option '%s'\n", argv[argIdx]);
+            return 1;
+        }
+        argIdx += 2;
+    }
+    LeydenJarBenchmarkHarness::SetConfig(config);
+
+    int result = RunSuites(argc - argIdx, argv + argIdx);
+
+    if (pJsonFileName != nullptr && LeydenJarBenchmarkHarness::WriteJson(pJsonFileName) == false)
+        result = 1;
+
+    return result;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Benchmark suites of the Leyden_Jar_Benchmarks executable.
+// Each suite gets its own arguments, argv[0] being the suite name.
+// Microbenchmark suites time their code with LeydenJarBenchmarkHarness, their results go to the JSON report.
+
+int RunAnalysisBenchmark(int argc, char** argv);
+int RunKernelBenchmark(int argc, char** argv);
+int RunProtocolBenchmark(int argc, char** argv);
+int RunLayoutBenchmark(int argc, char** argv);
+int RunLevelsBenchmark(int argc, char** argv);
+int RunDrawKeyBenchmark(int argc, char** argv);
@@ -0,0 +1,111 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Microbenchmark of keyboard key tessellation: DrawConvexKey() and DrawKey() of an ISO enter key, compared to the copy
+// of the same keys from a LeydenJarKeyGeometryCache, the way the diagnostic tool draws them every frame.
+// Keys are drawn in a standalone draw list with the anti-aliasing setup of an ImGui window, without any renderer. The
+// draw list is reset every 256 keys to keep its size bounded, that reset is part of the timings.
+//
+// Arguments: none
+
+#include <cstdio>
+
+#include "imgui.h"
+#include "LeydenJarImGuiHelpers.h"
+#include "LeydenJarBenchmarkHarness.h"
+#include "LeydenJarBenchmarks.h"
+
+static const uint64_t s_NbKeysPerReset = 256;
+
+static void ResetDrawList(ImDrawList& drawList, ImDrawListFlags flags)
+{
+    drawList._ResetForNewFrame();
+    drawList.Flags = flags;
+    drawList.PushClipRectFullScreen();
+    drawList.PushTextureID(ImGui::GetIO().Fonts->TexID);
+}
+
+int RunDrawKeyBenchmark(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    ImGui::CreateContext();
+
+    ImGuiIO& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(1920.f, 1080.f);
+    io.DeltaTime = 1.f / 60.f;
+    io.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
+    unsigned char* pFontPixels;
+    int fontWidth;
+    int fontHeight;
+    io.Fonts->GetTexDataAsRGBA32(&pFontPixels, &fontWidth, &fontHeight);
+
+    // Window draw lists get the anti-aliasing setup of the style, the benchmark draw list copies it
+    ImGui::NewFrame();
+    ImGui::Begin("Benchmark");
+    ImDrawListFlags drawListFlags = ImGui::GetWindowDrawList()->Flags;
+    ImGui::End();
+
+    ImDrawList drawList(ImGui::GetDrawListSharedData());
+    ImU32 bgCol = IM_COL32(45, 45, 255, 255);
+    ImU32 outlineCol = IM_COL32(200, 200, 200, 255);
+
+    LeydenJarBenchmarkHarness::PrintHeader("Key tessellation, 50 px key unit");
+
+    LeydenJarBenchmarkHarness::Run("drawkey", "DrawConvexKey 1u", [&](uint64_t nbIterations)
+    {
+        for (uint64_t i = 0; i < nbIterations; i++)
+        {
+            if (i % s_NbKeysPerReset == 0)
+                ResetDrawList(drawList, drawListFlags);
+            DrawConvexKey(&drawList, ImVec2(float(i & 15) * 50.f, 100.f), 1.f, 1.f, 0.f, 0.f, 50.f, bgCol, outlineCol);
+        }
+        LeydenJarBenchmarkHarness::Consume(uint64_t(drawList.VtxBuffer.Size));
+    });
+
+    LeydenJarBenchmarkHarness::Run("drawkey", "DrawKey ISO enter", [&](uint64_t nbIterations)
+    {
+        for (uint64_t i = 0; i < nbIterations; i++)
+        {
+            if (i % s_NbKeysPerReset == 0)
+                ResetDrawList(drawList, drawListFlags);
+            DrawKey(&drawList, ImVec2(float(i & 15) * 50.f, 100.f), 1.25f, 1.5f, 2.f, 1.f, 0.f, -0.25f, 0.f, 0.f, 50.f, bgCol, outlineCol);
+        }
+        LeydenJarBenchmarkHarness::Consume(uint64_t(drawList.VtxBuffer.Size));
+    });
+
+    ResetDrawList(drawList, drawListFlags);
+    LeydenJarKeyGeometryCache geometryCache;
+    geometryCache.Begin(&drawList);
+    int convexKeyIdx = geometryCache.AddConvexKey(1.f, 1.f, 0.f, 0.f, 50.f);
+    int isoKeyIdx = geometryCache.AddKey(1.25f, 1.5f, 2.f, 1.f, 0.f, -0.25f, 0.f, 0.f, 50.f);
+    geometryCache.End();
+
+    LeydenJarBenchmarkHarness::Run("drawkey", "cached convex key 1u", [&](uint64_t nbIterations)
+    {
+        for (uint64_t i = 0; i < nbIterations; i++)
+        {
+            if (i % s_NbKeysPerReset == 0)
+                ResetDrawList(drawList, drawListFlags);
+            geometryCache.Draw(&drawList, ImVec2(float(i & 15) * 50.f, 100.f), convexKeyIdx, bgCol, outlineCol);
+        }
+        LeydenJarBenchmarkHarness::Consume(uint64_t(drawList.VtxBuffer.Size));
+    });
+
+    LeydenJarBenchmarkHarness::Run("drawkey", "cached ISO enter", [&](uint64_t nbIterations)
+    {
+        for (uint64_t i = 0; i < nbIterations; i++)
+        {
+            if (i % s_NbKeysPerReset == 0)
+                ResetDrawList(drawList, drawListFlags);
+            geometryCache.Draw(&drawList, ImVec2(float(i & 15) * 50.f, 100.f), isoKeyIdx, bgCol, outlineCol);
+        }
+        LeydenJarBenchmarkHarness::Consume(uint64_t(drawList.VtxBuffer.Size));
+    });
+
+    ImGui::EndFrame();
+    ImGui::DestroyContext();
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Microbenchmark of the whole-matrix level kernels.
+// Kernels are compared to the reference per key code the level monitor used before: sort based median of 3,
+// threshold lookup through the binning map and branchy classification depending on switch technology.
+// Outputs of every kernel are checked against the reference before timing.
+//
+// Arguments: [nbFrames]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <algorithm>
+
+#include "LeydenJarLevelKernels.h"
+#include "LeydenJarBenchmarks.h"
+
+static const int s_NbFramesInBank = 64;
+
+struct LeydenJarKernelBenchmarkState
+{
+    uint16_t	thresholds[18][8];
+    uint16_t	dacThreshold[16];
+    uint8_t		binningMap[18][8];
+    uint16_t	minLevels[18][8];
+    uint16_t	maxLevels[18][8];
+    uint8_t		keyStates[18][8];
+};
+
+static inline uint16_t ReferenceMedian(uint16_t val0, uint16_t val1, uint16_t val2)
+{
+    std::array<uint16_t, 3> levels = { { val0, val1, val2 } };
+
+    std::sort(levels.begin(), levels.end());
+    return levels[1];
+}
+
+static void ProcessLevelsReference(LeydenJarKernelBenchmarkState& state, const uint16_t (*levels)[8], const uint16_t (*levelsPrev1)[8], const uint16_t (*levelsPrev2)[8], bool isBeamSpring)
+{
+    for (int col = 0; col < 18; col++)
+    {
+        for (int row = 0; row < 8; row++)
+        {
+            uint16_t threshold = state.dacThreshold[state.binningMap[col][row]];
+
+            if (levels[col][row] < threshold && levelsPrev1[col][row] < threshold && levelsPrev2[col][row] < threshold)
+                state.minLevels[col][row] = std::min(state.minLevels[col][row], ReferenceMedian(levels[col][row], levelsPrev1[col][row], levelsPrev2[col][row]));
+
+            if (levels[col][row] >= threshold && levelsPrev1[col][row] >= threshold && levelsPrev2[col][row] >= threshold)
+                state.maxLevels[col][row] = std::max(state.maxLevels[col][row], ReferenceMedian(levels[col][row], levelsPrev1[col][row], levelsPrev2[col][row]));
+
+            uint8_t keyState = 0;
+            if (isBeamSpring == false)
+            {
+                if (levels[col][row] >= threshold)
+                {
+                    if ((levels[col][row] - threshold) <= 3)
+                        keyState = 1;
+                    else
+                        keyState = 2;
+                }
+            }
+            else
+            {
+                if (levels[col][row] <= threshold)
+                {
+                    if ((threshold - levels[col][row]) <= 3)
+                        keyState = 1;
+                    else
+                        keyState = 2;
+                }
+            }
+            state.keyStates[col][row] = keyState;
+        }
+    }
+}
+
+static void InitState(LeydenJarKernelBenchmarkState& state)
+{
+    std::memset(&state, 0, sizeof(state));
+    state.dacThreshold[0] = 150;
+    state.dacThreshold[1] = 170;
+
+    for (int col = 0; col < 18; col++)
+    {
+        for (int row = 0; row < 8; row++)
+        {
+            state.binningMap[col][row] = uint8_t((col + row) & 1);
+            state.thresholds[col][row] = state.dacThreshold[state.binningMap[col][row]];
+        }
+    }
+    std::memset(state.minLevels, 0xFF, sizeof(state.minLevels));
+}
+
+static void FillFrameBank(std::vector<uint16_t>& frameBank)
+{
+    frameBank.resize(s_NbFramesInBank * 18 * 8);
+    std::srand(4321);
+
+    // Levels spread around both thresholds so that every classification path is taken
+    for (size_t i = 0; i < frameBank.size(); i++)
+        frameBank[i] = uint16_t(130 + std::rand() % 60);
+}
+
+static const uint16_t (*GetFrame(const std::vector<uint16_t>& frameBank, int frame))[8]
+{
+    return reinterpret_cast<const uint16_t (*)[8]>(&frameBank[(frame % s_NbFramesInBank) * 18 * 8]);
+}
+
+static void RunKernel(LeydenJarLevelKernel kernel, LeydenJarKernelBenchmarkState& state, const std::vector<uint16_t>& frameBank, int frame, bool isBeamSpring)
+{
+    LeydenJarLevelKernelParams params;
+
+    params.pLevels = GetFrame(frameBank, frame + 2);
+    params.pLevelsPrev1 = GetFrame(frameBank, frame + 1);
+    params.pLevelsPrev2 = GetFrame(frameBank, frame);
+    params.pThresholds = state.thresholds;
+    params.pMinLevels = state.minLevels;
+    params.pMaxLevels = state.maxLevels;
+    params.pKeyStates = state.keyStates;
+    params.firstCol = 0;
+    params.lastCol = 18;
+    params.isBeamSpring = isBeamSpring;
+    params.hasHistory = true;
+
+    kernel(params);
+}
+
+static bool CheckKernel(int kernelType, const std::vector<uint16_t>& frameBank, bool isBeamSpring)
+{
+    LeydenJarKernelBenchmarkState reference;
+    LeydenJarKernelBenchmarkState tested;
+
+    InitState(reference);
+    InitState(tested);
+
+    for (int frame = 0; frame < s_NbFramesInBank; frame++)
+    {
+        ProcessLevelsReference(reference, GetFrame(frameBank, frame + 2), GetFrame(frameBank, frame + 1), GetFrame(frameBank, frame), isBeamSpring);
+        RunKernel(GetLevelKernel(kernelType), tested, frameBank, frame, isBeamSpring);
+
+        if (std::memcmp(reference.minLevels, tested.minLevels, sizeof(reference.minLevels)) != 0 ||
+            std::memcmp(reference.maxLevels, tested.maxLevels, sizeof(reference.maxLevels)) != 0 ||
+            std::memcmp(reference.keyStates, tested.keyStates, sizeof(reference.keyStates)) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+int RunKernelBenchmark(int argc, char** argv)
+{
+    int nbFrames = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+    if (nbFrames <= 0)
+        nbFrames = 1000000;
+
+    std::vector<uint16_t> frameBank;
+    FillFrameBank(frameBank);
+
+    printf("Level kernels, %d frames of 18x8 keys\n", nbFrames);
+    printf("%10s %12s %12s %10s\n", "kernel", "ns/frame", "ns/key", "speedup");
+
+    // Reference timing, the same data and polarity mix is used for every kernel
+    LeydenJarKernelBenchmarkState state;
+    InitState(state);
+
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < nbFrames; frame++)
+        ProcessLevelsReference(state, GetFrame(frameBank, frame + 2), GetFrame(frameBank, frame + 1), GetFrame(frameBank, frame), (frame & 1024) != 0);
+    double referenceNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / nbFrames;
+
+    // Keeps the compiler from removing the reference loop
+    volatile uint8_t sink = state.keyStates[0][0];
+    (void)sink;
+
+    printf("%10s %12.1f %12.2f %10.2f\n", "Reference", referenceNs, referenceNs / (18 * 8), 1.0);
+
+    int result = 0;
+
+    for (int kernelType = 0; kernelType < LeydenJarLevelKernelCount; kernelType++)
+    {
+        if (IsLevelKernelSupported(kernelType) == false)
+        {
+            printf("%10s %12s\n", GetLevelKernelName(kernelType), "unsupported");
+            continue;
+        }
+
+        if (CheckKernel(kernelType, frameBank, false) == false || CheckKernel(kernelType, frameBank, true) == false)
+        {
+            printf("%10s %12s\n", GetLevelKernelName(kernelType), "MISMATCH");
+            result = 1;
+            continue;
+        }
+
+        LeydenJarLevelKernel kernel = GetLevelKernel(kernelType);
+        InitState(state);
+
+        startTime = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < nbFrames; frame++)
+            RunKernel(kernel, state, frameBank, frame, (frame & 1024) != 0);
+        double kernelNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / nbFrames;
+
+        sink = state.keyStates[0][0];
+
+        printf("%10s %12.1f %12.2f %10.2f\n", GetLevelKernelName(kernelType), kernelNs, kernelNs / (18 * 8), referenceNs / kernelNs);
+    }
+
+    return result;
+}
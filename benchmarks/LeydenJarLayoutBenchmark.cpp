@@ -0,0 +1,159 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Microbenchmark of the keyboard definition decoding done by DecodeVialKeyboardDefinition().
+// Definitions are generated JSON: a small 60% layout without layout options, and a large layout of 12 rows with
+// 8 layout options whose alternative keys are aligned on their default choice. Only the JSON decoding and key
+// positioning are timed, XZ decompression of the definition is library code and needs a compressed definition.
+//
+// Arguments: none
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "LeydenJarViaLayout.h"
+#include "LeydenJarBenchmarkHarness.h"
+#include "LeydenJarBenchmarks.h"
+
+static void AppendKey(std::string& json, int row, int col, int groupNum, int groupIdx)
+{
+    char key[64];
+
+    if (groupNum < 0)
+        snprintf(key, sizeof(key), "\"%d,%d\"", row, col);
+    else
+        snprintf(key, sizeof(key), "\"%d,%d\\n\\n\\n%d,%d\"", row, col, groupNum, groupIdx);
+    json += key;
+}
+
+// 5 rows of 14, 14, 13, 12 and 8 keys with ANSI widths
+static std::string GenerateSmallDefinition()
+{
+    static const int s_NbRowKeys[5] = { 14, 14, 13, 12, 8 };
+    std::string json = "{\"name\":\"Small\",\"matrix\":{\"rows\":5,\"cols\":14},\"layouts\":{\"keymap\":[";
+
+    for (int row = 0; row < 5; row++)
+    {
+        json += (row > 0) ? ",[" : "[";
+        for (int col = 0; col < s_NbRowKeys[row]; col++)
+        {
+            if (col > 0)
+                json += ",";
+            if (col == 0 && row > 0)
+                json += "{\"w\":1.5},";
+            else if (col == s_NbRowKeys[row] - 1 && row < 4)
+                json += "{\"w\":2},";
+            else if (row == 4 && col == 3)
+                json += "{\"w\":6.25},";
+            AppendKey(json, row, col, -1, 0);
+        }
+        json += "]";
+    }
+    json += "]}}";
+
+    return json;
+}
+
+// 12 rows of 22 keys, the first 8 rows end with the choices of a layout option: the default one is 1 key, the other
+// ones 2 keys placed on its right, the decoder moves them on the default choice
+static std::string GenerateLargeDefinition()
+{
+    std::string json = "{\"name\":\"Large\",\"matrix\":{\"rows\":12,\"cols\":24},\"layouts\":{\"labels\":[";
+
+    for (int option = 0; option < 8; option++)
+    {
+        char label[128];
+        if (option & 1)
+            snprintf(label, sizeof(label), "%s\"Option %d\"", option > 0 ? "," : "", option);
+        else
+            snprintf(label, sizeof(label), "%s[\"Option %d\",\"Default\",\"Split\",\"Stepped\"]", option > 0 ? "," : "", option);
+        json += label;
+    }
+    json += "],\"keymap\":[";
+
+    for (int row = 0; row < 12; row++)
+    {
+        json += (row > 0) ? ",[" : "[";
+        for (int col = 0; col < 22; col++)
+        {
+            if (col > 0)
+                json += ",";
+            if (col == 8 || col == 16)
+                json += "{\"x\":0.25},";
+            else if ((col % 5) == 4)
+                json += "{\"w\":1.25},";
+            AppendKey(json, row, col, -1, 0);
+        }
+
+        if (row < 8)
+        {
+            int nbChoices = (row & 1) ? 2 : 3;
+            for (int choice = 0; choice < nbChoices; choice++)
+            {
+                // Every choice starts half a key after the previous one
+                json += (choice == 2) ? ",{\"x\":0.5,\"w\":1.5}," : ",{\"x\":0.5},";
+                AppendKey(json, row, 22, row, choice);
+                if (choice > 0)
+                {
+                    json += ",";
+                    AppendKey(json, row, 23, row, choice);
+                }
+            }
+        }
+        json += "]";
+    }
+    json += "]}}";
+
+    return json;
+}
+
+static bool BenchmarkDefinition(const char* name, const std::string& json)
+{
+    std::vector<LeydenJarViaLayoutOption> layoutOptions;
+    std::vector< std::vector<LeydenJarViaKey> > keys;
+
+    DecodeViaKeyboardLayout(json.c_str(), json.size(), layoutOptions, keys);
+
+    size_t nbKeys = 0;
+    for (size_t row = 0; row < keys.size(); row++)
+        nbKeys += keys[row].size();
+    if (nbKeys == 0)
+    {
+        printf("%-36s %12s\n", name, "DECODE ERROR");
+        return false;
+    }
+
+    char benchmarkName[64];
+    snprintf(benchmarkName, sizeof(benchmarkName), "%s, %d keys, %d bytes", name, int(nbKeys), int(json.size()));
+
+    LeydenJarBenchmarkHarness::Run("layout", benchmarkName, [&json](uint64_t nbIterations)
+    {
+        for (uint64_t i = 0; i < nbIterations; i++)
+        {
+            std::vector<LeydenJarViaLayoutOption> layoutOptions;
+            std::vector< std::vector<LeydenJarViaKey> > keys;
+
+            DecodeViaKeyboardLayout(json.c_str(), json.size(), layoutOptions, keys);
+            LeydenJarBenchmarkHarness::Consume(keys.size());
+        }
+    });
+
+    return true;
+}
+
+int RunLayoutBenchmark(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    LeydenJarBenchmarkHarness::PrintHeader("Keyboard definition decoding");
+
+    int result = 0;
+    if (BenchmarkDefinition("small", GenerateSmallDefinition()) == false)
+        result = 1;
+    if (BenchmarkDefinition("large", GenerateLargeDefinition()) == false)
+        result = 1;
+
+    return result;
+}
@@ -0,0 +1,169 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Microbenchmark of the per frame level path of the level monitor: median of 3, min/max tracking and key state
+// classification with the fastest level kernel, key state to key colour lookup, and the level oscilloscope history
+// (frame append and min/max decimation of a full history to one pair per pixel column).
+// Levels are random values spread around 2 DAC thresholds so that every classification path is taken.
+//
+// Arguments: none
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "imgui.h"
+#include "LeydenJarLevelAnalysis.h"
+#include "LeydenJarLevelHistory.h"
+#include "LeydenJarImGuiHelpers.h"
+#include "LeydenJarBenchmarkHarness.h"
+#include "LeydenJarBenchmarks.h"
+
+static const int s_NbFramesInBank = 64;
+
+struct LeydenJarLevelsBenchmarkState
+{
+    uint16_t	thresholds[18][8];
+    uint16_t	minLevels[18][8];
+    uint16_t	maxLevels[18][8];
+    uint8_t		keyStates[18][8];
+    ImU32		keyColors[18][8];
+};
+
+static void InitState(LeydenJarLevelsBenchmarkState& state)
+{
+    std::memset(&state, 0, sizeof(state));
+
+    for (int col = 0; col < 18; col++)
+        for (int row = 0; row < 8; row++)
+            state.thresholds[col][row] = ((col + row) & 1) ? 170 : 150;
+    std::memset(state.minLevels, 0xFF, sizeof(state.minLevels));
+}
+
+static void FillFrameBank(std::vector<uint16_t>& frameBank)
+{
+    frameBank.resize(s_NbFramesInBank * 18 * 8);
+    std::srand(1234);
+
+    for (size_t i = 0; i < frameBank.size(); i++)
+        frameBank[i] = uint16_t(130 + std::rand() % 60);
+}
+
+static const uint16_t (*GetFrame(const std::vector<uint16_t>& frameBank, uint64_t frame))[8]
+{
+    return reinterpret_cast<const uint16_t (*)[8]>(&frameBank[(frame % s_NbFramesInBank) * 18 * 8]);
+}
+
+// Same lookup as LeydenJarDiagnosticTool::GetKeyColorFromLevel()
+static void ComputeKeyColors(LeydenJarLevelsBenchmarkState& state)
+{
+    for (int col = 0; col < 18; col++)
+        for (int row = 0; row < 8; row++)
+            state.keyColors[col][row] = GetKeyStateColor(state.keyStates[col][row]);
+}
+
+static void RunKernel(LeydenJarLevelKernel kernel, LeydenJarLevelsBenchmarkState& state, const std::vector<uint16_t>& frameBank, uint64_t frame)
+{
+    LeydenJarLevelKernelParams params;
+
+    params.pLevels = GetFrame(frameBank, frame + 2);
+    params.pLevelsPrev1 = GetFrame(frameBank, frame + 1);
+    params.pLevelsPrev2 = GetFrame(frameBank, frame);
+    params.pThresholds = state.thresholds;
+    params.pMinLevels = state.minLevels;
+    params.pMaxLevels = state.maxLevels;
+    params.pKeyStates = state.keyStates;
+    params.firstCol = 0;
+    params.lastCol = 18;
+    params.isBeamSpring = false;
+    params.hasHistory = true;
+
+    kernel(params);
+}
+
+int RunLevelsBenchmark(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    std::vector<uint16_t> frameBank;
+    FillFrameBank(frameBank);
+
+    LeydenJarLevelsBenchmarkState state;
+    InitState(state);
+
+    int kernelType = GetBestLevelKernelType();
+    LeydenJarLevelKernel kernel = GetLevelKernel(kernelType);
+
+    char title[64];
+    snprintf(title, sizeof(title), "Level frames of 18x8 keys, %s kernel", GetLevelKernelName(kernelType));
+    LeydenJarBenchmarkHarness::PrintHeader(title);
+
+    LeydenJarBenchmarkHarness::Run("levels", "median/min/max/state", [&](uint64_t nbIterations)
+    {
+        for (uint64_t frame = 0; frame < nbIterations; frame++)
+            RunKernel(kernel, state, frameBank, frame);
+        LeydenJarBenchmarkHarness::Consume(state.keyStates[0][0]);
+    });
+
+    LeydenJarBenchmarkHarness::Run("levels", "key colours", [&](uint64_t nbIterations)
+    {
+        for (uint64_t frame = 0; frame < nbIterations; frame++)
+        {
+            // Key states change every frame, colour lookups can not be hoisted
+            state.keyStates[frame % 18][frame & 7] = uint8_t(frame % 3);
+            ComputeKeyColors(state);
+        }
+        LeydenJarBenchmarkHarness::Consume(state.keyColors[0][0]);
+    });
+
+    LeydenJarBenchmarkHarness::Run("levels", "median/min/max/state/colours", [&](uint64_t nbIterations)
+    {
+        for (uint64_t frame = 0; frame < nbIterations; frame++)
+        {
+            RunKernel(kernel, state, frameBank, frame);
+            ComputeKeyColors(state);
+        }
+        LeydenJarBenchmarkHarness::Consume(state.keyColors[0][0]);
+    });
+
+    // Oscilloscope history of 8 traced keys, frames are 1 ms apart
+    LeydenJarLevelHistory history;
+    for (int trace = 0; trace < LeydenJarLevelHistory::kMaxTraces; trace++)
+        history.ToggleKey(trace, trace);
+
+    uint64_t frameTimeNs = 0;
+    LeydenJarBenchmarkHarness::Run("levels", "history append, 8 traces", [&](uint64_t nbIterations)
+    {
+        for (uint64_t frame = 0; frame < nbIterations; frame++)
+        {
+            frameTimeNs += 1000000;
+            history.AddFrame(GetFrame(frameBank, frame), frameTimeNs);
+        }
+        LeydenJarBenchmarkHarness::Consume(history.GetNbRetainedFrames());
+    });
+
+    // Fills the whole ring so that decimation always covers the full capacity
+    while (history.GetNbRetainedFrames() < history.GetCapacity())
+    {
+        frameTimeNs += 1000000;
+        history.AddFrame(GetFrame(frameBank, frameTimeNs / 1000000), frameTimeNs);
+    }
+
+    uint64_t firstNs;
+    uint64_t lastNs;
+    history.GetTimeRange(firstNs, lastNs);
+
+    std::vector<LeydenJarLevelHistory::LeydenJarLevelRange> ranges(1920);
+    char decimateName[64];
+    snprintf(decimateName, sizeof(decimateName), "history decimate %u frames", history.GetCapacity());
+    LeydenJarBenchmarkHarness::Run("levels", decimateName, [&](uint64_t nbIterations)
+    {
+        for (uint64_t i = 0; i < nbIterations; i++)
+            history.Decimate(int(i % LeydenJarLevelHistory::kMaxTraces), firstNs, lastNs, int(ranges.size()), &ranges[0]);
+        LeydenJarBenchmarkHarness::Consume(ranges[0].max);
+    });
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Microbenchmark of the packet encoding and decoding of LeydenJarProtocol.
+// The benchmark executable does not link hidapi, it provides a loopback device instead: hid_enumerate() returns one
+// raw HID interface and hid_read() answers with a synthetic packet derived from the last written one, so timings are
+// the protocol code plus a copy, without any USB transfer.
+//
+// Arguments: none
+
+#include <cstdio>
+#include <cstring>
+
+#include "LeydenJarProtocol.h"
+#include "LeydenJarBenchmarkHarness.h"
+#include "LeydenJarBenchmarks.h"
+
+struct hid_device_
+{
+    unsigned char	lastWrite[33];
+    unsigned char	counter;
+};
+
+static hid_device s_LoopbackDevice;
+static char s_LoopbackPath[] = "loopback";
+static struct hid_device_info s_LoopbackDeviceInfo;
+
+int HID_API_EXPORT HID_API_CALL hid_init(void)
+{
+    return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_exit(void)
+{
+    return 0;
+}
+
+struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate(unsigned short vendor_id, unsigned short product_id)
+{
+    std::memset(&s_LoopbackDeviceInfo, 0, sizeof(s_LoopbackDeviceInfo));
+    s_LoopbackDeviceInfo.path = s_LoopbackPath;
+    s_LoopbackDeviceInfo.vendor_id = vendor_id;
+    s_LoopbackDeviceInfo.product_id = product_id;
+    s_LoopbackDeviceInfo.usage_page = 0xFF60;
+    s_LoopbackDeviceInfo.usage = 0x61;
+
+    return &s_LoopbackDeviceInfo;
+}
+
+void HID_API_EXPORT HID_API_CALL hid_free_enumeration(struct hid_device_info* devs)
+{
+    (void)devs;
+}
+
+HID_API_EXPORT hid_device* HID_API_CALL hid_open_path(const char* path)
+{
+    (void)path;
+    std::memset(&s_LoopbackDevice, 0, sizeof(s_LoopbackDevice));
+    return &s_LoopbackDevice;
+}
+
+void HID_API_EXPORT HID_API_CALL hid_close(hid_device* dev)
+{
+    (void)dev;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_write(hid_device* dev, const unsigned char* data, size_t length)
+{
+    size_t copiedLength = length < sizeof(dev->lastWrite) ? length : sizeof(dev->lastWrite);
+    std::memcpy(dev->lastWrite, data, copiedLength);
+
+    return int(length);
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read(hid_device* dev, unsigned char* data, size_t length)
+{
+    // Answers start like the request without its report id, payload bytes change at every read
+    std::memset(data, 0, length);
+    std::memcpy(data, dev->lastWrite + 1, length < 4 ? length : 4);
+    for (size_t i = 4; i < length; i++)
+        data[i] = (unsigned char)(dev->counter + i * 7);
+    dev->counter++;
+
+    return int(length);
+}
+
+int RunProtocolBenchmark(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    LeydenJarProtocol protocol;
+
+    if (protocol.Initialize() == false || protocol.EnumerateDevices() == false || protocol.OpenDevice(0) == false)
+    {
+        printf("Cannot open the loopback device\n");
+        return 1;
+    }
+
+    LeydenJarBenchmarkHarness::PrintHeader("Protocol packets, loopback device");
+
+    LeydenJarBenchmarkHarness::Run("protocol", "GetColumnLevels", [&protocol](uint64_t nbIterations)
+    {
+        uint16_t columnLevels[8];
+        for (uint64_t i = 0; i < nbIterations; i++)
+        {
+            protocol.GetColumnLevels(int(i % 18), columnLevels);
+            LeydenJarBenchmarkHarness::Consume(columnLevels[i & 7]);
+        }
+    });
+
+    LeydenJarBenchmarkHarness::Run("protocol", "GetColumnLevels 18 columns", [&protocol](uint64_t nbIterations)
+    {
+        uint16_t levels[18][8];
+        for (uint64_t i = 0; i < nbIterations; i++)
+        {
+            for (int col = 0; col < 18; col++)
+                protocol.GetColumnLevels(col, levels[col]);
+            LeydenJarBenchmarkHarness::Consume(levels[i % 18][i & 7]);
+        }
+    });
+
+    LeydenJarBenchmarkHarness::Run("protocol", "GetScanPhysicalVals", [&protocol](uint64_t nbIterations)
+    {
+        uint8_t physicalVals[18];
+        for (uint64_t i = 0; i < nbIterations; i++)
+        {
+            protocol.GetScanPhysicalVals(physicalVals);
+            LeydenJarBenchmarkHarness::Consume(physicalVals[i % 18]);
+        }
+    });
+
+    LeydenJarBenchmarkHarness::Run("protocol", "GetScanLogicalRow", [&protocol](uint64_t nbIterations)
+    {
+        uint32_t rowVal = 0;
+        for (uint64_t i = 0; i < nbIterations; i++)
+        {
+            protocol.GetScanLogicalRow(int(i & 15), rowVal);
+            LeydenJarBenchmarkHarness::Consume(rowVal);
+        }
+    });
+
+    LeydenJarBenchmarkHarness::Run("protocol", "GetVialKeyboardDefinitionDataBlock", [&protocol](uint64_t nbIterations)
+    {
+        static uint8_t definitionData[256 * 32];
+        for (uint64_t i = 0; i < nbIterations; i++)
+            protocol.GetVialKeyboardDefinitionDataBlock(uint16_t(i & 255), definitionData);
+        LeydenJarBenchmarkHarness::Consume(definitionData[nbIterations & 8191]);
+    });
+
+    protocol.CloseDevice();
+    protocol.FreeEnumeratedDevices();
+    protocol.Finalize();
+
+    return 0;
+}
@@ -0,0 +1,347 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Usage: Leyden_Jar_Cli command [-d device] [-n frames] [-r rate]
+// Headless front end of LeydenJarAgent: no SDL, OpenGL or ImGui is involved, so it runs on CI runners,
+// over SSH or in containers. Results are written to standard output as JSON, one object per line,
+// errors go to standard error and give a non zero exit code.
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cwchar>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <json/json.h>
+
+#include "LeydenJarSessionManager.h"
+#include "LeydenJarLevelCompare.h"
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: Leyden_Jar_Cli command [-d device] [-n frames] [-r rate]\n");
+    fprintf(stderr, "Commands:\n");
+    fprintf(stderr, "  list            enumerates Leyden Jar compatible HID devices\n");
+    fprintf(stderr, "  info            connects to a device and prints its Leyden Jar, VIA and VIAL infos\n");
+    fprintf(stderr, "  scan-logical    prints logical (QMK view) scans\n");
+    fprintf(stderr, "  scan-physical   prints physical (controller view) scans\n");
+    fprintf(stderr, "  levels          prints analog levels\n");
+    fprintf(stderr, "  bootloader      makes the device enter its bootloader\n");
+    fprintf(stderr, "  erase-eeprom    erases the device EEPROM\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -d device       device index given by list or HID path, default is 0\n");
+    fprintf(stderr, "  -n frames       number of scans or level frames to print, default is 1\n");
+    fprintf(stderr, "  -r rate         fixed scan rate in Hz, default is the adaptive rate of the monitors\n");
+}
+
+static std::string WideToString(const wchar_t* pWideString)
+{
+    char buffer[256];
+
+    if (pWideString == nullptr)
+        return std::string();
+
+    size_t length = wcstombs(buffer, pWideString, sizeof(buffer));
+    if (length == size_t(-1))
+        return std::string();
+    buffer[sizeof(buffer) - 1] = 0;
+
+    return buffer;
+}
+
+static void WriteJsonLine(const Json::Value& value)
+{
+    static std::unique_ptr<Json::StreamWriter> s_pWriter;
+
+    if (s_pWriter == nullptr)
+    {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        s_pWriter.reset(builder.newStreamWriter());
+    }
+
+    // Flushed line by line so that scans can be piped to another program while they run
+    s_pWriter->write(value, &std::cout);
+    std::cout << std::endl;
+}
+
+static Json::Value HidDeviceToJson(int deviceIndex, const struct hid_device_info* pHidDeviceInfo)
+{
+    Json::Value value(Json::objectValue);
+    char hexString[8];
+
+    value["index"] = deviceIndex;
+    value["path"] = pHidDeviceInfo->path;
+    snprintf(hexString, sizeof(hexString), "0x%04x", pHidDeviceInfo->vendor_id);
+    value["vendor_id"] = hexString;
+    snprintf(hexString, sizeof(hexString), "0x%04x", pHidDeviceInfo->product_id);
+    value["product_id"] = hexString;
+    value["product"] = WideToString(pHidDeviceInfo->product_string);
+    value["manufacturer"] = WideToString(pHidDeviceInfo->manufacturer_string);
+    value["serial_number"] = WideToString(pHidDeviceInfo->serial_number);
+    value["release_number"] = pHidDeviceInfo->release_number;
+
+    return value;
+}
+
+static Json::Value DeviceInfoToJson(int deviceIndex, const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo)
+{
+    Json::Value value = HidDeviceToJson(deviceIndex, pDeviceInfo->pHidDeviceInfo);
+    char versionString[32];
+
+    snprintf(versionString, sizeof(versionString), "%d.%d.%d", pDeviceInfo->protocolVerMajor, pDeviceInfo->protocolVerMid, pDeviceInfo->protocolVerMinor);
+    value["protocol_version"] = versionString;
+    value["logical_rows"] = pDeviceInfo->nbLogicalRows;
+    value["logical_cols"] = pDeviceInfo->nbLogicalCols;
+    value["physical_rows"] = pDeviceInfo->nbPhysicalRows;
+    value["physical_cols"] = pDeviceInfo->nbPhysicalCols;
+    value["switch_technology"] = pDeviceInfo->switchTechnology == SwitchTechnologyBeamSpring ? "beam_spring" : "model_f";
+    value["keyboard_side"] = pDeviceInfo->isKeyboardLeft ? "left" : "right";
+
+    Json::Value bins(Json::arrayValue);
+    for (int bin = 0; bin < pDeviceInfo->nbBins && bin < 16; bin++)
+    {
+        Json::Value binValue(Json::objectValue);
+        binValue["dac_threshold"] = pDeviceInfo->dacThreshold[bin];
+        binValue["dac_ref_level"] = pDeviceInfo->dacRefLevel[bin];
+        bins.append(binValue);
+    }
+    value["bins"] = bins;
+
+    Json::Value binningMap(Json::arrayValue);
+    for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
+    {
+        Json::Value colBins(Json::arrayValue);
+        for (int row = 0; row < pDeviceInfo->nbPhysicalRows; row++)
+            colBins.append(pDeviceInfo->binningMap[col][row]);
+        binningMap.append(colBins);
+    }
+    value["binning_map"] = binningMap;
+
+    if (pDeviceInfo->viaVersionMajor != 0 || pDeviceInfo->viaVersionMinor != 0)
+    {
+        snprintf(versionString, sizeof(versionString), "%d.%d", pDeviceInfo->viaVersionMajor, pDeviceInfo->viaVersionMinor);
+        value["via_version"] = versionString;
+    }
+
+    if (pDeviceInfo->vialVersion0 != 0 || pDeviceInfo->vialVersion1 != 0 || pDeviceInfo->vialVersion2 != 0 || pDeviceInfo->vialVersion3 != 0)
+    {
+        char uidString[24];
+
+        snprintf(versionString, sizeof(versionString), "%d.%d.%d.%d", pDeviceInfo->vialVersion0, pDeviceInfo->vialVersion1, pDeviceInfo->vialVersion2, pDeviceInfo->vialVersion3);
+        value["vial_version"] = versionString;
+        for (int i = 0; i < 8; i++)
+            snprintf(&uidString[i * 2], 3, "%02x", pDeviceInfo->vialUid[i]);
+        value["vial_uid"] = uidString;
+        value["vial_definition_size"] = pDeviceInfo->vialKeyboardDefinitionSize;
+    }
+
+    return value;
+}
+
+static Json::Value FrameTimingToJson(const LeydenJarAgent::LeydenJarFrameTiming& timing)
+{
+    Json::Value value(Json::objectValue);
+
+    value["frame"] = Json::UInt64(timing.frameIndex);
+    value["time_ns"] = Json::UInt64(timing.acquisitionStartNs);
+    value["duration_us"] = Json::UInt64((timing.acquisitionEndNs - timing.acquisitionStartNs) / 1000);
+
+    return value;
+}
+
+// Finds a device by enumeration index or HID path, returns -1 if not found
+static int FindDevice(LeydenJarSessionManager& sessionManager, const char* pDevice)
+{
+    char* pEnd;
+    long deviceIndex = strtol(pDevice, &pEnd, 10);
+
+    if (*pDevice != 0 && *pEnd == 0)
+        return deviceIndex < sessionManager.GetNbEnumeratedDevices() ? int(deviceIndex) : -1;
+
+    for (int i = 0; i < sessionManager.GetNbEnumeratedDevices(); i++)
+        if (std::strcmp(sessionManager.GetHidDeviceInfo(i)->path, pDevice) == 0)
+            return i;
+
+    return -1;
+}
+
+static int RunScans(LeydenJarAgent* pAgent, const std::string& command, int nbFrames)
+{
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = pAgent->GetDeviceInfo();
+    bool isSuccess = true;
+
+    for (int frame = 0; frame < nbFrames; frame++)
+    {
+        Json::Value value;
+
+        if (command == "scan-logical")
+        {
+            pAgent->RequestLogicalScan();
+            isSuccess = pAgent->WaitEndRequest();
+            if (isSuccess == false)
+                break;
+
+            value = FrameTimingToJson(pAgent->GetLogicalScanTiming());
+            Json::Value rows(Json::arrayValue);
+            for (int row = 0; row < pDeviceInfo->nbLogicalRows; row++)
+                rows.append(pAgent->GetLogicalKeyboardState(row));
+            value["rows"] = rows;
+        }
+        else if (command == "scan-physical")
+        {
+            uint8_t physicalState[18];
+
+            pAgent->RequestPhysicalScan();
+            isSuccess = pAgent->WaitEndRequest();
+            if (isSuccess == false)
+                break;
+
+            value = FrameTimingToJson(pAgent->GetPhysicalScanTiming());
+            pAgent->GetPhysicalKeyboardState(physicalState);
+            Json::Value cols(Json::arrayValue);
+            for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
+                cols.append(physicalState[col]);
+            value["cols"] = cols;
+        }
+        else
+        {
+            pAgent->RequestDetectLevels();
+            isSuccess = pAgent->WaitEndRequest();
+            if (isSuccess == false)
+                break;
+
+            value = FrameTimingToJson(pAgent->GetLevelsTiming());
+            Json::Value levels(Json::arrayValue);
+            for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
+            {
+                uint16_t colLevels[8];
+                Json::Value colValue(Json::arrayValue);
+
+                pAgent->GetColLevels(col, colLevels);
+                for (int row = 0; row < pDeviceInfo->nbPhysicalRows; row++)
+                    colValue.append(colLevels[row]);
+                levels.append(colValue);
+            }
+            value["levels"] = levels;
+        }
+
+        WriteJsonLine(value);
+    }
+
+    if (pAgent->IsDeviceOpened() == false)
+    {
+        fprintf(stderr, "Device disconnected\n");
+        return 1;
+    }
+
+    if (isSuccess == false)
+    {
+        fprintf(stderr, "Request failed\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char* pDevice = "0";
+    int nbFrames = 1;
+    float rateHz = 0.f;
+
+    if (argc < 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string command = argv[1];
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            pDevice = argv[++i];
+        else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            nbFrames = atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            rateHz = float(atof(argv[++i]));
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    bool isScanCommand = command == "scan-logical" || command == "scan-physical" || command == "levels";
+    if (command != "list" && command != "info" && command != "bootloader" && command != "erase-eeprom" && isScanCommand == false)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    LeydenJarSessionManager sessionManager;
+
+    if (sessionManager.RefreshDeviceList() == false)
+    {
+        fprintf(stderr, "HID device enumeration failed\n");
+        return 1;
+    }
+
+    if (command == "list")
+    {
+        for (int i = 0; i < sessionManager.GetNbEnumeratedDevices(); i++)
+            WriteJsonLine(HidDeviceToJson(i, sessionManager.GetHidDeviceInfo(i)));
+        return 0;
+    }
+
+    int deviceIndex = FindDevice(sessionManager, pDevice);
+    if (deviceIndex == -1)
+    {
+        fprintf(stderr, "Device %s not found\n", pDevice);
+        return 1;
+    }
+
+    // Key outputs are disabled while the session is opened, the session manager enables them back when closing it
+    LeydenJarAgent* pAgent = sessionManager.OpenSession(deviceIndex);
+    if (pAgent == nullptr)
+    {
+        fprintf(stderr, "Connection to device %d failed\n", deviceIndex);
+        return 1;
+    }
+
+    if (command == "info")
+    {
+        WriteJsonLine(DeviceInfoToJson(deviceIndex, pAgent->GetDeviceInfo()));
+        return 0;
+    }
+
+    if (command == "bootloader" || command == "erase-eeprom")
+    {
+        if (command == "bootloader")
+            pAgent->RequestEnterBootloader();
+        else
+            pAgent->RequestEraseEeprom();
+
+        bool isSuccess = pAgent->WaitEndRequest();
+        Json::Value value(Json::objectValue);
+        value["index"] = deviceIndex;
+        value["command"] = command;
+        value["success"] = isSuccess;
+        WriteJsonLine(value);
+
+        return isSuccess ? 0 : 1;
+    }
+
+    if (rateHz > 0.f)
+    {
+        LeydenJarRateController::LeydenJarRateConfig rateConfig = pAgent->GetRateConfiguration();
+        rateConfig.minRateHz = rateConfig.maxRateHz = rateHz;
+        pAgent->RequestRateConfiguration(rateConfig);
+        pAgent->WaitEndRequest();
+    }
+
+    return RunScans(pAgent, command, nbFrames);
+}
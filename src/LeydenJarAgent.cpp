@@ -2,8 +2,14 @@
 // SPDX-License-Identifier: MIT
 
 #include <cstring>
+#include <cstdlib>
+#include <chrono>
 
 #include "LeydenJarAgent.h"
+#include "LeydenJarProfiler.h"
+
+static std::atomic<void (*)(void*)>	s_pCompletionCallback(nullptr);
+static std::atomic<void*>			s_pCompletionUserData(nullptr);
 
 bool LeydenJarAgent::LeydenJarDeviceInfo::IsProtocolVersionOlder(uint8_t major, uint8_t mid, uint16_t minor)
 {
@@ -22,15 +28,45 @@ bool LeydenJarAgent::LeydenJarDeviceInfo::IsProtocolVersionOlder(uint8_t major,
 }
 
 LeydenJarAgent::LeydenJarAgent()
-	: m_ReqType(LeydenJarReqNone)
+	: m_LastReqPriority(LeydenJarReqPriorityControl)
     , m_ReqDeviceIndex(-1)
-	, m_AckType(LeydenJarAckNone)
-	, m_Thread(&LeydenJarAgent::ThreadLoop, this)
+    , m_ReqRealTime(false)
+    , m_ReqCpuCore(-1)
+    , m_pReqRecorder(nullptr)
+    , m_pRecorder(nullptr)
+    , m_ExitThread(false)
 {
+    m_SchedulingStatus.policy = LeydenJarSchedulingPolicyDefault;
+    m_SchedulingStatus.priority = 0;
+    m_SchedulingStatus.cpuCore = -1;
+
+    for (int i = 0; i < LeydenJarReqPriorityCount; i++)
+    {
+        m_PendingReq[i] = LeydenJarReqNone;
+        m_AckType[i].store(LeydenJarAckNone, std::memory_order_relaxed);
+    }
+    m_DataGeneration.store(0, std::memory_order_relaxed);
+
     std::memset(&m_DeviceInfo, 0, sizeof(m_DeviceInfo));
     std::memset(&m_LogicKeyboardState, 0, sizeof(m_LogicKeyboardState));
     std::memset(&m_PhysicalKeyboardState, 0, sizeof(m_PhysicalKeyboardState));
     std::memset(&m_Levels, 0, sizeof(m_Levels));
+    std::memset(&m_ColLevelsTimestampNs, 0, sizeof(m_ColLevelsTimestampNs));
+    std::memset(&m_LogicalScanTiming, 0, sizeof(m_LogicalScanTiming));
+    std::memset(&m_PhysicalScanTiming, 0, sizeof(m_PhysicalScanTiming));
+    std::memset(&m_LevelsTiming, 0, sizeof(m_LevelsTiming));
+    std::memset(&m_LatencyTiming, 0, sizeof(m_LatencyTiming));
+    std::memset(&m_PrevLogicKeyboardState, 0, sizeof(m_PrevLogicKeyboardState));
+    std::memset(&m_PrevPhysicalKeyboardState, 0, sizeof(m_PrevPhysicalKeyboardState));
+    std::memset(&m_PrevLevels, 0, sizeof(m_PrevLevels));
+
+    m_ReqRateConfig = m_RateController.GetConfig();
+    m_CurrentScanRate.store(m_RateController.GetCurrentRateHz(), std::memory_order_relaxed);
+    m_ReqChatterConfig = m_ChatterDetector.GetConfig();
+    m_ReqLatencyConfig = m_LatencyMeter.GetConfig();
+
+    // The thread is started last so that it never sees uninitialized request slots
+    m_Thread = std::thread(&LeydenJarAgent::ThreadLoop, this);
 }
 
 LeydenJarAgent::~LeydenJarAgent()
@@ -42,194 +78,548 @@ LeydenJarAgent::~LeydenJarAgent()
     m_Thread.join();
 }
 
-void LeydenJarAgent::ThreadLoop()
+LeydenJarAgent::LeydenJarReqPriority LeydenJarAgent::GetRequestPriority(LeydenJarReq reqType)
 {
-    bool exitThread = false;
+    switch (reqType)
+    {
+        case LeydenJarReqScanLogical:
+        case LeydenJarReqScanPhysical:
+        case LeydenJarReqDetectLevels:
+        case LeydenJarReqMeasureLatency:
+            return LeydenJarReqPriorityAcquisition;
+
+        case LeydenJarReqEnumerate:
+        case LeydenJarReqConnect:
+            return LeydenJarReqPriorityBackground;
+
+        default:
+            return LeydenJarReqPriorityControl;
+    }
+}
 
+void LeydenJarAgent::ThreadLoop()
+{
     m_Protocol.Initialize();
 
     do
     {
-        std::unique_lock<std::mutex> lk(m_Mutex);
-        m_CondVar.wait(lk, [this] { return m_ReqType != LeydenJarReqNone; });
+        int reqType;
+        int reqPriority;
 
-        bool isSuccess = true;
-        switch (m_ReqType)
         {
-            case LeydenJarReqQuit:
-                exitThread = true;
-                break;
+            std::unique_lock<std::mutex> lk(m_Mutex);
+            m_CondVar.wait(lk, [this, &reqType, &reqPriority] { return PopPendingRequest(LeydenJarReqPriorityCount, reqType, reqPriority); });
+        }
+
+        // The mutex is not held while talking to the device, so that the application can queue more urgent requests
+        CompleteRequest(reqPriority, ExecuteRequest(reqType));
+    } 
+    while (m_ExitThread == false);
+
+    m_Protocol.Finalize();
+}
+
+bool LeydenJarAgent::PopPendingRequest(int priorityLimit, int& reqType, int& reqPriority)
+{
+    for (int priority = 0; priority < priorityLimit; priority++)
+    {
+        if (m_PendingReq[priority] != LeydenJarReqNone)
+        {
+            reqType = m_PendingReq[priority];
+            reqPriority = priority;
+            m_PendingReq[priority] = LeydenJarReqNone;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool LeydenJarAgent::HasPendingRequest(int priorityLimit)
+{
+    for (int priority = 0; priority < priorityLimit; priority++)
+        if (m_PendingReq[priority] != LeydenJarReqNone)
+            return true;
 
-            case LeydenJarReqEnumerate:
-                isSuccess = m_Protocol.EnumerateDevices();
+    return false;
+}
+
+void LeydenJarAgent::CompleteRequest(int reqPriority, bool isSuccess)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_Mutex);
+
+        // A request of the same class may have been sent while we were executing this one, it is still pending
+        if (m_PendingReq[reqPriority] == LeydenJarReqNone)
+        {
+            if (isSuccess == true)
+                m_AckType[reqPriority].store(LeydenJarAckSuccess, std::memory_order_release);
+            else
+                m_AckType[reqPriority].store(LeydenJarAckError, std::memory_order_release);
+        }
+    }
+    m_DataGeneration.fetch_add(1, std::memory_order_release);
+    m_CondVar.notify_all();
+
+    void (*pCallback)(void*) = s_pCompletionCallback.load(std::memory_order_acquire);
+    if (pCallback != nullptr)
+        pCallback(s_pCompletionUserData.load(std::memory_order_acquire));
+}
+
+bool LeydenJarAgent::YieldToHigherPriority(LeydenJarReqPriority priority)
+{
+    int reqType;
+    int reqPriority;
+
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_Mutex);
+            if (PopPendingRequest(priority, reqType, reqPriority) == false)
                 break;
+        }
 
-            case LeydenJarReqConnect:
-                isSuccess = m_Protocol.OpenDevice(m_ReqDeviceIndex);
-                if (isSuccess == false)
-                    break;
-                m_DeviceInfo.pHidDeviceInfo = m_Protocol.GetDeviceInfo(m_ReqDeviceIndex);
-                isSuccess = m_Protocol.GetProtocolVersion(m_DeviceInfo.protocolVerMajor, m_DeviceInfo.protocolVerMid, m_DeviceInfo.protocolVerMinor);
-                if (isSuccess == false)
-                    break;
-                isSuccess = m_Protocol.GetDetails(m_DeviceInfo.nbLogicalRows, m_DeviceInfo.nbLogicalCols, m_DeviceInfo.nbPhysicalRows, m_DeviceInfo.nbPhysicalCols, m_DeviceInfo.switchTechnology, m_DeviceInfo.nbBins);
-                if (isSuccess == false)
-                    break;
-                isSuccess = m_Protocol.GetMatrixMapping(m_DeviceInfo.matrixToControllerType, m_DeviceInfo.matrixToControllerRows, m_DeviceInfo.matrixToControllerCols, m_DeviceInfo.nbPhysicalRows, m_DeviceInfo.nbPhysicalCols);
-                if (isSuccess == false)
-                    break;
-                
-                memset(m_DeviceInfo.controllerToMatrixRows, 255, m_DeviceInfo.nbPhysicalRows);
+        CompleteRequest(reqPriority, ExecuteRequest(reqType));
+    }
+
+    return m_ExitThread == false && m_Protocol.IsDeviceOpened();
+}
+
+void LeydenJarAgent::BeginFrameTiming(LeydenJarFrameTiming& timing)
+{
+    timing.acquisitionStartNs = LeydenJarProtocol::GetTimestampNs();
+    timing.acquisitionEndNs = timing.acquisitionStartNs;
+    timing.nbCommands = 0;
+    timing.sumRoundTripNs = 0;
+    timing.maxRoundTripNs = 0;
+}
+
+void LeydenJarAgent::AddCommandTiming(LeydenJarFrameTiming& timing)
+{
+    const LeydenJarProtocol::LeydenJarCommandTiming& commandTiming = m_Protocol.GetLastCommandTiming();
+    uint64_t roundTripNs = commandTiming.receiveTimeNs - commandTiming.sendTimeNs;
+
+    timing.nbCommands++;
+    timing.sumRoundTripNs += roundTripNs;
+    if (roundTripNs > timing.maxRoundTripNs)
+        timing.maxRoundTripNs = roundTripNs;
+}
+
+void LeydenJarAgent::EndFrameTiming(LeydenJarFrameTiming& timing, LeydenJarFrameTiming& publishedTiming)
+{
+    timing.acquisitionEndNs = LeydenJarProtocol::GetTimestampNs();
+    timing.frameIndex = publishedTiming.frameIndex + 1;
+    publishedTiming = timing;
+}
+
+bool LeydenJarAgent::WaitForScanSlot()
+{
+    uint64_t scanTimeNs = m_RateController.GetNextScanTimeNs();
+
+    for (;;)
+    {
+        if (YieldToHigherPriority(LeydenJarReqPriorityAcquisition) == false)
+            return false;
+
+        uint64_t timeNs = LeydenJarProtocol::GetTimestampNs();
+        if (timeNs >= scanTimeNs)
+            return true;
+
+        // Sleep until the scan slot, a more urgent request wakes us up
+        std::unique_lock<std::mutex> lk(m_Mutex);
+        m_CondVar.wait_for(lk, std::chrono::nanoseconds(scanTimeNs - timeNs), [this] { return HasPendingRequest(LeydenJarReqPriorityAcquisition); });
+    }
+}
+
+bool LeydenJarAgent::DetectScanActivity(int reqType)
+{
+    bool activity = false;
+
+    switch (reqType)
+    {
+        case LeydenJarReqScanLogical:
+            if (std::memcmp(m_PrevLogicKeyboardState, m_LogicKeyboardState, sizeof(m_LogicKeyboardState)) != 0)
+                activity = true;
+            std::memcpy(m_PrevLogicKeyboardState, m_LogicKeyboardState, sizeof(m_LogicKeyboardState));
+        case LeydenJarReqScanPhysical:
+            if (std::memcmp(m_PrevPhysicalKeyboardState, m_PhysicalKeyboardState, sizeof(m_PhysicalKeyboardState)) != 0)
+                activity = true;
+            std::memcpy(m_PrevPhysicalKeyboardState, m_PhysicalKeyboardState, sizeof(m_PhysicalKeyboardState));
+            break;
+
+        case LeydenJarReqDetectLevels:
+        {
+            int levelNoise = m_RateController.GetConfig().levelNoise;
+            for (int col = 0; col < m_DeviceInfo.nbPhysicalCols; col++)
                 for (int row = 0; row < m_DeviceInfo.nbPhysicalRows; row++)
-                    for (int i = 0; i < m_DeviceInfo.nbPhysicalRows; i++)
-                        if (m_DeviceInfo.matrixToControllerRows[i] == row)
-                            m_DeviceInfo.controllerToMatrixRows[row] = i;
-
-                memset(m_DeviceInfo.controllerToMatrixCols, 255, m_DeviceInfo.nbPhysicalCols);
-                for (int col = 0; col < m_DeviceInfo.nbPhysicalCols; col++)
-                    for (int i = 0; i < m_DeviceInfo.nbPhysicalCols; i++)
-                        if (m_DeviceInfo.matrixToControllerCols[i] == col)
-                            m_DeviceInfo.controllerToMatrixCols[col] = i;
-                
-                m_DeviceInfo.vialVersion0 = m_DeviceInfo.vialVersion1 = m_DeviceInfo.vialVersion2 = m_DeviceInfo.vialVersion3 = 0;
-                isSuccess = m_Protocol.GetVialInfos(m_DeviceInfo.vialVersion0, m_DeviceInfo.vialVersion1, m_DeviceInfo.vialVersion2, m_DeviceInfo.vialVersion3, m_DeviceInfo.vialUid);
-                if (isSuccess == false)
-                    break;
-                isSuccess = m_Protocol.GetVialKeyboardDefinitionSize(m_DeviceInfo.vialKeyboardDefinitionSize);
-                if (isSuccess == false)
-                    break;
-                isSuccess = m_Protocol.GetVialKeyboardDefinitionData(m_DeviceInfo.vialKeyboardDefinitionSize, m_DeviceInfo.vialKeyboardDefinitionData);
+                    if (std::abs(int(m_Levels[col][row]) - int(m_PrevLevels[col][row])) > levelNoise)
+                        activity = true;
+            std::memcpy(m_PrevLevels, m_Levels, sizeof(m_Levels));
+            break;
+        }
+    }
+
+    return activity;
+}
+
+bool LeydenJarAgent::ExecuteRequest(int reqType)
+{
+    bool isSuccess = true;
+    LeydenJarFrameTiming frameTiming;
+
+    // Latency measurement cycles are not paced by the rate controller, their resolution is the time between reads
+    bool isScan = (GetRequestPriority((LeydenJarReq)reqType) == LeydenJarReqPriorityAcquisition && reqType != LeydenJarReqMeasureLatency);
+    if (isScan)
+    {
+        if (WaitForScanSlot() == false)
+            return false;
+        m_RateController.OnScanStart(LeydenJarProtocol::GetTimestampNs());
+    }
+
+    switch (reqType)
+    {
+        case LeydenJarReqQuit:
+            m_ExitThread = true;
+            break;
+
+        case LeydenJarReqEnumerate:
+            isSuccess = m_Protocol.EnumerateDevices();
+            break;
+
+        case LeydenJarReqConnect:
+            isSuccess = m_Protocol.OpenDevice(m_ReqDeviceIndex);
+            if (isSuccess == false)
+                break;
+            m_DeviceInfo.pHidDeviceInfo = m_Protocol.GetDeviceInfo(m_ReqDeviceIndex);
+            isSuccess = m_Protocol.GetProtocolVersion(m_DeviceInfo.protocolVerMajor, m_DeviceInfo.protocolVerMid, m_DeviceInfo.protocolVerMinor);
+            if (isSuccess == false)
+                break;
+            isSuccess = m_Protocol.GetDetails(m_DeviceInfo.nbLogicalRows, m_DeviceInfo.nbLogicalCols, m_DeviceInfo.nbPhysicalRows, m_DeviceInfo.nbPhysicalCols, m_DeviceInfo.switchTechnology, m_DeviceInfo.nbBins);
+            if (isSuccess == false)
+                break;
+            isSuccess = m_Protocol.GetMatrixMapping(m_DeviceInfo.matrixToControllerType, m_DeviceInfo.matrixToControllerRows, m_DeviceInfo.matrixToControllerCols, m_DeviceInfo.nbPhysicalRows, m_DeviceInfo.nbPhysicalCols);
+            if (isSuccess == false)
+                break;
+            
+            memset(m_DeviceInfo.controllerToMatrixRows, 255, m_DeviceInfo.nbPhysicalRows);
+            for (int row = 0; row < m_DeviceInfo.nbPhysicalRows; row++)
+                for (int i = 0; i < m_DeviceInfo.nbPhysicalRows; i++)
+                    if (m_DeviceInfo.matrixToControllerRows[i] == row)
+                        m_DeviceInfo.controllerToMatrixRows[row] = i;
+
+            memset(m_DeviceInfo.controllerToMatrixCols, 255, m_DeviceInfo.nbPhysicalCols);
+            for (int col = 0; col < m_DeviceInfo.nbPhysicalCols; col++)
+                for (int i = 0; i < m_DeviceInfo.nbPhysicalCols; i++)
+                    if (m_DeviceInfo.matrixToControllerCols[i] == col)
+                        m_DeviceInfo.controllerToMatrixCols[col] = i;
+            
+            m_DeviceInfo.vialVersion0 = m_DeviceInfo.vialVersion1 = m_DeviceInfo.vialVersion2 = m_DeviceInfo.vialVersion3 = 0;
+            isSuccess = m_Protocol.GetVialInfos(m_DeviceInfo.vialVersion0, m_DeviceInfo.vialVersion1, m_DeviceInfo.vialVersion2, m_DeviceInfo.vialVersion3, m_DeviceInfo.vialUid);
+            if (isSuccess == false)
+                break;
+            isSuccess = m_Protocol.GetVialKeyboardDefinitionSize(m_DeviceInfo.vialKeyboardDefinitionSize);
+            if (isSuccess == false)
+                break;
+            // The definition is downloaded block by block so that more urgent requests can be served in between
+            for (uint32_t blockNumber = 0; blockNumber * 32 < m_DeviceInfo.vialKeyboardDefinitionSize; blockNumber++)
+            {
+                isSuccess = YieldToHigherPriority(LeydenJarReqPriorityBackground);
                 if (isSuccess == false)
                     break;
-                m_DeviceInfo.viaVersionMajor = m_DeviceInfo.viaVersionMinor = 0;
-                isSuccess = m_Protocol.GetViaProtocolVersion(m_DeviceInfo.viaVersionMajor, m_DeviceInfo.viaVersionMinor);
+                isSuccess = m_Protocol.GetVialKeyboardDefinitionDataBlock((uint16_t)blockNumber, m_DeviceInfo.vialKeyboardDefinitionData);
                 if (isSuccess == false)
                     break;
+            }
+            if (isSuccess == false)
+                break;
+            m_DeviceInfo.viaVersionMajor = m_DeviceInfo.viaVersionMinor = 0;
+            isSuccess = m_Protocol.GetViaProtocolVersion(m_DeviceInfo.viaVersionMajor, m_DeviceInfo.viaVersionMinor);
+            if (isSuccess == false)
+                break;
 
-                memset(m_DeviceInfo.binningMap, 0, sizeof(m_DeviceInfo.binningMap));
-                m_DeviceInfo.isKeyboardLeft = true;
-                
-                if (!m_DeviceInfo.IsProtocolVersionOlder(0,9,1))
+            memset(m_DeviceInfo.binningMap, 0, sizeof(m_DeviceInfo.binningMap));
+            m_DeviceInfo.isKeyboardLeft = true;
+            
+            if (!m_DeviceInfo.IsProtocolVersionOlder(0,9,1))
+            {
+                for (int i = 0; i < m_DeviceInfo.nbBins; i++)
                 {
-                    for (int i = 0; i < m_DeviceInfo.nbBins; i++)
-                    {
-                        isSuccess = m_Protocol.GetDacThreshold(m_DeviceInfo.dacThreshold[i], i);
-                        if (isSuccess == false)
-                            break;
-                        isSuccess = m_Protocol.GetDacRefLevel(m_DeviceInfo.dacRefLevel[i], i);
-                        if (isSuccess == false)
-                            break;
-                    }
-
-                    for (int i = 0; i < m_DeviceInfo.nbPhysicalCols; i++)
-                    {
-                        isSuccess = m_Protocol.GetColumnBinMap(i, m_DeviceInfo.binningMap[i]);
-                        if (isSuccess == false)
-                            break;
-                    }
-
-                    if (!m_DeviceInfo.IsProtocolVersionOlder(1, 0, 0))
-                    {
-                        isSuccess = m_Protocol.GetIsKeyboardLeft(m_DeviceInfo.isKeyboardLeft);
-                        if (isSuccess == false)
-                            break;
-                    }
+                    isSuccess = m_Protocol.GetDacThreshold(m_DeviceInfo.dacThreshold[i], i);
+                    if (isSuccess == false)
+                        break;
+                    isSuccess = m_Protocol.GetDacRefLevel(m_DeviceInfo.dacRefLevel[i], i);
+                    if (isSuccess == false)
+                        break;
                 }
-                else
+
+                for (int i = 0; i < m_DeviceInfo.nbPhysicalCols; i++)
                 {
-                    isSuccess = m_Protocol.GetDacThreshold(m_DeviceInfo.dacThreshold[0], 0);
+                    isSuccess = m_Protocol.GetColumnBinMap(i, m_DeviceInfo.binningMap[i]);
                     if (isSuccess == false)
                         break;
                 }
-                break;
-
-            case LeydenJarReqEnterBootloader:
-                isSuccess = m_Protocol.EnterBootLoader();
-                m_Protocol.CloseDevice();
-                m_Protocol.FreeEnumeratedDevices();
-                break;
 
-            case LeydenJarReqEraseEeprom:
-                isSuccess = m_Protocol.EraseEeprom();
-                m_Protocol.CloseDevice();
-                break;
-
-            case LeydenJarReqDisable:
-                isSuccess = m_Protocol.SetKeyboardStatus(false);
-                break;
-
-            case LeydenJarReqEnable:
-                isSuccess = m_Protocol.SetKeyboardStatus(true);
-                break;
-
-            case LeydenJarReqScanLogical:
-                isSuccess = m_Protocol.ScanLogicalMatrix();
-                if (isSuccess == false)
-                    break;
-                for (int row = 0; row < m_DeviceInfo.nbLogicalRows; row++)
+                if (!m_DeviceInfo.IsProtocolVersionOlder(1, 0, 0))
                 {
-                    isSuccess = m_Protocol.GetScanLogicalRow(row, m_LogicKeyboardState[row]);
+                    isSuccess = m_Protocol.GetIsKeyboardLeft(m_DeviceInfo.isKeyboardLeft);
                     if (isSuccess == false)
                         break;
                 }
-            case LeydenJarReqScanPhysical:
-                isSuccess = m_Protocol.ScanPhysicalMatrix();
+            }
+            else
+            {
+                isSuccess = m_Protocol.GetDacThreshold(m_DeviceInfo.dacThreshold[0], 0);
                 if (isSuccess == false)
                     break;
-                isSuccess = m_Protocol.GetScanPhysicalVals(m_PhysicalKeyboardState);
+            }
+            m_ChatterDetector.SetLayout(m_DeviceInfo.nbPhysicalCols, m_DeviceInfo.nbPhysicalRows, m_DeviceInfo.switchTechnology, m_DeviceInfo.dacThreshold, m_DeviceInfo.binningMap);
+            {
+                LeydenJarLatencyMeter::LeydenJarLatencyLayout latencyLayout;
+                latencyLayout.nbPhysicalCols = m_DeviceInfo.nbPhysicalCols;
+                latencyLayout.nbPhysicalRows = m_DeviceInfo.nbPhysicalRows;
+                latencyLayout.nbLogicalCols = m_DeviceInfo.nbLogicalCols;
+                latencyLayout.nbLogicalRows = m_DeviceInfo.nbLogicalRows;
+                latencyLayout.switchTechnology = m_DeviceInfo.switchTechnology;
+                latencyLayout.isKeyboardLeft = m_DeviceInfo.isKeyboardLeft;
+                memcpy(latencyLayout.dacThreshold, m_DeviceInfo.dacThreshold, sizeof(latencyLayout.dacThreshold));
+                memcpy(latencyLayout.binningMap, m_DeviceInfo.binningMap, sizeof(latencyLayout.binningMap));
+                memcpy(latencyLayout.matrixToControllerRows, m_DeviceInfo.matrixToControllerRows, sizeof(latencyLayout.matrixToControllerRows));
+                memcpy(latencyLayout.matrixToControllerCols, m_DeviceInfo.matrixToControllerCols, sizeof(latencyLayout.matrixToControllerCols));
+                m_LatencyMeter.SetLayout(latencyLayout);
+            }
+            break;
+
+        case LeydenJarReqEnterBootloader:
+            isSuccess = m_Protocol.EnterBootLoader();
+            m_Protocol.CloseDevice();
+            m_Protocol.FreeEnumeratedDevices();
+            break;
+
+        case LeydenJarReqEraseEeprom:
+            isSuccess = m_Protocol.EraseEeprom();
+            m_Protocol.CloseDevice();
+            break;
+
+        case LeydenJarReqDisable:
+            isSuccess = m_Protocol.SetKeyboardStatus(false);
+            break;
+
+        case LeydenJarReqConfigureThread:
+            // Executed here as scheduling APIs act on the calling thread
+            isSuccess = ApplyThreadScheduling(m_ReqRealTime, m_ReqCpuCore, m_SchedulingStatus);
+            break;
+
+        case LeydenJarReqConfigureRate:
+            m_RateController.SetConfig(m_ReqRateConfig);
+            m_ReqRateConfig = m_RateController.GetConfig();
+            m_CurrentScanRate.store(m_RateController.GetCurrentRateHz(), std::memory_order_relaxed);
+            break;
+
+        case LeydenJarReqConfigureChatter:
+            m_ChatterDetector.SetConfig(m_ReqChatterConfig);
+            m_ReqChatterConfig = m_ChatterDetector.GetConfig();
+            break;
+
+        case LeydenJarReqResetChatter:
+            m_ChatterDetector.Reset();
+            break;
+
+        case LeydenJarReqConfigureRecorder:
+            m_pRecorder = m_pReqRecorder;
+            break;
+
+        case LeydenJarReqConfigureLatency:
+            m_LatencyMeter.SetConfig(m_ReqLatencyConfig);
+            m_ReqLatencyConfig = m_LatencyMeter.GetConfig();
+            break;
+
+        case LeydenJarReqResetLatency:
+            m_LatencyMeter.Reset();
+            break;
+
+        case LeydenJarReqMeasureLatency:
+            isSuccess = MeasureLatency(frameTiming);
+            break;
+
+        case LeydenJarReqEnable:
+            isSuccess = m_Protocol.SetKeyboardStatus(true);
+            break;
+
+        case LeydenJarReqScanLogical:
+            BeginFrameTiming(frameTiming);
+            isSuccess = m_Protocol.ScanLogicalMatrix();
+            if (isSuccess == false)
                 break;
-
-            case LeydenJarReqDetectLevels:
-                isSuccess = m_Protocol.DetectLevels();
+            AddCommandTiming(frameTiming);
+            for (int row = 0; row < m_DeviceInfo.nbLogicalRows; row++)
+            {
+                isSuccess = YieldToHigherPriority(LeydenJarReqPriorityAcquisition);
                 if (isSuccess == false)
                     break;
-                for (int col = 0; col < m_DeviceInfo.nbPhysicalCols; col++)
-                {
-                    isSuccess = m_Protocol.GetColumnLevels(col, m_Levels[col]);
-                    if (isSuccess == false)
-                        break;
-                }
+                isSuccess = m_Protocol.GetScanLogicalRow(row, m_LogicKeyboardState[row]);
+                if (isSuccess == false)
+                    break;
+                AddCommandTiming(frameTiming);
+            }
+            if (isSuccess == true)
+            {
+                EndFrameTiming(frameTiming, m_LogicalScanTiming);
+                if (m_pRecorder != nullptr)
+                    m_pRecorder->RecordLogicalScan(frameTiming.acquisitionStartNs, m_LogicKeyboardState);
+            }
+            if (isSuccess == false)
+                break;
+        case LeydenJarReqScanPhysical:
+            BeginFrameTiming(frameTiming);
+            isSuccess = m_Protocol.ScanPhysicalMatrix();
+            if (isSuccess == false)
+                break;
+            AddCommandTiming(frameTiming);
+            isSuccess = m_Protocol.GetScanPhysicalVals(m_PhysicalKeyboardState);
+            if (isSuccess == false)
+                break;
+            AddCommandTiming(frameTiming);
+            m_ChatterDetector.OnPhysicalScan(m_PhysicalKeyboardState, m_Protocol.GetLastCommandTiming().receiveTimeNs);
+            if (m_pRecorder != nullptr)
+                m_pRecorder->RecordPhysicalScan(frameTiming.acquisitionStartNs, m_PhysicalKeyboardState);
+            EndFrameTiming(frameTiming, m_PhysicalScanTiming);
+            break;
+
+        case LeydenJarReqDetectLevels:
+            BeginFrameTiming(frameTiming);
+            isSuccess = m_Protocol.DetectLevels();
+            if (isSuccess == false)
+                break;
+            AddCommandTiming(frameTiming);
+            for (int col = 0; col < m_DeviceInfo.nbPhysicalCols; col++)
+            {
+                isSuccess = YieldToHigherPriority(LeydenJarReqPriorityAcquisition);
+                if (isSuccess == false)
+                    break;
+                isSuccess = m_Protocol.GetColumnLevels(col, m_Levels[col]);
+                if (isSuccess == false)
+                    break;
+                AddCommandTiming(frameTiming);
+                m_ColLevelsTimestampNs[col] = m_Protocol.GetLastCommandTiming().receiveTimeNs;
+            }
+            if (isSuccess == true)
+            {
+                EndFrameTiming(frameTiming, m_LevelsTiming);
+                m_ChatterDetector.OnLevels(m_Levels, m_ColLevelsTimestampNs);
+                if (m_pRecorder != nullptr)
+                    m_pRecorder->RecordLevels(frameTiming.acquisitionStartNs, m_Levels);
+            }
+    }
+
+    if (isScan && isSuccess)
+    {
+        m_RateController.OnScanEnd(DetectScanActivity(reqType), LeydenJarProtocol::GetTimestampNs());
+        m_CurrentScanRate.store(m_RateController.GetCurrentRateHz(), std::memory_order_relaxed);
+    }
+
+    return isSuccess;
+}
+
+bool LeydenJarAgent::MeasureLatency(LeydenJarFrameTiming& frameTiming)
+{
+    uint64_t logicalRowTimeNs[16];
+    int firstRow;
+    int lastRow;
+
+    BeginFrameTiming(frameTiming);
+
+    if (m_LatencyMeter.GetConfig().measureLevels)
+    {
+        if (m_Protocol.DetectLevels() == false)
+            return false;
+        AddCommandTiming(frameTiming);
+        for (int col = 0; col < m_DeviceInfo.nbPhysicalCols; col++)
+        {
+            if (YieldToHigherPriority(LeydenJarReqPriorityAcquisition) == false)
+                return false;
+            if (m_Protocol.GetColumnLevels(col, m_Levels[col]) == false)
+                return false;
+            AddCommandTiming(frameTiming);
+            m_ColLevelsTimestampNs[col] = m_Protocol.GetLastCommandTiming().receiveTimeNs;
         }
+        m_LatencyMeter.OnLevels(m_Levels, m_ColLevelsTimestampNs);
+    }
 
-        if (isSuccess == true)
-            m_AckType.store(LeydenJarAckSuccess, std::memory_order_release);
-        else
-            m_AckType.store(LeydenJarAckError, std::memory_order_release);
-        
-        m_ReqType = LeydenJarReqNone;
+    if (YieldToHigherPriority(LeydenJarReqPriorityAcquisition) == false)
+        return false;
+    if (m_Protocol.ScanPhysicalMatrix() == false)
+        return false;
+    AddCommandTiming(frameTiming);
+    if (m_Protocol.GetScanPhysicalVals(m_PhysicalKeyboardState) == false)
+        return false;
+    AddCommandTiming(frameTiming);
+    m_LatencyMeter.OnPhysicalScan(m_PhysicalKeyboardState, m_Protocol.GetLastCommandTiming().receiveTimeNs);
 
-        lk.unlock();
-        m_CondVar.notify_one();
-    } 
-    while (exitThread == false);
+    // Only the rows of the connected keyboard half are read, the other half can not be correlated to physical keys
+    if (YieldToHigherPriority(LeydenJarReqPriorityAcquisition) == false)
+        return false;
+    if (m_Protocol.ScanLogicalMatrix() == false)
+        return false;
+    AddCommandTiming(frameTiming);
+    std::memset(logicalRowTimeNs, 0, sizeof(logicalRowTimeNs));
+    m_LatencyMeter.GetLocalLogicalRows(firstRow, lastRow);
+    for (int row = firstRow; row < lastRow; row++)
+    {
+        if (m_Protocol.GetScanLogicalRow(row, m_LogicKeyboardState[row]) == false)
+            return false;
+        AddCommandTiming(frameTiming);
+        logicalRowTimeNs[row] = m_Protocol.GetLastCommandTiming().receiveTimeNs;
+    }
+    m_LatencyMeter.OnLogicalScan(m_LogicKeyboardState, logicalRowTimeNs);
 
-    m_Protocol.Finalize();
+    EndFrameTiming(frameTiming, m_LatencyTiming);
+
+    return true;
 }
 
 void LeydenJarAgent::SendRequest(LeydenJarReq reqType)
 {
+    LeydenJarReqPriority priority = GetRequestPriority(reqType);
+
     {
         std::lock_guard<std::mutex> lk(m_Mutex);
-        m_AckType.store(LeydenJarAckPending, std::memory_order_release);
-        m_ReqType = reqType;
+        m_AckType[priority].store(LeydenJarAckPending, std::memory_order_release);
+        m_PendingReq[priority] = reqType;
+        m_LastReqPriority = priority;
     }
-    m_CondVar.notify_one();
+    m_CondVar.notify_all();
 }
 
 bool LeydenJarAgent::RequestInProgress()
 {
-    return (m_AckType.load(std::memory_order_relaxed) == LeydenJarAckPending);
+    for (int priority = 0; priority < LeydenJarReqPriorityCount; priority++)
+        if (m_AckType[priority].load(std::memory_order_relaxed) == LeydenJarAckPending)
+            return true;
+
+    return false;
+}
+
+bool LeydenJarAgent::RequestInProgress(LeydenJarReqPriority priority)
+{
+    return (m_AckType[priority].load(std::memory_order_relaxed) == LeydenJarAckPending);
 }
 
 bool LeydenJarAgent::WaitEndRequest()
 {
-    if (m_AckType == LeydenJarAckNone || m_AckType == LeydenJarAckSuccess)
+    return WaitEndRequest((LeydenJarReqPriority)m_LastReqPriority);
+}
+
+bool LeydenJarAgent::WaitEndRequest(LeydenJarReqPriority priority)
+{
+    if (m_AckType[priority] == LeydenJarAckNone || m_AckType[priority] == LeydenJarAckSuccess)
         return true;
 
     {
+        // Only actual waits are profiled
+        LeydenJarProfileScope profileScope(LeydenJarProfiler::ProfileZoneWaitEndRequest);
         std::unique_lock<std::mutex> lk(m_Mutex);
-        m_CondVar.wait(lk, [this] { return m_AckType != LeydenJarAckPending; });
-        if (m_AckType == LeydenJarAckSuccess)
+        m_CondVar.wait(lk, [this, priority] { return m_AckType[priority] != LeydenJarAckPending; });
+        if (m_AckType[priority] == LeydenJarAckSuccess)
             return true;
         else
             return false;
@@ -282,6 +672,87 @@ void LeydenJarAgent::RequestDetectLevels()
     SendRequest(LeydenJarReqDetectLevels);
 }
 
+void LeydenJarAgent::RequestThreadConfiguration(bool realTime, int cpuCore)
+{
+    m_ReqRealTime = realTime;
+    m_ReqCpuCore = cpuCore;
+    SendRequest(LeydenJarReqConfigureThread);
+}
+
+LeydenJarSchedulingStatus LeydenJarAgent::GetThreadSchedulingStatus()
+{
+    return m_SchedulingStatus;
+}
+
+void LeydenJarAgent::RequestRateConfiguration(const LeydenJarRateController::LeydenJarRateConfig& config)
+{
+    m_ReqRateConfig = config;
+    SendRequest(LeydenJarReqConfigureRate);
+}
+
+LeydenJarRateController::LeydenJarRateConfig LeydenJarAgent::GetRateConfiguration()
+{
+    return m_ReqRateConfig;
+}
+
+float LeydenJarAgent::GetCurrentScanRate()
+{
+    return m_CurrentScanRate.load(std::memory_order_relaxed);
+}
+
+void LeydenJarAgent::RequestChatterConfiguration(const LeydenJarChatterDetector::LeydenJarChatterConfig& config)
+{
+    m_ReqChatterConfig = config;
+    SendRequest(LeydenJarReqConfigureChatter);
+}
+
+LeydenJarChatterDetector::LeydenJarChatterConfig LeydenJarAgent::GetChatterConfiguration()
+{
+    return m_ReqChatterConfig;
+}
+
+void LeydenJarAgent::RequestChatterReset()
+{
+    SendRequest(LeydenJarReqResetChatter);
+}
+
+void LeydenJarAgent::GetChatterCounters(int source, LeydenJarChatterDetector::LeydenJarKeyChatterCounters* counters)
+{
+    std::memcpy(counters, m_ChatterDetector.GetCounters(source), LeydenJarChatterDetector::kNbKeys * sizeof(LeydenJarChatterDetector::LeydenJarKeyChatterCounters));
+}
+
+void LeydenJarAgent::RequestRecorder(LeydenJarRecorder* pRecorder)
+{
+    m_pReqRecorder = pRecorder;
+    SendRequest(LeydenJarReqConfigureRecorder);
+}
+
+void LeydenJarAgent::RequestLatencyMeasurement()
+{
+    SendRequest(LeydenJarReqMeasureLatency);
+}
+
+void LeydenJarAgent::RequestLatencyConfiguration(const LeydenJarLatencyMeter::LeydenJarLatencyConfig& config)
+{
+    m_ReqLatencyConfig = config;
+    SendRequest(LeydenJarReqConfigureLatency);
+}
+
+LeydenJarLatencyMeter::LeydenJarLatencyConfig LeydenJarAgent::GetLatencyConfiguration()
+{
+    return m_ReqLatencyConfig;
+}
+
+void LeydenJarAgent::RequestLatencyReset()
+{
+    SendRequest(LeydenJarReqResetLatency);
+}
+
+void LeydenJarAgent::GetKeyLatencies(LeydenJarLatencyMeter::LeydenJarKeyLatency* latencies)
+{
+    m_LatencyMeter.GetKeyLatencies(latencies);
+}
+
 int LeydenJarAgent::GetNbEnumeratedDevices()
 {
     return m_Protocol.GetNbEnumeratedDevices();
@@ -312,6 +783,42 @@ void LeydenJarAgent::GetColLevels(int col, uint16_t* colLevels)
     std::memcpy(colLevels, m_Levels[col], 8 * sizeof(uint16_t));
 }
 
+uint64_t LeydenJarAgent::GetColLevelsTimestamp(int col)
+{
+    return m_ColLevelsTimestampNs[col];
+}
+
+LeydenJarAgent::LeydenJarFrameTiming LeydenJarAgent::GetLogicalScanTiming()
+{
+    return m_LogicalScanTiming;
+}
+
+LeydenJarAgent::LeydenJarFrameTiming LeydenJarAgent::GetPhysicalScanTiming()
+{
+    return m_PhysicalScanTiming;
+}
+
+LeydenJarAgent::LeydenJarFrameTiming LeydenJarAgent::GetLevelsTiming()
+{
+    return m_LevelsTiming;
+}
+
+LeydenJarAgent::LeydenJarFrameTiming LeydenJarAgent::GetLatencyTiming()
+{
+    return m_LatencyTiming;
+}
+
+uint32_t LeydenJarAgent::GetDataGeneration()
+{
+    return m_DataGeneration.load(std::memory_order_acquire);
+}
+
+void LeydenJarAgent::SetCompletionCallback(void (*pCallback)(void* pUserData), void* pUserData)
+{
+    s_pCompletionUserData.store(pUserData, std::memory_order_release);
+    s_pCompletionCallback.store(pCallback, std::memory_order_release);
+}
+
 bool LeydenJarAgent::IsDeviceOpened()
 {
     return m_Protocol.IsDeviceOpened();
@@ -9,6 +9,11 @@
 #include <condition_variable>
 
 #include "LeydenJarProtocol.h"
+#include "LeydenJarThreadScheduling.h"
+#include "LeydenJarRateController.h"
+#include "LeydenJarChatterDetector.h"
+#include "LeydenJarLatencyMeter.h"
+#include "LeydenJarRecorder.h"
 
 // This class acts as a daemon, running in a dedicated thread to dot disturb main application.
 // It handles:
@@ -33,7 +38,26 @@ public:
 		LeydenJarReqEnable,
 		LeydenJarReqScanLogical,
 		LeydenJarReqScanPhysical,
-		LeydenJarReqDetectLevels
+		LeydenJarReqDetectLevels,
+		LeydenJarReqConfigureThread,
+		LeydenJarReqConfigureRate,
+		LeydenJarReqConfigureChatter,
+		LeydenJarReqResetChatter,
+		LeydenJarReqConfigureRecorder,
+		LeydenJarReqConfigureLatency,
+		LeydenJarReqResetLatency,
+		LeydenJarReqMeasureLatency
+	};
+
+	// Scheduling classes of the requests, lower values are served first.
+	// Control requests preempt acquisition at HID command boundaries, and background work (enumeration, connection
+	// with VIAL definition download) yields to both control and acquisition requests.
+	enum LeydenJarReqPriority
+	{
+		LeydenJarReqPriorityControl = 0,
+		LeydenJarReqPriorityAcquisition,
+		LeydenJarReqPriorityBackground,
+		LeydenJarReqPriorityCount
 	};
 
 	// List of all acknowledge types the the deamon can send back to the main application.
@@ -81,6 +105,18 @@ public:
 		bool IsProtocolVersionOlder(uint8_t major, uint8_t mid, uint16_t minor);
 	};
 
+	// Timing of a published frame (levels, logical scan or physical scan).
+	// All times are steady clock nanoseconds, see LeydenJarProtocol::GetTimestampNs().
+	struct LeydenJarFrameTiming
+	{
+		uint64_t				frameIndex;
+		uint64_t				acquisitionStartNs;
+		uint64_t				acquisitionEndNs;
+		uint32_t				nbCommands;
+		uint64_t				sumRoundTripNs;
+		uint64_t				maxRoundTripNs;
+	};
+
 public:
 
 	LeydenJarAgent();
@@ -88,8 +124,14 @@ public:
 	
 	// To know if a request is in progress, used by the application for asynchonous communication with the daemon
 	bool RequestInProgress();
-	// Wait the end of a request, used by the application for synchonous communication with the daemon
+	// To know if a request of a given scheduling class is in progress
+	bool RequestInProgress(LeydenJarReqPriority priority);
+	// Wait the end of the last sent request, used by the application for synchonous communication with the daemon
 	bool WaitEndRequest();
+	// Wait the end of the request of a given scheduling class
+	bool WaitEndRequest(LeydenJarReqPriority priority);
+	// Returns the scheduling class of a request type
+	static LeydenJarReqPriority GetRequestPriority(LeydenJarReq reqType);
 	// Ask to enumerate HID devices
 	void RequestDeviceEnumeration();
 	// Ask to connect to a specific HID device
@@ -108,6 +150,38 @@ public:
 	void RequestPhysicalScan();
 	// Ask to retrieve currently detected analogic levels 
 	void RequestDetectLevels();
+	// Ask to change the scheduling of the daemon thread (opt-in real-time policy and CPU core pinning, -1 for any core)
+	void RequestThreadConfiguration(bool realTime, int cpuCore);
+	// Returns the scheduling really achieved for the daemon thread by the last thread configuration request
+	LeydenJarSchedulingStatus GetThreadSchedulingStatus();
+	// Ask to change the adaptive scan rate bounds of the monitors
+	void RequestRateConfiguration(const LeydenJarRateController::LeydenJarRateConfig& config);
+	// Returns the adaptive scan rate configuration in use
+	LeydenJarRateController::LeydenJarRateConfig GetRateConfiguration();
+	// Returns the current target scan rate, 0 when the adaptive rate is disabled
+	float GetCurrentScanRate();
+	// Ask to change the chatter detection configuration, counters are cleared
+	void RequestChatterConfiguration(const LeydenJarChatterDetector::LeydenJarChatterConfig& config);
+	// Returns the chatter detection configuration in use
+	LeydenJarChatterDetector::LeydenJarChatterConfig GetChatterConfiguration();
+	// Ask to clear chatter counters
+	void RequestChatterReset();
+	// Returns per key chatter counters of the physical matrix (18 columns of 8 rows) for physical scans or level scans
+	void GetChatterCounters(int source, LeydenJarChatterDetector::LeydenJarKeyChatterCounters* counters);
+	// Ask to record all following scans with a started recorder, nullptr stops recording.
+	// Once the request is done the previous recorder is not used anymore by the daemon
+	void RequestRecorder(LeydenJarRecorder* pRecorder);
+	// Ask to run one latency measurement cycle: levels (optional), physical scan and logical scan read back to back.
+	// Key states and levels are published as with the separate scan requests, without waiting for the scan rate
+	void RequestLatencyMeasurement();
+	// Ask to change the latency measurement configuration, latencies are cleared
+	void RequestLatencyConfiguration(const LeydenJarLatencyMeter::LeydenJarLatencyConfig& config);
+	// Returns the latency measurement configuration in use
+	LeydenJarLatencyMeter::LeydenJarLatencyConfig GetLatencyConfiguration();
+	// Ask to clear measured latencies
+	void RequestLatencyReset();
+	// Computes per key latency summaries of the physical matrix (18 columns of 8 rows), only valid while no request is in progress
+	void GetKeyLatencies(LeydenJarLatencyMeter::LeydenJarKeyLatency* latencies);
 	// Returns the number of enumerated HID devices
 	int GetNbEnumeratedDevices();
 	// Returns information for the selected HID device
@@ -122,6 +196,19 @@ public:
 	void GetPhysicalKeyboardState(uint8_t* physicalState);
 	// Returns last requested analogic levels for a specific controller column
 	void GetColLevels(int col, uint16_t* colLevels);
+	// Returns the time the last requested analogic levels of a specific controller column were received
+	uint64_t GetColLevelsTimestamp(int col);
+	// Returns acquisition timings of the last requested logical scan, physical scan and analogic levels
+	LeydenJarFrameTiming GetLogicalScanTiming();
+	LeydenJarFrameTiming GetPhysicalScanTiming();
+	LeydenJarFrameTiming GetLevelsTiming();
+	// Returns acquisition timing of the last latency measurement cycle, its duration is the latency resolution
+	LeydenJarFrameTiming GetLatencyTiming();
+	// Returns a counter incremented by every completed request, a change means new data or acknowledges to look at
+	uint32_t GetDataGeneration();
+	// Sets a function called by the daemon threads of all agents after each completed request, nullptr removes it.
+	// It runs on the daemon thread and must return quickly, it is used to wake up an event driven main loop
+	static void SetCompletionCallback(void (*pCallback)(void* pUserData), void* pUserData);
 
 private:
 
@@ -129,13 +216,49 @@ private:
 	void ThreadLoop();
 	// Low level send request
 	void SendRequest(LeydenJarReq reqType);
+	// Executes a request on the daemon thread, returns false on error
+	bool ExecuteRequest(int reqType);
+	// Takes the most urgent pending request strictly more urgent than priorityLimit, mutex must be held
+	bool PopPendingRequest(int priorityLimit, int& reqType, int& reqPriority);
+	// Tells if a request strictly more urgent than priorityLimit is pending, mutex must be held
+	bool HasPendingRequest(int priorityLimit);
+	// Publishes the acknowledge of an executed request
+	void CompleteRequest(int reqPriority, bool isSuccess);
+	// Called between HID commands of long requests to serve more urgent ones.
+	// Returns false if the current request must be aborted (quit requested or device closed).
+	bool YieldToHigherPriority(LeydenJarReqPriority priority);
+	// Frame timing helpers, AddCommandTiming() is called after each successful HID command of the frame
+	void BeginFrameTiming(LeydenJarFrameTiming& timing);
+	void AddCommandTiming(LeydenJarFrameTiming& timing);
+	void EndFrameTiming(LeydenJarFrameTiming& timing, LeydenJarFrameTiming& publishedTiming);
+	// Waits until the rate controller allows the next scan, serving more urgent requests in the meantime
+	bool WaitForScanSlot();
+	// Compares the data of a completed scan with the previous one, returns true on key edges or level changes above noise
+	bool DetectScanActivity(int reqType);
+	// Runs one latency measurement cycle, reads are interleaved with as few delays as possible
+	bool MeasureLatency(LeydenJarFrameTiming& frameTiming);
 
 private:
 
 	LeydenJarProtocol		m_Protocol;
-	int						m_ReqType;
+	int						m_PendingReq[LeydenJarReqPriorityCount];
+	int						m_LastReqPriority;
 	int						m_ReqDeviceIndex;
-	std::atomic<int>		m_AckType;
+	bool					m_ReqRealTime;
+	int						m_ReqCpuCore;
+	LeydenJarSchedulingStatus m_SchedulingStatus;
+	LeydenJarRateController::LeydenJarRateConfig m_ReqRateConfig;
+	LeydenJarRateController	m_RateController;
+	std::atomic<float>		m_CurrentScanRate;
+	LeydenJarChatterDetector::LeydenJarChatterConfig m_ReqChatterConfig;
+	LeydenJarChatterDetector m_ChatterDetector;
+	LeydenJarLatencyMeter::LeydenJarLatencyConfig m_ReqLatencyConfig;
+	LeydenJarLatencyMeter	m_LatencyMeter;
+	LeydenJarRecorder*		m_pReqRecorder;
+	LeydenJarRecorder*		m_pRecorder;
+	bool					m_ExitThread;
+	std::atomic<int>		m_AckType[LeydenJarReqPriorityCount];
+	std::atomic<uint32_t>	m_DataGeneration;
 	std::mutex				m_Mutex;
 	std::condition_variable m_CondVar;
 	std::thread				m_Thread;
@@ -144,5 +267,13 @@ private:
 	uint32_t				m_LogicKeyboardState[16];
 	uint8_t					m_PhysicalKeyboardState[18];
 	uint16_t                m_Levels[18][8];
+	uint64_t				m_ColLevelsTimestampNs[18];
+	uint32_t				m_PrevLogicKeyboardState[16];
+	uint8_t					m_PrevPhysicalKeyboardState[18];
+	uint16_t				m_PrevLevels[18][8];
+	LeydenJarFrameTiming	m_LogicalScanTiming;
+	LeydenJarFrameTiming	m_PhysicalScanTiming;
+	LeydenJarFrameTiming	m_LevelsTiming;
+	LeydenJarFrameTiming	m_LatencyTiming;
 };
 
@@ -0,0 +1,298 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+
+#include "LeydenJarChatterDetector.h"
+#include "LeydenJarLevelCompare.h"
+
+LeydenJarChatterDetector::LeydenJarChatterDetector()
+    : m_NbCols(0)
+    , m_NbRows(0)
+    , m_IsBeamSpring(false)
+{
+    m_Config.windowUs = 10000;
+    m_Config.nbCrossings = 4;
+
+    std::memset(m_Thresholds, 0, sizeof(m_Thresholds));
+    Reset();
+}
+
+void LeydenJarChatterDetector::SetConfig(const LeydenJarChatterConfig& config)
+{
+    m_Config = config;
+
+    if (m_Config.nbCrossings < 2)
+        m_Config.nbCrossings = 2;
+    if (m_Config.nbCrossings > kMaxCrossings)
+        m_Config.nbCrossings = kMaxCrossings;
+
+    Reset();
+}
+
+const LeydenJarChatterDetector::LeydenJarChatterConfig& LeydenJarChatterDetector::GetConfig()
+{
+    return m_Config;
+}
+
+void LeydenJarChatterDetector::SetLayout(int nbCols, int nbRows, int switchTechnology, const uint16_t dacThreshold[16], const uint8_t binningMap[18][8])
+{
+    m_NbCols = nbCols;
+    m_NbRows = nbRows;
+    m_IsBeamSpring = switchTechnology == SwitchTechnologyBeamSpring;
+
+    // Unused matrix positions have no bin (255), first bin threshold is used for them
+    for (int col = 0; col < 18; col++)
+        for (int row = 0; row < 8; row++)
+            m_Thresholds[col][row] = dacThreshold[binningMap[col][row] < 16 ? binningMap[col][row] : 0];
+
+    Reset();
+}
+
+void LeydenJarChatterDetector::Reset()
+{
+    std::memset(m_HasKeyState, 0, sizeof(m_HasKeyState));
+    std::memset(m_KeyPressed, 0, sizeof(m_KeyPressed));
+    std::memset(m_LastEdgeNs, 0, sizeof(m_LastEdgeNs));
+    std::memset(m_LevelAbove, 0, sizeof(m_LevelAbove));
+    std::memset(m_CrossingIdx, 0, sizeof(m_CrossingIdx));
+    std::memset(m_CrossingNs, 0, sizeof(m_CrossingNs));
+    std::memset(m_Counters, 0, sizeof(m_Counters));
+    std::memset(m_FirstScanNs, 0, sizeof(m_FirstScanNs));
+    std::memset(m_FirstPressed, 0, sizeof(m_FirstPressed));
+    std::memset(m_FirstEdgeNs, 0, sizeof(m_FirstEdgeNs));
+    std::memset(m_FirstAbove, 0, sizeof(m_FirstAbove));
+    std::memset(m_NbCrossings, 0, sizeof(m_NbCrossings));
+    std::memset(m_FirstCrossingNs, 0, sizeof(m_FirstCrossingNs));
+
+    for (int source = 0; source < ChatterSourceCount; source++)
+        for (int key = 0; key < kNbKeys; key++)
+            m_Counters[source][key].minEdgeIntervalUs = 0xFFFFFFFF;
+}
+
+void LeydenJarChatterDetector::ClearKeyStates(int source)
+{
+    m_HasKeyState[source] = false;
+    std::memset(m_KeyPressed[source], 0, sizeof(m_KeyPressed[source]));
+    std::memset(m_LastEdgeNs[source], 0, sizeof(m_LastEdgeNs[source]));
+    std::memset(m_FirstScanNs[source], 0, sizeof(m_FirstScanNs[source]));
+    std::memset(m_FirstPressed[source], 0, sizeof(m_FirstPressed[source]));
+    std::memset(m_FirstEdgeNs[source], 0, sizeof(m_FirstEdgeNs[source]));
+
+    if (source == ChatterSourceLevels)
+    {
+        std::memset(m_LevelAbove, 0, sizeof(m_LevelAbove));
+        std::memset(m_CrossingIdx, 0, sizeof(m_CrossingIdx));
+        std::memset(m_CrossingNs, 0, sizeof(m_CrossingNs));
+        std::memset(m_FirstAbove, 0, sizeof(m_FirstAbove));
+        std::memset(m_NbCrossings, 0, sizeof(m_NbCrossings));
+        std::memset(m_FirstCrossingNs, 0, sizeof(m_FirstCrossingNs));
+    }
+}
+
+void LeydenJarChatterDetector::OnKeyState(int source, int key, bool isPressed, uint64_t timeNs)
+{
+    if (m_KeyPressed[source][key] == uint8_t(isPressed))
+        return;
+
+    LeydenJarKeyChatterCounters& counters = m_Counters[source][key];
+
+    m_KeyPressed[source][key] = uint8_t(isPressed);
+    if (isPressed)
+        counters.nbPresses++;
+
+    if (m_LastEdgeNs[source][key] != 0)
+        OnEdgeInterval(counters, m_LastEdgeNs[source][key], timeNs);
+    else
+        m_FirstEdgeNs[source][key] = timeNs;
+    m_LastEdgeNs[source][key] = timeNs;
+}
+
+void LeydenJarChatterDetector::OnEdgeInterval(LeydenJarKeyChatterCounters& counters, uint64_t lastEdgeNs, uint64_t timeNs)
+{
+    uint64_t intervalUs = (timeNs - lastEdgeNs) / 1000;
+
+    if (intervalUs < counters.minEdgeIntervalUs)
+        counters.minEdgeIntervalUs = uint32_t(intervalUs);
+
+    if (intervalUs <= m_Config.windowUs)
+    {
+        counters.nbBounces++;
+        counters.lastEventNs = timeNs;
+    }
+}
+
+void LeydenJarChatterDetector::OnCrossing(int key, uint64_t timeNs, bool canOscillate)
+{
+    uint8_t idx = m_CrossingIdx[key];
+    m_CrossingNs[key][idx] = timeNs;
+    m_CrossingIdx[key] = uint8_t((idx + 1) % kMaxCrossings);
+
+    if (m_NbCrossings[key] < kMaxCrossings)
+        m_FirstCrossingNs[key][m_NbCrossings[key]] = timeNs;
+    if (m_NbCrossings[key] < 255)
+        m_NbCrossings[key]++;
+
+    if (canOscillate == false)
+        return;
+
+    // The crossing nbCrossings - 1 before this one must be recent enough for an oscillation
+    uint64_t oldestNs = m_CrossingNs[key][(idx + kMaxCrossings - (m_Config.nbCrossings - 1)) % kMaxCrossings];
+    if (oldestNs != 0 && timeNs - oldestNs <= uint64_t(m_Config.windowUs) * 1000)
+    {
+        m_Counters[ChatterSourceLevels][key].nbOscillations++;
+        m_Counters[ChatterSourceLevels][key].lastEventNs = timeNs;
+    }
+}
+
+void LeydenJarChatterDetector::OnPhysicalScan(const uint8_t physicalState[18], uint64_t timeNs)
+{
+    if (m_HasKeyState[ChatterSourcePhysical] == false)
+    {
+        for (int col = 0; col < m_NbCols; col++)
+        {
+            for (int row = 0; row < m_NbRows; row++)
+            {
+                int key = col * 8 + row;
+                m_KeyPressed[ChatterSourcePhysical][key] = (physicalState[col] >> row) & 1;
+                m_FirstPressed[ChatterSourcePhysical][key] = m_KeyPressed[ChatterSourcePhysical][key];
+                m_FirstScanNs[ChatterSourcePhysical][key] = timeNs;
+            }
+        }
+        m_HasKeyState[ChatterSourcePhysical] = true;
+        return;
+    }
+
+    for (int col = 0; col < m_NbCols; col++)
+    {
+        // Only changed keys are looked at, most scans have none
+        uint8_t prevState = 0;
+        for (int row = 0; row < 8; row++)
+            prevState |= uint8_t(m_KeyPressed[ChatterSourcePhysical][col * 8 + row] << row);
+
+        uint8_t changedRows = uint8_t((prevState ^ physicalState[col]) & ((1 << m_NbRows) - 1));
+        for (int row = 0; changedRows != 0; row++, changedRows >>= 1)
+        {
+            if (changedRows & 1)
+                OnKeyState(ChatterSourcePhysical, col * 8 + row, ((physicalState[col] >> row) & 1) != 0, timeNs);
+        }
+    }
+}
+
+void LeydenJarChatterDetector::OnLevels(const uint16_t levels[18][8], const uint64_t colTimeNs[18])
+{
+    bool hasLevelState = m_HasKeyState[ChatterSourceLevels];
+
+    for (int col = 0; col < m_NbCols; col++)
+    {
+        for (int row = 0; row < m_NbRows; row++)
+        {
+            int key = col * 8 + row;
+            uint16_t level = levels[col][row];
+            uint16_t threshold = m_Thresholds[col][row];
+            uint8_t isAbove = level >= threshold;
+
+            if (hasLevelState && isAbove != m_LevelAbove[key])
+                OnCrossing(key, colTimeNs[col], true);
+            m_LevelAbove[key] = isAbove;
+
+            bool isPressed = IsLevelPressed(level, threshold, m_IsBeamSpring);
+            if (hasLevelState)
+            {
+                OnKeyState(ChatterSourceLevels, key, isPressed, colTimeNs[col]);
+            }
+            else
+            {
+                m_KeyPressed[ChatterSourceLevels][key] = uint8_t(isPressed);
+                m_FirstPressed[ChatterSourceLevels][key] = uint8_t(isPressed);
+                m_FirstScanNs[ChatterSourceLevels][key] = colTimeNs[col];
+                m_FirstAbove[key] = isAbove;
+            }
+        }
+    }
+
+    m_HasKeyState[ChatterSourceLevels] = true;
+}
+
+const LeydenJarChatterDetector::LeydenJarKeyChatterCounters* LeydenJarChatterDetector::GetCounters(int source)
+{
+    return m_Counters[source];
+}
+
+void LeydenJarChatterDetector::Append(const LeydenJarChatterDetector& next)
+{
+    for (int source = 0; source < ChatterSourceCount; source++)
+    {
+        if (next.m_HasKeyState[source] == false)
+            continue;
+
+        bool hasKeyState = m_HasKeyState[source];
+
+        for (int col = 0; col < m_NbCols; col++)
+        {
+            for (int row = 0; row < m_NbRows; row++)
+            {
+                int key = col * 8 + row;
+                LeydenJarKeyChatterCounters& counters = m_Counters[source][key];
+                const LeydenJarKeyChatterCounters& nextCounters = next.m_Counters[source][key];
+
+                if (hasKeyState)
+                {
+                    // The first scan of next can be an edge, and the first edge of next is compared to an earlier edge
+                    OnKeyState(source, key, next.m_FirstPressed[source][key] != 0, next.m_FirstScanNs[source][key]);
+                    if (next.m_FirstEdgeNs[source][key] != 0 && m_LastEdgeNs[source][key] != 0)
+                        OnEdgeInterval(counters, m_LastEdgeNs[source][key], next.m_FirstEdgeNs[source][key]);
+                }
+                else
+                {
+                    m_FirstScanNs[source][key] = next.m_FirstScanNs[source][key];
+                    m_FirstPressed[source][key] = next.m_FirstPressed[source][key];
+                    m_FirstEdgeNs[source][key] = next.m_FirstEdgeNs[source][key];
+                }
+                m_KeyPressed[source][key] = next.m_KeyPressed[source][key];
+                if (next.m_LastEdgeNs[source][key] != 0)
+                    m_LastEdgeNs[source][key] = next.m_LastEdgeNs[source][key];
+
+                if (source == ChatterSourceLevels && hasKeyState)
+                {
+                    // Crossings of next that could not see enough previous crossings are replayed
+                    if (m_LevelAbove[key] != next.m_FirstAbove[key])
+                        OnCrossing(key, next.m_FirstScanNs[source][key], true);
+
+                    int nbReplayed = next.m_NbCrossings[key] < kMaxCrossings ? next.m_NbCrossings[key] : kMaxCrossings;
+                    for (int crossing = 0; crossing < nbReplayed; crossing++)
+                        OnCrossing(key, next.m_FirstCrossingNs[key][crossing], crossing < m_Config.nbCrossings - 1);
+
+                    if (next.m_NbCrossings[key] > nbReplayed)
+                    {
+                        std::memcpy(m_CrossingNs[key], next.m_CrossingNs[key], sizeof(m_CrossingNs[key]));
+                        m_CrossingIdx[key] = next.m_CrossingIdx[key];
+                        int nbCrossings = m_NbCrossings[key] + next.m_NbCrossings[key] - nbReplayed;
+                        m_NbCrossings[key] = uint8_t(nbCrossings < 255 ? nbCrossings : 255);
+                    }
+                }
+                else if (source == ChatterSourceLevels)
+                {
+                    std::memcpy(m_CrossingNs[key], next.m_CrossingNs[key], sizeof(m_CrossingNs[key]));
+                    std::memcpy(m_FirstCrossingNs[key], next.m_FirstCrossingNs[key], sizeof(m_FirstCrossingNs[key]));
+                    m_CrossingIdx[key] = next.m_CrossingIdx[key];
+                    m_NbCrossings[key] = next.m_NbCrossings[key];
+                    m_FirstAbove[key] = next.m_FirstAbove[key];
+                }
+                if (source == ChatterSourceLevels)
+                    m_LevelAbove[key] = next.m_LevelAbove[key];
+
+                // Events of next all come after the ones found above
+                counters.nbPresses += nextCounters.nbPresses;
+                counters.nbBounces += nextCounters.nbBounces;
+                counters.nbOscillations += nextCounters.nbOscillations;
+                if (nextCounters.minEdgeIntervalUs < counters.minEdgeIntervalUs)
+                    counters.minEdgeIntervalUs = nextCounters.minEdgeIntervalUs;
+                if (nextCounters.lastEventNs != 0)
+                    counters.lastEventNs = nextCounters.lastEventNs;
+            }
+        }
+
+        m_HasKeyState[source] = true;
+    }
+}
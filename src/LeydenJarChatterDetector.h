@@ -0,0 +1,109 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+
+// This class detects key chatter on the timestamped scan stream of the agent thread.
+// Two kinds of events are counted per key of the physical matrix:
+//   - bounces: a key state edge (press or release) coming less than a time window after the previous edge of the same key.
+//   - oscillations: the level of a key crossing its DAC threshold a given number of times within the same time window.
+// Key states come from physical scans, or from levels compared to DAC thresholds for level scans. The firmware debounces
+// physical scans so both sources disagree for a few milliseconds around every edge: each source has its own key states,
+// edge times and counters, mixing them would count these disagreements as bounces.
+// All memory is fixed, processing a scan does not allocate so that it keeps up with the maximum scan rate.
+// It is owned and used by the agent thread only, it does no locking.
+
+class LeydenJarChatterDetector
+{
+public:
+
+	static const int kNbKeys = 18 * 8;
+	// Threshold crossing times kept per key, upper bound of the oscillation crossing count
+	static const int kMaxCrossings = 8;
+
+	enum LeydenJarChatterSource
+	{
+		ChatterSourcePhysical = 0,
+		ChatterSourceLevels,
+		ChatterSourceCount
+	};
+
+	struct LeydenJarChatterConfig
+	{
+		uint32_t	windowUs;
+		uint8_t		nbCrossings;
+	};
+
+	struct LeydenJarKeyChatterCounters
+	{
+		uint32_t	nbPresses;
+		uint32_t	nbBounces;
+		uint32_t	nbOscillations;
+		// Shortest time seen between two edges of the key, 0xFFFFFFFF when less than 2 edges were seen
+		uint32_t	minEdgeIntervalUs;
+		// Time of the last bounce or oscillation, 0 if none
+		uint64_t	lastEventNs;
+	};
+
+public:
+
+	LeydenJarChatterDetector();
+
+	// Changing configuration clears counters
+	void SetConfig(const LeydenJarChatterConfig& config);
+	const LeydenJarChatterConfig& GetConfig();
+	// Sets the matrix description of the connected device, counters are cleared
+	void SetLayout(int nbCols, int nbRows, int switchTechnology, const uint16_t dacThreshold[16], const uint8_t binningMap[18][8]);
+	void Reset();
+	// Forgets key states and edge times of a source but keeps its counters, the next scan only initializes states again.
+	// Used when scans are missing, so that states on both sides of the gap are not compared
+	void ClearKeyStates(int source);
+
+	// Called after each physical scan, one byte of row bits per column
+	void OnPhysicalScan(const uint8_t physicalState[18], uint64_t timeNs);
+	// Called after each level scan, with the reception time of every column
+	void OnLevels(const uint16_t levels[18][8], const uint64_t colTimeNs[18]);
+
+	// Counters of one source, oscillations are only counted on levels
+	const LeydenJarKeyChatterCounters* GetCounters(int source);
+
+	// Continues this detector with the scans processed by another one, whose first scans directly follow the last scans of
+	// this detector. Counters end as if this detector had processed all scans itself: recording chunks can be processed in
+	// parallel then appended in order. Both detectors must have the same configuration and layout
+	void Append(const LeydenJarChatterDetector& next);
+
+private:
+
+	void OnKeyState(int source, int key, bool isPressed, uint64_t timeNs);
+	void OnEdgeInterval(LeydenJarKeyChatterCounters& counters, uint64_t lastEdgeNs, uint64_t timeNs);
+	// An oscillation can only be counted if the crossings it spans are known
+	void OnCrossing(int key, uint64_t timeNs, bool canOscillate);
+
+private:
+
+	LeydenJarChatterConfig		m_Config;
+	int							m_NbCols;
+	int							m_NbRows;
+	bool						m_IsBeamSpring;
+	uint16_t					m_Thresholds[18][8];
+
+	// First scan of a source after a reset only initializes states, it can not produce edges
+	bool						m_HasKeyState[ChatterSourceCount];
+	uint8_t						m_KeyPressed[ChatterSourceCount][kNbKeys];
+	uint64_t					m_LastEdgeNs[ChatterSourceCount][kNbKeys];
+	uint8_t						m_LevelAbove[kNbKeys];
+	uint8_t						m_CrossingIdx[kNbKeys];
+	uint64_t					m_CrossingNs[kNbKeys][kMaxCrossings];
+	LeydenJarKeyChatterCounters	m_Counters[ChatterSourceCount][kNbKeys];
+
+	// What happened right after the first scan, the counters of these events depend on previous scans and are left to Append
+	uint64_t					m_FirstScanNs[ChatterSourceCount][kNbKeys];
+	uint8_t						m_FirstPressed[ChatterSourceCount][kNbKeys];
+	uint64_t					m_FirstEdgeNs[ChatterSourceCount][kNbKeys];
+	uint8_t						m_FirstAbove[kNbKeys];
+	// Saturates at 255
+	uint8_t						m_NbCrossings[kNbKeys];
+	uint64_t					m_FirstCrossingNs[kNbKeys][kMaxCrossings];
+};
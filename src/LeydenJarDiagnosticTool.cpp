@@ -3,13 +3,15 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <cmath>
+#include <ctime>
 #include <limits>
 #include <array>
 #include <algorithm>
 
 #include "LeydenJarDiagnosticTool.h"
 #include "LeydenJarImGuiHelpers.h"
-#include "json/json.h"
+#include "LeydenJarProfiler.h"
 
 // Minlzma library is in pure C99 code.
 // We unfortunately have to rely on the extern "C" thing to prevent link errors 
@@ -18,48 +20,107 @@ extern "C"
 #include "minlzma.h"
 }
 
+// Level plot trace colours, one per traced key
+static const ImU32 s_LevelPlotColors[LeydenJarLevelHistory::kMaxTraces] =
+{
+    IM_COL32(255, 214, 64, 255),
+    IM_COL32(64, 224, 255, 255),
+    IM_COL32(255, 96, 160, 255),
+    IM_COL32(128, 255, 128, 255),
+    IM_COL32(255, 160, 64, 255),
+    IM_COL32(176, 128, 255, 255),
+    IM_COL32(255, 255, 255, 255),
+    IM_COL32(96, 160, 255, 255)
+};
+
 // You can put this variable to true to display ImGui demo window.
 // If you plan to tweak the GUI yourself this is a very good place to start learning ImGui API.
 bool showDemoWindow = false;
 
-bool LeydenJarDiagnosticTool::Initialize()
+bool LeydenJarDiagnosticTool::Initialize(const char* glslVersion)
 {
+    m_pAgent = m_SessionManager.GetEnumerationAgent();
     m_IsDeviceListParsed = false;
     m_SelectedDeviceIndex = -1;
     m_VialUncompressedKeyboardDefinitionSize = 0;
+    m_DashboardLevels = false;
+    m_DashboardTileWidth = 240;
+    m_DashboardNbVisibleTiles = 0;
 
     m_CurrentLeftPaneLayout = LeftPaneLayoutDeciveDescription;
     m_CurrentRightPaneLayout = RightPaneLayoutDeciveDescription;
 
     m_RightPaneViewType = RightPaneViewKeyboardLayout;
 
+    std::memset(&m_FrameTiming, 0, sizeof(m_FrameTiming));
+    m_FrameRate = 0.f;
+
+    m_RateConfig = m_pAgent->GetRateConfiguration();
+    m_ChatterConfig = m_pAgent->GetChatterConfiguration();
+    std::memset(m_ChatterCounters, 0, sizeof(m_ChatterCounters));
+    m_LatencyMeasurement = false;
+    m_LatencyRequestSent = false;
+    m_LatencyConfig = m_pAgent->GetLatencyConfiguration();
+    std::memset(m_KeyLatencies, 0, sizeof(m_KeyLatencies));
+    m_AgentRealTime = false;
+    m_AgentCpuCore = -1;
+    m_MaxRefreshRate = 60;
+    m_ProfilerOverlay = false;
+    m_ColumnSkewCount = 0;
+    m_ColumnSkewMean = 0.0;
+    m_ColumnSkewM2 = 0.0;
+    m_HistogramKeyCol = 0;
+    m_HistogramKeyRow = 0;
+    m_LevelPlot = false;
+    m_LevelPlotWindowS = 10.f;
+    m_LevelPlotPaused = false;
+    m_LevelPlotPausedEndNs = 0;
+    m_pRecordingAgent = nullptr;
+
+    // Level heatmap is an option, the tool works without it when the shader can not be built
+    m_LevelHeatmap = false;
+    m_HeatmapRenderer.Initialize(glslVersion);
+
+    ResetLevelAnalysis();
+
     return true;
 }
 
 bool LeydenJarDiagnosticTool::Finalize()
 {
-    if (m_Agent.IsDeviceOpened())
-    {
-        m_Agent.RequestEnable();
-        m_Agent.WaitEndRequest();
-    }
+    StopRecording();
+    m_HeatmapRenderer.Finalize();
+    m_SessionManager.CloseAllSessions();
+    m_pAgent = m_SessionManager.GetEnumerationAgent();
     return true;
 }
 
 void LeydenJarDiagnosticTool::RefreshDeviceList()
 {
-    m_Agent.RequestDeviceEnumeration();
-    m_Agent.WaitEndRequest();
-    for (int i = 0; i < m_Agent.GetNbEnumeratedDevices(); i++)
+    // Sessions are closed by the refresh, the recorder must not be used by their agents anymore
+    StopRecording();
+    m_SessionManager.RefreshDeviceList();
+    m_pAgent = m_SessionManager.GetEnumerationAgent();
+
+    m_DeviceListNames.resize(m_SessionManager.GetNbEnumeratedDevices());
+    for (int i = 0; i < m_SessionManager.GetNbEnumeratedDevices(); i++)
     {
-        wcstombs(m_DeviceListNames[i], m_Agent.GetHidDeviceInfo(i)->product_string, 256);
+        char deviceName[256];
+        wcstombs(deviceName, m_SessionManager.GetHidDeviceInfo(i)->product_string, sizeof(deviceName));
+        deviceName[sizeof(deviceName) - 1] = 0;
+        m_DeviceListNames[i] = deviceName;
     }
 
+    // Sessions were closed, tiles restart without data
+    m_DashboardTiles.assign(m_SessionManager.GetNbEnumeratedDevices(), DashboardTile());
+
     m_SelectedDeviceIndex = -1;
 }
 
 void LeydenJarDiagnosticTool::DecodeVialKeyboardDefinition(const uint8_t* compressedVialData, uint32_t compressedVialSize)
 {
+    LeydenJarProfileScope profileScope(LeydenJarProfiler::ProfileZoneJsonDecode);
+
     //Decompress LZMA encoded VIAL keyboard definitions
     bool decodeResult = XzDecode(compressedVialData, compressedVialSize, nullptr, &m_VialUncompressedKeyboardDefinitionSize);
     if (decodeResult == true && m_VialUncompressedKeyboardDefinitionSize < sizeof(m_VialUncompressedKeyboardDefinitionData))
@@ -67,223 +128,14 @@ void LeydenJarDiagnosticTool::DecodeVialKeyboardDefinition(const uint8_t* compre
         XzDecode(compressedVialData, compressedVialSize, (uint8_t*)m_VialUncompressedKeyboardDefinitionData, &m_VialUncompressedKeyboardDefinitionSize);
     }
 
-    Json::Reader jsonReader;
-    Json::Value root;
-
-    // Decode decompressed json data
-    bool ret = jsonReader.parse(m_VialUncompressedKeyboardDefinitionData, m_VialUncompressedKeyboardDefinitionData + m_VialUncompressedKeyboardDefinitionSize, root, false);
-    if (ret == true)
-    {
-        // Read all possible layout options
-        Json::Value labels = root["layouts"]["labels"];
-        if (labels.isArray())
-        {
-            Json::ArrayIndex nbLabels = labels.size();
-            m_LayoutOptions.resize(nbLabels);
-
-            for (Json::ArrayIndex i = 0; i < nbLabels; i++)
-            {
-                Json::Value label = root["layouts"]["labels"][i];
-                if (label.isArray())
-                {
-                    Json::ArrayIndex nbLabelItems = label.size();
-                    m_LayoutOptions[i].listboxItems.resize(nbLabelItems - 1);
-                    m_LayoutOptions[i].isCheckbox = false;
-                    m_LayoutOptions[i].isChecked = false;
-                    m_LayoutOptions[i].selectionIndex = 0;
-
-                    for (Json::ArrayIndex j = 0; j < nbLabels; j++)
-                    {
-                        Json::Value labelElem = root["layouts"]["labels"][i][j];
-                        if (labelElem.isString())
-                        {
-                            Json::String str = labelElem.asString();
-                            if (j == 0)
-                                m_LayoutOptions[i].layoutName = str;
-                            else
-                                m_LayoutOptions[i].listboxItems[j - 1] = str;
-                        }
-                    }
-                }
-                else if (label.isString())
-                {
-                    Json::String str = label.asString();
-                    m_LayoutOptions[i].layoutName = str;
-                    m_LayoutOptions[i].isCheckbox = true;
-                    m_LayoutOptions[i].isChecked = false;
-                    m_LayoutOptions[i].selectionIndex = 0;
-                }
-            }
-        }
-
-        // Read keymap
-        Json::Value keymap = root["layouts"]["keymap"];
-        if (keymap.isArray())
-        {
-            Json::ArrayIndex nbRows = keymap.size();
-            m_Keys.resize(nbRows);
-
-            for (Json::ArrayIndex row = 0; row < nbRows; row++)
-            {
-                Json::Value rowArray = root["layouts"]["keymap"][row];
-                if (rowArray.isArray())
-                {
-                    ViaKey key;
-                    key.SetDefaultVals();
-
-                    Json::ArrayIndex nbRowElems = rowArray.size();
-
-                    for (Json::ArrayIndex rowElem = 0; rowElem < nbRowElems; rowElem++)
-                    {
-                        Json::Value elem = root["layouts"]["keymap"][row][rowElem];
-                        if (elem.isObject())
-                        {
-                            Json::Value elem = root["layouts"]["keymap"][row][rowElem]["x"];
-                            if (elem.isNumeric())
-                                key.x = elem.asFloat();
-                            elem = root["layouts"]["keymap"][row][rowElem]["y"];
-                            if (elem.isNumeric())
-                                key.y = elem.asFloat();
-                            elem = root["layouts"]["keymap"][row][rowElem]["w"];
-                            if (elem.isNumeric())
-                                key.w = key.w2 = elem.asFloat();
-                            elem = root["layouts"]["keymap"][row][rowElem]["h"];
-                            if (elem.isNumeric())
-                                key.h = key.h2 = elem.asFloat();
-                            elem = root["layouts"]["keymap"][row][rowElem]["x2"];
-                            if (elem.isNumeric())
-                                key.x2 = elem.asFloat();
-                            elem = root["layouts"]["keymap"][row][rowElem]["y2"];
-                            if (elem.isNumeric())
-                                key.y2 = elem.asFloat();
-                            elem = root["layouts"]["keymap"][row][rowElem]["w2"];
-                            if (elem.isNumeric())
-                                key.w2 = elem.asFloat();
-                            elem = root["layouts"]["keymap"][row][rowElem]["h2"];
-                            if (elem.isNumeric())
-                                key.h2 = elem.asFloat();
-                        }
-                        else if (elem.isString())
-                        {
-                            std::string::size_type rS;
-                            key.row = std::stoi(elem.asString(), &rS);
-                            std::string::size_type cS;
-                            key.col = std::stoi(elem.asString().substr(rS + 1), &cS);
-
-                            if (elem.asString().length() > rS + 1 + cS)
-                            {
-                                std::string::size_type gnS;
-                                key.groupNum = std::stoi(elem.asString().substr(rS + 1 + cS + 3), &gnS);
-                                key.groupIdx = std::stoi(elem.asString().substr(rS + 1 + cS + 3 + gnS + 1));
-                            }
-
-                            m_Keys[row].push_back(key);
-                            key.SetDefaultVals();
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    //Rework keymap to be usable for rendering keys
-    std::vector< std::vector<ImVec2> > layoutPositions;
-    layoutPositions.resize(m_LayoutOptions.size());
-    for (size_t i = 0; i < m_LayoutOptions.size(); i++)
-    {
-        size_t nbOptions;
-        if (m_LayoutOptions[i].isCheckbox)
-            nbOptions = 2;
-        else
-            nbOptions = m_LayoutOptions[i].listboxItems.size();
-        for (size_t j = 0; j < nbOptions; j++)
-            layoutPositions[i].push_back(ImVec2(0.f, 0.f));
-    }
+    DecodeViaKeyboardLayout(m_VialUncompressedKeyboardDefinitionData, m_VialUncompressedKeyboardDefinitionSize, m_LayoutOptions, m_Keys);
 
-    //All keys positions are relative, we translate them to absolute positions
-    for (size_t row = 0; row < m_Keys.size(); row++)
-    {
-        for (size_t col = 0; col < m_Keys[row].size(); col++)
-        {
-            if (row > 0)
-            {
-                if (col == 0)
-                    m_Keys[row][col].y += m_Keys[row - 1][0].y + m_Keys[row - 1][0].h;
-                else
-                    m_Keys[row][col].y = m_Keys[row][col - 1].y;
-            }
-            if (col > 0)
-            {
-                m_Keys[row][col].x += m_Keys[row][col - 1].x + m_Keys[row][col - 1].w;
-            }
-
-            if (m_Keys[row][col].groupNum != -1)
-            {
-                int groupNum = m_Keys[row][col].groupNum;
-                int groupIdx = m_Keys[row][col].groupIdx;
-
-                if (layoutPositions[groupNum][groupIdx].x == 0.f && layoutPositions[groupNum][groupIdx].y == 0.f)
-                {
-                    layoutPositions[groupNum][groupIdx].x = m_Keys[row][col].x + m_Keys[row][col].x2;
-                    layoutPositions[groupNum][groupIdx].y = m_Keys[row][col].y;
-                }
-            }
-        }
-    }
-
-    //Align all optional layouts to their default layout
-    for (size_t row = 0; row < m_Keys.size(); row++)
-    {
-        for (size_t col = 0; col < m_Keys[row].size(); col++)
-        {
-            if (m_Keys[row][col].groupNum != -1)
-            {
-                int groupNum = m_Keys[row][col].groupNum;
-                int groupIdx = m_Keys[row][col].groupIdx;
-
-                if (groupIdx > 0)
-                {
-                    if (layoutPositions[groupNum][groupIdx].x == layoutPositions[groupNum][0].x)
-                    {
-                        float offsetY = layoutPositions[groupNum][groupIdx].y - layoutPositions[groupNum][0].y;
-                        m_Keys[row][col].y -= offsetY;
-                    }
-                    else if (layoutPositions[groupNum][groupIdx].y == layoutPositions[groupNum][0].y)
-                    {
-                        float offsetX = layoutPositions[groupNum][groupIdx].x - layoutPositions[groupNum][0].x;
-                        m_Keys[row][col].x -= offsetX;
-                    }
-                }
-            }
-        }
-    }
-
-    //Find minimal X and Y positions for the layouts
-    float minX = FLT_MAX;
-    float minY = FLT_MAX;
-
-    for (size_t row = 0; row < m_Keys.size(); row++)
-    {
-        for (size_t col = 0; col < m_Keys[row].size(); col++)
-        {
-            minX = std::min(minX, m_Keys[row][col].x);
-            minY = std::min(minY, m_Keys[row][col].y);
-        }
-    }
-
-    //Translate layouts to zero
-    for (size_t row = 0; row < m_Keys.size(); row++)
-    {
-        for (size_t col = 0; col < m_Keys[row].size(); col++)
-        {
-            m_Keys[row][col].x -= minX;
-            m_Keys[row][col].y -= minY;
-        }
-    }
+    m_KeyboardLayoutGeometry.Invalidate();
 }
 
 void LeydenJarDiagnosticTool::RunStep()
 {
+    LeydenJarProfileScope profileScope(LeydenJarProfiler::ProfileZoneRunStep);
     ImGuiIO& io = ImGui::GetIO();
     
     ImVec2 displaySize = ImGui::GetIO().DisplaySize;
@@ -313,10 +165,45 @@ void LeydenJarDiagnosticTool::RunStep()
 
     ImGui::End();
 
+    if (ImGui::IsKeyPressed(ImGuiKey_F12, false))
+        m_ProfilerOverlay = !m_ProfilerOverlay;
+    if (m_ProfilerOverlay)
+        DrawProfilerOverlay();
+    LeydenJarProfiler::SetEnabled(m_ProfilerOverlay);
+
     if (showDemoWindow)
         ImGui::ShowDemoWindow(&showDemoWindow);
 }
 
+uint32_t LeydenJarDiagnosticTool::GetDataGeneration()
+{
+    // Dashboard tiles are refreshed by the completions of all sessions
+    if (m_CurrentLeftPaneLayout == LeftPaneLayoutDashboard)
+    {
+        uint32_t dataGeneration = 0;
+        for (int deviceIndex = 0; deviceIndex < m_SessionManager.GetNbEnumeratedDevices(); deviceIndex++)
+        {
+            LeydenJarAgent* pAgent = m_SessionManager.GetSession(deviceIndex);
+            if (pAgent != nullptr)
+                dataGeneration += pAgent->GetDataGeneration();
+        }
+        return dataGeneration;
+    }
+
+    return m_pAgent->GetDataGeneration();
+}
+
+uint32_t LeydenJarDiagnosticTool::GetMinFramePeriodMs()
+{
+    // Device description only changes on inputs, monitors request new data every frame
+    if (m_CurrentLeftPaneLayout == LeftPaneLayoutDashboard)
+        return uint32_t(1000 / m_MaxRefreshRate);
+    if (m_CurrentLeftPaneLayout == LeftPaneLayoutDeciveDescription || !m_pAgent->IsDeviceOpened())
+        return 0;
+
+    return uint32_t(1000 / m_MaxRefreshRate);
+}
+
 void LeydenJarDiagnosticTool::LeftPaneRendering()
 {
     switch (m_CurrentLeftPaneLayout)
@@ -330,12 +217,18 @@ void LeydenJarDiagnosticTool::LeftPaneRendering()
     case LeftPaneLayoutSignalMonitor:
         LeftPaneRenderingSignalLevels();
         break;
+    case LeftPaneLayoutDashboard:
+        LeftPaneRenderingDashboard();
+        break;
     }
 }
 
 void LeydenJarDiagnosticTool::RightPaneRendering()
 {
-    if (m_Agent.IsDeviceOpened())
+    // Dashboard shows all opened sessions, whatever the selected device
+    if (m_CurrentLeftPaneLayout == LeftPaneLayoutDashboard)
+        RightPaneRenderingDashboard();
+    else if (m_pAgent->IsDeviceOpened())
     {
         switch (m_CurrentLeftPaneLayout)
         {
@@ -348,6 +241,8 @@ void LeydenJarDiagnosticTool::RightPaneRendering()
         case LeftPaneLayoutSignalMonitor:
             RightPaneRenderingSignalLevels();
             break;
+        default:
+            break;
         }
     }
 }
@@ -377,7 +272,7 @@ void LeydenJarDiagnosticTool::LeftPaneDrawViaLayoutOptions()
 
 void LeydenJarDiagnosticTool::LeftPaneDrawLeydenJarInfos()
 {
-    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_Agent.GetDeviceInfo();
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
 
     ImGui::SeparatorText("Leyden Jar Infos");
 
@@ -399,82 +294,628 @@ void LeydenJarDiagnosticTool::LeftPaneDrawLeydenJarInfos()
     }
 }
 
+void LeydenJarDiagnosticTool::LeftPaneDrawAcquisitionTiming()
+{
+    ImGui::SeparatorText("Acquisition");
+
+    if (m_FrameTiming.nbCommands == 0)
+    {
+        ImGui::Text("Waiting for data...");
+        return;
+    }
+
+    ImGui::Text("Frame rate: %.1f Hz", m_FrameRate);
+    ImGui::Text("Frame duration: %.2f ms", (m_FrameTiming.acquisitionEndNs - m_FrameTiming.acquisitionStartNs) / 1000000.0);
+    ImGui::Text("HID commands per frame: %u", m_FrameTiming.nbCommands);
+    ImGui::Text("HID round trip: avg %.0f us, max %.0f us", m_FrameTiming.sumRoundTripNs / (1000.0 * m_FrameTiming.nbCommands), m_FrameTiming.maxRoundTripNs / 1000.0);
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawRateControllerOptions()
+{
+    ImGui::SeparatorText("Adaptive Scan Rate");
+
+    int idleHoldMs = int(m_RateConfig.idleHoldMs);
+    int levelNoise = int(m_RateConfig.levelNoise);
+
+    bool configChanged = ImGui::Checkbox("Adaptive rate", &m_RateConfig.enabled);
+    ImGui::SetItemTooltip("Scan fast on activity and back off to the idle rate when nothing changes");
+    configChanged |= ImGui::SliderFloat("Idle rate", &m_RateConfig.minRateHz, 1.f, 100.f, "%.0f Hz", ImGuiSliderFlags_Logarithmic);
+    configChanged |= ImGui::SliderFloat("Active rate", &m_RateConfig.maxRateHz, 10.f, 1000.f, "%.0f Hz", ImGuiSliderFlags_Logarithmic);
+    configChanged |= ImGui::SliderInt("Idle hold", &idleHoldMs, 0, 10000, "%d ms");
+    configChanged |= ImGui::SliderInt("Level noise", &levelNoise, 0, 50);
+    ImGui::SetItemTooltip("Level changes up to this value are not considered as activity");
+
+    if (configChanged)
+    {
+        m_RateConfig.idleHoldMs = uint32_t(idleHoldMs);
+        m_RateConfig.levelNoise = uint16_t(levelNoise);
+        m_pAgent->RequestRateConfiguration(m_RateConfig);
+        m_pAgent->WaitEndRequest();
+        m_RateConfig = m_pAgent->GetRateConfiguration();
+    }
+
+    if (m_RateConfig.enabled)
+        ImGui::Text("Target scan rate: %.1f Hz", m_pAgent->GetCurrentScanRate());
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawKeyStatistics()
+{
+    ImGui::SeparatorText("Key Statistics");
+
+    LeydenJarKeyStatistics::LeydenJarKeyStatsConfig config = m_LevelAnalysis.GetStatisticsConfig();
+
+    bool configChanged = ImGui::SliderInt("Window", &config.windowSize, 16, LeydenJarKeyStatistics::kMaxWindowSize, "%d samples", ImGuiSliderFlags_Logarithmic);
+    ImGui::SetItemTooltip("Number of last samples used for the statistics of each key");
+    configChanged |= ImGui::SliderFloat("Low percentile", &config.lowPercentile, 0.f, 50.f, "%.1f");
+    configChanged |= ImGui::SliderFloat("High percentile", &config.highPercentile, 50.f, 100.f, "%.1f");
+
+    if (configChanged)
+        m_LevelAnalysis.SetStatisticsConfig(m_TaskPool, config);
+
+    if (m_KeyboardLevelsAcquired == false)
+        return;
+
+    // Per bin summary, the worst key of a bin is the one closest to its DAC threshold relative to its noise
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+
+    for (int bin = 0; bin < pDeviceInfo->nbBins; bin++)
+    {
+        int nbKeys = 0;
+        float sumNoise = 0.f;
+        float worstSnrDb = 0.f;
+
+        for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
+        {
+            for (int row = 0; row < pDeviceInfo->nbPhysicalRows; row++)
+            {
+                const LeydenJarKeyStatistics::LeydenJarKeyStatsSummary& stats = m_LevelResults.keyStats[col][row];
+
+                if (pDeviceInfo->binningMap[col][row] != bin || stats.nbSamples == 0)
+                    continue;
+
+                if (nbKeys == 0 || stats.snrDb < worstSnrDb)
+                    worstSnrDb = stats.snrDb;
+                sumNoise += stats.stdDev;
+                nbKeys++;
+            }
+        }
+
+        if (nbKeys != 0)
+            ImGui::Text("Bin %d: noise floor %.2f, worst SNR %.1f dB", bin, sumNoise / nbKeys, worstSnrDb);
+    }
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawLevelHistograms()
+{
+    ImGui::SeparatorText("Level Histograms");
+
+    const char* comboItems[9] = { "1", "2", "4", "8", "16", "32", "64", "128", "256" };
+    int bucketWidthIdx = 0;
+    while ((1 << bucketWidthIdx) < m_LevelAnalysis.GetHistogramBucketWidth() && bucketWidthIdx < 8)
+        bucketWidthIdx++;
+
+    if (ImGui::Combo("Bucket width", &bucketWidthIdx, comboItems, 9))
+        m_LevelAnalysis.SetHistogramBucketWidth(m_TaskPool, 1 << bucketWidthIdx);
+    ImGui::SetItemTooltip("Levels per bucket, changing it clears histograms.\n"
+        "Histograms cover %d levels around the DAC threshold, levels outside are clamped into the first and last buckets.\n"
+        "Widths of 32 and more cover the whole ADC range.", LeydenJarLevelHistograms::kNbBuckets * (1 << bucketWidthIdx));
+
+    if (ImGui::Button("Clear Histograms", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        m_LevelAnalysis.ClearHistograms(m_TaskPool);
+        m_HistogramExportStatus.clear();
+    }
+
+    if (ImGui::Button("Export Histograms to CSV", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        char fileName[64];
+        std::time_t now = std::time(nullptr);
+        std::strftime(fileName, sizeof(fileName), "level_histograms_%Y%m%d_%H%M%S.csv", std::localtime(&now));
+
+        if (m_LevelAnalysis.ExportHistograms(m_TaskPool, fileName))
+            m_HistogramExportStatus = std::string("Exported to ") + fileName;
+        else
+            m_HistogramExportStatus = std::string("Could not write ") + fileName;
+    }
+
+    if (m_HistogramExportStatus.empty() == false)
+        ImGui::TextWrapped("%s", m_HistogramExportStatus.c_str());
+    else
+        ImGui::TextDisabled("Click a key to show its histogram");
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawChatterDetection()
+{
+    ImGui::SeparatorText("Chatter Detection");
+
+    float windowMs = m_ChatterConfig.windowUs / 1000.f;
+    int nbCrossings = m_ChatterConfig.nbCrossings;
+
+    bool configChanged = ImGui::SliderFloat("Chatter window", &windowMs, 0.5f, 100.f, "%.1f ms", ImGuiSliderFlags_Logarithmic);
+    ImGui::SetItemTooltip("Key edges closer than this are counted as bounces");
+    configChanged |= ImGui::SliderInt("Crossings", &nbCrossings, 2, LeydenJarChatterDetector::kMaxCrossings);
+    ImGui::SetItemTooltip("Threshold crossings within the window counted as a level oscillation");
+
+    if (configChanged)
+    {
+        m_ChatterConfig.windowUs = uint32_t(windowMs * 1000.f);
+        m_ChatterConfig.nbCrossings = uint8_t(nbCrossings);
+        m_pAgent->RequestChatterConfiguration(m_ChatterConfig);
+        m_pAgent->WaitEndRequest();
+        m_ChatterConfig = m_pAgent->GetChatterConfiguration();
+    }
+
+    if (ImGui::Button("Reset Chatter Counters", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        m_pAgent->RequestChatterReset();
+        m_pAgent->WaitEndRequest();
+        std::memset(m_ChatterCounters, 0, sizeof(m_ChatterCounters));
+    }
+
+    // Keys with the most events first, only a few of them are listed
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+    int chatteringKeys[LeydenJarChatterDetector::kNbKeys];
+    int nbChatteringKeys = 0;
+
+    for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
+    {
+        for (int row = 0; row < pDeviceInfo->nbPhysicalRows; row++)
+        {
+            const LeydenJarChatterDetector::LeydenJarKeyChatterCounters& counters = m_ChatterCounters[col * 8 + row];
+            if (counters.nbBounces != 0 || counters.nbOscillations != 0)
+                chatteringKeys[nbChatteringKeys++] = col * 8 + row;
+        }
+    }
+
+    std::sort(chatteringKeys, chatteringKeys + nbChatteringKeys, [this](int key0, int key1)
+        { return m_ChatterCounters[key0].nbBounces + m_ChatterCounters[key0].nbOscillations > m_ChatterCounters[key1].nbBounces + m_ChatterCounters[key1].nbOscillations; });
+
+    ImGui::Text("Chattering keys: %d", nbChatteringKeys);
+    for (int i = 0; i < std::min(nbChatteringKeys, 5); i++)
+    {
+        const LeydenJarChatterDetector::LeydenJarKeyChatterCounters& counters = m_ChatterCounters[chatteringKeys[i]];
+        ImGui::Text("C%d R%d: %u bounces, %u oscillations, min %.1f ms", chatteringKeys[i] / 8, chatteringKeys[i] % 8,
+            counters.nbBounces, counters.nbOscillations, counters.minEdgeIntervalUs / 1000.f);
+    }
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawLatencyMeasurement()
+{
+    static const char* stageNames[LeydenJarLatencyMeter::LatencyStageCount] = { "Level to physical", "Physical to logical", "Level to logical" };
+
+    ImGui::SeparatorText("Latency Measurement");
+
+    if (ImGui::Checkbox("Measure latencies", &m_LatencyMeasurement))
+        m_LatencyRequestSent = false;
+    ImGui::SetItemTooltip("Reads levels, physical and logical matrices back to back and correlates key edges between them");
+
+    int timeoutMs = int(m_LatencyConfig.timeoutMs);
+    bool configChanged = ImGui::Checkbox("Include levels", &m_LatencyConfig.measureLevels);
+    ImGui::SetItemTooltip("Levels are slow to read, without them physical to logical latencies have a finer resolution");
+    configChanged |= ImGui::SliderInt("Edge timeout", &timeoutMs, 5, 500, "%d ms");
+    ImGui::SetItemTooltip("Edges of a key farther apart than this are not correlated");
+
+    if (configChanged)
+    {
+        m_LatencyConfig.timeoutMs = uint32_t(timeoutMs);
+        m_pAgent->RequestLatencyConfiguration(m_LatencyConfig);
+        m_pAgent->WaitEndRequest();
+        m_LatencyConfig = m_pAgent->GetLatencyConfiguration();
+        std::memset(m_KeyLatencies, 0, sizeof(m_KeyLatencies));
+    }
+
+    if (ImGui::Button("Reset Latencies", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        m_pAgent->RequestLatencyReset();
+        m_pAgent->WaitEndRequest();
+        std::memset(m_KeyLatencies, 0, sizeof(m_KeyLatencies));
+    }
+
+    if (m_LatencyMeasurement == false)
+        return;
+
+    LeydenJarAgent::LeydenJarFrameTiming latencyTiming = m_pAgent->GetLatencyTiming();
+    if (latencyTiming.nbCommands != 0)
+        ImGui::Text("Resolution: %.2f ms per cycle", (latencyTiming.acquisitionEndNs - latencyTiming.acquisitionStartNs) / 1000000.0);
+
+    // All keys together, percentiles of different keys can not be merged so the worst key P95 is shown
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+    for (int stage = 0; stage < LeydenJarLatencyMeter::LatencyStageCount; stage++)
+    {
+        for (int edge = 0; edge < LeydenJarLatencyMeter::LatencyEdgeCount; edge++)
+        {
+            uint32_t nbEdges = 0;
+            double sumMs = 0.0;
+            float worstP95Ms = 0.f;
+
+            for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
+            {
+                for (int row = 0; row < pDeviceInfo->nbPhysicalRows; row++)
+                {
+                    const LeydenJarLatencyMeter::LeydenJarLatencySummary& summary = m_KeyLatencies[col * 8 + row].stages[stage][edge];
+                    nbEdges += summary.nbEdges;
+                    sumMs += double(summary.meanMs) * summary.nbEdges;
+                    worstP95Ms = std::max(worstP95Ms, summary.p95Ms);
+                }
+            }
+
+            if (nbEdges != 0)
+                ImGui::Text("%s %s: %u edges, mean %.2f ms, worst P95 %.2f ms", stageNames[stage], edge == LeydenJarLatencyMeter::LatencyEdgePress ? "press" : "release",
+                    nbEdges, sumMs / nbEdges, worstP95Ms);
+        }
+    }
+
+    // Physical to logical is the firmware debounce delay, slowest keys are listed
+    int measuredKeys[LeydenJarLatencyMeter::kNbKeys];
+    int nbMeasuredKeys = 0;
+
+    for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
+        for (int row = 0; row < pDeviceInfo->nbPhysicalRows; row++)
+            if (m_KeyLatencies[col * 8 + row].stages[LeydenJarLatencyMeter::LatencyPhysicalToLogical][LeydenJarLatencyMeter::LatencyEdgePress].nbEdges != 0)
+                measuredKeys[nbMeasuredKeys++] = col * 8 + row;
+
+    std::sort(measuredKeys, measuredKeys + nbMeasuredKeys, [this](int key0, int key1)
+        { return m_KeyLatencies[key0].stages[LeydenJarLatencyMeter::LatencyPhysicalToLogical][LeydenJarLatencyMeter::LatencyEdgePress].p95Ms >
+                 m_KeyLatencies[key1].stages[LeydenJarLatencyMeter::LatencyPhysicalToLogical][LeydenJarLatencyMeter::LatencyEdgePress].p95Ms; });
+
+    ImGui::Text("Measured keys: %d", nbMeasuredKeys);
+    for (int i = 0; i < std::min(nbMeasuredKeys, 5); i++)
+    {
+        const LeydenJarLatencyMeter::LeydenJarLatencySummary& press = m_KeyLatencies[measuredKeys[i]].stages[LeydenJarLatencyMeter::LatencyPhysicalToLogical][LeydenJarLatencyMeter::LatencyEdgePress];
+        const LeydenJarLatencyMeter::LeydenJarLatencySummary& release = m_KeyLatencies[measuredKeys[i]].stages[LeydenJarLatencyMeter::LatencyPhysicalToLogical][LeydenJarLatencyMeter::LatencyEdgeRelease];
+        ImGui::Text("C%d R%d: press median %.2f, P95 %.2f ms, release median %.2f, P95 %.2f ms", measuredKeys[i] / 8, measuredKeys[i] % 8,
+            press.medianMs, press.p95Ms, release.medianMs, release.p95Ms);
+    }
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawThresholdAdvisor()
+{
+    ImGui::SeparatorText("Threshold Advisor");
+
+    if (ImGui::Button("Reset Threshold Advisor", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+        m_LevelAnalysis.ResetThresholdAdvisor(m_TaskPool);
+
+    if (m_KeyboardLevelsAcquired == false)
+        return;
+
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+
+    for (int bin = 0; bin < pDeviceInfo->nbBins && bin < 16; bin++)
+    {
+        const LeydenJarThresholdAdvisor::LeydenJarBinRecommendation& recommendation = m_LevelResults.binRecommendations[bin];
+
+        if (recommendation.nbKeys == 0)
+            continue;
+
+        if (recommendation.isValid == false)
+        {
+            ImGui::Text("Bin %d: press its keys (%llu unpressed, %llu pressed samples)", bin,
+                (unsigned long long)recommendation.unpressed.nbSamples, (unsigned long long)recommendation.pressed.nbSamples);
+            continue;
+        }
+
+        ImGui::Text("Bin %d: threshold %d, recommended %d (margin %.1f sigma)", bin, recommendation.currentThreshold, recommendation.recommendedThreshold, recommendation.marginSigma);
+        ImGui::Text("  unpressed %.1f +/- %.2f (worst %d), pressed %.1f +/- %.2f (worst %d)",
+            recommendation.unpressed.mean, recommendation.unpressed.stdDev, recommendation.unpressed.worstLevel,
+            recommendation.pressed.mean, recommendation.pressed.stdDev, recommendation.pressed.worstLevel);
+        ImGui::Text("  false press %.1e -> %.1e, missed press %.1e -> %.1e",
+            recommendation.currentFalsePressRate, recommendation.falsePressRate, recommendation.currentMissedPressRate, recommendation.missedPressRate);
+    }
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawDriftTracking()
+{
+    ImGui::SeparatorText("Drift Tracking");
+
+    LeydenJarDriftTracker::LeydenJarDriftConfig config = m_LevelAnalysis.GetDriftConfig();
+    float fastTimeConstantMin = config.fastTimeConstantS / 60.f;
+    float slowTimeConstantMin = config.slowTimeConstantS / 60.f;
+
+    bool configChanged = ImGui::SliderFloat("Fast average", &fastTimeConstantMin, 0.1f, 60.f, "%.1f min", ImGuiSliderFlags_Logarithmic);
+    ImGui::SetItemTooltip("Time constant of the key baseline");
+    configChanged |= ImGui::SliderFloat("Slow average", &slowTimeConstantMin, 1.f, 600.f, "%.1f min", ImGuiSliderFlags_Logarithmic);
+    ImGui::SetItemTooltip("Time constant the baseline is compared to for the drift rate, rates are valid after that time");
+    configChanged |= ImGui::SliderFloat("Warning horizon", &config.warningHorizonH, 0.5f, 72.f, "%.1f h", ImGuiSliderFlags_Logarithmic);
+    ImGui::SetItemTooltip("Keys reaching their DAC threshold within this time are reported");
+
+    if (configChanged)
+    {
+        config.fastTimeConstantS = fastTimeConstantMin * 60.f;
+        config.slowTimeConstantS = slowTimeConstantMin * 60.f;
+        m_LevelAnalysis.SetDriftConfig(m_TaskPool, config);
+    }
+
+    if (ImGui::Button("Reset Baselines", ImVec2(ImGui::GetContentRegionAvail().x * 0.5f, 0)))
+        m_LevelAnalysis.ResetDriftTracker(m_TaskPool);
+    ImGui::SameLine();
+    if (ImGui::Button("Reset Min/Max", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        m_LevelAnalysis.ResetMinMax(m_TaskPool);
+        std::memset(&m_LevelResults.minLevels, 0xFF, sizeof(m_LevelResults.minLevels));
+        std::memset(&m_LevelResults.maxLevels, 0, sizeof(m_LevelResults.maxLevels));
+    }
+
+    if (m_KeyboardLevelsAcquired == false)
+        return;
+
+    // Keys closest to their threshold first, only a few of them are listed
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+    int driftingKeys[LeydenJarDriftTracker::kNbKeys];
+    int nbDriftingKeys = 0;
+    int nbValidKeys = 0;
+
+    for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
+    {
+        for (int row = 0; row < pDeviceInfo->nbPhysicalRows; row++)
+        {
+            if (m_LevelResults.drift[col][row].isValid)
+                nbValidKeys++;
+            if (m_LevelResults.drift[col][row].isDrifting)
+                driftingKeys[nbDriftingKeys++] = col * 8 + row;
+        }
+    }
+
+    if (nbValidKeys == 0)
+    {
+        ImGui::TextDisabled("Rates are estimated after %.1f min of unpressed levels", slowTimeConstantMin);
+        return;
+    }
+
+    std::sort(driftingKeys, driftingKeys + nbDriftingKeys, [this](int key0, int key1)
+        { return m_LevelResults.drift[key0 / 8][key0 % 8].timeToThresholdH < m_LevelResults.drift[key1 / 8][key1 % 8].timeToThresholdH; });
+
+    ImGui::Text("Drifting keys: %d", nbDriftingKeys);
+    for (int i = 0; i < std::min(nbDriftingKeys, 5); i++)
+    {
+        const LeydenJarDriftTracker::LeydenJarKeyDrift& drift = m_LevelResults.drift[driftingKeys[i] / 8][driftingKeys[i] % 8];
+        ImGui::Text("C%d R%d: baseline %.1f, %+.2f/h, threshold in %.1f h", driftingKeys[i] / 8, driftingKeys[i] % 8,
+            drift.baseline, drift.ratePerHour, drift.timeToThresholdH);
+    }
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawLevelPlot()
+{
+    ImGui::SeparatorText("Level Oscilloscope");
+
+    ImGui::Checkbox("Show plot", &m_LevelPlot);
+    ImGui::SetItemTooltip("Right click keys to add them to or remove them from the plot, up to %d keys", LeydenJarLevelHistory::kMaxTraces);
+    ImGui::SameLine();
+    if (ImGui::Checkbox("Pause", &m_LevelPlotPaused) && m_LevelPlotPaused)
+    {
+        uint64_t firstNs;
+        if (m_LevelHistory.GetTimeRange(firstNs, m_LevelPlotPausedEndNs) == false)
+            m_LevelPlotPaused = false;
+    }
+    ImGui::SetItemTooltip("Freezes the plot, levels are still recorded");
+
+    ImGui::SliderFloat("Time window", &m_LevelPlotWindowS, 0.1f, 3600.f, "%.1f s", ImGuiSliderFlags_Logarithmic);
+    ImGui::SetItemTooltip("Time span of the plot, mouse wheel over the plot zooms it");
+
+    for (int trace = 0; trace < m_LevelHistory.GetNbTraces(); trace++)
+    {
+        int col;
+        int row;
+        m_LevelHistory.GetTraceKey(trace, col, row);
+        if (trace % 4 != 0)
+            ImGui::SameLine();
+        ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(s_LevelPlotColors[trace]), "C%d R%d", col, row);
+    }
+
+    if (ImGui::Button("Clear Keys", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+        m_LevelHistory.ClearKeys();
+
+    ImGui::Text("History: %llu of %u frames", (unsigned long long)m_LevelHistory.GetNbRetainedFrames(), m_LevelHistory.GetCapacity());
+}
+
+void LeydenJarDiagnosticTool::StartRecording()
+{
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+    LeydenJarRecordingHeader header;
+
+    InitRecordingHeader(header);
+    header.nbPhysicalCols = pDeviceInfo->nbPhysicalCols;
+    header.nbPhysicalRows = pDeviceInfo->nbPhysicalRows;
+    header.nbLogicalRows = pDeviceInfo->nbLogicalRows;
+    header.switchTechnology = pDeviceInfo->switchTechnology;
+    header.nbBins = pDeviceInfo->nbBins;
+    std::memcpy(header.dacThreshold, pDeviceInfo->dacThreshold, sizeof(header.dacThreshold));
+    std::memcpy(header.binningMap, pDeviceInfo->binningMap, sizeof(header.binningMap));
+
+    char fileName[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(fileName, sizeof(fileName), "levels_%Y%m%d_%H%M%S.ljr", std::localtime(&now));
+
+    if (m_Recorder.Start(fileName, header) == false)
+    {
+        m_RecordingStatus = std::string("Could not create ") + fileName;
+        return;
+    }
+
+    m_pRecordingAgent = m_pAgent;
+    m_pRecordingAgent->RequestRecorder(&m_Recorder);
+    m_pRecordingAgent->WaitEndRequest();
+    m_RecordingStatus = fileName;
+}
+
+void LeydenJarDiagnosticTool::StopRecording()
+{
+    if (m_pRecordingAgent == nullptr)
+        return;
+
+    // The agent lets go of the recorder before it is stopped
+    m_pRecordingAgent->RequestRecorder(nullptr);
+    m_pRecordingAgent->WaitEndRequest();
+    m_pRecordingAgent = nullptr;
+    m_Recorder.Stop();
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawRecorder()
+{
+    ImGui::SeparatorText("Recorder");
+
+    if (m_pRecordingAgent == nullptr)
+    {
+        if (ImGui::Button("Start Recording", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+            StartRecording();
+    }
+    else
+    {
+        if (ImGui::Button("Stop Recording", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+            StopRecording();
+    }
+
+    if (m_RecordingStatus.empty())
+        return;
+
+    LeydenJarRecorder::LeydenJarRecorderStats stats = m_Recorder.GetStats();
+
+    ImGui::TextWrapped("%s", m_RecordingStatus.c_str());
+    ImGui::Text("Level frames: %llu, scans: %llu", (unsigned long long)stats.nbRecords[LeydenJarRecordLevels],
+        (unsigned long long)(stats.nbRecords[LeydenJarRecordPhysical] + stats.nbRecords[LeydenJarRecordLogical]));
+    ImGui::Text("Written: %.2f MB (raw %.2f MB)", stats.nbWrittenBytes / (1024.0 * 1024.0), stats.nbRawBytes / (1024.0 * 1024.0));
+    if (stats.nbDroppedRecords != 0)
+        ImGui::Text("Dropped records: %llu", (unsigned long long)stats.nbDroppedRecords);
+    if (stats.isWriteError)
+        ImGui::Text("Write error, recording is incomplete");
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawAgentThreadOptions()
+{
+    ImGui::SeparatorText("Agent Thread");
+
+    ImGui::Checkbox("Real-time scheduling", &m_AgentRealTime);
+    ImGui::InputInt("CPU core", &m_AgentCpuCore);
+    ImGui::SetItemTooltip("Core the agent thread is pinned on, -1 lets the OS choose");
+    if (m_AgentCpuCore < -1)
+        m_AgentCpuCore = -1;
+
+    if (ImGui::Button("Apply Thread Options", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        m_pAgent->RequestThreadConfiguration(m_AgentRealTime, m_AgentCpuCore);
+        m_pAgent->WaitEndRequest();
+
+        // Restart skew measurement so that the effect of the new options can be compared
+        m_ColumnSkewCount = 0;
+        m_ColumnSkewMean = 0.0;
+        m_ColumnSkewM2 = 0.0;
+    }
+
+    LeydenJarSchedulingStatus status = m_pAgent->GetThreadSchedulingStatus();
+    ImGui::Text("Policy: %s (priority %d)", GetSchedulingPolicyName(status.policy), status.priority);
+    if (status.cpuCore >= 0)
+        ImGui::Text("Pinned on core %d", status.cpuCore);
+    else
+        ImGui::Text("Not pinned");
+
+    if (m_ColumnSkewCount > 1)
+        ImGui::Text("Column skew: %.0f us (stddev %.0f us)", m_ColumnSkewMean, std::sqrt(m_ColumnSkewM2 / (m_ColumnSkewCount - 1)));
+}
+
+void LeydenJarDiagnosticTool::UpdateFrameTiming(const LeydenJarAgent::LeydenJarFrameTiming& frameTiming)
+{
+    if (frameTiming.frameIndex == m_FrameTiming.frameIndex)
+        return;
+
+    // Rate is measured between consecutive frames of the same stream only
+    if (m_FrameTiming.nbCommands != 0 && frameTiming.frameIndex == m_FrameTiming.frameIndex + 1 && frameTiming.acquisitionStartNs > m_FrameTiming.acquisitionStartNs)
+        m_FrameRate = float(1000000000.0 / (frameTiming.acquisitionStartNs - m_FrameTiming.acquisitionStartNs));
+
+    m_FrameTiming = frameTiming;
+}
+
 void LeydenJarDiagnosticTool::LeftPaneRenderingDeviceDescription()
 {
     ImGui::SeparatorText("Device List");
 
     if (ImGui::BeginListBox("Device List", ImVec2(-FLT_MIN, 5 * ImGui::GetTextLineHeightWithSpacing())))
     {
-        for (int n = 0; n < m_Agent.GetNbEnumeratedDevices(); n++)
+        for (int n = 0; n < m_SessionManager.GetNbEnumeratedDevices(); n++)
         {
             const bool is_selected = (m_SelectedDeviceIndex == n) || (m_SelectedDeviceIndex == -1);
-            bool selectionChanged = ImGui::Selectable(m_DeviceListNames[n], is_selected) || (m_SelectedDeviceIndex == -1);
+            bool selectionChanged = ImGui::Selectable(m_DeviceListNames[n].c_str(), is_selected) || (m_SelectedDeviceIndex == -1);
 
-            ImGui::SetItemTooltip(m_DeviceListNames[n]);
+            if (m_SessionManager.GetSession(n) != nullptr)
+                ImGui::SetItemTooltip("%s (session opened)", m_DeviceListNames[n].c_str());
+            else
+                ImGui::SetItemTooltip("%s", m_DeviceListNames[n].c_str());
 
             if (selectionChanged)
             {
                 m_SelectedDeviceIndex = n;
-                
-                if (m_Agent.IsDeviceOpened())
-                {
-                    m_Agent.RequestEnable();
-                    m_Agent.WaitEndRequest();
-                }
-
-                m_Agent.RequestDeviceConnection(m_SelectedDeviceIndex);
-                m_Agent.WaitEndRequest();
-
-                m_Agent.RequestDisable();
-                m_Agent.WaitEndRequest();
+                StopRecording();
+
+                // Previously selected devices stay opened in their own session, connection is only done once per device
+                m_pAgent = m_SessionManager.OpenSession(m_SelectedDeviceIndex);
+                if (m_pAgent == nullptr)
+                    m_pAgent = m_SessionManager.GetEnumerationAgent();
+                m_RateConfig = m_pAgent->GetRateConfiguration();
+                m_ChatterConfig = m_pAgent->GetChatterConfiguration();
+                std::memset(m_ChatterCounters, 0, sizeof(m_ChatterCounters));
+                m_LatencyConfig = m_pAgent->GetLatencyConfiguration();
+                std::memset(m_KeyLatencies, 0, sizeof(m_KeyLatencies));
+                m_LatencyRequestSent = false;
 
                 ImGui::SetItemDefaultFocus();
                 
                 m_VialUncompressedKeyboardDefinitionSize = 0;
                 m_LayoutOptions.clear();
                 m_Keys.clear();
+                m_KeyboardLayoutGeometry.Invalidate();
                 std::memset(m_LogicKeyboardState, 0, sizeof(m_LogicKeyboardState));
                 std::memset(m_PhysicalKeyboardState, 0, sizeof(m_PhysicalKeyboardState));
                 m_LogicalKeyboardStateRequestSent = false;
                 m_PhysicalKeyboardStateRequestSent = false;
                 m_KeyboardLevelsRequestSent = false;
                 m_KeyboardLevelsAcquired = false;
-                m_CurLevelIdx = -1;
-                std::memset(m_CurLevels, 0, sizeof(m_CurLevels));
-                std::memset(m_MinLevels, 0xFF, sizeof(m_MinLevels));
-                std::memset(m_MaxLevels, 0, sizeof(m_MaxLevels));
+                ResetLevelAnalysis();
+                std::memset(&m_FrameTiming, 0, sizeof(m_FrameTiming));
+                m_FrameRate = 0.f;
             }
         }
         ImGui::EndListBox();
     }
 
-    if (ImGui::Button("Refresh Device List", ImVec2(-FLT_MIN, 0)))
+    if (ImGui::Button("Refresh Device List", ImVec2(ImGui::GetContentRegionAvail().x * 0.5f, 0)))
     {
         RefreshDeviceList();
     }
+    ImGui::SameLine();
+    if (ImGui::Button("Open All Devices", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        m_SessionManager.OpenAllSessions();
+    }
+    ImGui::Text("Opened sessions: %d/%d", m_SessionManager.GetNbOpenedSessions(), m_SessionManager.GetNbEnumeratedDevices());
+    ImGui::BeginDisabled(m_SessionManager.GetNbOpenedSessions() == 0);
+    if (ImGui::Button("Dashboard", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        StopRecording();
+        m_CurrentLeftPaneLayout = LeftPaneLayoutDashboard;
+    }
+    ImGui::SetItemTooltip("Live thumbnails of all opened sessions");
+    ImGui::EndDisabled();
 
     ImGui::SeparatorText("Device actions");
 
     if (ImGui::Button("Enter Bootloader", ImVec2(ImGui::GetContentRegionAvail().x * 0.5f, 0)))
     {
-        if (m_Agent.IsDeviceOpened())
+        if (m_pAgent->IsDeviceOpened())
         {
-            m_Agent.RequestEnterBootloader();
-            m_Agent.WaitEndRequest();
+            m_pAgent->RequestEnterBootloader();
+            m_pAgent->WaitEndRequest();
         }
     }
     ImGui::SameLine();
     if (ImGui::Button("Erase EEPROM", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
     {
-        if (m_Agent.IsDeviceOpened())
+        if (m_pAgent->IsDeviceOpened())
         {
-            m_Agent.RequestEraseEeprom();
-            m_Agent.WaitEndRequest();
+            m_pAgent->RequestEraseEeprom();
+            m_pAgent->WaitEndRequest();
         }
     }
     if (ImGui::Button("Keypress Monitor", ImVec2(ImGui::GetContentRegionAvail().x * 0.5f, 0)))
     {
-        if (m_Agent.IsDeviceOpened())
+        if (m_pAgent->IsDeviceOpened())
         {
             m_CurrentLeftPaneLayout = LeftPaneLayoutKeyPressMonitor;
         }
@@ -482,15 +923,15 @@ void LeydenJarDiagnosticTool::LeftPaneRenderingDeviceDescription()
     ImGui::SameLine();
     if (ImGui::Button("Level Monitor", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
     {
-        if (m_Agent.IsDeviceOpened())
+        if (m_pAgent->IsDeviceOpened())
         {
             m_CurrentLeftPaneLayout = LeftPaneLayoutSignalMonitor;
         }
     }
 
-    if (m_Agent.IsDeviceOpened())
+    if (m_pAgent->IsDeviceOpened())
     {
-        const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_Agent.GetDeviceInfo();
+        const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
 
         LeftPaneDrawLeydenJarInfos();
 
@@ -528,52 +969,378 @@ void LeydenJarDiagnosticTool::LeftPaneRenderingDeviceDescription()
         ImGui::Text("Usage: 0x%04x", pDeviceInfo->pHidDeviceInfo->usage);
         ImGui::Text("Manufacturer String: %S", pDeviceInfo->pHidDeviceInfo->manufacturer_string);
 
-        LeftPaneDrawViaLayoutOptions();
-    }
+        LeftPaneDrawViaLayoutOptions();
+    }
+}
+
+void LeydenJarDiagnosticTool::LeftPaneRenderingKeyPresses()
+{
+    if (ImGui::Button("Device List", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        m_CurrentLeftPaneLayout = LeftPaneLayoutDeciveDescription;
+    }
+    if (ImGui::Button("Level Monitor", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        m_CurrentLeftPaneLayout = LeftPaneLayoutSignalMonitor;
+    }
+    
+    ImGui::SeparatorText("");
+
+    const char* comboItems[3] = { "Keyboard Layout", "QMK Matrix", "Physical Matrix" };
+    ImGui::Combo("View Type", &m_RightPaneViewType, comboItems, 3);
+
+    LeftPaneDrawAcquisitionTiming();
+
+    LeftPaneDrawLatencyMeasurement();
+
+    LeftPaneDrawChatterDetection();
+
+    LeftPaneDrawRecorder();
+
+    LeftPaneDrawRateControllerOptions();
+
+    LeftPaneDrawDisplayOptions();
+
+    LeftPaneDrawLeydenJarInfos();
+
+    if (m_RightPaneViewType == RightPaneViewKeyboardLayout)
+        LeftPaneDrawViaLayoutOptions();
+}
+
+void LeydenJarDiagnosticTool::LeftPaneDrawDisplayOptions()
+{
+    ImGui::SeparatorText("Display");
+
+    ImGui::SliderInt("Max refresh", &m_MaxRefreshRate, 5, 240, "%d Hz");
+    ImGui::SetItemTooltip("Monitors are redrawn when new data is received, at most at this rate");
+    if (m_MaxRefreshRate < 1)
+        m_MaxRefreshRate = 1;
+
+    ImGui::Checkbox("Profiler overlay (F12)", &m_ProfilerOverlay);
+    ImGui::SetItemTooltip("Frame times, durations of the instrumented zones and HID round trips");
+}
+
+void LeydenJarDiagnosticTool::DrawProfilerOverlay()
+{
+    ImGui::SetNextWindowPos(ImVec2(ImGui::GetIO().DisplaySize.x - 10.f, 30.f), ImGuiCond_FirstUseEver, ImVec2(1.f, 0.f));
+    ImGui::SetNextWindowBgAlpha(0.9f);
+    if (ImGui::Begin("Profiler", &m_ProfilerOverlay, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing) == false)
+    {
+        ImGui::End();
+        return;
+    }
+
+    // Statistics are computed on the last 2 seconds, graphs show the last frames
+    uint64_t statsWindowNs = 2000000000ull;
+    uint64_t nowNs = LeydenJarProfiler::GetTimestampNs();
+    const int nbGraphFrames = 240;
+    float graphValues[nbGraphFrames];
+    char overlayString[64];
+
+    for (int zone = LeydenJarProfiler::ProfileZoneFrame; zone <= LeydenJarProfiler::ProfileZoneRunStep; zone++)
+    {
+        LeydenJarProfiler::GetSamples(zone, 0, m_ProfilerSamples);
+        int nbValues = std::min(int(m_ProfilerSamples.size()), nbGraphFrames);
+        size_t firstSample = m_ProfilerSamples.size() - nbValues;
+        for (int valueIdx = 0; valueIdx < nbValues; valueIdx++)
+            graphValues[valueIdx] = m_ProfilerSamples[firstSample + valueIdx].durationNs / 1000000.f;
+
+        sprintf(overlayString, "%s: %.2f ms", LeydenJarProfiler::GetZoneName(zone), nbValues > 0 ? graphValues[nbValues - 1] : 0.f);
+        ImGui::PushID(zone);
+        ImGui::PlotLines("##FrameTimes", graphValues, nbValues, 0, overlayString, 0.f, 33.f, ImVec2(400.f, 60.f));
+        ImGui::PopID();
+    }
+
+    if (ImGui::BeginTable("Profiler Zones", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("Zone");
+        ImGui::TableSetupColumn("Rate");
+        ImGui::TableSetupColumn("Mean");
+        ImGui::TableSetupColumn("P50");
+        ImGui::TableSetupColumn("P90");
+        ImGui::TableSetupColumn("P99");
+        ImGui::TableSetupColumn("Max");
+        ImGui::TableHeadersRow();
+
+        for (int zone = 0; zone < LeydenJarProfiler::ProfileZoneCount; zone++)
+        {
+            LeydenJarProfiler::LeydenJarZoneStats stats;
+            LeydenJarProfiler::GetSamples(zone, nowNs - statsWindowNs, m_ProfilerSamples);
+            LeydenJarProfiler::ComputeStats(m_ProfilerSamples, statsWindowNs, stats);
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(LeydenJarProfiler::GetZoneName(zone));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f/s", stats.rateHz);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f us", stats.meanUs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f us", stats.p50Us);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f us", stats.p90Us);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f us", stats.p99Us);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f us", stats.maxUs);
+        }
+        ImGui::EndTable();
+    }
+
+    if (m_pAgent->IsDeviceOpened() && m_CurrentLeftPaneLayout != LeftPaneLayoutDeciveDescription)
+        ImGui::Text("Achieved sample rate: %.1f Hz, target %.1f Hz", m_FrameRate, m_pAgent->GetCurrentScanRate());
+
+    // HID round trips in 125 us buckets up to 8 ms
+    const int nbHidBuckets = 64;
+    float hidCounts[nbHidBuckets];
+    LeydenJarProfiler::GetSamples(LeydenJarProfiler::ProfileZoneHidRoundTrip, nowNs - statsWindowNs, m_ProfilerSamples);
+    LeydenJarProfiler::ComputeHistogram(m_ProfilerSamples, 125, nbHidBuckets, hidCounts);
+    sprintf(overlayString, "HID round trips, 0 to 8 ms, %u samples", unsigned(m_ProfilerSamples.size()));
+    ImGui::PlotHistogram("##HidRoundTrips", hidCounts, nbHidBuckets, 0, overlayString, 0.f, FLT_MAX, ImVec2(400.f, 80.f));
+
+    ImGui::End();
+}
+
+void LeydenJarDiagnosticTool::LeftPaneRenderingSignalLevels()
+{
+    if (ImGui::Button("Device List", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        m_CurrentLeftPaneLayout = LeftPaneLayoutDeciveDescription;
+    }
+    if (ImGui::Button("Keypress Monitor", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        m_CurrentLeftPaneLayout = LeftPaneLayoutKeyPressMonitor;
+    }
+
+    ImGui::SeparatorText("");
+
+    const char* comboItems[3] = { "Keyboard Layout", "QMK Matrix", "Physical Matrix" };
+    ImGui::Combo("View Type", &m_RightPaneViewType, comboItems, 3);
+
+    ImGui::BeginDisabled(!m_HeatmapRenderer.IsInitialized());
+    ImGui::Checkbox("Level heatmap", &m_LevelHeatmap);
+    ImGui::SetItemTooltip("Colours keys with a continuous ramp from their session min level to their session max level through the threshold");
+    ImGui::EndDisabled();
+
+    if (m_RightPaneViewType == RightPaneViewKeyboardLayout)
+        LeftPaneDrawViaLayoutOptions();
+
+    LeftPaneDrawAcquisitionTiming();
+
+    LeftPaneDrawKeyStatistics();
+
+    LeftPaneDrawLevelHistograms();
+
+    LeftPaneDrawThresholdAdvisor();
+
+    LeftPaneDrawDriftTracking();
+
+    LeftPaneDrawLevelPlot();
+
+    LeftPaneDrawChatterDetection();
+
+    LeftPaneDrawRecorder();
+
+    LeftPaneDrawRateControllerOptions();
+
+    LeftPaneDrawDisplayOptions();
+
+    LeftPaneDrawAgentThreadOptions();
+
+    LeftPaneDrawLeydenJarInfos();
 }
 
-void LeydenJarDiagnosticTool::LeftPaneRenderingKeyPresses()
+void LeydenJarDiagnosticTool::LeftPaneRenderingDashboard()
 {
     if (ImGui::Button("Device List", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
     {
         m_CurrentLeftPaneLayout = LeftPaneLayoutDeciveDescription;
     }
-    if (ImGui::Button("Level Monitor", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+
+    ImGui::SeparatorText("Dashboard");
+
+    const char* comboItems[2] = { "Key States", "Level Heatmaps" };
+    int tileContent = m_DashboardLevels ? 1 : 0;
+    if (ImGui::Combo("Tiles", &tileContent, comboItems, 2))
+        m_DashboardLevels = tileContent == 1;
+    ImGui::SliderInt("Tile width", &m_DashboardTileWidth, 40, 480, "%d px");
+    ImGui::SetItemTooltip("Small tiles drop key outlines, then key details");
+
+    if (ImGui::Button("Expand All", ImVec2(ImGui::GetContentRegionAvail().x * 0.5f, 0)))
     {
-        m_CurrentLeftPaneLayout = LeftPaneLayoutSignalMonitor;
+        for (size_t tileIdx = 0; tileIdx < m_DashboardTiles.size(); tileIdx++)
+            m_DashboardTiles[tileIdx].isCollapsed = false;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Collapse All", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    {
+        for (size_t tileIdx = 0; tileIdx < m_DashboardTiles.size(); tileIdx++)
+            m_DashboardTiles[tileIdx].isCollapsed = true;
     }
-    
-    ImGui::SeparatorText("");
 
-    const char* comboItems[3] = { "Keyboard Layout", "QMK Matrix", "Physical Matrix" };
-    ImGui::Combo("View Type", &m_RightPaneViewType, comboItems, 3);
+    ImGui::Text("Opened sessions: %d, visible: %d", m_SessionManager.GetNbOpenedSessions(), m_DashboardNbVisibleTiles);
+    ImGui::TextDisabled("Click a tile title to collapse it");
 
-    LeftPaneDrawLeydenJarInfos();
+    LeftPaneDrawDisplayOptions();
+}
 
-    if (m_RightPaneViewType == RightPaneViewKeyboardLayout)
-        LeftPaneDrawViaLayoutOptions();
+void LeydenJarDiagnosticTool::RightPaneRenderingDashboard()
+{
+    ImGuiStyle& style = ImGui::GetStyle();
+    float tileWidth = float(m_DashboardTileWidth);
+    float titleHeight = ImGui::GetTextLineHeightWithSpacing();
+    // Keys are drawn on a 18 x 8 grid of square cells, whatever the device matrix size
+    float bodyHeight = tileWidth * 8.f / 18.f;
+    int nbTileCols = std::max(1, int((ImGui::GetContentRegionAvail().x + style.ItemSpacing.x) / (tileWidth + style.ItemSpacing.x)));
+
+    // Tiles are placed on a grid of opened sessions, a row is as high as its highest tile
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    float rowY = pos.y;
+    float rowHeight = 0.f;
+    int tileCol = 0;
+
+    m_DashboardNbVisibleTiles = 0;
+    for (int deviceIndex = 0; deviceIndex < int(m_DashboardTiles.size()); deviceIndex++)
+    {
+        LeydenJarAgent* pAgent = m_SessionManager.GetSession(deviceIndex);
+        if (pAgent == nullptr || pAgent->IsDeviceOpened() == false)
+            continue;
+
+        float tileHeight = m_DashboardTiles[deviceIndex].isCollapsed ? titleHeight : titleHeight + bodyHeight;
+        ImVec2 tileMin = ImVec2(pos.x + tileCol * (tileWidth + style.ItemSpacing.x), rowY);
+        ImVec2 tileMax = ImVec2(tileMin.x + tileWidth, tileMin.y + tileHeight);
+
+        // Tiles out of the scrolled view are neither drawn nor refreshed, their agents stay idle
+        if (ImGui::IsRectVisible(tileMin, tileMax))
+        {
+            RightPaneDrawDashboardTile(deviceIndex, pAgent, tileMin, tileMax);
+            m_DashboardNbVisibleTiles++;
+        }
+
+        rowHeight = std::max(rowHeight, tileHeight);
+        if (++tileCol == nbTileCols)
+        {
+            tileCol = 0;
+            rowY += rowHeight + style.ItemSpacing.y;
+            rowHeight = 0.f;
+        }
+    }
+
+    // Content size for the scrollbar of the right pane
+    ImGui::Dummy(ImVec2(1.f, rowY + rowHeight - pos.y));
 }
 
-void LeydenJarDiagnosticTool::LeftPaneRenderingSignalLevels()
+void LeydenJarDiagnosticTool::RightPaneDrawDashboardTile(int deviceIndex, LeydenJarAgent* pAgent, const ImVec2& tileMin, const ImVec2& tileMax)
 {
-    if (ImGui::Button("Device List", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+    DashboardTile& tile = m_DashboardTiles[deviceIndex];
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = pAgent->GetDeviceInfo();
+    ImDrawList* pDrawList = ImGui::GetWindowDrawList();
+    float titleHeight = ImGui::GetTextLineHeightWithSpacing();
+    ImVec2 titleMax = ImVec2(tileMax.x, tileMin.y + titleHeight);
+
+    pDrawList->AddRectFilled(tileMin, titleMax, IM_COL32(60, 60, 70, 255));
+    pDrawList->PushClipRect(tileMin, titleMax, true);
+    pDrawList->AddText(ImVec2(tileMin.x + 4.f, tileMin.y + 1.f), ImGui::GetColorU32(ImGuiCol_Text), m_DeviceListNames[deviceIndex].c_str());
+    pDrawList->PopClipRect();
+
+    if (ImGui::IsWindowHovered() && ImGui::IsMouseHoveringRect(tileMin, titleMax))
     {
-        m_CurrentLeftPaneLayout = LeftPaneLayoutDeciveDescription;
+        ImGui::SetTooltip("%s", m_DeviceListNames[deviceIndex].c_str());
+        if (ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+            tile.isCollapsed = !tile.isCollapsed;
     }
-    if (ImGui::Button("Keypress Monitor", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
+
+    if (tile.isCollapsed)
+        return;
+
+    // Same request cycle as the monitors, with one request in flight per visible tile
+    if (!pAgent->RequestInProgress())
     {
-        m_CurrentLeftPaneLayout = LeftPaneLayoutKeyPressMonitor;
+        if (tile.isRequestSent)
+        {
+            if (tile.isLevelRequest)
+            {
+                for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
+                    pAgent->GetColLevels(col, tile.levels[col]);
+            }
+            else
+                pAgent->GetPhysicalKeyboardState(tile.physicalState);
+            tile.hasData = tile.isLevelRequest == m_DashboardLevels;
+        }
+
+        if (m_DashboardLevels)
+            pAgent->RequestDetectLevels();
+        else
+            pAgent->RequestPhysicalScan();
+        tile.isRequestSent = true;
+        tile.isLevelRequest = m_DashboardLevels;
     }
 
-    ImGui::SeparatorText("");
+    ImVec2 bodyMin = ImVec2(tileMin.x, titleMax.y);
+    pDrawList->AddRectFilled(bodyMin, tileMax, IM_COL32(25, 25, 25, 255));
+    if (tile.hasData == false)
+        return;
 
-    const char* comboItems[3] = { "Keyboard Layout", "QMK Matrix", "Physical Matrix" };
-    ImGui::Combo("View Type", &m_RightPaneViewType, comboItems, 3);
+    float cellSize = (tileMax.x - tileMin.x) / 18.f;
+    int nbCols = std::min<int>(pDeviceInfo->nbPhysicalCols, 18);
+    int nbRows = std::min<int>(pDeviceInfo->nbPhysicalRows, 8);
 
-    if (m_RightPaneViewType == RightPaneViewKeyboardLayout)
-        LeftPaneDrawViaLayoutOptions();
+    // Level of detail from the cell size: outlined keys, plain cells, then a single tile colour
+    if (cellSize >= 8.f)
+    {
+        for (int col = 0; col < nbCols; col++)
+        {
+            for (int row = 0; row < nbRows; row++)
+            {
+                if (pDeviceInfo->binningMap[col][row] >= 16)
+                    continue;
+                ImVec2 keyMin = ImVec2(bodyMin.x + col * cellSize + 1.f, bodyMin.y + row * cellSize + 1.f);
+                ImVec2 keyMax = ImVec2(keyMin.x + cellSize - 2.f, keyMin.y + cellSize - 2.f);
+                pDrawList->AddRectFilled(keyMin, keyMax, GetKeyActivityColor(GetDashboardKeyActivity(tile, pDeviceInfo, col, row)), 2.f);
+                pDrawList->AddRect(keyMin, keyMax, IM_COL32(200, 200, 200, 255), 2.f);
+            }
+        }
+    }
+    else if (cellSize >= 2.f)
+    {
+        pDrawList->PrimReserve(nbCols * nbRows * 6, nbCols * nbRows * 4);
+        for (int col = 0; col < nbCols; col++)
+        {
+            for (int row = 0; row < nbRows; row++)
+            {
+                ImVec2 keyMin = ImVec2(bodyMin.x + col * cellSize, bodyMin.y + row * cellSize);
+                pDrawList->PrimRect(keyMin, ImVec2(keyMin.x + cellSize, keyMin.y + cellSize), GetKeyActivityColor(GetDashboardKeyActivity(tile, pDeviceInfo, col, row)));
+            }
+        }
+    }
+    else
+    {
+        // The whole tile takes the colour of its most active key
+        float maxActivity = 0.f;
+        for (int col = 0; col < nbCols; col++)
+            for (int row = 0; row < nbRows; row++)
+                if (pDeviceInfo->binningMap[col][row] < 16)
+                    maxActivity = std::max(maxActivity, GetDashboardKeyActivity(tile, pDeviceInfo, col, row));
+        pDrawList->AddRectFilled(bodyMin, tileMax, GetKeyActivityColor(maxActivity));
+    }
+}
 
-    LeftPaneDrawLeydenJarInfos();
+float LeydenJarDiagnosticTool::GetDashboardKeyActivity(const DashboardTile& tile, const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo, int matrixCol, int matrixRow)
+{
+    if (tile.isLevelRequest == false)
+        return (tile.physicalState[matrixCol] & (1 << matrixRow)) ? 1.f : 0.f;
+
+    uint8_t binIdx = pDeviceInfo->binningMap[matrixCol][matrixRow];
+    if (binIdx >= 16 || pDeviceInfo->dacThreshold[binIdx] == 0)
+        return 0.f;
+
+    // Ramp centered on the bin threshold over +/- 25% of it
+    float threshold = pDeviceInfo->dacThreshold[binIdx];
+    float activity = (tile.levels[matrixCol][matrixRow] - threshold * 0.75f) / (threshold * 0.5f);
+    if (pDeviceInfo->switchTechnology == SwitchTechnologyBeamSpring)
+        activity = 1.f - activity;
+
+    return std::min(std::max(activity, 0.f), 1.f);
 }
 
 void LeydenJarDiagnosticTool::RightPaneRenderingDeviceDescription()
@@ -583,17 +1350,42 @@ void LeydenJarDiagnosticTool::RightPaneRenderingDeviceDescription()
 
 void LeydenJarDiagnosticTool::RightPaneRenderingKeyPresses()
 {
-    if (m_RightPaneViewType == RightPaneViewKeyboardLayout)
+    // A latency measurement cycle refreshes both logical and physical states, all views are drawn from it
+    if (m_LatencyMeasurement)
+    {
+        if (!m_pAgent->RequestInProgress())
+        {
+            if (m_LatencyRequestSent)
+            {
+                const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+                for (int row = 0; row < pDeviceInfo->nbLogicalRows; row++)
+                    m_LogicKeyboardState[row] = m_pAgent->GetLogicalKeyboardState(row);
+                m_pAgent->GetPhysicalKeyboardState(m_PhysicalKeyboardState);
+                UpdateFrameTiming(m_pAgent->GetLatencyTiming());
+                m_pAgent->GetKeyLatencies(m_KeyLatencies);
+            }
+            m_pAgent->RequestLatencyMeasurement();
+            m_LatencyRequestSent = true;
+        }
+
+        if (m_RightPaneViewType == RightPaneViewKeyboardLayout)
+            RightPaneDrawKeyboardLayout(false);
+        else
+            RightPaneDrawPhysicalLayout(false);
+    }
+    else if (m_RightPaneViewType == RightPaneViewKeyboardLayout)
     {
-        if (!m_Agent.RequestInProgress())
+        if (!m_pAgent->RequestInProgress())
         {
             if (m_LogicalKeyboardStateRequestSent)
             {
-                const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_Agent.GetDeviceInfo();
+                const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
                 for (int row = 0; row < pDeviceInfo->nbLogicalRows; row++)
-                    m_LogicKeyboardState[row] = m_Agent.GetLogicalKeyboardState(row);
+                    m_LogicKeyboardState[row] = m_pAgent->GetLogicalKeyboardState(row);
+                UpdateFrameTiming(m_pAgent->GetLogicalScanTiming());
+                m_pAgent->GetChatterCounters(LeydenJarChatterDetector::ChatterSourcePhysical, m_ChatterCounters);
             }
-            m_Agent.RequestLogicalScan();
+            m_pAgent->RequestLogicalScan();
             m_LogicalKeyboardStateRequestSent = true;
         }
 
@@ -601,16 +1393,18 @@ void LeydenJarDiagnosticTool::RightPaneRenderingKeyPresses()
     }
     else
     {
-        if (!m_Agent.RequestInProgress())
+        if (!m_pAgent->RequestInProgress())
         {
             if (m_PhysicalKeyboardStateRequestSent)
             {
-                const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_Agent.GetDeviceInfo();
+                const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
             
-                m_Agent.GetPhysicalKeyboardState(m_PhysicalKeyboardState);
+                m_pAgent->GetPhysicalKeyboardState(m_PhysicalKeyboardState);
+                UpdateFrameTiming(m_pAgent->GetPhysicalScanTiming());
+                m_pAgent->GetChatterCounters(LeydenJarChatterDetector::ChatterSourcePhysical, m_ChatterCounters);
             }
             
-            m_Agent.RequestPhysicalScan();
+            m_pAgent->RequestPhysicalScan();
             m_PhysicalKeyboardStateRequestSent = true;
         }
 
@@ -618,107 +1412,396 @@ void LeydenJarDiagnosticTool::RightPaneRenderingKeyPresses()
     }
 }
 
-static inline uint16_t medianLevelVal(uint16_t val0, uint16_t val1, uint16_t val2)
+void LeydenJarDiagnosticTool::ResetLevelAnalysis()
 {
-    std::array<uint16_t, 3> levels = { val0, val1, val2 };
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+    LeydenJarLevelAnalysis::LeydenJarLevelLayout layout;
+
+    layout.nbCols = pDeviceInfo->nbPhysicalCols;
+    layout.nbRows = pDeviceInfo->nbPhysicalRows;
+    layout.switchTechnology = pDeviceInfo->switchTechnology;
+    std::memcpy(layout.dacThreshold, pDeviceInfo->dacThreshold, sizeof(layout.dacThreshold));
+    std::memcpy(layout.binningMap, pDeviceInfo->binningMap, sizeof(layout.binningMap));
 
-    std::sort(levels.begin(), levels.end());
-    return levels[1];
+    m_LevelAnalysis.Reset(m_TaskPool, layout);
+
+    std::memset(&m_LevelResults, 0, sizeof(m_LevelResults));
+    std::memset(&m_LevelResults.minLevels, 0xFF, sizeof(m_LevelResults.minLevels));
+
+    m_LevelHistory.Reset();
+    m_LevelPlotPaused = false;
 }
 
 void LeydenJarDiagnosticTool::RightPaneRenderingSignalLevels()
 {
-    if (!m_Agent.RequestInProgress())
+    if (!m_pAgent->RequestInProgress())
     {
         if (m_KeyboardLevelsRequestSent)
         {
-            const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_Agent.GetDeviceInfo();
-            
-            m_CurLevelIdx++;
-
-            int idx = m_CurLevelIdx % 3;
+            const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+            uint16_t levels[18][8];
 
             for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
             {
-                m_Agent.GetColLevels(col, m_CurLevels[idx][col]);
+                m_pAgent->GetColLevels(col, levels[col]);
             }
 
-            for (int col = 0; col < pDeviceInfo->nbPhysicalCols; col++)
-            {
-                if (m_CurLevelIdx >= 2)
-                {
-                    int idxPrev1 = (m_CurLevelIdx - 1) % 3;
-                    int idxPrev2 = (m_CurLevelIdx - 2) % 3;
-
-                    for (int row = 0; row < pDeviceInfo->nbPhysicalRows; row++)
-                    {
-                        int binIdx = pDeviceInfo->binningMap[col][row];
+            // Median filtering, min/max tracking and key classification run on the task pool
+            m_LevelAnalysis.SubmitFrame(m_TaskPool, levels, m_pAgent->GetLevelsTiming().acquisitionStartNs);
+            m_LevelHistory.AddFrame(levels, m_pAgent->GetLevelsTiming().acquisitionStartNs);
 
-                        if (m_CurLevels[idx][col][row] < pDeviceInfo->dacThreshold[binIdx] &&
-                            m_CurLevels[idxPrev1][col][row] < pDeviceInfo->dacThreshold[binIdx] &&
-                            m_CurLevels[idxPrev2][col][row] < pDeviceInfo->dacThreshold[binIdx])
-                        {
-                            m_MinLevels[col][row] = std::min(m_MinLevels[col][row], medianLevelVal(m_CurLevels[idx][col][row], m_CurLevels[idxPrev1][col][row], m_CurLevels[idxPrev2][col][row]));
-                        }
+            UpdateFrameTiming(m_pAgent->GetLevelsTiming());
+            m_pAgent->GetChatterCounters(LeydenJarChatterDetector::ChatterSourceLevels, m_ChatterCounters);
 
-                        if (m_CurLevels[idx][col][row] >= pDeviceInfo->dacThreshold[binIdx] &&
-                            m_CurLevels[idxPrev1][col][row] >= pDeviceInfo->dacThreshold[binIdx] &&
-                            m_CurLevels[idxPrev2][col][row] >= pDeviceInfo->dacThreshold[binIdx])
-                        {
-                            m_MaxLevels[col][row] = std::max(m_MaxLevels[col][row], medianLevelVal(m_CurLevels[idx][col][row], m_CurLevels[idxPrev1][col][row], m_CurLevels[idxPrev2][col][row]));
-                        }
-                    }
-                }
+            // Time between first and last column reads, this is what a real-time agent thread reduces
+            if (pDeviceInfo->nbPhysicalCols > 1)
+            {
+                double skewUs = (m_pAgent->GetColLevelsTimestamp(pDeviceInfo->nbPhysicalCols - 1) - m_pAgent->GetColLevelsTimestamp(0)) / 1000.0;
+                m_ColumnSkewCount++;
+                double delta = skewUs - m_ColumnSkewMean;
+                m_ColumnSkewMean += delta / m_ColumnSkewCount;
+                m_ColumnSkewM2 += delta * (skewUs - m_ColumnSkewMean);
             }
-
-            m_KeyboardLevelsAcquired = true;
         }
     
-        m_Agent.RequestDetectLevels();
+        m_pAgent->RequestDetectLevels();
         m_KeyboardLevelsRequestSent = true;
     }
 
+    // Results of the last analysed frame, they lag acquisition by at most one frame
+    if (m_LevelAnalysis.GetResults(m_LevelResults))
+        m_KeyboardLevelsAcquired = true;
+
+    if (IsLevelHeatmapActive())
+        UploadLevelHeatmap();
+
     if (m_RightPaneViewType == RightPaneViewKeyboardLayout)
         RightPaneDrawKeyboardLayout(true);
     else
         RightPaneDrawPhysicalLayout(true);
+
+    RightPaneDrawLevelPlot();
+
+    RightPaneDrawKeyHistogramPopup();
 }
 
-ImU32 LeydenJarDiagnosticTool::GetKeyColorFromLevel(const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo, int idx, int matrixCol, int matrixRow)
+void LeydenJarDiagnosticTool::ToggleLevelPlotKey(int matrixCol, int matrixRow)
 {
-    ImU32 gbColUnpressed = IM_COL32(45, 45, 45, 255);
-    ImU32 gbColPressed = IM_COL32(45, 45, 255, 255);
-    ImU32 gbColPressedLight = IM_COL32(128, 128, 255, 255);
+    if (m_LevelHistory.ToggleKey(matrixCol, matrixRow))
+        m_LevelPlot = true;
+}
 
-    ImU32 colKey = gbColUnpressed;
+void LeydenJarDiagnosticTool::RightPaneDrawLevelPlot()
+{
+    uint64_t firstNs;
+    uint64_t lastNs;
+
+    if (m_LevelPlot == false || m_LevelHistory.GetNbTraces() == 0 || m_LevelHistory.GetTimeRange(firstNs, lastNs) == false)
+        return;
+
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+    ImU32 axisCol = IM_COL32(128, 128, 128, 255);
+    ImU32 textCol = ImGui::GetColorU32(ImGuiCol_Text);
+
+    // The plot is docked at the bottom of the right pane, over the matrix views when they do not fit
+    float plotHeight = 240.f;
+    ImGui::SetCursorPosY(ImGui::GetWindowHeight() - plotHeight - ImGui::GetStyle().WindowPadding.y);
+    ImGui::BeginChild("Level Plot", ImVec2(0, plotHeight), true, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+
+    ImDrawList* pDrawList = ImGui::GetWindowDrawList();
+    ImVec2 canvasPos = ImGui::GetCursorScreenPos();
+    ImVec2 canvasSize = ImGui::GetContentRegionAvail();
+
+    // Left margin holds the level axis labels, bottom one the time labels
+    float axisWidth = 50.f;
+    ImVec2 plotMin = ImVec2(canvasPos.x + axisWidth, canvasPos.y + 2.f);
+    ImVec2 plotMax = ImVec2(canvasPos.x + canvasSize.x, canvasPos.y + canvasSize.y - ImGui::GetTextLineHeight() - 2.f);
+    int nbColumns = int(plotMax.x - plotMin.x);
+    if (nbColumns <= 0 || plotMax.y <= plotMin.y)
+    {
+        ImGui::EndChild();
+        return;
+    }
 
-    int binIdx = pDeviceInfo->binningMap[matrixCol][matrixRow];
+    ImGui::InvisibleButton("plot canvas", canvasSize);
+    if (ImGui::IsItemHovered() && ImGui::GetIO().MouseWheel != 0.f)
+    {
+        m_LevelPlotWindowS *= std::pow(0.8f, ImGui::GetIO().MouseWheel);
+        m_LevelPlotWindowS = std::min(std::max(m_LevelPlotWindowS, 0.1f), 3600.f);
+    }
 
-    if (m_KeyboardLevelsAcquired)
+    uint64_t endNs = m_LevelPlotPaused ? m_LevelPlotPausedEndNs : lastNs;
+    uint64_t windowNs = uint64_t(double(m_LevelPlotWindowS) * 1e9);
+    uint64_t startNs = endNs > windowNs ? endNs - windowNs : 0;
+    int nbTraces = m_LevelHistory.GetNbTraces();
+
+    // One min/max pair per pixel column and trace, whatever the number of frames in the window
+    m_LevelPlotRanges.resize(size_t(nbTraces) * nbColumns);
+    for (int trace = 0; trace < nbTraces; trace++)
+        m_LevelHistory.Decimate(trace, startNs, endNs, nbColumns, &m_LevelPlotRanges[size_t(trace) * nbColumns]);
+
+    // Level axis fits the visible levels and the thresholds of the traced keys
+    int minLevel = 0xFFFF;
+    int maxLevel = 0;
+    uint16_t thresholds[LeydenJarLevelHistory::kMaxTraces];
+    for (int trace = 0; trace < nbTraces; trace++)
     {
-        if (pDeviceInfo->switchTechnology == SwitchTechnologyModelF)
+        int col;
+        int row;
+        m_LevelHistory.GetTraceKey(trace, col, row);
+        uint8_t binIdx = pDeviceInfo->binningMap[col][row];
+        thresholds[trace] = binIdx < 16 ? pDeviceInfo->dacThreshold[binIdx] : 0;
+        if (binIdx < 16)
+        {
+            minLevel = std::min<int>(minLevel, thresholds[trace]);
+            maxLevel = std::max<int>(maxLevel, thresholds[trace]);
+        }
+
+        const LeydenJarLevelHistory::LeydenJarLevelRange* pRanges = &m_LevelPlotRanges[size_t(trace) * nbColumns];
+        for (int column = 0; column < nbColumns; column++)
         {
-            if (m_CurLevels[idx][matrixCol][matrixRow] >= pDeviceInfo->dacThreshold[binIdx])
+            if (pRanges[column].isValid)
             {
-                if ((m_CurLevels[idx][matrixCol][matrixRow] - pDeviceInfo->dacThreshold[binIdx]) <= 3)
-                    colKey = gbColPressedLight;
-                else
-                    colKey = gbColPressed;
+                minLevel = std::min<int>(minLevel, pRanges[column].min);
+                maxLevel = std::max<int>(maxLevel, pRanges[column].max);
+            }
+        }
+    }
+    if (minLevel > maxLevel)
+    {
+        minLevel = 0;
+        maxLevel = 1023;
+    }
+    int levelMargin = std::max(8, (maxLevel - minLevel) / 20);
+    minLevel = std::max(0, minLevel - levelMargin);
+    maxLevel += levelMargin;
+
+    float levelScale = (plotMax.y - plotMin.y) / float(maxLevel - minLevel);
+    char labelString[32];
+
+    pDrawList->AddRect(plotMin, plotMax, axisCol);
+    sprintf(labelString, "%d", maxLevel);
+    pDrawList->AddText(ImVec2(canvasPos.x, plotMin.y), textCol, labelString);
+    sprintf(labelString, "%d", minLevel);
+    pDrawList->AddText(ImVec2(canvasPos.x, plotMax.y - ImGui::GetTextLineHeight()), textCol, labelString);
+    sprintf(labelString, "-%.1f s", m_LevelPlotWindowS);
+    pDrawList->AddText(ImVec2(plotMin.x, plotMax.y + 2.f), textCol, labelString);
+    const char* endLabel = m_LevelPlotPaused ? "paused" : "now";
+    pDrawList->AddText(ImVec2(plotMax.x - ImGui::CalcTextSize(endLabel).x, plotMax.y + 2.f), textCol, endLabel);
+
+    pDrawList->PushClipRect(plotMin, plotMax, true);
+
+    for (int trace = 0; trace < nbTraces; trace++)
+    {
+        if (thresholds[trace] == 0)
+            continue;
+        float thresholdY = plotMax.y - (thresholds[trace] - minLevel) * levelScale;
+        pDrawList->AddLine(ImVec2(plotMin.x, thresholdY), ImVec2(plotMax.x, thresholdY), (s_LevelPlotColors[trace] & ~IM_COL32_A_MASK) | IM_COL32(0, 0, 0, 96));
+    }
+
+    // Every valid column is a 1 pixel wide bar from its min to its max, stretched to join the previous column
+    for (int trace = 0; trace < nbTraces; trace++)
+    {
+        const LeydenJarLevelHistory::LeydenJarLevelRange* pRanges = &m_LevelPlotRanges[size_t(trace) * nbColumns];
+        int nbValidColumns = 0;
+        for (int column = 0; column < nbColumns; column++)
+            nbValidColumns += pRanges[column].isValid ? 1 : 0;
+        if (nbValidColumns == 0)
+            continue;
+
+        pDrawList->PrimReserve(nbValidColumns * 6, nbValidColumns * 4);
+        for (int column = 0; column < nbColumns; column++)
+        {
+            if (pRanges[column].isValid == false)
+                continue;
+
+            int columnMin = pRanges[column].min;
+            int columnMax = pRanges[column].max;
+            if (column > 0 && pRanges[column - 1].isValid)
+            {
+                columnMin = std::min<int>(columnMin, pRanges[column - 1].max);
+                columnMax = std::max<int>(columnMax, pRanges[column - 1].min);
             }
+
+            float columnX = plotMin.x + column;
+            pDrawList->PrimRect(ImVec2(columnX, plotMax.y - (columnMax - minLevel) * levelScale - 0.5f),
+                                ImVec2(columnX + 1.f, plotMax.y - (columnMin - minLevel) * levelScale + 0.5f), s_LevelPlotColors[trace]);
         }
-        else if (pDeviceInfo->switchTechnology == SwitchTechnologyBeamSpring)
+    }
+
+    pDrawList->PopClipRect();
+
+    // Levels of the hovered column
+    if (ImGui::IsItemHovered())
+    {
+        int column = int(ImGui::GetIO().MousePos.x - plotMin.x);
+        if (column >= 0 && column < nbColumns && ImGui::BeginTooltip())
         {
-            if (m_CurLevels[idx][matrixCol][matrixRow] <= pDeviceInfo->dacThreshold[binIdx])
+            ImGui::Text("%.3f s", (double(startNs) + double(endNs - startNs) * column / nbColumns - double(endNs)) / 1e9);
+            for (int trace = 0; trace < nbTraces; trace++)
             {
-                if ((pDeviceInfo->dacThreshold[binIdx] - m_CurLevels[idx][matrixCol][matrixRow]) <= 3)
-                    colKey = gbColPressedLight;
-                else
-                    colKey = gbColPressed;
+                const LeydenJarLevelHistory::LeydenJarLevelRange& range = m_LevelPlotRanges[size_t(trace) * nbColumns + column];
+                int col;
+                int row;
+                m_LevelHistory.GetTraceKey(trace, col, row);
+                if (range.isValid && range.min != range.max)
+                    ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(s_LevelPlotColors[trace]), "C%d R%d: %d to %d", col, row, range.min, range.max);
+                else if (range.isValid)
+                    ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(s_LevelPlotColors[trace]), "C%d R%d: %d", col, row, range.min);
             }
+            ImGui::EndTooltip();
+        }
+    }
+
+    ImGui::EndChild();
+}
+
+ImU32 LeydenJarDiagnosticTool::GetKeyColorFromLevel(int matrixCol, int matrixRow)
+{
+    if (m_KeyboardLevelsAcquired == false)
+        return GetKeyStateColor(LeydenJarLevelAnalysis::KeyStateUnpressed);
+
+    return GetKeyStateColor(m_LevelResults.keyStates[matrixCol][matrixRow]);
+}
+
+bool LeydenJarDiagnosticTool::IsLevelHeatmapActive()
+{
+    return m_LevelHeatmap && m_KeyboardLevelsAcquired && m_HeatmapRenderer.IsInitialized();
+}
+
+void LeydenJarDiagnosticTool::UploadLevelHeatmap()
+{
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+    uint16_t thresholds[18][8];
+
+    for (int col = 0; col < 18; col++)
+    {
+        for (int row = 0; row < 8; row++)
+        {
+            uint8_t binIdx = pDeviceInfo->binningMap[col][row];
+            thresholds[col][row] = binIdx < 16 ? pDeviceInfo->dacThreshold[binIdx] : 0;
         }
     }
 
-    return colKey;
+    m_HeatmapRenderer.UploadLevels(m_LevelResults.curLevels, thresholds, m_LevelResults.minLevels, m_LevelResults.maxLevels,
+                                   pDeviceInfo->switchTechnology == SwitchTechnologyBeamSpring);
+}
+
+ImU32 LeydenJarDiagnosticTool::GetKeyOutlineColor(int matrixCol, int matrixRow)
+{
+    ImU32 outlineCol = IM_COL32(200, 200, 200, 255);
+    ImU32 chatterCol = IM_COL32(255, 64, 64, 255);
+    ImU32 driftCol = IM_COL32(255, 160, 32, 255);
+
+    // Keys that chattered during the last 2 seconds are outlined
+    uint64_t lastEventNs = m_ChatterCounters[matrixCol * 8 + matrixRow].lastEventNs;
+    if (lastEventNs != 0 && LeydenJarProtocol::GetTimestampNs() - lastEventNs < 2000000000ull)
+        return chatterCol;
+
+    if (m_KeyboardLevelsAcquired && m_LevelResults.drift[matrixCol][matrixRow].isDrifting)
+        return driftCol;
+
+    return outlineCol;
+}
+
+void LeydenJarDiagnosticTool::RightPaneDrawKeyStatisticsTooltip(int matrixCol, int matrixRow)
+{
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+    const LeydenJarKeyStatistics::LeydenJarKeyStatsSummary& stats = m_LevelResults.keyStats[matrixCol][matrixRow];
+    const LeydenJarKeyStatistics::LeydenJarKeyStatsConfig& config = m_LevelAnalysis.GetStatisticsConfig();
+
+    if (stats.nbSamples == 0)
+        return;
+
+    if (ImGui::BeginTooltip())
+    {
+        int binIdx = pDeviceInfo->binningMap[matrixCol][matrixRow];
+        if (binIdx < 16)
+            ImGui::Text("Col %d, Row %d, Bin %d (DAC threshold %d)", matrixCol, matrixRow, binIdx, pDeviceInfo->dacThreshold[binIdx]);
+        else
+            ImGui::Text("Col %d, Row %d, no bin", matrixCol, matrixRow);
+        ImGui::Text("Last %u samples", stats.nbSamples);
+        ImGui::Text("Mean: %.2f, stddev: %.2f", stats.mean, stats.stdDev);
+        ImGui::Text("Min: %d, max: %d, median: %d", stats.min, stats.max, stats.median);
+        ImGui::Text("P%.1f: %d, P%.1f: %d", config.lowPercentile, stats.lowPercentile, config.highPercentile, stats.highPercentile);
+        ImGui::Text("SNR: %.1f dB", stats.snrDb);
+
+        const LeydenJarChatterDetector::LeydenJarKeyChatterCounters& counters = m_ChatterCounters[matrixCol * 8 + matrixRow];
+        ImGui::Text("Presses: %u, bounces: %u, oscillations: %u", counters.nbPresses, counters.nbBounces, counters.nbOscillations);
+
+        const LeydenJarDriftTracker::LeydenJarKeyDrift& drift = m_LevelResults.drift[matrixCol][matrixRow];
+        if (drift.isValid && drift.timeToThresholdH >= 0.f)
+            ImGui::Text("Baseline: %.1f, drift %+.2f/h, threshold in %.1f h", drift.baseline, drift.ratePerHour, drift.timeToThresholdH);
+        else if (drift.isValid)
+            ImGui::Text("Baseline: %.1f, drift %+.2f/h", drift.baseline, drift.ratePerHour);
+        ImGui::EndTooltip();
+    }
+}
+
+void LeydenJarDiagnosticTool::RightPaneDrawKeyHistogramPopup()
+{
+    if (ImGui::BeginPopup("Key Histogram") == false)
+        return;
+
+    uint32_t counts[LeydenJarLevelHistograms::kNbBuckets];
+    int bucketStartLevels[LeydenJarLevelHistograms::kNbBuckets];
+    m_LevelAnalysis.GetHistogram(m_TaskPool, m_HistogramKeyCol, m_HistogramKeyRow, counts, bucketStartLevels);
+
+    // Only the range of non empty buckets is plotted
+    int firstBucket = LeydenJarLevelHistograms::kNbBuckets;
+    int lastBucket = -1;
+    uint64_t nbSamples = 0;
+    for (int bucket = 0; bucket < LeydenJarLevelHistograms::kNbBuckets; bucket++)
+    {
+        if (counts[bucket] == 0)
+            continue;
+        firstBucket = std::min(firstBucket, bucket);
+        lastBucket = bucket;
+        nbSamples += counts[bucket];
+    }
+
+    ImGui::Text("Col %d, Row %d, %llu samples", m_HistogramKeyCol, m_HistogramKeyRow, (unsigned long long)nbSamples);
+    int bucketWidth = m_LevelAnalysis.GetHistogramBucketWidth();
+    ImGui::Text("DAC threshold starts bucket of levels %d-%d", bucketStartLevels[LeydenJarLevelHistograms::kThresholdBucket],
+        bucketStartLevels[LeydenJarLevelHistograms::kThresholdBucket] + bucketWidth - 1);
+    ImGui::Text("Range %d to %d, levels outside are clamped into the first and last buckets", std::max(bucketStartLevels[0], 0),
+        bucketStartLevels[LeydenJarLevelHistograms::kNbBuckets - 1] + bucketWidth - 1);
+    if ((bucketStartLevels[0] > 0 && counts[0] != 0) || counts[LeydenJarLevelHistograms::kNbBuckets - 1] != 0)
+        ImGui::Text("Edge buckets are not empty, levels may be clamped: increase the bucket width");
+
+    if (lastBucket >= 0)
+    {
+        float values[LeydenJarLevelHistograms::kNbBuckets];
+        for (int bucket = firstBucket; bucket <= lastBucket; bucket++)
+            values[bucket - firstBucket] = float(counts[bucket]);
+
+        char overlayString[64];
+        sprintf(overlayString, "levels %d to %d", bucketStartLevels[firstBucket], bucketStartLevels[lastBucket] + bucketWidth - 1);
+        ImGui::PlotHistogram("##KeyHistogram", values, lastBucket - firstBucket + 1, 0, overlayString, 0.f, FLT_MAX, ImVec2(512.f, 200.f));
+    }
+    else
+        ImGui::TextDisabled("No sample yet");
+
+    ImGui::EndPopup();
+}
+
+void LeydenJarDiagnosticTool::GetMatrixViewKey(int col, int row, int& matrixCol, int& matrixRow)
+{
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
+
+    if (m_RightPaneViewType == RightPaneViewPhysicalMatrix)
+    {
+        matrixCol = col;
+        matrixRow = row;
+    }
+    else
+    {
+        matrixCol = pDeviceInfo->matrixToControllerCols[col];
+        if (row < 8)
+            matrixRow = pDeviceInfo->matrixToControllerRows[row];
+        else
+            matrixRow = pDeviceInfo->matrixToControllerRows[row - 8];
+    }
 }
 
 void LeydenJarDiagnosticTool::RightPaneDrawPhysicalLayout(bool drawLevels)
@@ -728,7 +1811,7 @@ void LeydenJarDiagnosticTool::RightPaneDrawPhysicalLayout(bool drawLevels)
 
     ImVec2 rowConnectorDrawPos = ImVec2(pos.x + 1.5f * 40.f, pos.y + 2.f * 40.f + (1.5f * 40.f) / 2.f);
 
-    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_Agent.GetDeviceInfo();
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
 
     int maxCol;
     int maxRow;
@@ -772,11 +1855,36 @@ void LeydenJarDiagnosticTool::RightPaneDrawPhysicalLayout(bool drawLevels)
     
     ImU32 gbColUnpressed    = IM_COL32(45, 45, 45, 255);
     ImU32 gbColPressed      = IM_COL32(45, 45, 255, 255);
-    ImU32 outlineCol        = IM_COL32(200, 200, 200, 255);
     ImU32 binCol            = IM_COL32(128, 255, 128, 255);
-
-    int idx = m_CurLevelIdx % 3;
+    ImU32 textCol           = ImGui::GetColorU32(ImGuiCol_Text);
     
+    if (!m_MatrixKeyGeometry.IsValid(pDrawList))
+    {
+        m_MatrixKeyGeometry.Begin(pDrawList);
+        m_MatrixKeyGeometry.AddConvexKey(1.30f, 1.5f, 0.f, 0.f, 40.f);
+        m_MatrixKeyGeometry.End();
+    }
+
+    // Heatmap fills are drawn first in a single shader pass, outlines and numbers are then drawn over them
+    bool drawHeatmap = drawLevels && IsLevelHeatmapActive();
+    if (drawHeatmap)
+    {
+        m_HeatmapRenderer.Begin(pDrawList);
+        for (int col = 0; col < maxCol; col++)
+        {
+            for (int row = startRow; row < maxRow; row++)
+            {
+                int matrixCol;
+                int matrixRow;
+                GetMatrixViewKey(col, row, matrixCol, matrixRow);
+
+                ImVec2 keyDrawPos = ImVec2(pos.x + keyDrawPosX + col * keyDrawIncX, pos.y + keyDrawPosY + (row - startRow) * keyDrawIncY);
+                m_MatrixKeyGeometry.DrawFill(pDrawList, keyDrawPos, 0, LeydenJarHeatmapRenderer::GetKeyUv(matrixCol, matrixRow), IM_COL32_WHITE);
+            }
+        }
+        m_HeatmapRenderer.End(pDrawList);
+    }
+
     for (int col = 0; col < maxCol; col++)
     {
         char colNumberString[4];
@@ -794,20 +1902,7 @@ void LeydenJarDiagnosticTool::RightPaneDrawPhysicalLayout(bool drawLevels)
         {
             int matrixCol;
             int matrixRow;
-
-            if (m_RightPaneViewType == RightPaneViewPhysicalMatrix)
-            {
-                matrixCol = col;
-                matrixRow = row;
-            }
-            else
-            {
-                matrixCol = pDeviceInfo->matrixToControllerCols[col];
-                if (row < 8)
-                    matrixRow = pDeviceInfo->matrixToControllerRows[row];
-                else
-                    matrixRow = pDeviceInfo->matrixToControllerRows[row - 8];
-            }
+            GetMatrixViewKey(col, row, matrixCol, matrixRow);
 
             if (!drawLevels)
             {
@@ -822,35 +1917,41 @@ void LeydenJarDiagnosticTool::RightPaneDrawPhysicalLayout(bool drawLevels)
                         colKey = gbColPressed;
                 }
 
-                DrawConvexKey(pDrawList, keyDrawPos, 1.30f, 1.5f, 0.f, 0.f, 40.f, colKey, outlineCol);
+                m_MatrixKeyGeometry.Draw(pDrawList, keyDrawPos, 0, colKey, GetKeyOutlineColor(matrixCol, matrixRow));
             }
             else
             {
-                ImU32 colKey = GetKeyColorFromLevel(pDeviceInfo, idx, matrixCol, matrixRow);
-
-                DrawConvexKey(pDrawList, keyDrawPos, 1.30f, 1.5f, 0.f, 0.f, 40.f, colKey, outlineCol);
+                if (drawHeatmap)
+                    m_MatrixKeyGeometry.DrawOutline(pDrawList, keyDrawPos, 0, GetKeyOutlineColor(matrixCol, matrixRow));
+                else
+                    m_MatrixKeyGeometry.Draw(pDrawList, keyDrawPos, 0, GetKeyColorFromLevel(matrixCol, matrixRow), GetKeyOutlineColor(matrixCol, matrixRow));
 
-                if (m_KeyboardLevelsAcquired == true)
+                if (m_KeyboardLevelsAcquired == true && ImGui::IsWindowHovered() &&
+                    ImGui::IsMouseHoveringRect(keyDrawPos, ImVec2(keyDrawPos.x + 1.30f * 40.f, keyDrawPos.y + 1.5f * 40.f)))
                 {
-                    char levelString[6];
-                    if (m_MaxLevels[matrixCol][matrixRow] != 0)
-                    {
-                        sprintf(levelString, "%d", m_MaxLevels[matrixCol][matrixRow]);
-                        pDrawList->AddText(NULL, 0.0f, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 5.f), ImGui::GetColorU32(ImGuiCol_Text), levelString, levelString + strlen(levelString), 0.0f, NULL);
-                    }
-                    sprintf(levelString, "%d", m_CurLevels[idx][matrixCol][matrixRow]);
-                    pDrawList->AddText(NULL, 0.0f, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 22.f), ImGui::GetColorU32(ImGuiCol_Text), levelString, levelString + strlen(levelString), 0.0f, NULL);
-                    if (m_MinLevels[matrixCol][matrixRow] != 0xFFFF)
+                    RightPaneDrawKeyStatisticsTooltip(matrixCol, matrixRow);
+                    if (ImGui::IsMouseClicked(ImGuiMouseButton_Left))
                     {
-                        sprintf(levelString, "%d", m_MinLevels[matrixCol][matrixRow]);
-                        pDrawList->AddText(NULL, 0.0f, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 40.f), ImGui::GetColorU32(ImGuiCol_Text), levelString, levelString + strlen(levelString), 0.0f, NULL);
+                        m_HistogramKeyCol = matrixCol;
+                        m_HistogramKeyRow = matrixRow;
+                        ImGui::OpenPopup("Key Histogram");
                     }
+                    if (ImGui::IsMouseClicked(ImGuiMouseButton_Right))
+                        ToggleLevelPlotKey(matrixCol, matrixRow);
+                }
+
+                if (m_KeyboardLevelsAcquired == true)
+                {
+                    // 4 label slots per matrix position: max, current, min and bin
+                    int labelIdx = (col * 16 + row) * 4;
+                    if (m_LevelResults.maxLevels[matrixCol][matrixRow] != 0)
+                        m_MatrixLevelLabels.Draw(pDrawList, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 5.f), labelIdx, m_LevelResults.maxLevels[matrixCol][matrixRow], textCol);
+                    m_MatrixLevelLabels.Draw(pDrawList, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 22.f), labelIdx + 1, m_LevelResults.curLevels[matrixCol][matrixRow], textCol);
+                    if (m_LevelResults.minLevels[matrixCol][matrixRow] != 0xFFFF)
+                        m_MatrixLevelLabels.Draw(pDrawList, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 40.f), labelIdx + 2, m_LevelResults.minLevels[matrixCol][matrixRow], textCol);
 
                     if (pDeviceInfo->binningMap[matrixCol][matrixRow] != 255)
-                    {
-                        sprintf(levelString, "%d", pDeviceInfo->binningMap[matrixCol][matrixRow]);
-                        pDrawList->AddText(NULL, 0.0f, ImVec2(keyDrawPos.x + 36.f, keyDrawPos.y + 40.f), binCol, levelString, levelString + strlen(levelString), 0.0f, NULL);
-                    }
+                        m_MatrixLevelLabels.Draw(pDrawList, ImVec2(keyDrawPos.x + 36.f, keyDrawPos.y + 40.f), labelIdx + 3, pDeviceInfo->binningMap[matrixCol][matrixRow], binCol);
                 }
             }
 
@@ -863,7 +1964,7 @@ void LeydenJarDiagnosticTool::RightPaneDrawPhysicalLayout(bool drawLevels)
 
 void LeydenJarDiagnosticTool::RightPaneDrawKeyboardLayout(bool drawLevels)
 {
-    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_Agent.GetDeviceInfo();
+    const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo = m_pAgent->GetDeviceInfo();
 
     ImDrawList* drawList = ImGui::GetWindowDrawList();
     ImVec2 pos = ImGui::GetCursorScreenPos();
@@ -872,12 +1973,50 @@ void LeydenJarDiagnosticTool::RightPaneDrawKeyboardLayout(bool drawLevels)
     ImU32 gbColPressed = IM_COL32(45, 45, 255, 255);
     ImU32 outlineCol = IM_COL32(200, 200, 200, 255);
     ImU32 binCol = IM_COL32(128, 255, 128, 255);
+    ImU32 textCol = ImGui::GetColorU32(ImGuiCol_Text);
+
+    // Keys are tessellated once per layout, frames only copy them with their colours
+    if (!m_KeyboardLayoutGeometry.IsValid(drawList))
+    {
+        m_KeyboardLayoutGeometry.Begin(drawList);
+        for (size_t row = 0; row < m_Keys.size(); row++)
+        {
+            for (size_t col = 0; col < m_Keys[row].size(); col++)
+            {
+                m_KeyboardLayoutGeometry.AddKey(m_Keys[row][col].w, m_Keys[row][col].w2, m_Keys[row][col].h, m_Keys[row][col].h2,
+                                                m_Keys[row][col].x, m_Keys[row][col].x2, m_Keys[row][col].y, m_Keys[row][col].y2, 50.f);
+            }
+        }
+        m_KeyboardLayoutGeometry.End();
+    }
 
-    int idx = m_CurLevelIdx % 3;
+    // Heatmap fills of the keys of the connected half are drawn first in a single shader pass
+    bool drawHeatmap = drawLevels && IsLevelHeatmapActive();
+    if (drawHeatmap)
+    {
+        m_HeatmapRenderer.Begin(drawList);
+        int fillKeyIdx = 0;
+        for (size_t row = 0; row < m_Keys.size(); row++)
+        {
+            for (size_t col = 0; col < m_Keys[row].size(); col++, fillKeyIdx++)
+            {
+                bool isSelected = m_Keys[row][col].groupNum == -1 || m_Keys[row][col].groupIdx == m_LayoutOptions[m_Keys[row][col].groupNum].selectionIndex;
+                bool isLocal = (pDeviceInfo->isKeyboardLeft && m_Keys[row][col].row < 8) || (!pDeviceInfo->isKeyboardLeft && m_Keys[row][col].row >= 8);
+                if (!isSelected || !isLocal)
+                    continue;
+
+                int matrixCol = pDeviceInfo->matrixToControllerCols[m_Keys[row][col].col];
+                int matrixRow = pDeviceInfo->matrixToControllerRows[m_Keys[row][col].row % 8];
+                m_KeyboardLayoutGeometry.DrawFill(drawList, pos, fillKeyIdx, LeydenJarHeatmapRenderer::GetKeyUv(matrixCol, matrixRow), IM_COL32_WHITE);
+            }
+        }
+        m_HeatmapRenderer.End(drawList);
+    }
 
+    int keyIdx = 0;
     for (size_t row = 0; row < m_Keys.size(); row++)
     {
-        for (size_t col = 0; col < m_Keys[row].size(); col++)
+        for (size_t col = 0; col < m_Keys[row].size(); col++, keyIdx++)
         {
             if (!drawLevels)
             {
@@ -889,10 +2028,7 @@ void LeydenJarDiagnosticTool::RightPaneDrawKeyboardLayout(bool drawLevels)
                     colKey = gbColUnpressed;
 
                 if (m_Keys[row][col].groupNum == -1 || m_Keys[row][col].groupIdx == m_LayoutOptions[m_Keys[row][col].groupNum].selectionIndex)
-                    DrawKey(drawList, pos,
-                        m_Keys[row][col].w, m_Keys[row][col].w2, m_Keys[row][col].h, m_Keys[row][col].h2,
-                        m_Keys[row][col].x, m_Keys[row][col].x2, m_Keys[row][col].y, m_Keys[row][col].y2,
-                        50.f, colKey, outlineCol);
+                    m_KeyboardLayoutGeometry.Draw(drawList, pos, keyIdx, colKey, outlineCol);
             }
             else
             {
@@ -914,12 +2050,27 @@ void LeydenJarDiagnosticTool::RightPaneDrawKeyboardLayout(bool drawLevels)
                         colKey = gbColUnpressed;
                     }
                     else
-                        colKey = GetKeyColorFromLevel(pDeviceInfo, idx, matrixCol, matrixRow);
+                        colKey = GetKeyColorFromLevel(matrixCol, matrixRow);
 
-                    DrawKey(drawList, pos,
-                        m_Keys[row][col].w, m_Keys[row][col].w2, m_Keys[row][col].h, m_Keys[row][col].h2,
-                        m_Keys[row][col].x, m_Keys[row][col].x2, m_Keys[row][col].y, m_Keys[row][col].y2,
-                        50.f, colKey, outlineCol);
+                    if (drawHeatmap && !deadKey)
+                        m_KeyboardLayoutGeometry.DrawOutline(drawList, pos, keyIdx, GetKeyOutlineColor(matrixCol, matrixRow));
+                    else
+                        m_KeyboardLayoutGeometry.Draw(drawList, pos, keyIdx, colKey, deadKey ? outlineCol : GetKeyOutlineColor(matrixCol, matrixRow));
+
+                    if (m_KeyboardLevelsAcquired == true && !deadKey && ImGui::IsWindowHovered() &&
+                        ImGui::IsMouseHoveringRect(ImVec2(pos.x + m_Keys[row][col].x * 50.f, pos.y + m_Keys[row][col].y * 50.f),
+                                                   ImVec2(pos.x + (m_Keys[row][col].x + m_Keys[row][col].w) * 50.f, pos.y + (m_Keys[row][col].y + m_Keys[row][col].h) * 50.f)))
+                    {
+                        RightPaneDrawKeyStatisticsTooltip(matrixCol, matrixRow);
+                        if (ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+                        {
+                            m_HistogramKeyCol = matrixCol;
+                            m_HistogramKeyRow = matrixRow;
+                            ImGui::OpenPopup("Key Histogram");
+                        }
+                        if (ImGui::IsMouseClicked(ImGuiMouseButton_Right))
+                            ToggleLevelPlotKey(matrixCol, matrixRow);
+                    }
 
                     if (m_KeyboardLevelsAcquired == true && !deadKey)
                     {
@@ -927,25 +2078,16 @@ void LeydenJarDiagnosticTool::RightPaneDrawKeyboardLayout(bool drawLevels)
                         keyDrawPos.x = pos.x + (m_Keys[row][col].x + m_Keys[row][col].w / 2 - 0.5f) * 50.f;
                         keyDrawPos.y = pos.y + (m_Keys[row][col].y + m_Keys[row][col].h / 2 - 0.5f) * 50.f;
 
-                        char levelString[6];
-                        if (m_MaxLevels[matrixCol][matrixRow] != 0)
-                        {
-                            sprintf(levelString, "%d", m_MaxLevels[matrixCol][matrixRow]);
-                            drawList->AddText(NULL, 0.0f, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 5.f), ImGui::GetColorU32(ImGuiCol_Text), levelString, levelString + strlen(levelString), 0.0f, NULL);
-                        }
-                        sprintf(levelString, "%d", m_CurLevels[idx][matrixCol][matrixRow]);
-                        drawList->AddText(NULL, 0.0f, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 18.f), ImGui::GetColorU32(ImGuiCol_Text), levelString, levelString + strlen(levelString), 0.0f, NULL);
-                        if (m_MinLevels[matrixCol][matrixRow] != 0xFFFF)
-                        {
-                            sprintf(levelString, "%d", m_MinLevels[matrixCol][matrixRow]);
-                            drawList->AddText(NULL, 0.0f, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 31.f), ImGui::GetColorU32(ImGuiCol_Text), levelString, levelString + strlen(levelString), 0.0f, NULL);
-                        }
+                        // 4 label slots per key: max, current, min and bin
+                        int labelIdx = keyIdx * 4;
+                        if (m_LevelResults.maxLevels[matrixCol][matrixRow] != 0)
+                            m_KeyboardLevelLabels.Draw(drawList, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 5.f), labelIdx, m_LevelResults.maxLevels[matrixCol][matrixRow], textCol);
+                        m_KeyboardLevelLabels.Draw(drawList, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 18.f), labelIdx + 1, m_LevelResults.curLevels[matrixCol][matrixRow], textCol);
+                        if (m_LevelResults.minLevels[matrixCol][matrixRow] != 0xFFFF)
+                            m_KeyboardLevelLabels.Draw(drawList, ImVec2(keyDrawPos.x + 8.f, keyDrawPos.y + 31.f), labelIdx + 2, m_LevelResults.minLevels[matrixCol][matrixRow], textCol);
 
                         if (pDeviceInfo->binningMap[matrixCol][matrixRow] != 255)
-                        {
-                            sprintf(levelString, "%d", pDeviceInfo->binningMap[matrixCol][matrixRow]);
-                            drawList->AddText(NULL, 0.0f, ImVec2(keyDrawPos.x + 36.f, keyDrawPos.y + 31.f), binCol, levelString, levelString + strlen(levelString), 0.0f, NULL);
-                        }
+                            m_KeyboardLevelLabels.Draw(drawList, ImVec2(keyDrawPos.x + 36.f, keyDrawPos.y + 31.f), labelIdx + 3, pDeviceInfo->binningMap[matrixCol][matrixRow], binCol);
                     }
                 }
             }
@@ -6,6 +6,16 @@
 #include <vector>
 #include <string>
 #include "LeydenJarAgent.h"
+#include "LeydenJarSessionManager.h"
+#include "LeydenJarTaskPool.h"
+#include "LeydenJarLevelAnalysis.h"
+#include "LeydenJarLevelCompare.h"
+#include "LeydenJarRecorder.h"
+#include "LeydenJarImGuiHelpers.h"
+#include "LeydenJarHeatmapRenderer.h"
+#include "LeydenJarLevelHistory.h"
+#include "LeydenJarProfiler.h"
+#include "LeydenJarViaLayout.h"
 #include "imgui.h"
 
 // This class handles:
@@ -16,52 +26,15 @@ class LeydenJarDiagnosticTool
 {
 private:
 
-	struct ViaKey
-	{
-		float x;
-		float y;
-		float w;
-		float h;
-		float x2;
-		float y2;
-		float w2;
-		float h2;
-		int row;
-		int col;
-		int groupNum;
-		int groupIdx;
-
-		void SetDefaultVals() 
-		{
-			x = 0.f;
-			y = 0.f;
-			w = 1.f;
-			h = 1.f;
-			x2 = 0.f;
-			y2 = 0.f;
-			w2 = 1.f;
-			h2 = 1.f;
-			row = -1;
-			col = -1;
-			groupNum = -1;
-			groupIdx = -1;
-		}
-	};
-
-	struct ViaLayoutOption
-	{
-		bool isCheckbox;
-		bool isChecked;
-		std::string layoutName;
-		std::vector<std::string> listboxItems;
-		int selectionIndex;
-	};
+	typedef LeydenJarViaKey ViaKey;
+	typedef LeydenJarViaLayoutOption ViaLayoutOption;
 
 	enum LeftPaneLayout
 	{
 		LeftPaneLayoutDeciveDescription,
 		LeftPaneLayoutKeyPressMonitor,
-		LeftPaneLayoutSignalMonitor
+		LeftPaneLayoutSignalMonitor,
+		LeftPaneLayoutDashboard
 	};
 
 	enum RightPaneLayout
@@ -71,10 +44,15 @@ private:
 		RightPaneLayoutSignalMonitor
 	};
 
-	enum SwitchTechnology
+	// Dashboard thumbnail of an enumerated device, data is only copied for visible tiles
+	struct DashboardTile
 	{
-		SwitchTechnologyModelF = 0,
-		SwitchTechnologyBeamSpring
+		bool		isCollapsed;
+		bool		isRequestSent;
+		bool		isLevelRequest;
+		bool		hasData;
+		uint8_t		physicalState[18];
+		uint16_t	levels[18][8];
 	};
 
 	enum RightPaneView
@@ -86,46 +64,101 @@ private:
 
 public:
 
-	bool Initialize();
+	// Must be called with the OpenGL context current, glslVersion is the one given to the ImGui OpenGL3 backend
+	bool Initialize(const char* glslVersion);
 	bool Finalize();
 
 	void RunStep();
 
+	// Data generation of the displayed device agent, the main loop renders a frame when it changes
+	uint32_t GetDataGeneration();
+	// Minimum time between 2 frames, live monitors are limited to their maximum refresh rate
+	uint32_t GetMinFramePeriodMs();
+
 private:
 
 	void LeftPaneRendering();
 	void LeftPaneRenderingDeviceDescription();
 	void LeftPaneRenderingKeyPresses();
 	void LeftPaneRenderingSignalLevels();
+	void LeftPaneRenderingDashboard();
 
 	void LeftPaneDrawViaLayoutOptions();
 	void LeftPaneDrawLeydenJarInfos();
+	void LeftPaneDrawAcquisitionTiming();
+	void LeftPaneDrawAgentThreadOptions();
+	void LeftPaneDrawRateControllerOptions();
+	void LeftPaneDrawDisplayOptions();
+	void DrawProfilerOverlay();
+	void LeftPaneDrawKeyStatistics();
+	void LeftPaneDrawLevelHistograms();
+	void LeftPaneDrawChatterDetection();
+	void LeftPaneDrawLatencyMeasurement();
+	void LeftPaneDrawThresholdAdvisor();
+	void LeftPaneDrawDriftTracking();
+	void LeftPaneDrawLevelPlot();
+	void LeftPaneDrawRecorder();
 
 	void RightPaneRendering();
 	void RightPaneRenderingDeviceDescription();
 	void RightPaneRenderingSignalLevels();
 	void RightPaneRenderingKeyPresses();
-
-	ImU32 GetKeyColorFromLevel(const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo, int idx, int matrixCol, int matrixRow);
+	void RightPaneRenderingDashboard();
+	void RightPaneDrawDashboardTile(int deviceIndex, LeydenJarAgent* pAgent, const ImVec2& tileMin, const ImVec2& tileMax);
+	// Key activity from 0 (unpressed) to 1 (pressed), 0.5 is the threshold for levels
+	float GetDashboardKeyActivity(const DashboardTile& tile, const LeydenJarAgent::LeydenJarDeviceInfo* pDeviceInfo, int matrixCol, int matrixRow);
+
+	ImU32 GetKeyColorFromLevel(int matrixCol, int matrixRow);
+	bool IsLevelHeatmapActive();
+	// Controller matrix position of a key of the QMK or physical matrix views
+	void GetMatrixViewKey(int col, int row, int& matrixCol, int& matrixRow);
+	void UploadLevelHeatmap();
+	ImU32 GetKeyOutlineColor(int matrixCol, int matrixRow);
 
 	void RightPaneDrawKeyboardLayout(bool drawLevels);
 	void RightPaneDrawPhysicalLayout(bool drawLevels);
+	void RightPaneDrawKeyStatisticsTooltip(int matrixCol, int matrixRow);
+	void RightPaneDrawKeyHistogramPopup();
+	void RightPaneDrawLevelPlot();
+	// Right click on a level monitor key adds it to or removes it from the level plot
+	void ToggleLevelPlotKey(int matrixCol, int matrixRow);
 	
+	void UpdateFrameTiming(const LeydenJarAgent::LeydenJarFrameTiming& frameTiming);
+	void ResetLevelAnalysis();
+	void StartRecording();
+	void StopRecording();
+
 	void RefreshDeviceList();
 	void DecodeVialKeyboardDefinition(const uint8_t* compressedVialData, uint32_t compressedVialSize);
 
 private: 
 
-	LeydenJarAgent m_Agent;
+	LeydenJarSessionManager m_SessionManager;
+	LeydenJarAgent* m_pAgent;
 	bool m_IsDeviceListParsed;
 	int m_SelectedDeviceIndex;
-	char m_DeviceListNames[16][256];
+	std::vector<std::string> m_DeviceListNames;
+	std::vector<DashboardTile> m_DashboardTiles;
+	// Tiles show level heatmaps instead of physical key states
+	bool m_DashboardLevels;
+	int m_DashboardTileWidth;
+	int m_DashboardNbVisibleTiles;
 	
 	uint32_t m_VialUncompressedKeyboardDefinitionSize;
 	char m_VialUncompressedKeyboardDefinitionData[8192];
 
 	std::vector< ViaLayoutOption> m_LayoutOptions;
 	std::vector< std::vector<ViaKey> > m_Keys;
+	// VIA layout keys in m_Keys order, including keys of unselected layout options
+	LeydenJarKeyGeometryCache m_KeyboardLayoutGeometry;
+	// Single matrix key, drawn at every matrix position
+	LeydenJarKeyGeometryCache m_MatrixKeyGeometry;
+	// Level and bin numbers drawn on keys, one instance per view so that label slots keep their values
+	LeydenJarNumberLabels m_KeyboardLevelLabels;
+	LeydenJarNumberLabels m_MatrixLevelLabels;
+	// Level monitor key fills coloured by a shader from the levels, instead of the 3 level states
+	bool			m_LevelHeatmap;
+	LeydenJarHeatmapRenderer m_HeatmapRenderer;
 
 	LeftPaneLayout  m_CurrentLeftPaneLayout;
 	RightPaneLayout m_CurrentRightPaneLayout;
@@ -136,8 +169,39 @@ private:
 	bool			m_KeyboardLevelsAcquired;
 	uint32_t		m_LogicKeyboardState[16];
 	uint8_t         m_PhysicalKeyboardState[18];
-	int             m_CurLevelIdx;
-	uint16_t		m_CurLevels[3][18][8];
-	uint16_t		m_MinLevels[18][8];
-	uint16_t		m_MaxLevels[18][8];
+	LeydenJarTaskPool		m_TaskPool;
+	LeydenJarLevelAnalysis	m_LevelAnalysis;
+	LeydenJarLevelAnalysis::LeydenJarLevelResults m_LevelResults;
+	LeydenJarAgent::LeydenJarFrameTiming m_FrameTiming;
+	float			m_FrameRate;
+	LeydenJarRateController::LeydenJarRateConfig m_RateConfig;
+	bool			m_AgentRealTime;
+	int				m_AgentCpuCore;
+	int				m_MaxRefreshRate;
+	bool			m_ProfilerOverlay;
+	std::vector<LeydenJarProfiler::LeydenJarProfileSample> m_ProfilerSamples;
+	uint32_t		m_ColumnSkewCount;
+	double			m_ColumnSkewMean;
+	double			m_ColumnSkewM2;
+	int				m_HistogramKeyCol;
+	int				m_HistogramKeyRow;
+	std::string		m_HistogramExportStatus;
+	// Level oscilloscope: level history of the traced keys, decimated to the plot width every frame
+	LeydenJarLevelHistory	m_LevelHistory;
+	bool			m_LevelPlot;
+	float			m_LevelPlotWindowS;
+	bool			m_LevelPlotPaused;
+	uint64_t		m_LevelPlotPausedEndNs;
+	std::vector<LeydenJarLevelHistory::LeydenJarLevelRange> m_LevelPlotRanges;
+	LeydenJarChatterDetector::LeydenJarChatterConfig m_ChatterConfig;
+	LeydenJarChatterDetector::LeydenJarKeyChatterCounters m_ChatterCounters[LeydenJarChatterDetector::kNbKeys];
+	// Keypress monitor reads levels, physical and logical matrices back to back instead of a single view
+	bool			m_LatencyMeasurement;
+	bool			m_LatencyRequestSent;
+	LeydenJarLatencyMeter::LeydenJarLatencyConfig m_LatencyConfig;
+	LeydenJarLatencyMeter::LeydenJarKeyLatency m_KeyLatencies[LeydenJarLatencyMeter::kNbKeys];
+	LeydenJarRecorder		m_Recorder;
+	// Agent the recorder is attached to, nullptr when not recording
+	LeydenJarAgent*			m_pRecordingAgent;
+	std::string				m_RecordingStatus;
 };
@@ -0,0 +1,121 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <cmath>
+
+#include "LeydenJarDriftTracker.h"
+
+LeydenJarDriftTracker::LeydenJarDriftTracker()
+    : m_IsBeamSpring(false)
+{
+    m_Config.fastTimeConstantS = 60.f;
+    m_Config.slowTimeConstantS = 600.f;
+    m_Config.warningHorizonH = 8.f;
+
+    std::memset(m_Thresholds, 0, sizeof(m_Thresholds));
+    Reset();
+}
+
+void LeydenJarDriftTracker::SetConfig(const LeydenJarDriftConfig& config)
+{
+    m_Config = config;
+
+    if (m_Config.fastTimeConstantS < 1.f)
+        m_Config.fastTimeConstantS = 1.f;
+    // Rate is computed from the difference of time constants, they must be apart
+    if (m_Config.slowTimeConstantS < m_Config.fastTimeConstantS * 2.f)
+        m_Config.slowTimeConstantS = m_Config.fastTimeConstantS * 2.f;
+
+    Reset();
+}
+
+const LeydenJarDriftTracker::LeydenJarDriftConfig& LeydenJarDriftTracker::GetConfig()
+{
+    return m_Config;
+}
+
+void LeydenJarDriftTracker::SetLayout(bool isBeamSpring, const uint16_t thresholds[18][8])
+{
+    m_IsBeamSpring = isBeamSpring;
+    std::memcpy(m_Thresholds, thresholds, sizeof(m_Thresholds));
+
+    Reset();
+}
+
+void LeydenJarDriftTracker::Reset()
+{
+    std::memset(m_Keys, 0, sizeof(m_Keys));
+}
+
+void LeydenJarDriftTracker::AddSample(int col, int row, uint16_t level, uint64_t timeNs)
+{
+    LeydenJarKeyBaseline& key = m_Keys[col * 8 + row];
+
+    if (key.firstTimeNs == 0)
+    {
+        key.firstTimeNs = timeNs;
+        key.lastTimeNs = timeNs;
+        key.fastAverage = level;
+        key.slowAverage = level;
+        return;
+    }
+
+    if (timeNs <= key.lastTimeNs)
+        return;
+
+    // Weights follow the time between samples so that the averages do not depend on the scan rate.
+    // dt / (tau + dt) is close enough to 1 - exp(-dt / tau) for scan periods much shorter than the time constants
+    double dtS = (timeNs - key.lastTimeNs) * 1e-9;
+    double fastWeight = dtS / (m_Config.fastTimeConstantS + dtS);
+    double slowWeight = dtS / (m_Config.slowTimeConstantS + dtS);
+
+    key.fastAverage += (level - key.fastAverage) * fastWeight;
+    key.slowAverage += (level - key.slowAverage) * slowWeight;
+    key.lastTimeNs = timeNs;
+}
+
+void LeydenJarDriftTracker::GetDrift(int col, int row, LeydenJarKeyDrift& drift)
+{
+    const LeydenJarKeyBaseline& key = m_Keys[col * 8 + row];
+
+    drift.isValid = false;
+    drift.isDrifting = false;
+    drift.baseline = float(key.fastAverage);
+    drift.ratePerHour = 0.f;
+    drift.timeToThresholdH = -1.f;
+
+    double elapsedS = (key.lastTimeNs - key.firstTimeNs) * 1e-9;
+    if (key.firstTimeNs == 0 || elapsedS < m_Config.slowTimeConstantS)
+        return;
+
+    // Averages start from the first level, after t seconds of a ramp an average lags it by rate * tau * (1 - exp(-t / tau)).
+    // Using these lags instead of the settled ones removes the start-up bias, that is about 40% after one slow time constant
+    double fastLag = m_Config.fastTimeConstantS * (1.0 - std::exp(-elapsedS / m_Config.fastTimeConstantS));
+    double slowLag = m_Config.slowTimeConstantS * (1.0 - std::exp(-elapsedS / m_Config.slowTimeConstantS));
+    double ratePerS = (key.fastAverage - key.slowAverage) / (slowLag - fastLag);
+
+    drift.isValid = true;
+    drift.ratePerHour = float(ratePerS * 3600.0);
+
+    // Unpressed levels are below the threshold for capacitive keys and above it for beam spring keys
+    double distance = m_Thresholds[col][row] - key.fastAverage;
+    double towardRatePerS = ratePerS;
+    if (m_IsBeamSpring)
+    {
+        distance = -distance;
+        towardRatePerS = -towardRatePerS;
+    }
+
+    if (towardRatePerS > 0.0 && distance > 0.0)
+    {
+        drift.timeToThresholdH = float(distance / towardRatePerS / 3600.0);
+        drift.isDrifting = drift.timeToThresholdH < m_Config.warningHorizonH;
+    }
+    else if (distance <= 0.0)
+    {
+        // Baseline already reached the threshold
+        drift.timeToThresholdH = 0.f;
+        drift.isDrifting = true;
+    }
+}
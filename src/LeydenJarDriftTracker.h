@@ -0,0 +1,73 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+
+// This class tracks the slow drift of unpressed levels, caused by temperature and humidity changes over hours.
+// Every key has two exponentially weighted moving averages of its unpressed levels, a fast and a slow one.
+// On a level ramp both averages lag the signal by their time constant, so their difference divided by
+// the difference of time constants gives the drift rate without keeping any history. Averages start from the first level
+// and only reach that lag after a few time constants, the rate uses the lags of the elapsed time to stay unbiased meanwhile.
+// The fast average is the key baseline, its distance to the DAC threshold and the drift rate give a time to threshold.
+// Different keys can be updated from different threads, a given key must always be updated by a single thread at a time.
+
+class LeydenJarDriftTracker
+{
+public:
+
+	static const int kNbKeys = 18 * 8;
+
+	struct LeydenJarDriftConfig
+	{
+		float	fastTimeConstantS;
+		float	slowTimeConstantS;
+		// Keys reaching their threshold within this time are reported as drifting
+		float	warningHorizonH;
+	};
+
+	struct LeydenJarKeyDrift
+	{
+		// Rate and time to threshold are only valid once the key was tracked for a slow time constant
+		bool	isValid;
+		bool	isDrifting;
+		float	baseline;
+		// Levels per hour, positive when levels go up
+		float	ratePerHour;
+		// Hours before the baseline reaches the DAC threshold, negative when drifting away from it
+		float	timeToThresholdH;
+	};
+
+public:
+
+	LeydenJarDriftTracker();
+
+	// Changing configuration clears all baselines
+	void SetConfig(const LeydenJarDriftConfig& config);
+	const LeydenJarDriftConfig& GetConfig();
+	// Sets polarity and per key thresholds, baselines are cleared
+	void SetLayout(bool isBeamSpring, const uint16_t thresholds[18][8]);
+	void Reset();
+
+	// Adds an unpressed level of a key, timeNs is the steady clock time of the frame
+	void AddSample(int col, int row, uint16_t level, uint64_t timeNs);
+	void GetDrift(int col, int row, LeydenJarKeyDrift& drift);
+
+private:
+
+	struct LeydenJarKeyBaseline
+	{
+		uint64_t	firstTimeNs;
+		uint64_t	lastTimeNs;
+		double		fastAverage;
+		double		slowAverage;
+	};
+
+private:
+
+	LeydenJarDriftConfig	m_Config;
+	bool					m_IsBeamSpring;
+	uint16_t				m_Thresholds[18][8];
+	LeydenJarKeyBaseline	m_Keys[kNbKeys];
+};
@@ -0,0 +1,266 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#include "LeydenJarHeatmapRenderer.h"
+// Functions loaded by the ImGui OpenGL3 backend
+#include "backends/imgui_impl_opengl3_loader.h"
+
+// Some constants are not part of the subset defined by the backend loader
+#ifndef GL_RGBA16
+#define GL_RGBA16 0x805B
+#endif
+#ifndef GL_NEAREST
+#define GL_NEAREST 0x2600
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_TEXTURE_WRAP_S
+#define GL_TEXTURE_WRAP_S 0x2802
+#endif
+#ifndef GL_TEXTURE_WRAP_T
+#define GL_TEXTURE_WRAP_T 0x2803
+#endif
+
+// Older backend loaders do not load glTexSubImage2D, it is then loaded through the backend loader by Initialize()
+#ifndef glTexSubImage2D
+#define LEYDEN_JAR_LOAD_TEX_SUB_IMAGE_2D
+#if defined(_WIN32)
+typedef void (__stdcall *LeydenJarTexSubImage2DProc)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*);
+#else
+typedef void (*LeydenJarTexSubImage2DProc)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*);
+#endif
+static LeydenJarTexSubImage2DProc s_TexSubImage2D = nullptr;
+#define glTexSubImage2D s_TexSubImage2D
+#endif
+
+// Same attributes and projection as the backend shaders, valid for GLSL 130 and 150
+static const char* s_VertexShader =
+    "uniform mat4 ProjMtx;\n"
+    "in vec2 Position;\n"
+    "in vec2 UV;\n"
+    "in vec4 Color;\n"
+    "out vec2 Frag_UV;\n"
+    "out vec4 Frag_Color;\n"
+    "void main()\n"
+    "{\n"
+    "    Frag_UV = UV;\n"
+    "    Frag_Color = Color;\n"
+    "    gl_Position = ProjMtx * vec4(Position.xy, 0, 1);\n"
+    "}\n";
+
+static const char* s_FragmentShader =
+    "uniform sampler2D Texture;\n"
+    "uniform int BeamSpring;\n"
+    "in vec2 Frag_UV;\n"
+    "in vec4 Frag_Color;\n"
+    "out vec4 Out_Color;\n"
+    "const vec3 UnpressedCol = vec3(45.0, 45.0, 45.0) / 255.0;\n"
+    "const vec3 PressedLightCol = vec3(128.0, 128.0, 255.0) / 255.0;\n"
+    "const vec3 PressedCol = vec3(45.0, 45.0, 255.0) / 255.0;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 key = texture(Texture, Frag_UV) * 65535.0;\n"
+    "    float level = key.x;\n"
+    "    float threshold = key.y;\n"
+    "    float ramp = -1.0;\n"
+    "    if (threshold > 0.0)\n"
+    "    {\n"
+    "        // Distance to the threshold in the press direction, scaled by the session range on that side\n"
+    "        float distance = BeamSpring != 0 ? threshold - level : level - threshold;\n"
+    "        float pressedRange = BeamSpring != 0 ? threshold - key.z : key.w - threshold;\n"
+    "        float unpressedRange = BeamSpring != 0 ? key.w - threshold : threshold - key.z;\n"
+    "        ramp = clamp(distance / max(distance >= 0.0 ? pressedRange : unpressedRange, 1.0), -1.0, 1.0);\n"
+    "    }\n"
+    "    vec3 col = ramp < 0.0 ? mix(PressedLightCol, UnpressedCol, -ramp) : mix(PressedLightCol, PressedCol, ramp);\n"
+    "    Out_Color = vec4(col, 1.0) * Frag_Color;\n"
+    "}\n";
+
+LeydenJarHeatmapRenderer::LeydenJarHeatmapRenderer()
+    : m_Program(0)
+    , m_Texture(0)
+    , m_UniformProjMtx(-1)
+    , m_UniformTexture(-1)
+    , m_UniformBeamSpring(-1)
+    , m_AttribPosition(-1)
+    , m_AttribUv(-1)
+    , m_AttribColor(-1)
+    , m_IsBeamSpring(false)
+{
+    std::memset(m_Texels, 0, sizeof(m_Texels));
+}
+
+LeydenJarHeatmapRenderer::~LeydenJarHeatmapRenderer()
+{
+}
+
+bool LeydenJarHeatmapRenderer::CheckShader(unsigned int shader)
+{
+    GLint status = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    return status == GL_TRUE;
+}
+
+bool LeydenJarHeatmapRenderer::Initialize(const char* glslVersion)
+{
+    Finalize();
+
+#ifdef LEYDEN_JAR_LOAD_TEX_SUB_IMAGE_2D
+    s_TexSubImage2D = (LeydenJarTexSubImage2DProc)imgl3wGetProcAddress("glTexSubImage2D");
+    if (s_TexSubImage2D == nullptr)
+        return false;
+#endif
+
+    std::string vertexSource = std::string(glslVersion) + "\n" + s_VertexShader;
+    std::string fragmentSource = std::string(glslVersion) + "\n" + s_FragmentShader;
+    const GLchar* pVertexSource = vertexSource.c_str();
+    const GLchar* pFragmentSource = fragmentSource.c_str();
+
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &pVertexSource, NULL);
+    glCompileShader(vertexShader);
+
+    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &pFragmentSource, NULL);
+    glCompileShader(fragmentShader);
+
+    GLint linkStatus = 0;
+    if (CheckShader(vertexShader) && CheckShader(fragmentShader))
+    {
+        m_Program = glCreateProgram();
+        glAttachShader(m_Program, vertexShader);
+        glAttachShader(m_Program, fragmentShader);
+        glLinkProgram(m_Program);
+        glGetProgramiv(m_Program, GL_LINK_STATUS, &linkStatus);
+        glDetachShader(m_Program, vertexShader);
+        glDetachShader(m_Program, fragmentShader);
+    }
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    if (linkStatus != GL_TRUE)
+    {
+        Finalize();
+        return false;
+    }
+
+    m_UniformProjMtx = glGetUniformLocation(m_Program, "ProjMtx");
+    m_UniformTexture = glGetUniformLocation(m_Program, "Texture");
+    m_UniformBeamSpring = glGetUniformLocation(m_Program, "BeamSpring");
+    m_AttribPosition = glGetAttribLocation(m_Program, "Position");
+    m_AttribUv = glGetAttribLocation(m_Program, "UV");
+    m_AttribColor = glGetAttribLocation(m_Program, "Color");
+
+    // Texels are sampled at their center, nearest filtering keeps keys independent
+    GLint lastTexture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &lastTexture);
+    glGenTextures(1, &m_Texture);
+    glBindTexture(GL_TEXTURE_2D, m_Texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, 18, 8, 0, GL_RGBA, GL_UNSIGNED_SHORT, m_Texels);
+    glBindTexture(GL_TEXTURE_2D, lastTexture);
+
+    return true;
+}
+
+void LeydenJarHeatmapRenderer::Finalize()
+{
+    if (m_Texture != 0)
+        glDeleteTextures(1, &m_Texture);
+    if (m_Program != 0)
+        glDeleteProgram(m_Program);
+
+    m_Texture = 0;
+    m_Program = 0;
+}
+
+bool LeydenJarHeatmapRenderer::IsInitialized()
+{
+    return m_Program != 0;
+}
+
+void LeydenJarHeatmapRenderer::UploadLevels(const uint16_t levels[18][8], const uint16_t thresholds[18][8],
+                                            const uint16_t minLevels[18][8], const uint16_t maxLevels[18][8], bool isBeamSpring)
+{
+    for (int row = 0; row < 8; row++)
+    {
+        for (int col = 0; col < 18; col++)
+        {
+            uint16_t* pTexel = m_Texels[row][col];
+            pTexel[0] = levels[col][row];
+            pTexel[1] = thresholds[col][row];
+            // Keys without session min/max yet use their current level, the shader keeps a range of at least 1 level
+            pTexel[2] = minLevels[col][row] != 0xFFFF ? minLevels[col][row] : levels[col][row];
+            pTexel[3] = maxLevels[col][row] != 0 ? maxLevels[col][row] : levels[col][row];
+        }
+    }
+    m_IsBeamSpring = isBeamSpring;
+
+    GLint lastTexture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &lastTexture);
+    glBindTexture(GL_TEXTURE_2D, m_Texture);
+#ifdef GL_UNPACK_ROW_LENGTH
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+    // Storage is allocated once by Initialize(), only texels are updated
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 18, 8, GL_RGBA, GL_UNSIGNED_SHORT, m_Texels);
+    glBindTexture(GL_TEXTURE_2D, lastTexture);
+}
+
+void LeydenJarHeatmapRenderer::Begin(ImDrawList* pDrawList)
+{
+    pDrawList->AddCallback(SetupRenderState, this);
+    pDrawList->PushTextureID((ImTextureID)(intptr_t)m_Texture);
+}
+
+void LeydenJarHeatmapRenderer::End(ImDrawList* pDrawList)
+{
+    pDrawList->PopTextureID();
+    pDrawList->AddCallback(ImDrawCallback_ResetRenderState, NULL);
+}
+
+ImVec2 LeydenJarHeatmapRenderer::GetKeyUv(int matrixCol, int matrixRow)
+{
+    return ImVec2((matrixCol + 0.5f) / 18.f, (matrixRow + 0.5f) / 8.f);
+}
+
+void LeydenJarHeatmapRenderer::SetupRenderState(const ImDrawList* pParentList, const ImDrawCmd* pCmd)
+{
+    (void)pParentList;
+
+    const LeydenJarHeatmapRenderer* pRenderer = (const LeydenJarHeatmapRenderer*)pCmd->UserCallbackData;
+    const ImDrawData* pDrawData = ImGui::GetDrawData();
+
+    // Same orthographic projection as the backend
+    float left = pDrawData->DisplayPos.x;
+    float right = pDrawData->DisplayPos.x + pDrawData->DisplaySize.x;
+    float top = pDrawData->DisplayPos.y;
+    float bottom = pDrawData->DisplayPos.y + pDrawData->DisplaySize.y;
+    const float orthoProjection[4][4] =
+    {
+        { 2.f / (right - left), 0.f, 0.f, 0.f },
+        { 0.f, 2.f / (top - bottom), 0.f, 0.f },
+        { 0.f, 0.f, -1.f, 0.f },
+        { (right + left) / (left - right), (top + bottom) / (bottom - top), 0.f, 1.f },
+    };
+
+    glUseProgram(pRenderer->m_Program);
+    glUniform1i(pRenderer->m_UniformTexture, 0);
+    glUniform1i(pRenderer->m_UniformBeamSpring, pRenderer->m_IsBeamSpring ? 1 : 0);
+    glUniformMatrix4fv(pRenderer->m_UniformProjMtx, 1, GL_FALSE, &orthoProjection[0][0]);
+
+    // The backend vertex buffer is still bound, attribute locations of this program may differ from the backend ones
+    glEnableVertexAttribArray(GLuint(pRenderer->m_AttribPosition));
+    glEnableVertexAttribArray(GLuint(pRenderer->m_AttribUv));
+    glEnableVertexAttribArray(GLuint(pRenderer->m_AttribColor));
+    glVertexAttribPointer(GLuint(pRenderer->m_AttribPosition), 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)offsetof(ImDrawVert, pos));
+    glVertexAttribPointer(GLuint(pRenderer->m_AttribUv), 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)offsetof(ImDrawVert, uv));
+    glVertexAttribPointer(GLuint(pRenderer->m_AttribColor), 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)offsetof(ImDrawVert, col));
+}
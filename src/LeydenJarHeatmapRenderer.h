@@ -0,0 +1,58 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+
+#include "imgui.h"
+
+// This class colours key fills of the level monitor with a continuous ramp computed on the GPU.
+// Current levels, bin thresholds and session min/max levels of the physical matrix are uploaded every frame to a
+// 18x8 texture allocated once, one texel per key. Key fills drawn between Begin() and End() sample the texel of their
+// key and a fragment shader maps the level to a ramp going through the colours of the level states: unpressed at the
+// session min level, light press at the threshold and press at the session max level (mirrored for beam spring keys).
+// Begin() and End() add draw callbacks switching the ImGui OpenGL3 backend to this shader and back, so it only works
+// with that backend. All functions must be called on the thread owning the OpenGL context.
+
+class LeydenJarHeatmapRenderer
+{
+public:
+
+	LeydenJarHeatmapRenderer();
+	~LeydenJarHeatmapRenderer();
+
+	// Builds the shader and the texture, glslVersion is the version string given to the ImGui OpenGL3 backend
+	bool Initialize(const char* glslVersion);
+	// Releases OpenGL objects, must be called before the OpenGL context is destroyed
+	void Finalize();
+	bool IsInitialized();
+
+	// Uploads the levels of a frame, thresholds of keys without bin must be 0
+	void UploadLevels(const uint16_t levels[18][8], const uint16_t thresholds[18][8],
+					  const uint16_t minLevels[18][8], const uint16_t maxLevels[18][8], bool isBeamSpring);
+
+	void Begin(ImDrawList* pDrawList);
+	void End(ImDrawList* pDrawList);
+	// Texture coordinates giving to a key fill the colour of a physical matrix key
+	static ImVec2 GetKeyUv(int matrixCol, int matrixRow);
+
+private:
+
+	static void SetupRenderState(const ImDrawList* pParentList, const ImDrawCmd* pCmd);
+	static bool CheckShader(unsigned int shader);
+
+private:
+
+	unsigned int	m_Program;
+	unsigned int	m_Texture;
+	int				m_UniformProjMtx;
+	int				m_UniformTexture;
+	int				m_UniformBeamSpring;
+	int				m_AttribPosition;
+	int				m_AttribUv;
+	int				m_AttribColor;
+	bool			m_IsBeamSpring;
+	// Texels of the 8 rows of 18 columns: level, threshold, min level and max level
+	uint16_t		m_Texels[8][18][4];
+};
@@ -1,14 +1,15 @@
 // SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
 // SPDX-License-Identifier: MIT
 
+#include <cstring>
+
 #include "LeydenJarImGuiHelpers.h"
 
-void DrawKey(ImDrawList* pDrawList, const ImVec2& startDrawPos, 
-             float width0, float width1, float height0, float height1, float x0, float x1, float y0, float y1,
-             float unitSize, ImU32 bgCol, ImU32 outlineCol)
+static void DrawKeyFill(ImDrawList* pDrawList, const ImVec2& startDrawPos,
+                        float width0, float width1, float height0, float height1, float x0, float x1, float y0, float y1,
+                        float unitSize, ImU32 col)
 {
     const float spacing = 4.f;
-    const float radius = 2.f;
     const float fillOffset = 1.f;
 
     if (height0 != height1 && x1 != 0.f) //ISO case
@@ -18,15 +19,35 @@ void DrawKey(ImDrawList* pDrawList, const ImVec2& startDrawPos,
         pDrawList->PathLineTo(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - fillOffset - spacing, startDrawPos.y + (y0 + height1) * unitSize - fillOffset - spacing));
         pDrawList->PathLineTo(ImVec2(startDrawPos.x + (x0 + x1) * unitSize + fillOffset + spacing, startDrawPos.y + (y0 + height1) * unitSize - fillOffset - spacing));
 
-        pDrawList->PathFillConvex(bgCol);
+        pDrawList->PathFillConvex(col);
 
         pDrawList->PathLineTo(ImVec2(startDrawPos.x + x0 * unitSize + fillOffset + spacing, startDrawPos.y + (y0 + height1) * unitSize - fillOffset - spacing));
         pDrawList->PathLineTo(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - fillOffset - spacing, startDrawPos.y + (y0 + height1) * unitSize - fillOffset - spacing));
         pDrawList->PathLineTo(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - fillOffset - spacing, startDrawPos.y + (y0 + height0) * unitSize - fillOffset - spacing));
         pDrawList->PathLineTo(ImVec2(startDrawPos.x + x0 * unitSize + fillOffset + spacing, startDrawPos.y + (y0 + height0) * unitSize - fillOffset - spacing));
 
-        pDrawList->PathFillConvex(bgCol);
+        pDrawList->PathFillConvex(col);
+    }
+    else
+    {
+        pDrawList->PathLineTo(ImVec2(startDrawPos.x + x0 * unitSize + fillOffset + spacing, startDrawPos.y + y0 * unitSize + fillOffset + spacing));
+        pDrawList->PathLineTo(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - fillOffset - spacing, startDrawPos.y + y0 * unitSize + fillOffset + spacing));
+        pDrawList->PathLineTo(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - fillOffset - spacing, startDrawPos.y + (y0 + height0) * unitSize - fillOffset - spacing));
+        pDrawList->PathLineTo(ImVec2(startDrawPos.x + x0 * unitSize + fillOffset + spacing, startDrawPos.y + (y0 + height0) * unitSize - fillOffset - spacing));
+        
+        pDrawList->PathFillConvex(col);
+    }
+}
 
+static void DrawKeyOutline(ImDrawList* pDrawList, const ImVec2& startDrawPos,
+                           float width0, float width1, float height0, float height1, float x0, float x1, float y0, float y1,
+                           float unitSize, ImU32 col)
+{
+    const float spacing = 4.f;
+    const float radius = 2.f;
+
+    if (height0 != height1 && x1 != 0.f) //ISO case
+    {
         pDrawList->PathArcToFast(ImVec2(startDrawPos.x + (x0 + x1) * unitSize + radius + spacing, startDrawPos.y + y0 * unitSize + radius + spacing), radius, 6, 9);
         pDrawList->PathArcToFast(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - radius - spacing, startDrawPos.y + y0 * unitSize + radius + spacing), radius, 9, 12);
         pDrawList->PathArcToFast(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - radius - spacing, startDrawPos.y + (y0 + height0) * unitSize - radius - spacing), radius, 0, 3);
@@ -35,29 +56,286 @@ void DrawKey(ImDrawList* pDrawList, const ImVec2& startDrawPos,
         pDrawList->PathLineTo(ImVec2(startDrawPos.x + x0 * unitSize + spacing, startDrawPos.y + (y0 + height1) * unitSize - spacing));
         pDrawList->PathArcToFast(ImVec2(startDrawPos.x + (x0 + x1) * unitSize + radius + spacing, startDrawPos.y + (y0 + height1) * unitSize - radius - spacing), radius, 3, 6);
 
-        pDrawList->PathStroke(outlineCol, ImDrawFlags_Closed, 2.f);
+        pDrawList->PathStroke(col, ImDrawFlags_Closed, 2.f);
     }
     else
     {
-        pDrawList->PathLineTo(ImVec2(startDrawPos.x + x0 * unitSize + fillOffset + spacing, startDrawPos.y + y0 * unitSize + fillOffset + spacing));
-        pDrawList->PathLineTo(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - fillOffset - spacing, startDrawPos.y + y0 * unitSize + fillOffset + spacing));
-        pDrawList->PathLineTo(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - fillOffset - spacing, startDrawPos.y + (y0 + height0) * unitSize - fillOffset - spacing));
-        pDrawList->PathLineTo(ImVec2(startDrawPos.x + x0 * unitSize + fillOffset + spacing, startDrawPos.y + (y0 + height0) * unitSize - fillOffset - spacing));
-        
-        pDrawList->PathFillConvex(bgCol);
-
         pDrawList->PathArcToFast(ImVec2(startDrawPos.x + x0 * unitSize + radius + spacing, startDrawPos.y + y0 * unitSize + radius + spacing), radius, 6, 9);
         pDrawList->PathArcToFast(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - radius - spacing, startDrawPos.y + y0 * unitSize + radius + spacing), radius, 9, 12);
         pDrawList->PathArcToFast(ImVec2(startDrawPos.x + (x0 + width0) * unitSize - radius - spacing, startDrawPos.y + (y0 + height0) * unitSize - radius - spacing), radius, 0, 3);
         pDrawList->PathArcToFast(ImVec2(startDrawPos.x + x0 * unitSize + radius + spacing, startDrawPos.y + (y0 + height0) * unitSize - radius - spacing), radius, 3, 6);
 
-        pDrawList->PathStroke(outlineCol, ImDrawFlags_Closed, 2.f);
+        pDrawList->PathStroke(col, ImDrawFlags_Closed, 2.f);
     }
 }
 
+void DrawKey(ImDrawList* pDrawList, const ImVec2& startDrawPos, 
+             float width0, float width1, float height0, float height1, float x0, float x1, float y0, float y1,
+             float unitSize, ImU32 bgCol, ImU32 outlineCol)
+{
+    DrawKeyFill(pDrawList, startDrawPos, width0, width1, height0, height1, x0, x1, y0, y1, unitSize, bgCol);
+    DrawKeyOutline(pDrawList, startDrawPos, width0, width1, height0, height1, x0, x1, y0, y1, unitSize, outlineCol);
+}
+
 void DrawConvexKey(ImDrawList* pDrawList, const ImVec2& startDrawPos, 
                    float width, float height, float x, float y, 
                    float unitSize, ImU32 bgCol, ImU32 outlineCol)
 {
     DrawKey(pDrawList, startDrawPos, width, width, height, height, x, x, y, y, unitSize, bgCol, outlineCol);
 }
+
+
+// Indexed by key state: unpressed, pressed light, pressed
+static const ImU32 s_KeyStateColors[3] =
+{
+    IM_COL32(45, 45, 45, 255),
+    IM_COL32(128, 128, 255, 255),
+    IM_COL32(45, 45, 255, 255)
+};
+
+ImU32 GetKeyStateColor(int keyState)
+{
+    return (keyState >= 0 && keyState < 3) ? s_KeyStateColors[keyState] : s_KeyStateColors[0];
+}
+
+ImU32 GetKeyActivityColor(float activity)
+{
+    ImVec4 col0 = ImGui::ColorConvertU32ToFloat4(s_KeyStateColors[activity < 0.5f ? 0 : 1]);
+    ImVec4 col1 = ImGui::ColorConvertU32ToFloat4(s_KeyStateColors[activity < 0.5f ? 1 : 2]);
+    float blend = activity < 0.5f ? activity * 2.f : activity * 2.f - 1.f;
+
+    return ImGui::ColorConvertFloat4ToU32(ImVec4(col0.x + (col1.x - col0.x) * blend, col0.y + (col1.y - col0.y) * blend,
+                                                 col0.z + (col1.z - col0.z) * blend, 1.f));
+}
+
+LeydenJarKeyGeometryCache::LeydenJarKeyGeometryCache()
+    : m_pScratchDrawList(NULL)
+    , m_IsValid(false)
+    , m_DrawListFlags(0)
+    , m_FringeScale(1.f)
+{
+}
+
+LeydenJarKeyGeometryCache::~LeydenJarKeyGeometryCache()
+{
+    delete m_pScratchDrawList;
+}
+
+bool LeydenJarKeyGeometryCache::IsValid(ImDrawList* pDrawList)
+{
+    return m_IsValid && m_DrawListFlags == pDrawList->Flags && m_FringeScale == pDrawList->_FringeScale;
+}
+
+void LeydenJarKeyGeometryCache::Invalidate()
+{
+    m_IsValid = false;
+}
+
+void LeydenJarKeyGeometryCache::Begin(ImDrawList* pDrawList)
+{
+    m_Vertices.clear();
+    m_Indices.clear();
+    m_Keys.clear();
+
+    m_IsValid = false;
+    m_DrawListFlags = pDrawList->Flags;
+    m_FringeScale = pDrawList->_FringeScale;
+
+    // Keys are tessellated by ImGui itself in a draw list sharing the setup of the target one
+    if (m_pScratchDrawList == NULL)
+        m_pScratchDrawList = new ImDrawList(ImGui::GetDrawListSharedData());
+}
+
+int LeydenJarKeyGeometryCache::AddKey(float width0, float width1, float height0, float height1, float x0, float x1, float y0, float y1, float unitSize)
+{
+    // Scratch list is reset for every key so that key indices start at 0
+    m_pScratchDrawList->_ResetForNewFrame();
+    m_pScratchDrawList->Flags = m_DrawListFlags;
+    m_pScratchDrawList->_FringeScale = m_FringeScale;
+
+    // Opaque white is the placeholder colour, fringe vertices come out with a null alpha
+    DrawKeyFill(m_pScratchDrawList, ImVec2(0.f, 0.f), width0, width1, height0, height1, x0, x1, y0, y1, unitSize, IM_COL32_WHITE);
+    int nbFillVtx = m_pScratchDrawList->VtxBuffer.Size;
+    int nbFillIdx = m_pScratchDrawList->IdxBuffer.Size;
+    DrawKeyOutline(m_pScratchDrawList, ImVec2(0.f, 0.f), width0, width1, height0, height1, x0, x1, y0, y1, unitSize, IM_COL32_WHITE);
+
+    LeydenJarCachedKey key;
+    key.firstVtx = int(m_Vertices.size());
+    key.nbFillVtx = nbFillVtx;
+    key.nbVtx = m_pScratchDrawList->VtxBuffer.Size;
+    key.firstIdx = int(m_Indices.size());
+    key.nbFillIdx = nbFillIdx;
+    key.nbIdx = m_pScratchDrawList->IdxBuffer.Size;
+
+    m_Vertices.insert(m_Vertices.end(), m_pScratchDrawList->VtxBuffer.Data, m_pScratchDrawList->VtxBuffer.Data + key.nbVtx);
+    m_Indices.insert(m_Indices.end(), m_pScratchDrawList->IdxBuffer.Data, m_pScratchDrawList->IdxBuffer.Data + key.nbIdx);
+
+    // Outline indices are made relative to the first outline vertex, so that fill and outline can be drawn alone
+    for (int i = key.firstIdx + nbFillIdx; i < key.firstIdx + key.nbIdx; i++)
+        m_Indices[i] = ImDrawIdx(m_Indices[i] - nbFillVtx);
+    m_Keys.push_back(key);
+
+    return int(m_Keys.size()) - 1;
+}
+
+int LeydenJarKeyGeometryCache::AddConvexKey(float width, float height, float x, float y, float unitSize)
+{
+    return AddKey(width, width, height, height, x, x, y, y, unitSize);
+}
+
+void LeydenJarKeyGeometryCache::End()
+{
+    // Builds only happen on layout changes, scratch memory is not kept
+    delete m_pScratchDrawList;
+    m_pScratchDrawList = NULL;
+
+    m_IsValid = true;
+}
+
+void LeydenJarKeyGeometryCache::Draw(ImDrawList* pDrawList, const ImVec2& startDrawPos, int keyIdx, ImU32 bgCol, ImU32 outlineCol)
+{
+    const LeydenJarCachedKey& key = m_Keys[keyIdx];
+    DrawVertices(pDrawList, startDrawPos, key.firstVtx, key.nbFillVtx, key.firstIdx, key.nbFillIdx, NULL, bgCol);
+    DrawOutline(pDrawList, startDrawPos, keyIdx, outlineCol);
+}
+
+void LeydenJarKeyGeometryCache::DrawFill(ImDrawList* pDrawList, const ImVec2& startDrawPos, int keyIdx, const ImVec2& uv, ImU32 bgCol)
+{
+    const LeydenJarCachedKey& key = m_Keys[keyIdx];
+    DrawVertices(pDrawList, startDrawPos, key.firstVtx, key.nbFillVtx, key.firstIdx, key.nbFillIdx, &uv, bgCol);
+}
+
+void LeydenJarKeyGeometryCache::DrawOutline(ImDrawList* pDrawList, const ImVec2& startDrawPos, int keyIdx, ImU32 outlineCol)
+{
+    const LeydenJarCachedKey& key = m_Keys[keyIdx];
+    DrawVertices(pDrawList, startDrawPos, key.firstVtx + key.nbFillVtx, key.nbVtx - key.nbFillVtx,
+                 key.firstIdx + key.nbFillIdx, key.nbIdx - key.nbFillIdx, NULL, outlineCol);
+}
+
+void LeydenJarKeyGeometryCache::DrawVertices(ImDrawList* pDrawList, const ImVec2& startDrawPos, int firstVtx, int nbVtx, int firstIdx, int nbIdx,
+                                             const ImVec2* pUv, ImU32 col)
+{
+    const ImDrawVert* pVertices = &m_Vertices[firstVtx];
+    const ImDrawIdx* pIndices = &m_Indices[firstIdx];
+
+    pDrawList->PrimReserve(nbIdx, nbVtx);
+
+    // Indices are written first, PrimWriteVtx() moves the current vertex index
+    ImDrawIdx firstVtxIdx = ImDrawIdx(pDrawList->_VtxCurrentIdx);
+    for (int i = 0; i < nbIdx; i++)
+        pDrawList->PrimWriteIdx(ImDrawIdx(firstVtxIdx + pIndices[i]));
+
+    // Cached colours are opaque or transparent white, masking keeps the transparency of fringe vertices
+    for (int i = 0; i < nbVtx; i++)
+    {
+        const ImDrawVert& vertex = pVertices[i];
+        pDrawList->PrimWriteVtx(ImVec2(startDrawPos.x + vertex.pos.x, startDrawPos.y + vertex.pos.y), pUv != NULL ? *pUv : vertex.uv,
+                                col & (vertex.col | ~IM_COL32_A_MASK));
+    }
+}
+
+// Two digits per entry, numbers are converted 2 digits at a time
+static const char s_DigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+LeydenJarNumberLabels::LeydenJarNumberLabels()
+    : m_pFont(NULL)
+    , m_FontSize(0.f)
+{
+    for (int digit = 0; digit < 10; digit++)
+        m_Digits[digit] = LeydenJarDigitGlyph();
+}
+
+void LeydenJarNumberLabels::BakeDigits(ImFont* pFont, float fontSize)
+{
+    float scale = fontSize / pFont->FontSize;
+
+    for (int digit = 0; digit < 10; digit++)
+    {
+        LeydenJarDigitGlyph& digitGlyph = m_Digits[digit];
+        const ImFontGlyph* pGlyph = pFont->FindGlyph(ImWchar('0' + digit));
+
+        if (pGlyph == NULL)
+        {
+            digitGlyph = LeydenJarDigitGlyph();
+            continue;
+        }
+
+        digitGlyph.pos0 = ImVec2(pGlyph->X0 * scale, pGlyph->Y0 * scale);
+        digitGlyph.pos1 = ImVec2(pGlyph->X1 * scale, pGlyph->Y1 * scale);
+        digitGlyph.uv0 = ImVec2(pGlyph->U0, pGlyph->V0);
+        digitGlyph.uv1 = ImVec2(pGlyph->U1, pGlyph->V1);
+        digitGlyph.advanceX = pGlyph->AdvanceX * scale;
+    }
+
+    m_pFont = pFont;
+    m_FontSize = fontSize;
+}
+
+void LeydenJarNumberLabels::Draw(ImDrawList* pDrawList, const ImVec2& pos, int labelIdx, uint32_t value, ImU32 col)
+{
+    ImFont* pFont = ImGui::GetFont();
+    float fontSize = ImGui::GetFontSize();
+
+    if (pFont != m_pFont || fontSize != m_FontSize)
+        BakeDigits(pFont, fontSize);
+
+    if (labelIdx >= int(m_Labels.size()))
+    {
+        LeydenJarLabel emptyLabel;
+        std::memset(&emptyLabel, 0, sizeof(emptyLabel));
+        m_Labels.resize(labelIdx + 1, emptyLabel);
+    }
+
+    LeydenJarLabel& label = m_Labels[labelIdx];
+    if (label.nbDigits == 0 || label.value != value)
+    {
+        uint8_t digits[10];
+        int nbDigits = 0;
+        uint32_t remaining = value;
+
+        // Digits are produced least significant first
+        while (remaining >= 100)
+        {
+            const char* pPair = &s_DigitPairs[(remaining % 100) * 2];
+            digits[nbDigits++] = uint8_t(pPair[1] - '0');
+            digits[nbDigits++] = uint8_t(pPair[0] - '0');
+            remaining /= 100;
+        }
+        if (remaining >= 10)
+        {
+            const char* pPair = &s_DigitPairs[remaining * 2];
+            digits[nbDigits++] = uint8_t(pPair[1] - '0');
+            digits[nbDigits++] = uint8_t(pPair[0] - '0');
+        }
+        else
+            digits[nbDigits++] = uint8_t(remaining);
+
+        for (int i = 0; i < nbDigits; i++)
+            label.digits[i] = digits[nbDigits - 1 - i];
+        label.nbDigits = uint8_t(nbDigits);
+        label.value = value;
+    }
+
+    // Same pixel alignment as AddText()
+    float x = float(int(pos.x));
+    float y = float(int(pos.y));
+
+    pDrawList->PrimReserve(label.nbDigits * 6, label.nbDigits * 4);
+    for (int i = 0; i < label.nbDigits; i++)
+    {
+        const LeydenJarDigitGlyph& digitGlyph = m_Digits[label.digits[i]];
+        pDrawList->PrimRectUV(ImVec2(x + digitGlyph.pos0.x, y + digitGlyph.pos0.y), ImVec2(x + digitGlyph.pos1.x, y + digitGlyph.pos1.y),
+                              digitGlyph.uv0, digitGlyph.uv1, col);
+        x += digitGlyph.advanceX;
+    }
+}
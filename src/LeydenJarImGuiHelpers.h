@@ -4,7 +4,10 @@
 // SPDX-License-Identifier: MIT
 
 // Set of helper functions to deal with low level ImGui rendering.
-// For the moment there are only functions to hide complexity of rendering keyboard keys 
+// For the moment there are only functions and a geometry cache to hide complexity of rendering keyboard keys
+
+#include <stdint.h>
+#include <vector>
 
 #include "imgui.h"
 
@@ -17,4 +20,106 @@ void DrawKey(ImDrawList* pDrawList, const ImVec2& startDrawPos,
 // To draw an ISO key the generic function defined earlier must be used.
 void DrawConvexKey(ImDrawList* pDrawList, const ImVec2& startDrawPos, 
 				   float width, float height, float x, float y,
-				   float unitSize, ImU32 bgCol, ImU32 outlineCol);
\ No newline at end of file
+				   float unitSize, ImU32 bgCol, ImU32 outlineCol);
+
+// Fill colour of a key from its level state, states are LeydenJarLevelAnalysis::LeydenJarKeyState values
+// (0: unpressed, 1: pressed light, 2: pressed).
+ImU32 GetKeyStateColor(int keyState);
+
+// Fill colour of a key from an activity between 0 and 1, key state colours are blended: unpressed to pressed light
+// then pressed light to pressed.
+ImU32 GetKeyActivityColor(float activity);
+
+// Keys tessellated once and copied to a draw list every frame, only their draw position and colours change.
+// Keys are built relative to the draw origin with the same paths as DrawKey(), then drawn at any origin: the fill and
+// outline vertices get the new colours, anti-aliasing fringe vertices keep their transparency.
+// Geometry depends on the anti-aliasing setup of the draw list, it is rebuilt when that setup changes.
+class LeydenJarKeyGeometryCache
+{
+public:
+
+	LeydenJarKeyGeometryCache();
+	~LeydenJarKeyGeometryCache();
+
+	// Returns true when keys were built and the draw list setup did not change, owners invalidate keys on layout changes
+	bool IsValid(ImDrawList* pDrawList);
+	void Invalidate();
+
+	// Keys are added between Begin() and End(), AddKey() returns the index used to draw the key
+	void Begin(ImDrawList* pDrawList);
+	int AddKey(float width0, float width1, float height0, float height1, float x0, float x1, float y0, float y1, float unitSize);
+	int AddConvexKey(float width, float height, float x, float y, float unitSize);
+	void End();
+
+	void Draw(ImDrawList* pDrawList, const ImVec2& startDrawPos, int keyIdx, ImU32 bgCol, ImU32 outlineCol);
+	// Draws the fill only, all its vertices get the given texture coordinates
+	void DrawFill(ImDrawList* pDrawList, const ImVec2& startDrawPos, int keyIdx, const ImVec2& uv, ImU32 bgCol);
+	void DrawOutline(ImDrawList* pDrawList, const ImVec2& startDrawPos, int keyIdx, ImU32 outlineCol);
+
+private:
+
+	struct LeydenJarCachedKey
+	{
+		int		firstVtx;
+		int		nbFillVtx;
+		int		nbVtx;
+		int		firstIdx;
+		int		nbFillIdx;
+		int		nbIdx;
+	};
+
+	// Copies vertices [firstVtx, firstVtx + nbVtx) of the cache and their indices, pUv overrides texture coordinates when not null
+	void DrawVertices(ImDrawList* pDrawList, const ImVec2& startDrawPos, int firstVtx, int nbVtx, int firstIdx, int nbIdx,
+					  const ImVec2* pUv, ImU32 col);
+
+	ImDrawList*						m_pScratchDrawList;
+	std::vector<ImDrawVert>			m_Vertices;
+	// Indices are relative to the first vertex of their key
+	std::vector<ImDrawIdx>			m_Indices;
+	std::vector<LeydenJarCachedKey>	m_Keys;
+
+	bool							m_IsValid;
+	ImDrawListFlags					m_DrawListFlags;
+	float							m_FringeScale;
+};
+
+// Unsigned integer labels drawn as quads of the current font digit glyphs, it replaces sprintf() and AddText() for numbers
+// refreshed every frame. Digit glyphs are looked up once per font and every label slot keeps the digits of its last value,
+// so an unchanged value is drawn without any conversion. Labels are drawn like AddText() at the current font size.
+class LeydenJarNumberLabels
+{
+public:
+
+	LeydenJarNumberLabels();
+
+	// Label slots are created on first use, each slot must always be drawn at the same font size
+	void Draw(ImDrawList* pDrawList, const ImVec2& pos, int labelIdx, uint32_t value, ImU32 col);
+
+private:
+
+	struct LeydenJarDigitGlyph
+	{
+		ImVec2	pos0;
+		ImVec2	pos1;
+		ImVec2	uv0;
+		ImVec2	uv1;
+		float	advanceX;
+	};
+
+	struct LeydenJarLabel
+	{
+		uint32_t	value;
+		uint8_t		nbDigits;
+		// Most significant digit first
+		uint8_t		digits[10];
+	};
+
+	void BakeDigits(ImFont* pFont, float fontSize);
+
+private:
+
+	ImFont*							m_pFont;
+	float							m_FontSize;
+	LeydenJarDigitGlyph				m_Digits[10];
+	std::vector<LeydenJarLabel>		m_Labels;
+};
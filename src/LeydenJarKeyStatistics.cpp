@@ -0,0 +1,163 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "LeydenJarKeyStatistics.h"
+
+LeydenJarKeyStatistics::LeydenJarKeyStatistics()
+{
+    LeydenJarKeyStatsConfig config;
+
+    config.windowSize = 256;
+    config.lowPercentile = 5.f;
+    config.highPercentile = 95.f;
+
+    SetConfig(config);
+}
+
+void LeydenJarKeyStatistics::SetConfig(const LeydenJarKeyStatsConfig& config)
+{
+    m_Config = config;
+    m_Config.windowSize = std::min(std::max(m_Config.windowSize, 2), int(kMaxWindowSize));
+    m_Config.lowPercentile = std::min(std::max(m_Config.lowPercentile, 0.f), 50.f);
+    m_Config.highPercentile = std::min(std::max(m_Config.highPercentile, 50.f), 100.f);
+
+    m_Quantiles[QuantileLow] = m_Config.lowPercentile / 100.f;
+    m_Quantiles[QuantileMedian] = 0.5f;
+    m_Quantiles[QuantileHigh] = m_Config.highPercentile / 100.f;
+
+    m_Windows.assign(size_t(kNbKeys) * m_Config.windowSize, 0);
+    m_Histograms.assign(size_t(kNbKeys) * kNbLevels, 0);
+    m_MinQueues.assign(size_t(kNbKeys) * m_Config.windowSize, 0);
+    m_MaxQueues.assign(size_t(kNbKeys) * m_Config.windowSize, 0);
+
+    Reset();
+}
+
+const LeydenJarKeyStatistics::LeydenJarKeyStatsConfig& LeydenJarKeyStatistics::GetConfig()
+{
+    return m_Config;
+}
+
+void LeydenJarKeyStatistics::Reset()
+{
+    std::fill(m_Histograms.begin(), m_Histograms.end(), 0);
+    std::memset(m_Keys, 0, sizeof(m_Keys));
+}
+
+void LeydenJarKeyStatistics::UpdateCursor(const uint16_t* pHistogram, uint32_t nbSamples, float quantile, LeydenJarQuantileCursor& cursor)
+{
+    uint32_t rank = uint32_t(quantile * (nbSamples - 1) + 0.5f);
+
+    while (rank < cursor.nbBelow)
+    {
+        cursor.level--;
+        cursor.nbBelow -= pHistogram[cursor.level];
+    }
+
+    while (rank >= cursor.nbBelow + pHistogram[cursor.level])
+    {
+        cursor.nbBelow += pHistogram[cursor.level];
+        cursor.level++;
+    }
+}
+
+void LeydenJarKeyStatistics::PopExpired(uint16_t* pQueue, LeydenJarLevelQueue& queue, uint32_t pos)
+{
+    // Only the oldest sample of the window leaves it, if it is still queued it is the front one
+    if (queue.nbEntries != 0 && pQueue[queue.first] == pos)
+    {
+        queue.first = (queue.first + 1) % m_Config.windowSize;
+        queue.nbEntries--;
+    }
+}
+
+void LeydenJarKeyStatistics::PushLevel(uint16_t* pQueue, LeydenJarLevelQueue& queue, const uint16_t* pWindow, uint32_t pos, bool isMax)
+{
+    // Queued samples that can no longer be the min or max before leaving the window are dropped
+    uint16_t level = pWindow[pos];
+    while (queue.nbEntries != 0)
+    {
+        uint16_t backLevel = pWindow[pQueue[(queue.first + queue.nbEntries - 1) % m_Config.windowSize]];
+        if (isMax ? (backLevel > level) : (backLevel < level))
+            break;
+        queue.nbEntries--;
+    }
+
+    pQueue[(queue.first + queue.nbEntries) % m_Config.windowSize] = uint16_t(pos);
+    queue.nbEntries++;
+}
+
+void LeydenJarKeyStatistics::AddSample(int key, uint16_t level)
+{
+    LeydenJarKeyState& state = m_Keys[key];
+    uint16_t* pWindow = &m_Windows[size_t(key) * m_Config.windowSize];
+    uint16_t* pHistogram = &m_Histograms[size_t(key) * kNbLevels];
+    uint16_t* pMinQueue = &m_MinQueues[size_t(key) * m_Config.windowSize];
+    uint16_t* pMaxQueue = &m_MaxQueues[size_t(key) * m_Config.windowSize];
+
+    level = std::min(level, uint16_t(kNbLevels - 1));
+
+    if (state.nbSamples == uint32_t(m_Config.windowSize))
+    {
+        uint16_t oldLevel = pWindow[state.writePos];
+
+        state.sum -= oldLevel;
+        state.sumSquares -= uint64_t(oldLevel) * oldLevel;
+        pHistogram[oldLevel]--;
+        for (int i = 0; i < QuantileCount; i++)
+            if (oldLevel < state.cursors[i].level)
+                state.cursors[i].nbBelow--;
+        PopExpired(pMinQueue, state.minQueue, state.writePos);
+        PopExpired(pMaxQueue, state.maxQueue, state.writePos);
+    }
+    else
+        state.nbSamples++;
+
+    pWindow[state.writePos] = level;
+    PushLevel(pMinQueue, state.minQueue, pWindow, state.writePos, false);
+    PushLevel(pMaxQueue, state.maxQueue, pWindow, state.writePos, true);
+    state.writePos = (state.writePos + 1) % m_Config.windowSize;
+
+    state.sum += level;
+    state.sumSquares += uint64_t(level) * level;
+    pHistogram[level]++;
+    for (int i = 0; i < QuantileCount; i++)
+        if (level < state.cursors[i].level)
+            state.cursors[i].nbBelow++;
+
+    for (int i = 0; i < QuantileCount; i++)
+        UpdateCursor(pHistogram, state.nbSamples, m_Quantiles[i], state.cursors[i]);
+}
+
+void LeydenJarKeyStatistics::GetSummary(int key, uint16_t dacThreshold, LeydenJarKeyStatsSummary& summary)
+{
+    const LeydenJarKeyState& state = m_Keys[key];
+    const uint16_t* pWindow = &m_Windows[size_t(key) * m_Config.windowSize];
+
+    std::memset(&summary, 0, sizeof(summary));
+    summary.nbSamples = state.nbSamples;
+    if (state.nbSamples == 0)
+        return;
+
+    double mean = double(state.sum) / state.nbSamples;
+    double variance = 0.0;
+    if (state.nbSamples > 1)
+        variance = std::max((double(state.sumSquares) - double(state.sum) * mean) / (state.nbSamples - 1), 0.0);
+
+    summary.mean = float(mean);
+    summary.stdDev = float(std::sqrt(variance));
+    summary.min = pWindow[m_MinQueues[size_t(key) * m_Config.windowSize + state.minQueue.first]];
+    summary.lowPercentile = state.cursors[QuantileLow].level;
+    summary.median = state.cursors[QuantileMedian].level;
+    summary.highPercentile = state.cursors[QuantileHigh].level;
+    summary.max = pWindow[m_MaxQueues[size_t(key) * m_Config.windowSize + state.maxQueue.first]];
+
+    // A perfectly stable key still has the quantization noise of the ADC (1/sqrt(12) LSB)
+    double noiseFloor = std::max(double(summary.stdDev), 0.2887);
+    double margin = std::max(std::fabs(mean - dacThreshold), 0.001);
+    summary.snrDb = float(20.0 * std::log10(margin / noiseFloor));
+}
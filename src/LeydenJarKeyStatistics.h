@@ -0,0 +1,110 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <vector>
+
+// This class keeps rolling statistics over the last N level samples of every key of a matrix.
+// Memory is allocated once when the window size is configured. Per sample update costs are:
+//  - O(1) for mean and variance, they come from running sums over the window,
+//  - amortized O(1) for min and max, they come from monotonic queues of window positions,
+//  - proportional to the level distance the quantile moved for median and percentiles, they come from a per-key level
+//    histogram and quantile cursors. That distance is a few levels for noise but can be the whole press depth when the
+//    samples of a key go from one population to the other.
+// Different keys can be updated from different threads, a given key must always be updated by a single thread at a time.
+
+class LeydenJarKeyStatistics
+{
+public:
+
+	static const int kNbKeys = 18 * 8;
+	static const int kMaxWindowSize = 4096;
+	// Controller ADC is 12 bits, higher levels are clamped
+	static const int kNbLevels = 4096;
+
+	struct LeydenJarKeyStatsConfig
+	{
+		int		windowSize;
+		float	lowPercentile;
+		float	highPercentile;
+	};
+
+	struct LeydenJarKeyStatsSummary
+	{
+		uint32_t	nbSamples;
+		float		mean;
+		float		stdDev;
+		uint16_t	median;
+		uint16_t	lowPercentile;
+		uint16_t	highPercentile;
+		uint16_t	min;
+		uint16_t	max;
+		// Distance between mean level and bin DAC threshold, relative to noise floor
+		float		snrDb;
+	};
+
+public:
+
+	LeydenJarKeyStatistics();
+
+	// Changing configuration clears all statistics
+	void SetConfig(const LeydenJarKeyStatsConfig& config);
+	const LeydenJarKeyStatsConfig& GetConfig();
+	void Reset();
+
+	void AddSample(int key, uint16_t level);
+	void GetSummary(int key, uint16_t dacThreshold, LeydenJarKeyStatsSummary& summary);
+
+private:
+
+	enum LeydenJarQuantile
+	{
+		QuantileLow = 0,
+		QuantileMedian,
+		QuantileHigh,
+		QuantileCount
+	};
+
+	// Level of the quantile and number of window samples strictly below that level
+	struct LeydenJarQuantileCursor
+	{
+		uint16_t	level;
+		uint32_t	nbBelow;
+	};
+
+	// Ring of window positions whose levels are strictly monotonic, the front one holds the min or max of the window
+	struct LeydenJarLevelQueue
+	{
+		uint32_t	first;
+		uint32_t	nbEntries;
+	};
+
+	struct LeydenJarKeyState
+	{
+		uint32_t	nbSamples;
+		uint32_t	writePos;
+		uint64_t	sum;
+		uint64_t	sumSquares;
+		LeydenJarQuantileCursor cursors[QuantileCount];
+		LeydenJarLevelQueue minQueue;
+		LeydenJarLevelQueue maxQueue;
+	};
+
+private:
+
+	void UpdateCursor(const uint16_t* pHistogram, uint32_t nbSamples, float quantile, LeydenJarQuantileCursor& cursor);
+	void PopExpired(uint16_t* pQueue, LeydenJarLevelQueue& queue, uint32_t pos);
+	void PushLevel(uint16_t* pQueue, LeydenJarLevelQueue& queue, const uint16_t* pWindow, uint32_t pos, bool isMax);
+
+private:
+
+	LeydenJarKeyStatsConfig	m_Config;
+	float					m_Quantiles[QuantileCount];
+	std::vector<uint16_t>	m_Windows;
+	std::vector<uint16_t>	m_Histograms;
+	std::vector<uint16_t>	m_MinQueues;
+	std::vector<uint16_t>	m_MaxQueues;
+	LeydenJarKeyState		m_Keys[kNbKeys];
+};
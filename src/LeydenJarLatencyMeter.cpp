@@ -0,0 +1,252 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <algorithm>
+
+#include "LeydenJarLatencyMeter.h"
+#include "LeydenJarLevelCompare.h"
+
+LeydenJarLatencyMeter::LeydenJarLatencyMeter()
+    : m_Counts(size_t(kNbKeys) * LatencyStageCount * LatencyEdgeCount * kNbBuckets, 0)
+{
+    m_Config.measureLevels = true;
+    m_Config.timeoutMs = 100;
+
+    std::memset(&m_Layout, 0, sizeof(m_Layout));
+    m_Layout.isKeyboardLeft = true;
+    SetLayout(m_Layout);
+}
+
+void LeydenJarLatencyMeter::SetConfig(const LeydenJarLatencyConfig& config)
+{
+    m_Config = config;
+
+    if (m_Config.timeoutMs < 1)
+        m_Config.timeoutMs = 1;
+
+    Reset();
+}
+
+const LeydenJarLatencyMeter::LeydenJarLatencyConfig& LeydenJarLatencyMeter::GetConfig()
+{
+    return m_Config;
+}
+
+void LeydenJarLatencyMeter::SetLayout(const LeydenJarLatencyLayout& layout)
+{
+    m_Layout = layout;
+    m_Layout.nbPhysicalCols = std::min<uint8_t>(m_Layout.nbPhysicalCols, 18);
+    m_Layout.nbPhysicalRows = std::min<uint8_t>(m_Layout.nbPhysicalRows, 8);
+    m_Layout.nbLogicalCols = std::min<uint8_t>(m_Layout.nbLogicalCols, 32);
+    m_Layout.nbLogicalRows = std::min<uint8_t>(m_Layout.nbLogicalRows, 16);
+
+    // Unused matrix positions have no bin (255), first bin threshold is used for them
+    for (int col = 0; col < 18; col++)
+    {
+        for (int row = 0; row < 8; row++)
+        {
+            uint8_t binIdx = m_Layout.binningMap[col][row];
+            m_Thresholds[col][row] = m_Layout.dacThreshold[binIdx < 16 ? binIdx : 0];
+        }
+    }
+
+    // Same mapping as the keypress monitor: a logical row and its counterpart on the other half share the controller row
+    int firstRow;
+    int lastRow;
+    GetLocalLogicalRows(firstRow, lastRow);
+    std::memset(m_LogicalToKey, 0xFF, sizeof(m_LogicalToKey));
+    for (int row = firstRow; row < lastRow; row++)
+    {
+        for (int col = 0; col < m_Layout.nbLogicalCols && col < 18; col++)
+        {
+            int controllerCol = m_Layout.matrixToControllerCols[col];
+            int controllerRow = m_Layout.matrixToControllerRows[row % 8];
+            if (controllerCol < m_Layout.nbPhysicalCols && controllerRow < m_Layout.nbPhysicalRows)
+                m_LogicalToKey[row][col] = int16_t(controllerCol * 8 + controllerRow);
+        }
+    }
+
+    Reset();
+}
+
+void LeydenJarLatencyMeter::Reset()
+{
+    std::memset(m_HasViewState, 0, sizeof(m_HasViewState));
+    std::memset(m_Keys, 0, sizeof(m_Keys));
+    std::memset(m_Accumulators, 0, sizeof(m_Accumulators));
+    std::fill(m_Counts.begin(), m_Counts.end(), 0);
+}
+
+void LeydenJarLatencyMeter::GetLocalLogicalRows(int& firstRow, int& lastRow)
+{
+    if (m_Layout.isKeyboardLeft)
+    {
+        firstRow = 0;
+        lastRow = m_Layout.nbLogicalRows > 8 ? m_Layout.nbLogicalRows / 2 : m_Layout.nbLogicalRows;
+    }
+    else
+    {
+        firstRow = 8;
+        lastRow = m_Layout.nbLogicalRows;
+    }
+}
+
+void LeydenJarLatencyMeter::OnLevels(const uint16_t levels[18][8], const uint64_t colTimeNs[18])
+{
+    bool isBeamSpring = m_Layout.switchTechnology == SwitchTechnologyBeamSpring;
+
+    for (int col = 0; col < m_Layout.nbPhysicalCols; col++)
+    {
+        for (int row = 0; row < m_Layout.nbPhysicalRows; row++)
+        {
+            if (m_Layout.binningMap[col][row] >= 16)
+                continue;
+
+            bool isPressed = IsLevelPressed(levels[col][row], m_Thresholds[col][row], isBeamSpring);
+            OnKeyState(col * 8 + row, LatencyViewLevels, isPressed, colTimeNs[col]);
+        }
+    }
+
+    m_HasViewState[LatencyViewLevels] = true;
+}
+
+void LeydenJarLatencyMeter::OnPhysicalScan(const uint8_t physicalState[18], uint64_t timeNs)
+{
+    for (int col = 0; col < m_Layout.nbPhysicalCols; col++)
+        for (int row = 0; row < m_Layout.nbPhysicalRows; row++)
+            OnKeyState(col * 8 + row, LatencyViewPhysical, (physicalState[col] & (1 << row)) != 0, timeNs);
+
+    m_HasViewState[LatencyViewPhysical] = true;
+}
+
+void LeydenJarLatencyMeter::OnLogicalScan(const uint32_t logicalRows[16], const uint64_t rowTimeNs[16])
+{
+    int firstRow;
+    int lastRow;
+
+    GetLocalLogicalRows(firstRow, lastRow);
+    for (int row = firstRow; row < lastRow; row++)
+    {
+        for (int col = 0; col < m_Layout.nbLogicalCols; col++)
+        {
+            int key = m_LogicalToKey[row][col];
+            if (key >= 0)
+                OnKeyState(key, LatencyViewLogical, (logicalRows[row] & (1u << col)) != 0, rowTimeNs[row]);
+        }
+    }
+
+    m_HasViewState[LatencyViewLogical] = true;
+}
+
+void LeydenJarLatencyMeter::OnKeyState(int key, int view, bool isPressed, uint64_t timeNs)
+{
+    LeydenJarKeyTracking& tracking = m_Keys[key];
+
+    if (tracking.isPressed[view] == uint8_t(isPressed))
+        return;
+
+    tracking.isPressed[view] = uint8_t(isPressed);
+    if (m_HasViewState[view] == false)
+        return;
+
+    int edge = isPressed ? LatencyEdgePress : LatencyEdgeRelease;
+
+    switch (view)
+    {
+        case LatencyViewLevels:
+            // A level oscillating around its threshold keeps the last crossing, that is what the controller reports
+            tracking.levelEdgeNs[edge] = timeNs;
+            tracking.isLevelEdgeMatched[edge] = false;
+            break;
+
+        case LatencyViewPhysical:
+            if (tracking.levelEdgeNs[edge] != 0 && tracking.isLevelEdgeMatched[edge] == false)
+            {
+                AddLatency(key, LatencyLevelToPhysical, edge, tracking.levelEdgeNs[edge], timeNs);
+                tracking.isLevelEdgeMatched[edge] = true;
+            }
+            tracking.physicalEdgeNs[edge] = timeNs;
+            break;
+
+        case LatencyViewLogical:
+            if (tracking.physicalEdgeNs[edge] != 0)
+                AddLatency(key, LatencyPhysicalToLogical, edge, tracking.physicalEdgeNs[edge], timeNs);
+            if (tracking.levelEdgeNs[edge] != 0)
+                AddLatency(key, LatencyLevelToLogical, edge, tracking.levelEdgeNs[edge], timeNs);
+            tracking.physicalEdgeNs[edge] = 0;
+            tracking.levelEdgeNs[edge] = 0;
+            break;
+    }
+}
+
+void LeydenJarLatencyMeter::AddLatency(int key, int stage, int edge, uint64_t fromNs, uint64_t toNs)
+{
+    // An edge seen first by a later view happened between two reads, its latency is below the cycle resolution
+    uint64_t latencyUs = toNs > fromNs ? (toNs - fromNs) / 1000 : 0;
+    if (latencyUs > uint64_t(m_Config.timeoutMs) * 1000)
+        return;
+
+    LeydenJarStageAccumulator& accumulator = m_Accumulators[key][stage][edge];
+    if (accumulator.nbEdges == 0 || latencyUs < accumulator.minUs)
+        accumulator.minUs = uint32_t(latencyUs);
+    if (latencyUs > accumulator.maxUs)
+        accumulator.maxUs = uint32_t(latencyUs);
+    accumulator.sumUs += latencyUs;
+    accumulator.nbEdges++;
+
+    int bucket = std::min(int(latencyUs / kBucketWidthUs), kNbBuckets - 1);
+    GetCounts(key, stage, edge)[bucket]++;
+}
+
+uint32_t* LeydenJarLatencyMeter::GetCounts(int key, int stage, int edge)
+{
+    return &m_Counts[((size_t(key) * LatencyStageCount + stage) * LatencyEdgeCount + edge) * kNbBuckets];
+}
+
+void LeydenJarLatencyMeter::GetKeyLatencies(LeydenJarKeyLatency* latencies)
+{
+    for (int key = 0; key < kNbKeys; key++)
+    {
+        for (int stage = 0; stage < LatencyStageCount; stage++)
+        {
+            for (int edge = 0; edge < LatencyEdgeCount; edge++)
+            {
+                const LeydenJarStageAccumulator& accumulator = m_Accumulators[key][stage][edge];
+                LeydenJarLatencySummary& summary = latencies[key].stages[stage][edge];
+
+                std::memset(&summary, 0, sizeof(summary));
+                summary.nbEdges = accumulator.nbEdges;
+                if (accumulator.nbEdges == 0)
+                    continue;
+
+                summary.minMs = accumulator.minUs / 1000.f;
+                summary.maxMs = accumulator.maxUs / 1000.f;
+                summary.meanMs = float(double(accumulator.sumUs) / accumulator.nbEdges / 1000.0);
+
+                // Percentiles are bucket centers, clamped to the exact min/max
+                const uint32_t* pCounts = GetCounts(key, stage, edge);
+                uint32_t medianRank = (accumulator.nbEdges + 1) / 2;
+                uint32_t p95Rank = std::max<uint32_t>(1, uint32_t(accumulator.nbEdges * 0.95f + 0.5f));
+                uint32_t cumulated = 0;
+                bool hasMedian = false;
+
+                for (int bucket = 0; bucket < kNbBuckets; bucket++)
+                {
+                    cumulated += pCounts[bucket];
+                    float bucketCenterMs = (bucket * kBucketWidthUs + kBucketWidthUs / 2) / 1000.f;
+                    if (hasMedian == false && cumulated >= medianRank)
+                    {
+                        summary.medianMs = std::min(std::max(bucketCenterMs, summary.minMs), summary.maxMs);
+                        hasMedian = true;
+                    }
+                    if (cumulated >= p95Rank)
+                    {
+                        summary.p95Ms = std::min(std::max(bucketCenterMs, summary.minMs), summary.maxMs);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
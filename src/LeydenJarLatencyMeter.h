@@ -0,0 +1,150 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <vector>
+
+// This class measures key press and release latencies through the 3 views of the firmware:
+//   - levels: the time a key level crosses its DAC threshold,
+//   - physical matrix: the time the controller reports the key state change,
+//   - logical matrix: the time QMK reports it, after debouncing.
+// Edges of a key in the 3 views are correlated through the matrix to controller mapping, and the delays
+// level to physical, physical to logical and level to logical are accumulated in per key histograms.
+// Edge times are the reception times of the reads that saw them, so a latency is only known within one
+// measurement cycle: reads of the 3 views must be interleaved as fast as possible.
+// It is written by the agent thread only and does no locking: like other agent data, results are read from other threads
+// (LeydenJarAgent::GetKeyLatencies) only while no request is in progress.
+
+class LeydenJarLatencyMeter
+{
+public:
+
+	static const int kNbKeys = 18 * 8;
+	// Histograms have 0.25 ms buckets up to 32 ms, longer latencies go in the last bucket
+	static const int kNbBuckets = 128;
+	static const uint32_t kBucketWidthUs = 250;
+
+	enum LeydenJarLatencyStage
+	{
+		LatencyLevelToPhysical = 0,
+		LatencyPhysicalToLogical,
+		LatencyLevelToLogical,
+		LatencyStageCount
+	};
+
+	enum LeydenJarLatencyEdge
+	{
+		LatencyEdgePress = 0,
+		LatencyEdgeRelease,
+		LatencyEdgeCount
+	};
+
+	struct LeydenJarLatencyConfig
+	{
+		// Levels are the slowest view to read, leaving them out gives a faster physical to logical measurement
+		bool		measureLevels;
+		// Edges farther apart than this are not considered as the same key event
+		uint32_t	timeoutMs;
+	};
+
+	// Matrix description needed by the measurement, filled from the agent device info
+	struct LeydenJarLatencyLayout
+	{
+		uint8_t		nbPhysicalCols;
+		uint8_t		nbPhysicalRows;
+		uint8_t		nbLogicalCols;
+		uint8_t		nbLogicalRows;
+		uint8_t		switchTechnology;
+		bool		isKeyboardLeft;
+		uint16_t	dacThreshold[16];
+		uint8_t		binningMap[18][8];
+		uint8_t		matrixToControllerRows[8];
+		uint8_t		matrixToControllerCols[18];
+	};
+
+	struct LeydenJarLatencySummary
+	{
+		uint32_t	nbEdges;
+		float		minMs;
+		float		meanMs;
+		float		medianMs;
+		float		p95Ms;
+		float		maxMs;
+	};
+
+	struct LeydenJarKeyLatency
+	{
+		LeydenJarLatencySummary stages[LatencyStageCount][LatencyEdgeCount];
+	};
+
+public:
+
+	LeydenJarLatencyMeter();
+
+	// Changing configuration clears all latencies
+	void SetConfig(const LeydenJarLatencyConfig& config);
+	const LeydenJarLatencyConfig& GetConfig();
+	// Sets the matrix description of the connected device, latencies are cleared
+	void SetLayout(const LeydenJarLatencyLayout& layout);
+	void Reset();
+
+	// Logical rows of the keyboard half connected to the controller, other rows are not measured
+	void GetLocalLogicalRows(int& firstRow, int& lastRow);
+
+	// Called with every read of the measurement cycle, in the order they were done
+	void OnLevels(const uint16_t levels[18][8], const uint64_t colTimeNs[18]);
+	void OnPhysicalScan(const uint8_t physicalState[18], uint64_t timeNs);
+	void OnLogicalScan(const uint32_t logicalRows[16], const uint64_t rowTimeNs[16]);
+
+	// Computes summaries of the physical matrix keys (18 columns of 8 rows)
+	void GetKeyLatencies(LeydenJarKeyLatency* latencies);
+
+private:
+
+	enum LeydenJarLatencyView
+	{
+		LatencyViewLevels = 0,
+		LatencyViewPhysical,
+		LatencyViewLogical,
+		LatencyViewCount
+	};
+
+	struct LeydenJarKeyTracking
+	{
+		uint8_t		isPressed[LatencyViewCount];
+		// Time of the last unmatched level and physical edges, 0 when none
+		uint64_t	levelEdgeNs[LatencyEdgeCount];
+		uint64_t	physicalEdgeNs[LatencyEdgeCount];
+		bool		isLevelEdgeMatched[LatencyEdgeCount];
+	};
+
+	struct LeydenJarStageAccumulator
+	{
+		uint32_t	nbEdges;
+		uint32_t	minUs;
+		uint32_t	maxUs;
+		uint64_t	sumUs;
+	};
+
+private:
+
+	void OnKeyState(int key, int view, bool isPressed, uint64_t timeNs);
+	void AddLatency(int key, int stage, int edge, uint64_t fromNs, uint64_t toNs);
+	uint32_t* GetCounts(int key, int stage, int edge);
+
+private:
+
+	LeydenJarLatencyConfig	m_Config;
+	LeydenJarLatencyLayout	m_Layout;
+	uint16_t				m_Thresholds[18][8];
+	// Physical key index of every logical matrix position, -1 when not mapped
+	int16_t					m_LogicalToKey[16][32];
+
+	// First read of a view after a reset only initializes states, it can not produce edges
+	bool					m_HasViewState[LatencyViewCount];
+	LeydenJarKeyTracking	m_Keys[kNbKeys];
+	LeydenJarStageAccumulator m_Accumulators[kNbKeys][LatencyStageCount][LatencyEdgeCount];
+	std::vector<uint32_t>	m_Counts;
+};
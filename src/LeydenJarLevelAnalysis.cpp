@@ -0,0 +1,244 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <algorithm>
+
+#include "LeydenJarLevelAnalysis.h"
+#include "LeydenJarLevelCompare.h"
+
+LeydenJarLevelAnalysis::LeydenJarLevelAnalysis()
+    : m_NbColumnsPerTask(6)
+    , m_NbColumnGroupsLeft(0)
+    , m_FrameIndex(0)
+    , m_FrameTimeNs(0)
+    , m_HasResults(false)
+{
+    SetKernelType(GetBestLevelKernelType());
+
+    std::memset(&m_Layout, 0, sizeof(m_Layout));
+    std::memset(&m_Thresholds, 0, sizeof(m_Thresholds));
+    std::memset(&m_Levels, 0, sizeof(m_Levels));
+    std::memset(&m_WorkResults, 0, sizeof(m_WorkResults));
+    std::memset(&m_WorkResults.minLevels, 0xFF, sizeof(m_WorkResults.minLevels));
+    std::memset(&m_Results, 0, sizeof(m_Results));
+}
+
+LeydenJarLevelAnalysis::~LeydenJarLevelAnalysis()
+{
+    // Tasks reference this object, they must be done before it goes away
+    m_TaskGroup.Wait();
+}
+
+void LeydenJarLevelAnalysis::Reset(LeydenJarTaskPool& pool, const LeydenJarLevelLayout& layout)
+{
+    pool.Wait(m_TaskGroup);
+
+    m_Layout = layout;
+    m_FrameIndex = 0;
+
+    // Thresholds are resolved once per key so that kernels only deal with packed matrices.
+    // Unused matrix positions have no bin (255), first bin threshold is used for them
+    for (int col = 0; col < 18; col++)
+    {
+        for (int row = 0; row < 8; row++)
+        {
+            uint8_t binIdx = m_Layout.binningMap[col][row];
+            m_Thresholds[col][row] = m_Layout.dacThreshold[binIdx < 16 ? binIdx : 0];
+        }
+    }
+
+    std::memset(&m_Levels, 0, sizeof(m_Levels));
+    std::memset(&m_WorkResults, 0, sizeof(m_WorkResults));
+    std::memset(&m_WorkResults.minLevels, 0xFF, sizeof(m_WorkResults.minLevels));
+    m_KeyStatistics.Reset();
+    m_Histograms.SetThresholds(m_Thresholds);
+    m_ThresholdAdvisor.SetLayout(m_Layout.switchTechnology == SwitchTechnologyBeamSpring, m_Thresholds, m_Layout.binningMap);
+    m_DriftTracker.SetLayout(m_Layout.switchTechnology == SwitchTechnologyBeamSpring, m_Thresholds);
+
+    std::lock_guard<std::mutex> lk(m_ResultsMutex);
+    m_HasResults = false;
+}
+
+void LeydenJarLevelAnalysis::SetColumnsPerTask(int nbColumnsPerTask)
+{
+    m_NbColumnsPerTask = std::max(nbColumnsPerTask, 1);
+}
+
+void LeydenJarLevelAnalysis::SetKernelType(int kernelType)
+{
+    if (IsLevelKernelSupported(kernelType) == false)
+        kernelType = LeydenJarLevelKernelScalar;
+
+    m_KernelType = kernelType;
+    m_Kernel = GetLevelKernel(kernelType);
+}
+
+int LeydenJarLevelAnalysis::GetKernelType()
+{
+    return m_KernelType;
+}
+
+void LeydenJarLevelAnalysis::SetStatisticsConfig(LeydenJarTaskPool& pool, const LeydenJarKeyStatistics::LeydenJarKeyStatsConfig& config)
+{
+    pool.Wait(m_TaskGroup);
+    m_KeyStatistics.SetConfig(config);
+}
+
+const LeydenJarKeyStatistics::LeydenJarKeyStatsConfig& LeydenJarLevelAnalysis::GetStatisticsConfig()
+{
+    return m_KeyStatistics.GetConfig();
+}
+
+void LeydenJarLevelAnalysis::ResetThresholdAdvisor(LeydenJarTaskPool& pool)
+{
+    pool.Wait(m_TaskGroup);
+    m_ThresholdAdvisor.Reset();
+}
+
+void LeydenJarLevelAnalysis::ResetMinMax(LeydenJarTaskPool& pool)
+{
+    pool.Wait(m_TaskGroup);
+    std::memset(&m_WorkResults.minLevels, 0xFF, sizeof(m_WorkResults.minLevels));
+    std::memset(&m_WorkResults.maxLevels, 0, sizeof(m_WorkResults.maxLevels));
+}
+
+void LeydenJarLevelAnalysis::SetDriftConfig(LeydenJarTaskPool& pool, const LeydenJarDriftTracker::LeydenJarDriftConfig& config)
+{
+    pool.Wait(m_TaskGroup);
+    m_DriftTracker.SetConfig(config);
+}
+
+const LeydenJarDriftTracker::LeydenJarDriftConfig& LeydenJarLevelAnalysis::GetDriftConfig()
+{
+    return m_DriftTracker.GetConfig();
+}
+
+void LeydenJarLevelAnalysis::ResetDriftTracker(LeydenJarTaskPool& pool)
+{
+    pool.Wait(m_TaskGroup);
+    m_DriftTracker.Reset();
+}
+
+void LeydenJarLevelAnalysis::GetHistogram(LeydenJarTaskPool& pool, int col, int row, uint32_t counts[LeydenJarLevelHistograms::kNbBuckets], int bucketStartLevels[LeydenJarLevelHistograms::kNbBuckets])
+{
+    pool.Wait(m_TaskGroup);
+
+    std::memcpy(counts, m_Histograms.GetCounts(col, row), LeydenJarLevelHistograms::kNbBuckets * sizeof(uint32_t));
+    for (int bucket = 0; bucket < LeydenJarLevelHistograms::kNbBuckets; bucket++)
+        bucketStartLevels[bucket] = m_Histograms.GetBucketStartLevel(col, row, bucket);
+}
+
+void LeydenJarLevelAnalysis::SetHistogramBucketWidth(LeydenJarTaskPool& pool, int bucketWidth)
+{
+    pool.Wait(m_TaskGroup);
+    m_Histograms.SetBucketWidth(bucketWidth);
+}
+
+int LeydenJarLevelAnalysis::GetHistogramBucketWidth()
+{
+    return m_Histograms.GetBucketWidth();
+}
+
+void LeydenJarLevelAnalysis::ClearHistograms(LeydenJarTaskPool& pool)
+{
+    pool.Wait(m_TaskGroup);
+    m_Histograms.Clear();
+}
+
+bool LeydenJarLevelAnalysis::ExportHistograms(LeydenJarTaskPool& pool, const char* pFileName)
+{
+    pool.Wait(m_TaskGroup);
+    return m_Histograms.ExportCsv(pFileName, m_Layout.nbCols, m_Layout.nbRows, m_Layout.binningMap);
+}
+
+void LeydenJarLevelAnalysis::SubmitFrame(LeydenJarTaskPool& pool, const uint16_t levels[18][8], uint64_t timeNs)
+{
+    pool.Wait(m_TaskGroup);
+
+    std::memcpy(m_Levels[m_FrameIndex % 3], levels, sizeof(m_Levels[0]));
+    m_FrameTimeNs = timeNs;
+
+    int nbCols = m_Layout.nbCols;
+    int nbGroups = (nbCols + m_NbColumnsPerTask - 1) / m_NbColumnsPerTask;
+    if (nbGroups == 0)
+        return;
+
+    m_NbColumnGroupsLeft.store(nbGroups, std::memory_order_relaxed);
+
+    for (int firstCol = 0; firstCol < nbCols; firstCol += m_NbColumnsPerTask)
+    {
+        int lastCol = std::min(firstCol + m_NbColumnsPerTask, nbCols);
+        pool.Submit(m_TaskGroup, [this, firstCol, lastCol] { AnalyseColumns(firstCol, lastCol); });
+    }
+}
+
+void LeydenJarLevelAnalysis::Wait(LeydenJarTaskPool& pool)
+{
+    pool.Wait(m_TaskGroup);
+}
+
+bool LeydenJarLevelAnalysis::GetResults(LeydenJarLevelResults& results)
+{
+    std::lock_guard<std::mutex> lk(m_ResultsMutex);
+
+    if (m_HasResults == false)
+        return false;
+
+    results = m_Results;
+    return true;
+}
+
+void LeydenJarLevelAnalysis::AnalyseColumns(int firstCol, int lastCol)
+{
+    LeydenJarLevelKernelParams params;
+
+    params.pLevels = m_Levels[m_FrameIndex % 3];
+    params.pLevelsPrev1 = m_Levels[(m_FrameIndex + 2) % 3];
+    params.pLevelsPrev2 = m_Levels[(m_FrameIndex + 1) % 3];
+    params.pThresholds = m_Thresholds;
+    params.pMinLevels = m_WorkResults.minLevels;
+    params.pMaxLevels = m_WorkResults.maxLevels;
+    params.pKeyStates = m_WorkResults.keyStates;
+    params.firstCol = firstCol;
+    params.lastCol = lastCol;
+    params.isBeamSpring = m_Layout.switchTechnology == SwitchTechnologyBeamSpring;
+    params.hasHistory = m_FrameIndex >= 2;
+
+    // Median filtering, min/max tracking and key state classification of whole columns
+    m_Kernel(params);
+
+    std::memcpy(m_WorkResults.curLevels[firstCol], params.pLevels[firstCol], (lastCol - firstCol) * sizeof(m_WorkResults.curLevels[0]));
+
+    for (int col = firstCol; col < lastCol; col++)
+    {
+        for (int row = 0; row < m_Layout.nbRows; row++)
+        {
+            m_KeyStatistics.AddSample(col * 8 + row, params.pLevels[col][row]);
+            m_Histograms.AddSample(col, row, params.pLevels[col][row]);
+            if (params.hasHistory)
+                m_ThresholdAdvisor.AddSample(col, row, params.pLevels[col][row], params.pLevelsPrev1[col][row], params.pLevelsPrev2[col][row]);
+            // Baselines only follow unpressed levels, key states need the median of 3 frames
+            if (params.hasHistory && m_WorkResults.keyStates[col][row] == KeyStateUnpressed)
+                m_DriftTracker.AddSample(col, row, params.pLevels[col][row], m_FrameTimeNs);
+            m_DriftTracker.GetDrift(col, row, m_WorkResults.drift[col][row]);
+            m_KeyStatistics.GetSummary(col * 8 + row, m_Thresholds[col][row], m_WorkResults.keyStats[col][row]);
+        }
+    }
+
+    if (m_NbColumnGroupsLeft.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        PublishResults();
+}
+
+void LeydenJarLevelAnalysis::PublishResults()
+{
+    // Keys of a bin are spread over column groups, they are merged once all groups are done
+    m_ThresholdAdvisor.ComputeRecommendations(m_Layout.nbCols, m_Layout.nbRows, m_WorkResults.binRecommendations);
+
+    m_WorkResults.frameIndex = m_FrameIndex;
+    m_FrameIndex++;
+
+    std::lock_guard<std::mutex> lk(m_ResultsMutex);
+    m_Results = m_WorkResults;
+    m_HasResults = true;
+}
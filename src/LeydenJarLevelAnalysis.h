@@ -0,0 +1,122 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <mutex>
+
+#include "LeydenJarTaskPool.h"
+#include "LeydenJarKeyStatistics.h"
+#include "LeydenJarLevelHistograms.h"
+#include "LeydenJarThresholdAdvisor.h"
+#include "LeydenJarDriftTracker.h"
+#include "LeydenJarLevelKernels.h"
+
+// This class post-processes the level frames of one device outside of the GUI thread.
+// A frame is split in column groups that are analysed as separate tasks of a LeydenJarTaskPool:
+// median of the last 3 frames, min/max tracking of unpressed/pressed levels, key state classification
+// rolling per-key statistics, per-key level histograms, DAC threshold recommendations and unpressed level drift.
+// Once the last column group is done, results are published and can be copied by any thread.
+
+class LeydenJarLevelAnalysis
+{
+public:
+
+	enum LeydenJarKeyState
+	{
+		KeyStateUnpressed = 0,
+		KeyStatePressedLight,
+		KeyStatePressed
+	};
+
+	// Matrix description needed by the analysis, filled from the agent device info
+	struct LeydenJarLevelLayout
+	{
+		uint8_t		nbCols;
+		uint8_t		nbRows;
+		uint8_t		switchTechnology;
+		uint16_t	dacThreshold[16];
+		uint8_t		binningMap[18][8];
+	};
+
+	struct LeydenJarLevelResults
+	{
+		uint64_t	frameIndex;
+		uint16_t	curLevels[18][8];
+		uint16_t	minLevels[18][8];
+		uint16_t	maxLevels[18][8];
+		uint8_t		keyStates[18][8];
+		LeydenJarKeyStatistics::LeydenJarKeyStatsSummary keyStats[18][8];
+		LeydenJarThresholdAdvisor::LeydenJarBinRecommendation binRecommendations[16];
+		LeydenJarDriftTracker::LeydenJarKeyDrift drift[18][8];
+	};
+
+public:
+
+	LeydenJarLevelAnalysis();
+	~LeydenJarLevelAnalysis();
+
+	// Clears all history, pending tasks are waited for first
+	void Reset(LeydenJarTaskPool& pool, const LeydenJarLevelLayout& layout);
+	// Sets how many columns are analysed by a single task
+	void SetColumnsPerTask(int nbColumnsPerTask);
+	// Selects the level kernel, the fastest one supported by the CPU is used by default.
+	// Must not be called while a frame is analysed
+	void SetKernelType(int kernelType);
+	int GetKernelType();
+	// Changes the rolling statistics window, statistics are cleared
+	void SetStatisticsConfig(LeydenJarTaskPool& pool, const LeydenJarKeyStatistics::LeydenJarKeyStatsConfig& config);
+	const LeydenJarKeyStatistics::LeydenJarKeyStatsConfig& GetStatisticsConfig();
+	// Clears the samples threshold recommendations are computed from
+	void ResetThresholdAdvisor(LeydenJarTaskPool& pool);
+	// Restarts min/max tracking of unpressed/pressed levels
+	void ResetMinMax(LeydenJarTaskPool& pool);
+	// Changing drift configuration clears baselines
+	void SetDriftConfig(LeydenJarTaskPool& pool, const LeydenJarDriftTracker::LeydenJarDriftConfig& config);
+	const LeydenJarDriftTracker::LeydenJarDriftConfig& GetDriftConfig();
+	void ResetDriftTracker(LeydenJarTaskPool& pool);
+	// Histogram functions wait for pending tasks before accessing histograms
+	// Copies the histogram of one key, bucketStartLevels receives the first level of every bucket
+	void GetHistogram(LeydenJarTaskPool& pool, int col, int row, uint32_t counts[LeydenJarLevelHistograms::kNbBuckets], int bucketStartLevels[LeydenJarLevelHistograms::kNbBuckets]);
+	// Changing bucket width clears histograms
+	void SetHistogramBucketWidth(LeydenJarTaskPool& pool, int bucketWidth);
+	int GetHistogramBucketWidth();
+	void ClearHistograms(LeydenJarTaskPool& pool);
+	bool ExportHistograms(LeydenJarTaskPool& pool, const char* pFileName);
+	// Queues the analysis of a new frame acquired at timeNs (steady clock), the previous frame analysis is waited for first
+	void SubmitFrame(LeydenJarTaskPool& pool, const uint16_t levels[18][8], uint64_t timeNs);
+	// Waits for the analysis of the last submitted frame
+	void Wait(LeydenJarTaskPool& pool);
+	// Copies the last published results, returns false if no frame was analysed since last reset
+	bool GetResults(LeydenJarLevelResults& results);
+
+private:
+
+	void AnalyseColumns(int firstCol, int lastCol);
+	void PublishResults();
+
+private:
+
+	LeydenJarLevelLayout	m_Layout;
+	uint16_t				m_Thresholds[18][8];
+	int						m_KernelType;
+	LeydenJarLevelKernel	m_Kernel;
+	LeydenJarTaskGroup		m_TaskGroup;
+	int						m_NbColumnsPerTask;
+	std::atomic<int>		m_NbColumnGroupsLeft;
+
+	// Written by analysis tasks only, each task owns its columns
+	uint64_t				m_FrameIndex;
+	uint64_t				m_FrameTimeNs;
+	uint16_t				m_Levels[3][18][8];
+	LeydenJarLevelResults	m_WorkResults;
+	LeydenJarKeyStatistics	m_KeyStatistics;
+	LeydenJarLevelHistograms	m_Histograms;
+	LeydenJarThresholdAdvisor	m_ThresholdAdvisor;
+	LeydenJarDriftTracker	m_DriftTracker;
+
+	std::mutex				m_ResultsMutex;
+	bool					m_HasResults;
+	LeydenJarLevelResults	m_Results;
+};
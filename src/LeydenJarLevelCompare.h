@@ -0,0 +1,47 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LEYDEN_JAR_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Level comparisons shared by every consumer of key levels, so that they all agree on when a key is pressed.
+// Thresholds are inclusive: capacitive keys levels go up when pressed, beam spring keys levels go down.
+
+// Switch technology reported by the firmware and stored in recordings
+enum LeydenJarSwitchTechnology
+{
+	SwitchTechnologyModelF = 0,
+	SwitchTechnologyBeamSpring
+};
+
+inline bool IsLevelPressed(uint16_t level, uint16_t threshold, bool isBeamSpring)
+{
+	return isBeamSpring ? (level <= threshold) : (level >= threshold);
+}
+
+#ifdef LEYDEN_JAR_HAS_SSE2
+
+// SSE2 has no unsigned 16 bits compare or min/max, saturated subtraction is used instead:
+// a >= b is (b -sat a) == 0, min(a, b) is a - (a -sat b), max(a, b) is b + (a -sat b)
+static inline __m128i CmpGeU16(__m128i a, __m128i b)
+{
+	return _mm_cmpeq_epi16(_mm_subs_epu16(b, a), _mm_setzero_si128());
+}
+
+static inline __m128i MinU16(__m128i a, __m128i b)
+{
+	return _mm_sub_epi16(a, _mm_subs_epu16(a, b));
+}
+
+static inline __m128i MaxU16(__m128i a, __m128i b)
+{
+	return _mm_add_epi16(b, _mm_subs_epu16(a, b));
+}
+
+#endif
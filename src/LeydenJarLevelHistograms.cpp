@@ -0,0 +1,119 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "LeydenJarLevelHistograms.h"
+
+LeydenJarLevelHistograms::LeydenJarLevelHistograms()
+    : m_BucketShift(2)
+    , m_Counts(size_t(kNbKeys) * kNbBuckets, 0)
+{
+    std::memset(m_Thresholds, 0, sizeof(m_Thresholds));
+    SetThresholds(m_Thresholds);
+}
+
+void LeydenJarLevelHistograms::SetBucketWidth(int bucketWidth)
+{
+    m_BucketShift = 0;
+    while ((2 << m_BucketShift) <= bucketWidth && m_BucketShift < 8)
+        m_BucketShift++;
+
+    SetThresholds(m_Thresholds);
+}
+
+int LeydenJarLevelHistograms::GetBucketWidth()
+{
+    return 1 << m_BucketShift;
+}
+
+void LeydenJarLevelHistograms::SetThresholds(const uint16_t thresholds[18][8])
+{
+    if (thresholds != m_Thresholds)
+        std::memcpy(m_Thresholds, thresholds, sizeof(m_Thresholds));
+
+    for (int col = 0; col < 18; col++)
+        for (int row = 0; row < 8; row++)
+            m_FirstBucketLevel[col][row] = int(m_Thresholds[col][row]) - (kThresholdBucket << m_BucketShift);
+
+    Clear();
+}
+
+void LeydenJarLevelHistograms::Clear()
+{
+    std::fill(m_Counts.begin(), m_Counts.end(), 0);
+}
+
+void LeydenJarLevelHistograms::AddSample(int col, int row, uint16_t level)
+{
+    int offset = int(level) - m_FirstBucketLevel[col][row];
+    int bucket = offset < 0 ? 0 : (offset >> m_BucketShift);
+    if (bucket >= kNbBuckets)
+        bucket = kNbBuckets - 1;
+
+    uint32_t& count = m_Counts[(col * 8 + row) * kNbBuckets + bucket];
+    if (count != 0xFFFFFFFF)
+        count++;
+}
+
+const uint32_t* LeydenJarLevelHistograms::GetCounts(int col, int row)
+{
+    return &m_Counts[(col * 8 + row) * kNbBuckets];
+}
+
+uint64_t LeydenJarLevelHistograms::GetNbSamples(int col, int row)
+{
+    const uint32_t* pCounts = GetCounts(col, row);
+    uint64_t nbSamples = 0;
+
+    for (int bucket = 0; bucket < kNbBuckets; bucket++)
+        nbSamples += pCounts[bucket];
+
+    return nbSamples;
+}
+
+int LeydenJarLevelHistograms::GetBucketStartLevel(int col, int row, int bucket)
+{
+    return m_FirstBucketLevel[col][row] + (bucket << m_BucketShift);
+}
+
+bool LeydenJarLevelHistograms::ExportCsv(const char* pFileName, int nbCols, int nbRows, const uint8_t binningMap[18][8])
+{
+    FILE* pFile = fopen(pFileName, "w");
+    if (pFile == nullptr)
+        return false;
+
+    fprintf(pFile, "col,row,bin,threshold,bucket_start,bucket_end,count\n");
+
+    for (int col = 0; col < nbCols; col++)
+    {
+        for (int row = 0; row < nbRows; row++)
+        {
+            const uint32_t* pCounts = GetCounts(col, row);
+
+            for (int bucket = 0; bucket < kNbBuckets; bucket++)
+            {
+                if (pCounts[bucket] == 0)
+                    continue;
+
+                // Range of first and last buckets is widened to the levels they really absorb
+                int bucketStart = GetBucketStartLevel(col, row, bucket);
+                int bucketEnd = bucketStart + GetBucketWidth() - 1;
+                if (bucket == 0)
+                    bucketStart = 0;
+                if (bucket == kNbBuckets - 1)
+                    bucketEnd = 65535;
+
+                fprintf(pFile, "%d,%d,%d,%d,%d,%d,%u\n", col, row, binningMap[col][row], m_Thresholds[col][row],
+                    bucketStart, bucketEnd, pCounts[bucket]);
+            }
+        }
+    }
+
+    bool isSuccess = ferror(pFile) == 0;
+    fclose(pFile);
+
+    return isSuccess;
+}
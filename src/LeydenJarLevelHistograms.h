@@ -0,0 +1,54 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <vector>
+
+// This class accumulates a level histogram for every key of a matrix, meant for long soak tests.
+// Memory use is fixed whatever the run duration, a sample only increments a bucket counter (saturating at 2^32 - 1).
+// Buckets of a key are aligned on the DAC threshold of its bin: the threshold is always the start of bucket kThresholdBucket,
+// so histograms of keys of the same bin can be compared bucket per bucket.
+// The range is kNbBuckets buckets wide, from kThresholdBucket buckets below the threshold: +/-512 levels around it at the
+// default width of 4 levels. Levels falling below or above it are clamped into the first and last buckets. Widths of 32 levels
+// and more cover the whole 12 bits range of the controller ADC.
+// Different keys can be updated from different threads, a given key must always be updated by a single thread at a time.
+
+class LeydenJarLevelHistograms
+{
+public:
+
+	static const int kNbKeys = 18 * 8;
+	static const int kNbBuckets = 256;
+	static const int kThresholdBucket = kNbBuckets / 2;
+
+public:
+
+	LeydenJarLevelHistograms();
+
+	// Bucket width must be a power of 2 up to 256, changing it clears histograms
+	void SetBucketWidth(int bucketWidth);
+	int GetBucketWidth();
+	// Sets the DAC threshold each key histogram is aligned to, histograms are cleared
+	void SetThresholds(const uint16_t thresholds[18][8]);
+	void Clear();
+
+	void AddSample(int col, int row, uint16_t level);
+
+	const uint32_t* GetCounts(int col, int row);
+	uint64_t GetNbSamples(int col, int row);
+	// Returns the first level of a bucket, last bucket level is this value + bucket width - 1
+	int GetBucketStartLevel(int col, int row, int bucket);
+
+	// Writes all non empty buckets of the first nbCols x nbRows keys as CSV
+	bool ExportCsv(const char* pFileName, int nbCols, int nbRows, const uint8_t binningMap[18][8]);
+
+private:
+
+	int			m_BucketShift;
+	// First level of the first bucket of each key, can be negative
+	int			m_FirstBucketLevel[18][8];
+	uint16_t	m_Thresholds[18][8];
+	std::vector<uint32_t>	m_Counts;
+};
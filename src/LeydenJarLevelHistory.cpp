@@ -0,0 +1,237 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "LeydenJarLevelHistory.h"
+
+LeydenJarLevelHistory::LeydenJarLevelHistory()
+    : m_Capacity(0)
+    , m_NbFrames(0)
+{
+    // About 4.5 hours of frames at 60 Hz, 32 MB for 8 traces
+    SetCapacity(1u << 20);
+}
+
+void LeydenJarLevelHistory::SetCapacity(uint32_t nbFrames)
+{
+    uint32_t minCapacity = 1u << (kBlockShift * kNbBlockLevels);
+    uint32_t capacity = minCapacity;
+    while (capacity < nbFrames && capacity < (1u << 30))
+        capacity <<= 1;
+
+    m_Capacity = capacity;
+    Reset();
+}
+
+uint32_t LeydenJarLevelHistory::GetCapacity()
+{
+    return m_Capacity;
+}
+
+void LeydenJarLevelHistory::Reset()
+{
+    m_NbFrames = 0;
+    m_Timestamps.assign(m_Capacity, 0);
+    m_Traces.clear();
+}
+
+void LeydenJarLevelHistory::AllocateTrace(LeydenJarTrace& trace)
+{
+    trace.levels.assign(m_Capacity, 0);
+    for (int blockLevel = 0; blockLevel < kNbBlockLevels; blockLevel++)
+    {
+        size_t nbBlocks = m_Capacity >> (kBlockShift * (blockLevel + 1));
+        trace.blockMins[blockLevel].assign(nbBlocks, 0);
+        trace.blockMaxs[blockLevel].assign(nbBlocks, 0);
+    }
+}
+
+bool LeydenJarLevelHistory::ToggleKey(int col, int row)
+{
+    for (size_t trace = 0; trace < m_Traces.size(); trace++)
+    {
+        if (m_Traces[trace].col == col && m_Traces[trace].row == row)
+        {
+            m_Traces.erase(m_Traces.begin() + trace);
+            return false;
+        }
+    }
+
+    if (int(m_Traces.size()) >= kMaxTraces)
+        return false;
+
+    m_Traces.push_back(LeydenJarTrace());
+    LeydenJarTrace& trace = m_Traces.back();
+    trace.col = col;
+    trace.row = row;
+    trace.firstFrame = m_NbFrames;
+    AllocateTrace(trace);
+
+    return true;
+}
+
+void LeydenJarLevelHistory::ClearKeys()
+{
+    m_Traces.clear();
+}
+
+int LeydenJarLevelHistory::GetNbTraces()
+{
+    return int(m_Traces.size());
+}
+
+void LeydenJarLevelHistory::GetTraceKey(int trace, int& col, int& row)
+{
+    col = m_Traces[trace].col;
+    row = m_Traces[trace].row;
+}
+
+void LeydenJarLevelHistory::AddFrame(const uint16_t levels[18][8], uint64_t timeNs)
+{
+    uint64_t frame = m_NbFrames;
+    uint32_t mask = m_Capacity - 1;
+
+    // Time searches need increasing times
+    if (frame > 0 && timeNs < m_Timestamps[(frame - 1) & mask])
+        timeNs = m_Timestamps[(frame - 1) & mask];
+    m_Timestamps[frame & mask] = timeNs;
+
+    for (size_t traceIdx = 0; traceIdx < m_Traces.size(); traceIdx++)
+    {
+        LeydenJarTrace& trace = m_Traces[traceIdx];
+        uint16_t level = levels[trace.col][trace.row];
+
+        trace.levels[frame & mask] = level;
+
+        // A block is restarted by its first frame, so blocks overwritten by the ring never mix old and new frames
+        for (int blockLevel = 0; blockLevel < kNbBlockLevels; blockLevel++)
+        {
+            int shift = kBlockShift * (blockLevel + 1);
+            size_t blockSlot = size_t((frame >> shift) & (mask >> shift));
+            uint16_t& blockMin = trace.blockMins[blockLevel][blockSlot];
+            uint16_t& blockMax = trace.blockMaxs[blockLevel][blockSlot];
+
+            if ((frame & ((uint64_t(1) << shift) - 1)) == 0)
+            {
+                blockMin = level;
+                blockMax = level;
+            }
+            else
+            {
+                blockMin = std::min(blockMin, level);
+                blockMax = std::max(blockMax, level);
+            }
+        }
+    }
+
+    m_NbFrames++;
+}
+
+uint64_t LeydenJarLevelHistory::GetOldestFrame()
+{
+    return m_NbFrames > m_Capacity ? m_NbFrames - m_Capacity : 0;
+}
+
+uint64_t LeydenJarLevelHistory::GetNbRetainedFrames()
+{
+    return m_NbFrames - GetOldestFrame();
+}
+
+bool LeydenJarLevelHistory::GetTimeRange(uint64_t& firstNs, uint64_t& lastNs)
+{
+    if (m_NbFrames == 0)
+        return false;
+
+    uint32_t mask = m_Capacity - 1;
+    firstNs = m_Timestamps[GetOldestFrame() & mask];
+    lastNs = m_Timestamps[(m_NbFrames - 1) & mask];
+    return true;
+}
+
+uint64_t LeydenJarLevelHistory::FindFrame(uint64_t timeNs)
+{
+    uint32_t mask = m_Capacity - 1;
+    uint64_t low = GetOldestFrame();
+    uint64_t high = m_NbFrames;
+
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (m_Timestamps[middle & mask] < timeNs)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+void LeydenJarLevelHistory::GetLevelRange(const LeydenJarTrace& trace, uint64_t firstFrame, uint64_t endFrame, uint16_t& minLevel, uint16_t& maxLevel)
+{
+    uint32_t mask = m_Capacity - 1;
+    uint64_t frame = firstFrame;
+
+    minLevel = 0xFFFF;
+    maxLevel = 0;
+
+    // Largest aligned block fitting in the range at each step: at most 15 steps per block level on each side of the range.
+    // Blocks starting inside a retained range were never partially overwritten
+    while (frame < endFrame)
+    {
+        int blockLevel = kNbBlockLevels - 1;
+        for (; blockLevel >= 0; blockLevel--)
+        {
+            int shift = kBlockShift * (blockLevel + 1);
+            uint64_t blockSize = uint64_t(1) << shift;
+            if ((frame & (blockSize - 1)) == 0 && frame + blockSize <= endFrame)
+            {
+                size_t blockSlot = size_t((frame >> shift) & (mask >> shift));
+                minLevel = std::min(minLevel, trace.blockMins[blockLevel][blockSlot]);
+                maxLevel = std::max(maxLevel, trace.blockMaxs[blockLevel][blockSlot]);
+                frame += blockSize;
+                break;
+            }
+        }
+
+        if (blockLevel < 0)
+        {
+            uint16_t level = trace.levels[frame & mask];
+            minLevel = std::min(minLevel, level);
+            maxLevel = std::max(maxLevel, level);
+            frame++;
+        }
+    }
+}
+
+void LeydenJarLevelHistory::Decimate(int trace, uint64_t startNs, uint64_t endNs, int nbColumns, LeydenJarLevelRange* ranges)
+{
+    const LeydenJarTrace& traceData = m_Traces[trace];
+    uint32_t mask = m_Capacity - 1;
+    uint64_t firstFrame = std::max(GetOldestFrame(), traceData.firstFrame);
+    uint64_t durationNs = endNs > startNs ? endNs - startNs : 0;
+
+    uint64_t columnFirstFrame = std::max(FindFrame(startNs), firstFrame);
+    for (int column = 0; column < nbColumns; column++)
+    {
+        LeydenJarLevelRange& range = ranges[column];
+        uint64_t columnEndNs = startNs + durationNs * uint64_t(column + 1) / uint64_t(nbColumns);
+        uint64_t columnEndFrame = std::max(FindFrame(columnEndNs), columnFirstFrame);
+
+        range.isValid = false;
+        if (columnFirstFrame < columnEndFrame)
+        {
+            GetLevelRange(traceData, columnFirstFrame, columnEndFrame, range.min, range.max);
+            range.isValid = true;
+        }
+        else if (columnFirstFrame > firstFrame && columnFirstFrame < m_NbFrames)
+        {
+            // Between two frames, the level is held
+            range.min = traceData.levels[(columnFirstFrame - 1) & mask];
+            range.max = range.min;
+            range.isValid = true;
+        }
+
+        columnFirstFrame = columnEndFrame;
+    }
+}
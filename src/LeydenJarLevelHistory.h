@@ -0,0 +1,84 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <vector>
+
+// This class keeps the level history of a few traced keys in a bounded ring, it feeds the level oscilloscope.
+// Every level frame appends one level per traced key along with the frame time.
+// Min/max levels of aligned blocks of 16, 256, 4096 and 65536 frames are kept next to the levels, so that the min/max
+// of any frame range is read from a bounded number of blocks and levels: decimating a time window to one min/max pair
+// per pixel column costs the same whether the window holds a few frames or millions of them.
+// It is owned and used by the GUI thread only, it does no locking.
+
+class LeydenJarLevelHistory
+{
+public:
+
+	static const int kMaxTraces = 8;
+	static const int kNbBlockLevels = 4;
+	// Each block level groups 16 blocks (or frames) of the level below
+	static const int kBlockShift = 4;
+
+	struct LeydenJarLevelRange
+	{
+		uint16_t	min;
+		uint16_t	max;
+		bool		isValid;
+	};
+
+public:
+
+	LeydenJarLevelHistory();
+
+	// Capacity is rounded up to a power of two of at least 65536 frames, history and traces are cleared
+	void SetCapacity(uint32_t nbFrames);
+	uint32_t GetCapacity();
+	// Clears history and traces
+	void Reset();
+
+	// Starts or stops tracing a physical matrix key, returns true if the key is traced afterwards.
+	// A new trace starts with the next frame, at most kMaxTraces keys are traced
+	bool ToggleKey(int col, int row);
+	void ClearKeys();
+	int GetNbTraces();
+	void GetTraceKey(int trace, int& col, int& row);
+
+	void AddFrame(const uint16_t levels[18][8], uint64_t timeNs);
+
+	// Number of frames in the ring and time of the oldest and newest ones, false when empty
+	uint64_t GetNbRetainedFrames();
+	bool GetTimeRange(uint64_t& firstNs, uint64_t& lastNs);
+
+	// Min/max levels of a trace over nbColumns equal time slices of [startNs, endNs).
+	// Slices without frame hold the level of the previous frame, slices before the trace start or after the last frame are invalid
+	void Decimate(int trace, uint64_t startNs, uint64_t endNs, int nbColumns, LeydenJarLevelRange* ranges);
+
+private:
+
+	struct LeydenJarTrace
+	{
+		int						col;
+		int						row;
+		uint64_t				firstFrame;
+		std::vector<uint16_t>	levels;
+		std::vector<uint16_t>	blockMins[kNbBlockLevels];
+		std::vector<uint16_t>	blockMaxs[kNbBlockLevels];
+	};
+
+	uint64_t GetOldestFrame();
+	// First retained frame whose time is at or after timeNs, the frame count when there is none
+	uint64_t FindFrame(uint64_t timeNs);
+	// Min/max of the frames [firstFrame, endFrame) of a trace, the range must be retained and not empty
+	void GetLevelRange(const LeydenJarTrace& trace, uint64_t firstFrame, uint64_t endFrame, uint16_t& minLevel, uint16_t& maxLevel);
+	void AllocateTrace(LeydenJarTrace& trace);
+
+private:
+
+	uint32_t					m_Capacity;
+	uint64_t					m_NbFrames;
+	std::vector<uint64_t>		m_Timestamps;
+	std::vector<LeydenJarTrace>	m_Traces;
+};
@@ -0,0 +1,189 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include "LeydenJarLevelKernels.h"
+#include "LeydenJarLevelCompare.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+void ProcessLevelsScalar(const LeydenJarLevelKernelParams& params)
+{
+    for (int col = params.firstCol; col < params.lastCol; col++)
+    {
+        for (int row = 0; row < 8; row++)
+        {
+            uint16_t level = params.pLevels[col][row];
+            uint16_t levelPrev1 = params.pLevelsPrev1[col][row];
+            uint16_t levelPrev2 = params.pLevelsPrev2[col][row];
+            uint16_t threshold = params.pThresholds[col][row];
+
+            if (params.hasHistory)
+            {
+                uint16_t lo = levelPrev1 < levelPrev2 ? levelPrev1 : levelPrev2;
+                uint16_t hi = levelPrev1 < levelPrev2 ? levelPrev2 : levelPrev1;
+                uint16_t median = level < lo ? lo : (level > hi ? hi : level);
+
+                if (level < threshold && levelPrev1 < threshold && levelPrev2 < threshold && median < params.pMinLevels[col][row])
+                    params.pMinLevels[col][row] = median;
+                if (level >= threshold && levelPrev1 >= threshold && levelPrev2 >= threshold && median > params.pMaxLevels[col][row])
+                    params.pMaxLevels[col][row] = median;
+            }
+
+            uint8_t keyState = 0;
+            if (IsLevelPressed(level, threshold, params.isBeamSpring))
+            {
+                int depth = params.isBeamSpring ? threshold - level : level - threshold;
+                keyState = (depth <= 3) ? 1 : 2;
+            }
+            params.pKeyStates[col][row] = keyState;
+        }
+    }
+}
+
+#ifdef LEYDEN_JAR_HAS_SSE2
+
+void ProcessLevelsSse2(const LeydenJarLevelKernelParams& params)
+{
+    const __m128i lightMargin = _mm_set1_epi16(3);
+    const __m128i pressedState = _mm_set1_epi16(2);
+    const __m128i lightState = _mm_set1_epi16(3);
+
+    for (int col = params.firstCol; col < params.lastCol; col++)
+    {
+        __m128i level = _mm_loadu_si128(reinterpret_cast<const __m128i*>(params.pLevels[col]));
+        __m128i levelPrev1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(params.pLevelsPrev1[col]));
+        __m128i levelPrev2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(params.pLevelsPrev2[col]));
+        __m128i threshold = _mm_loadu_si128(reinterpret_cast<const __m128i*>(params.pThresholds[col]));
+
+        if (params.hasHistory)
+        {
+            __m128i median = MaxU16(MinU16(level, levelPrev1), MinU16(MaxU16(level, levelPrev1), levelPrev2));
+
+            __m128i ge0 = CmpGeU16(level, threshold);
+            __m128i ge1 = CmpGeU16(levelPrev1, threshold);
+            __m128i ge2 = CmpGeU16(levelPrev2, threshold);
+
+            // Masks of keys whose last 3 levels are all above or all below threshold
+            __m128i above = _mm_and_si128(_mm_and_si128(ge0, ge1), ge2);
+            __m128i below = _mm_andnot_si128(_mm_or_si128(_mm_or_si128(ge0, ge1), ge2), _mm_set1_epi16(-1));
+
+            __m128i minLevels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(params.pMinLevels[col]));
+            __m128i maxLevels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(params.pMaxLevels[col]));
+
+            minLevels = _mm_or_si128(_mm_and_si128(below, MinU16(minLevels, median)), _mm_andnot_si128(below, minLevels));
+            maxLevels = _mm_or_si128(_mm_and_si128(above, MaxU16(maxLevels, median)), _mm_andnot_si128(above, maxLevels));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(params.pMinLevels[col]), minLevels);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(params.pMaxLevels[col]), maxLevels);
+        }
+
+        // Polarity only swaps the compare operands, pressed light keys are within 3 levels of the threshold
+        __m128i pressed;
+        __m128i light;
+        if (params.isBeamSpring == false)
+        {
+            pressed = CmpGeU16(level, threshold);
+            light = CmpGeU16(_mm_adds_epu16(threshold, lightMargin), level);
+        }
+        else
+        {
+            pressed = CmpGeU16(threshold, level);
+            light = CmpGeU16(_mm_adds_epu16(level, lightMargin), threshold);
+        }
+
+        // pressed gives 2, pressed and light gives 2 ^ 3 = 1
+        __m128i keyState = _mm_xor_si128(_mm_and_si128(pressed, pressedState), _mm_and_si128(_mm_and_si128(pressed, light), lightState));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(params.pKeyStates[col]), _mm_packus_epi16(keyState, keyState));
+    }
+}
+
+#else
+
+void ProcessLevelsSse2(const LeydenJarLevelKernelParams& params)
+{
+    ProcessLevelsScalar(params);
+}
+
+#endif
+
+static bool IsAvx2SupportedByCpu()
+{
+#if defined(LEYDEN_JAR_ENABLE_AVX2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#elif defined(LEYDEN_JAR_ENABLE_AVX2) && defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int cpuInfo[4];
+
+    // AVX2 support must be checked on the CPU side and also on the OS side (saving of YMM registers)
+    __cpuid(cpuInfo, 1);
+    bool osSavesYmm = (cpuInfo[2] & (1 << 27)) && (cpuInfo[2] & (1 << 28)) && ((_xgetbv(0) & 0x6) == 0x6);
+    __cpuidex(cpuInfo, 7, 0);
+    return osSavesYmm && (cpuInfo[1] & (1 << 5));
+#else
+    return false;
+#endif
+}
+
+bool IsLevelKernelSupported(int kernelType)
+{
+    static const bool isAvx2Supported = IsAvx2SupportedByCpu();
+
+    switch (kernelType)
+    {
+        case LeydenJarLevelKernelScalar:
+            return true;
+        case LeydenJarLevelKernelSse2:
+#ifdef LEYDEN_JAR_HAS_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case LeydenJarLevelKernelAvx2:
+            return isAvx2Supported;
+        default:
+            return false;
+    }
+}
+
+int GetBestLevelKernelType()
+{
+    for (int kernelType = LeydenJarLevelKernelCount - 1; kernelType > LeydenJarLevelKernelScalar; kernelType--)
+    {
+        if (IsLevelKernelSupported(kernelType))
+            return kernelType;
+    }
+    return LeydenJarLevelKernelScalar;
+}
+
+LeydenJarLevelKernel GetLevelKernel(int kernelType)
+{
+    if (IsLevelKernelSupported(kernelType) == false)
+        return ProcessLevelsScalar;
+
+    switch (kernelType)
+    {
+        case LeydenJarLevelKernelSse2:
+            return ProcessLevelsSse2;
+        case LeydenJarLevelKernelAvx2:
+            return ProcessLevelsAvx2;
+        default:
+            return ProcessLevelsScalar;
+    }
+}
+
+const char* GetLevelKernelName(int kernelType)
+{
+    switch (kernelType)
+    {
+        case LeydenJarLevelKernelScalar:
+            return "Scalar";
+        case LeydenJarLevelKernelSse2:
+            return "SSE2";
+        case LeydenJarLevelKernelAvx2:
+            return "AVX2";
+        default:
+            return "Unknown";
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+
+// Whole-matrix level kernels, they process a range of columns of the packed [18][8] level matrices in one pass:
+// median of the last 3 frames, per key threshold masks, min/max tracking and key state classification.
+// A column holds 8 rows of 16 bits levels, so one column fits an SSE2 register and two columns an AVX2 register.
+// All rows of a column are processed, rows above the matrix row count simply produce unused values.
+// Key states match LeydenJarLevelAnalysis::LeydenJarKeyState values (0: unpressed, 1: pressed light, 2: pressed).
+
+enum LeydenJarLevelKernelType
+{
+	LeydenJarLevelKernelScalar = 0,
+	LeydenJarLevelKernelSse2,
+	LeydenJarLevelKernelAvx2,
+	LeydenJarLevelKernelCount
+};
+
+struct LeydenJarLevelKernelParams
+{
+	const uint16_t	(*pLevels)[8];
+	const uint16_t	(*pLevelsPrev1)[8];
+	const uint16_t	(*pLevelsPrev2)[8];
+	// DAC threshold of every key, already resolved from its bin
+	const uint16_t	(*pThresholds)[8];
+	uint16_t		(*pMinLevels)[8];
+	uint16_t		(*pMaxLevels)[8];
+	uint8_t			(*pKeyStates)[8];
+	int				firstCol;
+	int				lastCol;
+	bool			isBeamSpring;
+	// Min and max are only updated once 3 frames are available
+	bool			hasHistory;
+};
+
+typedef void (*LeydenJarLevelKernel)(const LeydenJarLevelKernelParams& params);
+
+void ProcessLevelsScalar(const LeydenJarLevelKernelParams& params);
+void ProcessLevelsSse2(const LeydenJarLevelKernelParams& params);
+void ProcessLevelsAvx2(const LeydenJarLevelKernelParams& params);
+
+// Returns true if the kernel was compiled in and the CPU supports it
+bool IsLevelKernelSupported(int kernelType);
+// Returns the fastest kernel supported by the CPU
+int GetBestLevelKernelType();
+// Returns the kernel function, falls back to the scalar kernel if not supported
+LeydenJarLevelKernel GetLevelKernel(int kernelType);
+const char* GetLevelKernelName(int kernelType);
@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// This file is the only one compiled with AVX2 code generation enabled (LEYDEN_JAR_ENABLE_AVX2 CMake option),
+// its kernel is only called after a runtime check of the CPU.
+
+#include "LeydenJarLevelKernels.h"
+
+#ifdef LEYDEN_JAR_ENABLE_AVX2
+
+#include <immintrin.h>
+
+void ProcessLevelsAvx2(const LeydenJarLevelKernelParams& params)
+{
+    const __m256i lightMargin = _mm256_set1_epi16(3);
+    const __m256i pressedState = _mm256_set1_epi16(2);
+    const __m256i lightState = _mm256_set1_epi16(3);
+    const __m256i allOnes = _mm256_set1_epi16(-1);
+
+    int col = params.firstCol;
+
+    // Two columns per iteration, the remaining odd column is done by the SSE2 kernel
+    for (; col + 2 <= params.lastCol; col += 2)
+    {
+        __m256i level = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(params.pLevels[col]));
+        __m256i levelPrev1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(params.pLevelsPrev1[col]));
+        __m256i levelPrev2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(params.pLevelsPrev2[col]));
+        __m256i threshold = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(params.pThresholds[col]));
+
+        if (params.hasHistory)
+        {
+            __m256i median = _mm256_max_epu16(_mm256_min_epu16(level, levelPrev1), _mm256_min_epu16(_mm256_max_epu16(level, levelPrev1), levelPrev2));
+
+            // a >= b is max(a, b) == a
+            __m256i ge0 = _mm256_cmpeq_epi16(_mm256_max_epu16(level, threshold), level);
+            __m256i ge1 = _mm256_cmpeq_epi16(_mm256_max_epu16(levelPrev1, threshold), levelPrev1);
+            __m256i ge2 = _mm256_cmpeq_epi16(_mm256_max_epu16(levelPrev2, threshold), levelPrev2);
+
+            __m256i above = _mm256_and_si256(_mm256_and_si256(ge0, ge1), ge2);
+            __m256i below = _mm256_andnot_si256(_mm256_or_si256(_mm256_or_si256(ge0, ge1), ge2), allOnes);
+
+            __m256i minLevels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(params.pMinLevels[col]));
+            __m256i maxLevels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(params.pMaxLevels[col]));
+
+            minLevels = _mm256_blendv_epi8(minLevels, _mm256_min_epu16(minLevels, median), below);
+            maxLevels = _mm256_blendv_epi8(maxLevels, _mm256_max_epu16(maxLevels, median), above);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(params.pMinLevels[col]), minLevels);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(params.pMaxLevels[col]), maxLevels);
+        }
+
+        __m256i pressed;
+        __m256i light;
+        if (params.isBeamSpring == false)
+        {
+            pressed = _mm256_cmpeq_epi16(_mm256_max_epu16(level, threshold), level);
+            light = _mm256_cmpeq_epi16(_mm256_min_epu16(level, _mm256_adds_epu16(threshold, lightMargin)), level);
+        }
+        else
+        {
+            pressed = _mm256_cmpeq_epi16(_mm256_min_epu16(level, threshold), level);
+            light = _mm256_cmpeq_epi16(_mm256_max_epu16(_mm256_adds_epu16(level, lightMargin), threshold), _mm256_adds_epu16(level, lightMargin));
+        }
+
+        __m256i keyState = _mm256_xor_si256(_mm256_and_si256(pressed, pressedState), _mm256_and_si256(_mm256_and_si256(pressed, light), lightState));
+
+        // Packing works per 128 bits lane, each lane holds one column in its low 8 bytes
+        __m256i packed = _mm256_packus_epi16(keyState, keyState);
+        __m128i packedCols = _mm_unpacklo_epi64(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(params.pKeyStates[col]), packedCols);
+    }
+
+    if (col < params.lastCol)
+    {
+        LeydenJarLevelKernelParams tailParams = params;
+        tailParams.firstCol = col;
+        ProcessLevelsSse2(tailParams);
+    }
+}
+
+#else
+
+void ProcessLevelsAvx2(const LeydenJarLevelKernelParams& params)
+{
+    ProcessLevelsScalar(params);
+}
+
+#endif
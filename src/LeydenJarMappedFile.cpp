@@ -0,0 +1,134 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include "LeydenJarMappedFile.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+LeydenJarMappedFile::LeydenJarMappedFile()
+    : m_pData(nullptr)
+    , m_Size(0)
+    , m_FileHandle(nullptr)
+    , m_MappingHandle(nullptr)
+{
+}
+
+LeydenJarMappedFile::~LeydenJarMappedFile()
+{
+    Close();
+}
+
+#if defined(_WIN32)
+
+bool LeydenJarMappedFile::Open(const char* pFileName)
+{
+    Close();
+
+    HANDLE fileHandle = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(fileHandle, &fileSize) == FALSE || fileSize.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == NULL)
+    {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    void* pData = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (pData == NULL)
+    {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    m_FileHandle = fileHandle;
+    m_MappingHandle = mappingHandle;
+    m_pData = static_cast<const uint8_t*>(pData);
+    m_Size = size_t(fileSize.QuadPart);
+
+    return true;
+}
+
+void LeydenJarMappedFile::Close()
+{
+    if (m_pData != nullptr)
+        UnmapViewOfFile(m_pData);
+    if (m_MappingHandle != nullptr)
+        CloseHandle(m_MappingHandle);
+    if (m_FileHandle != nullptr)
+        CloseHandle(m_FileHandle);
+
+    m_pData = nullptr;
+    m_Size = 0;
+    m_FileHandle = nullptr;
+    m_MappingHandle = nullptr;
+}
+
+#else
+
+bool LeydenJarMappedFile::Open(const char* pFileName)
+{
+    Close();
+
+    int fd = open(pFileName, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* pData = mmap(nullptr, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid once the file descriptor is closed
+    close(fd);
+    if (pData == MAP_FAILED)
+        return false;
+
+    // Chunks are read front to back
+    madvise(pData, size_t(fileStat.st_size), MADV_SEQUENTIAL);
+
+    m_pData = static_cast<const uint8_t*>(pData);
+    m_Size = size_t(fileStat.st_size);
+
+    return true;
+}
+
+void LeydenJarMappedFile::Close()
+{
+    if (m_pData != nullptr)
+        munmap(const_cast<uint8_t*>(m_pData), m_Size);
+
+    m_pData = nullptr;
+    m_Size = 0;
+}
+
+#endif
+
+const uint8_t* LeydenJarMappedFile::GetData()
+{
+    return m_pData;
+}
+
+size_t LeydenJarMappedFile::GetSize()
+{
+    return m_Size;
+}
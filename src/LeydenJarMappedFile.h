@@ -0,0 +1,37 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <stddef.h>
+
+// This class maps a whole file in memory for reading, pages are only loaded by the OS when accessed.
+// Windows file mapping API and POSIX mmap are used depending on the platform.
+
+class LeydenJarMappedFile
+{
+public:
+
+	LeydenJarMappedFile();
+	~LeydenJarMappedFile();
+
+	bool Open(const char* pFileName);
+	void Close();
+
+	const uint8_t* GetData();
+	size_t GetSize();
+
+private:
+
+	// Copies are not allowed, the mapping is owned by a single object
+	LeydenJarMappedFile(const LeydenJarMappedFile&);
+	LeydenJarMappedFile& operator=(const LeydenJarMappedFile&);
+
+private:
+
+	const uint8_t*	m_pData;
+	size_t			m_Size;
+	void*			m_FileHandle;
+	void*			m_MappingHandle;
+};
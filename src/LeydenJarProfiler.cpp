@@ -0,0 +1,191 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+#include "LeydenJarProfiler.h"
+
+std::atomic<bool> LeydenJarProfiler::s_IsEnabled(false);
+std::mutex LeydenJarProfiler::s_RingsMutex;
+std::atomic<LeydenJarProfiler::LeydenJarThreadRings*> LeydenJarProfiler::s_pRings[LeydenJarProfiler::kMaxThreads];
+std::atomic<int> LeydenJarProfiler::s_NbRings(0);
+
+LeydenJarProfiler::LeydenJarThreadRingsOwner::LeydenJarThreadRingsOwner()
+    : pRings(AcquireRings())
+{
+}
+
+LeydenJarProfiler::LeydenJarThreadRingsOwner::~LeydenJarThreadRingsOwner()
+{
+    if (pRings != nullptr)
+        pRings->isUsed.store(false);
+}
+
+void LeydenJarProfiler::SetEnabled(bool isEnabled)
+{
+    s_IsEnabled.store(isEnabled, std::memory_order_relaxed);
+}
+
+bool LeydenJarProfiler::IsEnabled()
+{
+    return s_IsEnabled.load(std::memory_order_relaxed);
+}
+
+const char* LeydenJarProfiler::GetZoneName(int zone)
+{
+    switch (zone)
+    {
+    case ProfileZoneFrame:
+        return "Frame";
+    case ProfileZoneRunStep:
+        return "RunStep";
+    case ProfileZoneJsonDecode:
+        return "Keyboard definition decode";
+    case ProfileZoneWaitEndRequest:
+        return "Wait end request";
+    case ProfileZoneHidRoundTrip:
+        return "HID round trip";
+    default:
+        return "Unknown";
+    }
+}
+
+uint64_t LeydenJarProfiler::GetTimestampNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LeydenJarProfiler::LeydenJarThreadRings* LeydenJarProfiler::AcquireRings()
+{
+    std::lock_guard<std::mutex> lk(s_RingsMutex);
+
+    int nbRings = s_NbRings.load();
+    for (int ringsIdx = 0; ringsIdx < nbRings; ringsIdx++)
+    {
+        LeydenJarThreadRings* pRings = s_pRings[ringsIdx].load();
+        bool isUsed = false;
+        if (pRings->isUsed.compare_exchange_strong(isUsed, true))
+            return pRings;
+    }
+
+    if (nbRings == kMaxThreads)
+        return nullptr;
+
+    LeydenJarThreadRings* pRings = new LeydenJarThreadRings;
+    pRings->isUsed.store(true);
+    for (int zone = 0; zone < ProfileZoneCount; zone++)
+    {
+        pRings->writeIdx[zone].store(0);
+        for (uint32_t sampleIdx = 0; sampleIdx < kRingSize; sampleIdx++)
+        {
+            pRings->endNs[zone][sampleIdx].store(0);
+            pRings->durationNs[zone][sampleIdx].store(0);
+        }
+    }
+
+    s_pRings[nbRings].store(pRings);
+    s_NbRings.store(nbRings + 1);
+
+    return pRings;
+}
+
+LeydenJarProfiler::LeydenJarThreadRings* LeydenJarProfiler::GetThreadRings()
+{
+    static thread_local LeydenJarThreadRingsOwner owner;
+    return owner.pRings;
+}
+
+void LeydenJarProfiler::Record(int zone, uint64_t startNs, uint64_t endNs)
+{
+    LeydenJarThreadRings* pRings = GetThreadRings();
+    if (pRings == nullptr)
+        return;
+
+    uint64_t durationNs = endNs - startNs;
+    uint32_t writeIdx = pRings->writeIdx[zone].load(std::memory_order_relaxed);
+    uint32_t slot = writeIdx & (kRingSize - 1);
+
+    // Pairs with the acquire fence of GetSamples(): a reader seeing any of these stores then sees at least this writeIdx
+    std::atomic_thread_fence(std::memory_order_release);
+    pRings->endNs[zone][slot].store(endNs, std::memory_order_relaxed);
+    pRings->durationNs[zone][slot].store(uint32_t(std::min<uint64_t>(durationNs, 0xFFFFFFFFu)), std::memory_order_relaxed);
+    pRings->writeIdx[zone].store(writeIdx + 1, std::memory_order_release);
+}
+
+void LeydenJarProfiler::GetSamples(int zone, uint64_t sinceNs, std::vector<LeydenJarProfileSample>& samples)
+{
+    samples.clear();
+
+    int nbRings = s_NbRings.load();
+    for (int ringsIdx = 0; ringsIdx < nbRings; ringsIdx++)
+    {
+        LeydenJarThreadRings* pRings = s_pRings[ringsIdx].load();
+        size_t firstSample = samples.size();
+
+        uint32_t writeIdx = pRings->writeIdx[zone].load(std::memory_order_acquire);
+        uint32_t nbSamples = std::min(writeIdx, kRingSize);
+        for (uint32_t sampleIdx = writeIdx - nbSamples; sampleIdx != writeIdx; sampleIdx++)
+        {
+            LeydenJarProfileSample sample;
+            sample.endNs = pRings->endNs[zone][sampleIdx & (kRingSize - 1)].load(std::memory_order_relaxed);
+            sample.durationNs = pRings->durationNs[zone][sampleIdx & (kRingSize - 1)].load(std::memory_order_relaxed);
+            samples.push_back(sample);
+        }
+
+        // Oldest samples may have been overwritten by the owning thread during the copy. Samples before newWriteIdx - kRingSize
+        // are, and the one at newWriteIdx - kRingSize may be: its slot is the one written by a Record() in progress
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t newWriteIdx = pRings->writeIdx[zone].load(std::memory_order_relaxed);
+        int32_t nbInvalid = int32_t(newWriteIdx + 1 - kRingSize - (writeIdx - nbSamples));
+        uint32_t nbOverwritten = nbInvalid > 0 ? std::min(uint32_t(nbInvalid), nbSamples) : 0;
+        samples.erase(samples.begin() + firstSample, samples.begin() + firstSample + nbOverwritten);
+    }
+
+    samples.erase(std::remove_if(samples.begin(), samples.end(), [sinceNs](const LeydenJarProfileSample& sample) { return sample.endNs <= sinceNs; }), samples.end());
+    std::sort(samples.begin(), samples.end(), [](const LeydenJarProfileSample& sample0, const LeydenJarProfileSample& sample1) { return sample0.endNs < sample1.endNs; });
+}
+
+void LeydenJarProfiler::ComputeStats(const std::vector<LeydenJarProfileSample>& samples, uint64_t windowNs, LeydenJarZoneStats& stats)
+{
+    stats.nbSamples = uint32_t(samples.size());
+    stats.rateHz = 0.f;
+    stats.meanUs = 0.f;
+    stats.p50Us = 0.f;
+    stats.p90Us = 0.f;
+    stats.p99Us = 0.f;
+    stats.maxUs = 0.f;
+
+    if (samples.empty())
+        return;
+
+    std::vector<uint32_t> durations(samples.size());
+    uint64_t sumNs = 0;
+    for (size_t sampleIdx = 0; sampleIdx < samples.size(); sampleIdx++)
+    {
+        durations[sampleIdx] = samples[sampleIdx].durationNs;
+        sumNs += samples[sampleIdx].durationNs;
+    }
+    std::sort(durations.begin(), durations.end());
+
+    // Nearest rank percentiles
+    size_t nbDurations = durations.size();
+    stats.rateHz = windowNs > 0 ? float(double(nbDurations) * 1e9 / double(windowNs)) : 0.f;
+    stats.meanUs = float(double(sumNs) / nbDurations / 1000.0);
+    stats.p50Us = durations[std::min(nbDurations - 1, (nbDurations * 50 + 99) / 100 - 1)] / 1000.f;
+    stats.p90Us = durations[std::min(nbDurations - 1, (nbDurations * 90 + 99) / 100 - 1)] / 1000.f;
+    stats.p99Us = durations[std::min(nbDurations - 1, (nbDurations * 99 + 99) / 100 - 1)] / 1000.f;
+    stats.maxUs = durations.back() / 1000.f;
+}
+
+void LeydenJarProfiler::ComputeHistogram(const std::vector<LeydenJarProfileSample>& samples, uint32_t bucketWidthUs, int nbBuckets, float* counts)
+{
+    std::fill(counts, counts + nbBuckets, 0.f);
+
+    for (size_t sampleIdx = 0; sampleIdx < samples.size(); sampleIdx++)
+    {
+        uint32_t bucket = samples[sampleIdx].durationNs / 1000 / bucketWidthUs;
+        counts[std::min<uint32_t>(bucket, uint32_t(nbBuckets - 1))] += 1.f;
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// This class collects the durations of a few instrumented zones of the GUI and agent threads: frames, RunStep(),
+// keyboard definition decoding, waits for agent requests and HID round trips.
+// Every thread writes its samples in its own rings, one per zone, with relaxed atomic stores only: recording a zone costs
+// 2 clock reads and no lock. The GUI thread reads the rings of all threads to build the profiler overlay, samples
+// overwritten while being read are dropped.
+// Nothing is recorded while the profiler is disabled, a zone then only costs a flag read.
+
+class LeydenJarProfiler
+{
+public:
+
+	enum LeydenJarProfileZone
+	{
+		// Main loop frame, from the start of the ImGui frame to the buffer swap
+		ProfileZoneFrame = 0,
+		ProfileZoneRunStep,
+		ProfileZoneJsonDecode,
+		ProfileZoneWaitEndRequest,
+		ProfileZoneHidRoundTrip,
+		ProfileZoneCount
+	};
+
+	// Samples kept per zone and thread, a power of 2. HID round trips go up to 8 kHz, so this keeps about 2 seconds of them:
+	// the statistics window of the overlay. Rings take about 1 MB per recording thread
+	static const uint32_t kRingSize = 16384;
+	// Threads recording samples at the same time, samples of extra threads are dropped
+	static const int kMaxThreads = 64;
+
+	struct LeydenJarProfileSample
+	{
+		uint64_t	endNs;
+		uint32_t	durationNs;
+	};
+
+	struct LeydenJarZoneStats
+	{
+		uint32_t	nbSamples;
+		// Zone occurrences per second over the statistics window
+		float		rateHz;
+		float		meanUs;
+		float		p50Us;
+		float		p90Us;
+		float		p99Us;
+		float		maxUs;
+	};
+
+public:
+
+	static void SetEnabled(bool isEnabled);
+	static bool IsEnabled();
+	static const char* GetZoneName(int zone);
+
+	// Steady clock timestamp in nanoseconds, the single time source of the profiler and of HID command timings
+	static uint64_t GetTimestampNs();
+	// Called by LeydenJarProfileScope, startNs is 0 when the profiler was disabled at the start of the zone
+	static void Record(int zone, uint64_t startNs, uint64_t endNs);
+
+	// Samples of a zone from all threads ending after sinceNs, in end time order
+	static void GetSamples(int zone, uint64_t sinceNs, std::vector<LeydenJarProfileSample>& samples);
+	static void ComputeStats(const std::vector<LeydenJarProfileSample>& samples, uint64_t windowNs, LeydenJarZoneStats& stats);
+	// Duration histogram, the last bucket also counts longer durations
+	static void ComputeHistogram(const std::vector<LeydenJarProfileSample>& samples, uint32_t bucketWidthUs, int nbBuckets, float* counts);
+
+private:
+
+	struct LeydenJarThreadRings
+	{
+		std::atomic<bool>		isUsed;
+		std::atomic<uint32_t>	writeIdx[ProfileZoneCount];
+		std::atomic<uint64_t>	endNs[ProfileZoneCount][kRingSize];
+		std::atomic<uint32_t>	durationNs[ProfileZoneCount][kRingSize];
+	};
+
+	struct LeydenJarThreadRingsOwner
+	{
+		LeydenJarThreadRings*	pRings;
+
+		LeydenJarThreadRingsOwner();
+		~LeydenJarThreadRingsOwner();
+	};
+
+	static LeydenJarThreadRings* GetThreadRings();
+	static LeydenJarThreadRings* AcquireRings();
+
+	static std::atomic<bool> s_IsEnabled;
+	// Rings of all threads, rings of ended threads are reused by new ones. They are never freed so that readers can
+	// use them without lock once they are published
+	static std::mutex		s_RingsMutex;
+	static std::atomic<LeydenJarThreadRings*> s_pRings[kMaxThreads];
+	static std::atomic<int>	s_NbRings;
+};
+
+// Records the duration of the enclosing scope in a profiler zone
+
+class LeydenJarProfileScope
+{
+public:
+
+	LeydenJarProfileScope(int zone)
+		: m_Zone(zone)
+		, m_StartNs(LeydenJarProfiler::IsEnabled() ? LeydenJarProfiler::GetTimestampNs() : 0)
+	{
+	}
+
+	~LeydenJarProfileScope()
+	{
+		if (m_StartNs != 0)
+			LeydenJarProfiler::Record(m_Zone, m_StartNs, LeydenJarProfiler::GetTimestampNs());
+	}
+
+private:
+
+	LeydenJarProfileScope(const LeydenJarProfileScope&);
+	LeydenJarProfileScope& operator=(const LeydenJarProfileScope&);
+
+	int			m_Zone;
+	uint64_t	m_StartNs;
+};
@@ -3,7 +3,9 @@
 
 #include <iostream>
 #include <cstring>
+#include <mutex>
 #include "LeydenJarProtocol.h" 
+#include "LeydenJarProfiler.h"
 
 const uint16_t	c_LeydenJarProtocolMagic	= 0x21C0;
 const uint8_t	c_GetProtocolVersionId		= 1;
@@ -32,6 +34,12 @@ enum LeydenJarCommandId {
 	LeydenJarCommandIdIsKeyboardLeft
 };
 
+// Several protocol instances can live in different threads (one per opened device).
+// The HID library is initialized by the first instance and finalized by the last one,
+// and enumeration/opening calls, that touch library wide state, are serialized.
+static std::mutex	s_HidLibraryMutex;
+static int			s_HidLibraryRefCount = 0;
+
 enum VialKeyboardValueId {
 	VialGetKeyboardId = 0,
 	VialGetSize,
@@ -46,15 +54,30 @@ LeydenJarProtocol::LeydenJarProtocol()
 {
 	std::memset(m_RawHidSendPacket, 0, sizeof(m_RawHidSendPacket));
 	std::memset(m_RawHidRcvPacket, 0, sizeof(m_RawHidRcvPacket));
+	std::memset(&m_LastCommandTiming, 0, sizeof(m_LastCommandTiming));
+}
+
+uint64_t LeydenJarProtocol::GetTimestampNs()
+{
+	// Same clock as profiler zones, so that command timings and profiled zones can be compared
+	return LeydenJarProfiler::GetTimestampNs();
+}
+
+const LeydenJarProtocol::LeydenJarCommandTiming& LeydenJarProtocol::GetLastCommandTiming()
+{
+	return m_LastCommandTiming;
 }
 
 bool LeydenJarProtocol::Initialize()
 {
-	if (hid_init())
+	std::lock_guard<std::mutex> lk(s_HidLibraryMutex);
+
+	if (s_HidLibraryRefCount == 0 && hid_init())
 	{
 		printf("ERROR: Cannot initialize HID library.");
 		return false;
 	}
+	s_HidLibraryRefCount++;
 
 	return true;
 }
@@ -64,7 +87,13 @@ bool LeydenJarProtocol::Finalize()
 	CloseDevice();
 	FreeEnumeratedDevices();
 
-	if (hid_exit())
+	std::lock_guard<std::mutex> lk(s_HidLibraryMutex);
+
+	if (s_HidLibraryRefCount == 0)
+		return false;
+	s_HidLibraryRefCount--;
+
+	if (s_HidLibraryRefCount == 0 && hid_exit())
 	{
 		printf("ERROR: Cannot finalize HID library.");
 		return false;
@@ -78,7 +107,10 @@ bool LeydenJarProtocol::EnumerateDevices()
 	CloseDevice();
 	FreeEnumeratedDevices();
 
-	m_pEnumeratedDeviceInfo = hid_enumerate(0x1209, 0x4704);
+	{
+		std::lock_guard<std::mutex> lk(s_HidLibraryMutex);
+		m_pEnumeratedDeviceInfo = hid_enumerate(0x1209, 0x4704);
+	}
 	if (m_pEnumeratedDeviceInfo == nullptr)
 	{
 		printf("INFO: Cannot enumerate HID devices or no Leyden Jar devices connected.");
@@ -92,6 +124,7 @@ void LeydenJarProtocol::FreeEnumeratedDevices()
 {
 	if (m_pEnumeratedDeviceInfo != nullptr)
 	{
+		std::lock_guard<std::mutex> lk(s_HidLibraryMutex);
 		hid_free_enumeration(m_pEnumeratedDeviceInfo);
 		m_pEnumeratedDeviceInfo = nullptr;
 	}
@@ -147,7 +180,10 @@ bool LeydenJarProtocol::OpenDevice(int deviceIndex)
 		return false;
 	}
 
-	m_pHidDevice = hid_open_path(selectedHidDeviceInfo->path);
+	{
+		std::lock_guard<std::mutex> lk(s_HidLibraryMutex);
+		m_pHidDevice = hid_open_path(selectedHidDeviceInfo->path);
+	}
 	if (m_pHidDevice == nullptr)
 		return false;
 
@@ -233,6 +269,14 @@ void LeydenJarProtocol::FillViaSendPacketHeader(uint8_t viaCommand, uint8_t comm
 
 bool LeydenJarProtocol::HidSendCommand(bool hidReceive, bool checkReturn)
 {
+	LeydenJarProfileScope profileScope(LeydenJarProfiler::ProfileZoneHidRoundTrip);
+
+	m_LastCommandTiming.sendTimeNs = GetTimestampNs();
+	m_LastCommandTiming.receiveTimeNs = m_LastCommandTiming.sendTimeNs;
+
+	if (m_pHidDevice == nullptr)
+		return false;
+
 	int ret = hid_write(m_pHidDevice, m_RawHidSendPacket, sizeof(m_RawHidSendPacket));
 	if (ret != sizeof(m_RawHidSendPacket))
 	{
@@ -243,6 +287,7 @@ bool LeydenJarProtocol::HidSendCommand(bool hidReceive, bool checkReturn)
 	if (hidReceive == true)
 	{
 		ret = hid_read(m_pHidDevice, m_RawHidRcvPacket, sizeof(m_RawHidRcvPacket));
+		m_LastCommandTiming.receiveTimeNs = GetTimestampNs();
 		if (ret != sizeof(m_RawHidRcvPacket))
 		{
 			printf("ERROR: hid_read call.");
@@ -11,6 +11,15 @@
 
 class LeydenJarProtocol
 {
+public:
+	// Steady clock timing of the last HID command exchange, in nanoseconds.
+	// receiveTimeNs equals sendTimeNs when no answer was expected.
+	struct LeydenJarCommandTiming
+	{
+		uint64_t sendTimeNs;
+		uint64_t receiveTimeNs;
+	};
+
 public:
 	LeydenJarProtocol();
 	~LeydenJarProtocol() {}
@@ -49,11 +58,17 @@ public:
 	bool GetVialInfos(uint8_t& version0, uint8_t& version1, uint8_t& version2, uint8_t& version3, uint8_t* pUid);
 	bool GetVialKeyboardDefinitionSize(uint32_t& definitionSize);
 	bool GetVialKeyboardDefinitionData(uint32_t definitionSize, uint8_t* pKeyboardDefinitionData);
+	bool GetVialKeyboardDefinitionDataBlock(uint16_t blockNumber, uint8_t* pBlockData);
 
 	bool GetViaProtocolVersion(uint8_t& major, uint8_t& minor);
 
 	void PrintDeviceList();
 
+	// Timing of the last command sent with HidSendCommand()
+	const LeydenJarCommandTiming& GetLastCommandTiming();
+	// Steady clock timestamp in nanoseconds, the time base of all the timings
+	static uint64_t GetTimestampNs();
+
 private:
 	void PrintDevice(struct hid_device_info* curDev, int deviceIndex);
 	void FillLeydenJarSendPacketHeader(uint8_t getOrSet, uint8_t command);
@@ -61,8 +76,6 @@ private:
 	bool HidSendCommand(bool hidReceive = true, bool checkReturn = true);
 	bool GenericCommandNoPayload(uint8_t getOrSet, uint8_t command, bool hidReceive = true);
 
-	bool GetVialKeyboardDefinitionDataBlock(uint16_t blockNumber, uint8_t* pBlockData);
-
 private:
 	struct hid_device_info* m_pEnumeratedDeviceInfo;
 	hid_device* m_pHidDevice;
@@ -70,4 +83,5 @@ private:
 	uint8_t m_RawHidRcvPacket[32];
 	uint8_t* m_pSendPayloadPtr;
 	uint8_t* m_pRcvPayloadPtr;
+	LeydenJarCommandTiming m_LastCommandTiming;
 };
\ No newline at end of file
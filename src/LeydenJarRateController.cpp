@@ -0,0 +1,76 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include "LeydenJarRateController.h"
+
+// Rate multiplier applied on each idle scan once the idle hold time has elapsed
+const float c_IdleBackoffFactor = 0.9f;
+
+LeydenJarRateController::LeydenJarRateController()
+    : m_LastScanStartNs(0)
+    , m_LastActivityNs(0)
+{
+    m_Config.enabled = true;
+    m_Config.minRateHz = 10.f;
+    m_Config.maxRateHz = 1000.f;
+    m_Config.idleHoldMs = 2000;
+    m_Config.levelNoise = 3;
+
+    m_CurrentRateHz = m_Config.maxRateHz;
+}
+
+void LeydenJarRateController::SetConfig(const LeydenJarRateConfig& config)
+{
+    m_Config = config;
+
+    if (m_Config.minRateHz < 0.1f)
+        m_Config.minRateHz = 0.1f;
+    if (m_Config.maxRateHz < m_Config.minRateHz)
+        m_Config.maxRateHz = m_Config.minRateHz;
+
+    // Start again from the fastest rate, the user is probably looking at the monitor
+    m_CurrentRateHz = m_Config.maxRateHz;
+}
+
+const LeydenJarRateController::LeydenJarRateConfig& LeydenJarRateController::GetConfig()
+{
+    return m_Config;
+}
+
+uint64_t LeydenJarRateController::GetNextScanTimeNs()
+{
+    if (m_Config.enabled == false || m_LastScanStartNs == 0)
+        return 0;
+
+    return m_LastScanStartNs + uint64_t(1000000000.0 / m_CurrentRateHz);
+}
+
+void LeydenJarRateController::OnScanStart(uint64_t timeNs)
+{
+    m_LastScanStartNs = timeNs;
+}
+
+void LeydenJarRateController::OnScanEnd(bool activity, uint64_t timeNs)
+{
+    if (activity)
+    {
+        m_LastActivityNs = timeNs;
+        m_CurrentRateHz = m_Config.maxRateHz;
+        return;
+    }
+
+    if (timeNs - m_LastActivityNs < uint64_t(m_Config.idleHoldMs) * 1000000)
+        return;
+
+    m_CurrentRateHz *= c_IdleBackoffFactor;
+    if (m_CurrentRateHz < m_Config.minRateHz)
+        m_CurrentRateHz = m_Config.minRateHz;
+}
+
+float LeydenJarRateController::GetCurrentRateHz()
+{
+    if (m_Config.enabled == false)
+        return 0.f;
+
+    return m_CurrentRateHz;
+}
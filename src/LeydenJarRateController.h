@@ -0,0 +1,48 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+
+// This class paces the scans of the keypress and level monitors.
+// The scan rate jumps to its maximum as soon as some activity is seen (key edges, level changes above noise)
+// and slowly backs off to an idle rate when nothing changes for a while.
+// It is owned and used by the agent thread only, it does no locking.
+
+class LeydenJarRateController
+{
+public:
+
+	struct LeydenJarRateConfig
+	{
+		bool		enabled;
+		float		minRateHz;
+		float		maxRateHz;
+		uint32_t	idleHoldMs;
+		uint16_t	levelNoise;
+	};
+
+public:
+
+	LeydenJarRateController();
+
+	void SetConfig(const LeydenJarRateConfig& config);
+	const LeydenJarRateConfig& GetConfig();
+
+	// Returns the earliest time the next scan should start, in steady clock nanoseconds
+	uint64_t GetNextScanTimeNs();
+	// Called when a scan starts
+	void OnScanStart(uint64_t timeNs);
+	// Called when a scan is completed, with the result of the activity detection on its data
+	void OnScanEnd(bool activity, uint64_t timeNs);
+	// Returns the current target scan rate
+	float GetCurrentRateHz();
+
+private:
+
+	LeydenJarRateConfig	m_Config;
+	float				m_CurrentRateHz;
+	uint64_t			m_LastScanStartNs;
+	uint64_t			m_LastActivityNs;
+};
@@ -0,0 +1,222 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+
+#include "LeydenJarRecorder.h"
+
+// Encoded chunks are gathered and written to the file once this size is reached
+const size_t c_WriteBatchSize = 1024 * 1024;
+
+LeydenJarRecorder::LeydenJarRecorder()
+    : m_IsRecording(false)
+    , m_IsStopping(false)
+    , m_pFile(nullptr)
+    , m_QueueHead(0)
+    , m_QueueCount(0)
+{
+    std::memset(&m_Header, 0, sizeof(m_Header));
+    std::memset(&m_Stats, 0, sizeof(m_Stats));
+
+    for (int stream = 0; stream < LeydenJarRecordStreamCount; stream++)
+        m_CurrentChunk[stream] = -1;
+}
+
+LeydenJarRecorder::~LeydenJarRecorder()
+{
+    Stop();
+}
+
+bool LeydenJarRecorder::Start(const char* pFileName, const LeydenJarRecordingHeader& header)
+{
+    Stop();
+
+    m_pFile = fopen(pFileName, "wb");
+    if (m_pFile == nullptr)
+        return false;
+
+    m_Header = header;
+    std::memset(&m_Stats, 0, sizeof(m_Stats));
+    if (fwrite(&m_Header, sizeof(m_Header), 1, m_pFile) != 1)
+        m_Stats.isWriteError = true;
+    m_Stats.nbWrittenBytes = sizeof(m_Header);
+
+    // All memory used by the acquisition path is allocated here
+    m_Chunks.resize(LeydenJarRecordStreamCount * kNbChunksPerStream);
+    for (int stream = 0; stream < LeydenJarRecordStreamCount; stream++)
+    {
+        m_CurrentChunk[stream] = -1;
+        m_FreeChunks[stream].clear();
+        m_FreeChunks[stream].reserve(kNbChunksPerStream);
+
+        for (int i = 0; i < kNbChunksPerStream; i++)
+        {
+            int chunkIdx = stream * kNbChunksPerStream + i;
+            m_Chunks[chunkIdx].stream = stream;
+            m_Chunks[chunkIdx].nbRecords = 0;
+            m_Chunks[chunkIdx].timestamps.resize(kChunkRecords);
+            m_Chunks[chunkIdx].records.resize(kChunkRecords * GetRecordSize(stream));
+            m_FreeChunks[stream].push_back(chunkIdx);
+        }
+    }
+    m_QueueHead = 0;
+    m_QueueCount = 0;
+    m_WriteBuffer.reserve(c_WriteBatchSize + kChunkRecords * GetRecordSize(LeydenJarRecordLevels));
+
+    m_IsStopping = false;
+    m_IsRecording = true;
+    m_Thread = std::thread(&LeydenJarRecorder::WriterLoop, this);
+
+    return true;
+}
+
+void LeydenJarRecorder::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_Mutex);
+        if (m_IsRecording == false)
+            return;
+
+        // Partially filled chunks are written as well
+        for (int stream = 0; stream < LeydenJarRecordStreamCount; stream++)
+        {
+            if (m_CurrentChunk[stream] != -1)
+                QueueChunk(m_CurrentChunk[stream]);
+            m_CurrentChunk[stream] = -1;
+        }
+        m_IsRecording = false;
+        m_IsStopping = true;
+    }
+    m_CondVar.notify_all();
+    m_Thread.join();
+
+    fclose(m_pFile);
+    m_pFile = nullptr;
+}
+
+bool LeydenJarRecorder::IsRecording()
+{
+    std::lock_guard<std::mutex> lk(m_Mutex);
+    return m_IsRecording;
+}
+
+LeydenJarRecorder::LeydenJarRecorderStats LeydenJarRecorder::GetStats()
+{
+    std::lock_guard<std::mutex> lk(m_Mutex);
+    return m_Stats;
+}
+
+void LeydenJarRecorder::RecordLevels(uint64_t timeNs, const uint16_t levels[18][8])
+{
+    Record(LeydenJarRecordLevels, timeNs, levels);
+}
+
+void LeydenJarRecorder::RecordPhysicalScan(uint64_t timeNs, const uint8_t physicalState[18])
+{
+    Record(LeydenJarRecordPhysical, timeNs, physicalState);
+}
+
+void LeydenJarRecorder::RecordLogicalScan(uint64_t timeNs, const uint32_t logicalRows[16])
+{
+    Record(LeydenJarRecordLogical, timeNs, logicalRows);
+}
+
+void LeydenJarRecorder::Record(int stream, uint64_t timeNs, const void* pRecord)
+{
+    bool isChunkFull = false;
+
+    {
+        std::lock_guard<std::mutex> lk(m_Mutex);
+        if (m_IsRecording == false)
+            return;
+
+        if (m_CurrentChunk[stream] == -1)
+        {
+            if (m_FreeChunks[stream].empty())
+            {
+                m_Stats.nbDroppedRecords++;
+                return;
+            }
+            m_CurrentChunk[stream] = m_FreeChunks[stream].back();
+            m_FreeChunks[stream].pop_back();
+        }
+
+        LeydenJarRecordChunk& chunk = m_Chunks[m_CurrentChunk[stream]];
+        size_t recordSize = GetRecordSize(stream);
+
+        chunk.timestamps[chunk.nbRecords] = timeNs;
+        std::memcpy(&chunk.records[chunk.nbRecords * recordSize], pRecord, recordSize);
+        chunk.nbRecords++;
+
+        m_Stats.nbRecords[stream]++;
+        m_Stats.nbRawBytes += recordSize + sizeof(uint64_t);
+
+        if (chunk.nbRecords == kChunkRecords)
+        {
+            QueueChunk(m_CurrentChunk[stream]);
+            m_CurrentChunk[stream] = -1;
+            isChunkFull = true;
+        }
+    }
+
+    if (isChunkFull)
+        m_CondVar.notify_all();
+}
+
+void LeydenJarRecorder::QueueChunk(int chunkIdx)
+{
+    int nbQueueSlots = LeydenJarRecordStreamCount * kNbChunksPerStream;
+
+    m_QueuedChunks[(m_QueueHead + m_QueueCount) % nbQueueSlots] = chunkIdx;
+    m_QueueCount++;
+}
+
+void LeydenJarRecorder::WriterLoop()
+{
+    int nbQueueSlots = LeydenJarRecordStreamCount * kNbChunksPerStream;
+
+    for (;;)
+    {
+        int chunkIdx;
+
+        {
+            std::unique_lock<std::mutex> lk(m_Mutex);
+            m_CondVar.wait(lk, [this] { return m_QueueCount != 0 || m_IsStopping; });
+
+            if (m_QueueCount == 0)
+                break;
+
+            chunkIdx = m_QueuedChunks[m_QueueHead];
+            m_QueueHead = (m_QueueHead + 1) % nbQueueSlots;
+            m_QueueCount--;
+        }
+
+        // The chunk is owned by this thread until it is given back to the free list
+        LeydenJarRecordChunk& chunk = m_Chunks[chunkIdx];
+        EncodeRecordingChunk(m_Header, chunk.stream, chunk.nbRecords, chunk.timestamps.data(), chunk.records.data(), m_WriteBuffer);
+
+        if (m_WriteBuffer.size() >= c_WriteBatchSize)
+            WriteBuffer();
+
+        std::lock_guard<std::mutex> lk(m_Mutex);
+        chunk.nbRecords = 0;
+        m_FreeChunks[chunk.stream].push_back(chunkIdx);
+    }
+
+    WriteBuffer();
+    fflush(m_pFile);
+}
+
+void LeydenJarRecorder::WriteBuffer()
+{
+    if (m_WriteBuffer.empty())
+        return;
+
+    bool isSuccess = fwrite(m_WriteBuffer.data(), 1, m_WriteBuffer.size(), m_pFile) == m_WriteBuffer.size();
+
+    std::lock_guard<std::mutex> lk(m_Mutex);
+    m_Stats.nbWrittenBytes += m_WriteBuffer.size();
+    if (isSuccess == false)
+        m_Stats.isWriteError = true;
+    m_WriteBuffer.clear();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "LeydenJarRecordingCodec.h"
+
+// This class records level frames, physical scans and logical scans to a file, see LeydenJarRecordingCodec.h for the format.
+// Record functions are called by the agent thread on its acquisition path: they only copy the record into a preallocated
+// chunk, encoding and file writes are done by a background thread in batches.
+// When the writer falls behind and no chunk is free, records are dropped and counted instead of blocking acquisition.
+
+class LeydenJarRecorder
+{
+public:
+
+	static const uint32_t kChunkRecords = 4096;
+	static const int kNbChunksPerStream = 4;
+
+	struct LeydenJarRecorderStats
+	{
+		uint64_t	nbRecords[LeydenJarRecordStreamCount];
+		uint64_t	nbDroppedRecords;
+		uint64_t	nbRawBytes;
+		uint64_t	nbWrittenBytes;
+		bool		isWriteError;
+	};
+
+public:
+
+	LeydenJarRecorder();
+	~LeydenJarRecorder();
+
+	// Creates the file and starts the writer thread
+	bool Start(const char* pFileName, const LeydenJarRecordingHeader& header);
+	// Writes pending records and closes the file
+	void Stop();
+	bool IsRecording();
+	LeydenJarRecorderStats GetStats();
+
+	void RecordLevels(uint64_t timeNs, const uint16_t levels[18][8]);
+	void RecordPhysicalScan(uint64_t timeNs, const uint8_t physicalState[18]);
+	void RecordLogicalScan(uint64_t timeNs, const uint32_t logicalRows[16]);
+
+private:
+
+	struct LeydenJarRecordChunk
+	{
+		int						stream;
+		uint32_t				nbRecords;
+		std::vector<uint64_t>	timestamps;
+		std::vector<uint8_t>	records;
+	};
+
+	void Record(int stream, uint64_t timeNs, const void* pRecord);
+	// Queues a chunk for writing, mutex must be held
+	void QueueChunk(int chunkIdx);
+	void WriterLoop();
+	void WriteBuffer();
+
+private:
+
+	std::mutex					m_Mutex;
+	std::condition_variable		m_CondVar;
+	std::thread					m_Thread;
+	bool						m_IsRecording;
+	bool						m_IsStopping;
+
+	LeydenJarRecordingHeader	m_Header;
+	FILE*						m_pFile;
+	std::vector<LeydenJarRecordChunk> m_Chunks;
+	// Chunk being filled per stream, -1 if none
+	int							m_CurrentChunk[LeydenJarRecordStreamCount];
+	std::vector<int>			m_FreeChunks[LeydenJarRecordStreamCount];
+	// Ring of chunks waiting for the writer, in recording order
+	int							m_QueuedChunks[LeydenJarRecordStreamCount * kNbChunksPerStream];
+	int							m_QueueHead;
+	int							m_QueueCount;
+
+	// Writer thread only
+	std::vector<uint8_t>		m_WriteBuffer;
+
+	LeydenJarRecorderStats		m_Stats;
+};
@@ -0,0 +1,338 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <algorithm>
+
+#include "LeydenJarRecordingCodec.h"
+
+const uint16_t c_RecordingVersion = 1;
+const uint32_t c_BlockSize = 128;
+// Recorder chunks hold 4096 records (about 1.2 MB of levels), anything much larger comes from a corrupted header
+const size_t c_MaxChunkRecordsSize = 64 * 1024 * 1024;
+
+void InitRecordingHeader(LeydenJarRecordingHeader& header)
+{
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "LJRC", 4);
+    header.version = c_RecordingVersion;
+}
+
+bool IsRecordingHeaderValid(const LeydenJarRecordingHeader& header)
+{
+    return std::memcmp(header.magic, "LJRC", 4) == 0 && header.version == c_RecordingVersion &&
+        header.nbPhysicalCols <= 18 && header.nbPhysicalRows <= 8 && header.nbLogicalRows <= 16;
+}
+
+bool IsChunkHeaderValid(const LeydenJarChunkHeader& chunkHeader)
+{
+    if (std::memcmp(chunkHeader.magic, "CHNK", 4) != 0 || chunkHeader.stream >= LeydenJarRecordStreamCount)
+        return false;
+
+    // Each record has at least a one byte timestamp varint
+    if (chunkHeader.nbRecords > chunkHeader.payloadSize)
+        return false;
+
+    return uint64_t(chunkHeader.nbRecords) * GetRecordSize(chunkHeader.stream) <= c_MaxChunkRecordsSize;
+}
+
+size_t GetRecordSize(int stream)
+{
+    switch (stream)
+    {
+        case LeydenJarRecordLevels:
+            return 18 * 8 * sizeof(uint16_t);
+        case LeydenJarRecordPhysical:
+            return 18;
+        case LeydenJarRecordLogical:
+            return 16 * sizeof(uint32_t);
+        default:
+            return 0;
+    }
+}
+
+static inline uint32_t ZigZagEncode(int32_t value)
+{
+    return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+static inline int32_t ZigZagDecode(uint32_t value)
+{
+    return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+static void WriteVarint(uint64_t value, std::vector<uint8_t>& out)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+static bool ReadVarint(const uint8_t*& pData, const uint8_t* pEnd, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (pData >= pEnd)
+            return false;
+
+        uint8_t byte = *pData++;
+        value |= uint64_t(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void PackValues(const uint32_t* values, uint32_t nbValues, std::vector<uint8_t>& out)
+{
+    for (uint32_t first = 0; first < nbValues; first += c_BlockSize)
+    {
+        uint32_t count = std::min(c_BlockSize, nbValues - first);
+
+        uint32_t orBits = 0;
+        for (uint32_t i = 0; i < count; i++)
+            orBits |= values[first + i];
+
+        uint8_t width = 0;
+        while (width < 32 && (orBits >> width) != 0)
+            width++;
+        out.push_back(width);
+
+        uint64_t bits = 0;
+        int nbBits = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            bits |= uint64_t(values[first + i]) << nbBits;
+            nbBits += width;
+            while (nbBits >= 8)
+            {
+                out.push_back(uint8_t(bits));
+                bits >>= 8;
+                nbBits -= 8;
+            }
+        }
+        if (nbBits > 0)
+            out.push_back(uint8_t(bits));
+    }
+}
+
+static bool UnpackValues(const uint8_t*& pData, const uint8_t* pEnd, uint32_t nbValues, uint32_t* values)
+{
+    for (uint32_t first = 0; first < nbValues; first += c_BlockSize)
+    {
+        uint32_t count = std::min(c_BlockSize, nbValues - first);
+
+        if (pData >= pEnd)
+            return false;
+        uint8_t width = *pData++;
+        if (width > 32 || size_t(pEnd - pData) < (size_t(count) * width + 7) / 8)
+            return false;
+
+        uint64_t mask = (uint64_t(1) << width) - 1;
+        uint64_t bits = 0;
+        int nbBits = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            while (nbBits < width)
+            {
+                bits |= uint64_t(*pData++) << nbBits;
+                nbBits += 8;
+            }
+            values[first + i] = uint32_t(bits & mask);
+            bits >>= width;
+            nbBits -= width;
+        }
+    }
+    return true;
+}
+
+static uint32_t ReadRecordValue(int stream, const uint8_t* pRecord, int column)
+{
+    uint16_t level;
+    uint32_t row;
+
+    switch (stream)
+    {
+        case LeydenJarRecordLevels:
+            std::memcpy(&level, pRecord + column * sizeof(uint16_t), sizeof(level));
+            return level;
+        case LeydenJarRecordPhysical:
+            return pRecord[column];
+        default:
+            std::memcpy(&row, pRecord + column * sizeof(uint32_t), sizeof(row));
+            return row;
+    }
+}
+
+static void WriteRecordValue(int stream, uint8_t* pRecord, int column, uint32_t value)
+{
+    uint16_t level = uint16_t(value);
+
+    switch (stream)
+    {
+        case LeydenJarRecordLevels:
+            std::memcpy(pRecord + column * sizeof(uint16_t), &level, sizeof(level));
+            break;
+        case LeydenJarRecordPhysical:
+            pRecord[column] = uint8_t(value);
+            break;
+        default:
+            std::memcpy(pRecord + column * sizeof(uint32_t), &value, sizeof(value));
+            break;
+    }
+}
+
+// Columns of a stream, as indices of values inside a raw record
+static int GetColumns(const LeydenJarRecordingHeader& header, int stream, int columns[18 * 8])
+{
+    int nbColumns = 0;
+
+    switch (stream)
+    {
+        case LeydenJarRecordLevels:
+            for (int col = 0; col < header.nbPhysicalCols; col++)
+                for (int row = 0; row < header.nbPhysicalRows; row++)
+                    columns[nbColumns++] = col * 8 + row;
+            break;
+        case LeydenJarRecordPhysical:
+            for (int col = 0; col < header.nbPhysicalCols; col++)
+                columns[nbColumns++] = col;
+            break;
+        case LeydenJarRecordLogical:
+            for (int row = 0; row < header.nbLogicalRows; row++)
+                columns[nbColumns++] = row;
+            break;
+    }
+
+    return nbColumns;
+}
+
+void EncodeRecordingChunk(const LeydenJarRecordingHeader& header, int stream, uint32_t nbRecords, const uint64_t* timestamps, const uint8_t* records, std::vector<uint8_t>& out)
+{
+    LeydenJarChunkHeader chunkHeader;
+    std::memset(&chunkHeader, 0, sizeof(chunkHeader));
+    std::memcpy(chunkHeader.magic, "CHNK", 4);
+    chunkHeader.stream = uint8_t(stream);
+    chunkHeader.nbRecords = nbRecords;
+    chunkHeader.firstTimestampNs = nbRecords != 0 ? timestamps[0] : 0;
+
+    size_t headerOffset = out.size();
+    out.resize(headerOffset + sizeof(chunkHeader));
+
+    // Timestamps are paced by the agent, delta of delta is small but gaps can be long so varints are used
+    uint64_t prevTimestamp = chunkHeader.firstTimestampNs;
+    int64_t prevDelta = 0;
+    for (uint32_t i = 0; i < nbRecords; i++)
+    {
+        int64_t delta = int64_t(timestamps[i] - prevTimestamp);
+        int64_t deltaOfDelta = delta - prevDelta;
+        WriteVarint((uint64_t(deltaOfDelta) << 1) ^ uint64_t(deltaOfDelta >> 63), out);
+        prevTimestamp = timestamps[i];
+        prevDelta = delta;
+    }
+
+    size_t recordSize = GetRecordSize(stream);
+    int columns[18 * 8];
+    int nbColumns = GetColumns(header, stream, columns);
+    std::vector<uint32_t> values(nbRecords);
+
+    for (int i = 0; i < nbColumns && nbRecords != 0; i++)
+    {
+        uint32_t prevValue = ReadRecordValue(stream, records, columns[i]);
+
+        if (stream == LeydenJarRecordLevels)
+        {
+            WriteVarint(prevValue, out);
+            for (uint32_t record = 1; record < nbRecords; record++)
+            {
+                uint32_t value = ReadRecordValue(stream, records + record * recordSize, columns[i]);
+                values[record - 1] = ZigZagEncode(int32_t(value) - int32_t(prevValue));
+                prevValue = value;
+            }
+            PackValues(values.data(), nbRecords - 1, out);
+        }
+        else
+        {
+            values[0] = prevValue;
+            for (uint32_t record = 1; record < nbRecords; record++)
+            {
+                uint32_t value = ReadRecordValue(stream, records + record * recordSize, columns[i]);
+                values[record] = value ^ prevValue;
+                prevValue = value;
+            }
+            PackValues(values.data(), nbRecords, out);
+        }
+    }
+
+    chunkHeader.payloadSize = uint32_t(out.size() - headerOffset - sizeof(chunkHeader));
+    std::memcpy(&out[headerOffset], &chunkHeader, sizeof(chunkHeader));
+}
+
+bool DecodeRecordingChunk(const LeydenJarRecordingHeader& header, const LeydenJarChunkHeader& chunkHeader, const uint8_t* payload, std::vector<uint64_t>& timestamps, std::vector<uint8_t>& records)
+{
+    int stream = chunkHeader.stream;
+    uint32_t nbRecords = chunkHeader.nbRecords;
+    const uint8_t* pData = payload;
+    const uint8_t* pEnd = payload + chunkHeader.payloadSize;
+
+    if (IsChunkHeaderValid(chunkHeader) == false)
+        return false;
+
+    size_t recordSize = GetRecordSize(stream);
+    timestamps.resize(nbRecords);
+    records.assign(size_t(nbRecords) * recordSize, 0);
+
+    uint64_t prevTimestamp = chunkHeader.firstTimestampNs;
+    int64_t prevDelta = 0;
+    for (uint32_t i = 0; i < nbRecords; i++)
+    {
+        uint64_t zigZag;
+        if (ReadVarint(pData, pEnd, zigZag) == false)
+            return false;
+
+        int64_t delta = prevDelta + (int64_t(zigZag >> 1) ^ -int64_t(zigZag & 1));
+        timestamps[i] = prevTimestamp + uint64_t(delta);
+        prevTimestamp = timestamps[i];
+        prevDelta = delta;
+    }
+
+    int columns[18 * 8];
+    int nbColumns = GetColumns(header, stream, columns);
+    std::vector<uint32_t> values(nbRecords);
+
+    for (int i = 0; i < nbColumns && nbRecords != 0; i++)
+    {
+        if (stream == LeydenJarRecordLevels)
+        {
+            uint64_t firstValue;
+            if (ReadVarint(pData, pEnd, firstValue) == false || UnpackValues(pData, pEnd, nbRecords - 1, values.data()) == false)
+                return false;
+
+            uint32_t value = uint32_t(firstValue);
+            WriteRecordValue(stream, &records[0], columns[i], value);
+            for (uint32_t record = 1; record < nbRecords; record++)
+            {
+                value = uint32_t(int32_t(value) + ZigZagDecode(values[record - 1]));
+                WriteRecordValue(stream, &records[record * recordSize], columns[i], value);
+            }
+        }
+        else
+        {
+            if (UnpackValues(pData, pEnd, nbRecords, values.data()) == false)
+                return false;
+
+            uint32_t value = 0;
+            for (uint32_t record = 0; record < nbRecords; record++)
+            {
+                value ^= values[record];
+                WriteRecordValue(stream, &records[record * recordSize], columns[i], value);
+            }
+        }
+    }
+
+    return pData == pEnd;
+}
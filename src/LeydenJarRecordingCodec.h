@@ -0,0 +1,66 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Level recording file format, all integers are little endian:
+//   - a LeydenJarRecordingHeader,
+//   - then chunks until end of file, each one is a LeydenJarChunkHeader followed by payloadSize bytes.
+// A chunk holds consecutive records of a single stream (levels, physical scans or logical scans) stored column by column:
+//   - timestamps: delta of delta to the previous timestamp, zigzag encoded and bit-packed,
+//   - levels: one column per key, first level as a varint then deltas to previous level, zigzag encoded and bit-packed,
+//   - physical and logical scans: one column per controller column or logical row, XOR with previous value and bit-packed.
+// Bit-packed columns are blocks of up to 128 values: the bit width as one byte then the values packed LSB first.
+// Unchanged keys cost a single byte per block of 128 records, every chunk can be decoded on its own.
+
+enum LeydenJarRecordStream
+{
+	LeydenJarRecordLevels = 0,
+	LeydenJarRecordPhysical,
+	LeydenJarRecordLogical,
+	LeydenJarRecordStreamCount
+};
+
+struct LeydenJarRecordingHeader
+{
+	char		magic[4];
+	uint16_t	version;
+	uint8_t		nbPhysicalCols;
+	uint8_t		nbPhysicalRows;
+	uint8_t		nbLogicalRows;
+	uint8_t		switchTechnology;
+	uint8_t		nbBins;
+	uint8_t		reserved;
+	uint16_t	dacThreshold[16];
+	uint8_t		binningMap[18][8];
+};
+
+struct LeydenJarChunkHeader
+{
+	char		magic[4];
+	uint8_t		stream;
+	uint8_t		reserved[3];
+	uint32_t	nbRecords;
+	uint32_t	payloadSize;
+	uint64_t	firstTimestampNs;
+};
+
+// Fills magic and version of a recording header
+void InitRecordingHeader(LeydenJarRecordingHeader& header);
+bool IsRecordingHeaderValid(const LeydenJarRecordingHeader& header);
+
+// Checks magic, stream and record count of a chunk header before anything is allocated from it: every record costs at
+// least one payload byte and the decoded records of a chunk are limited to 64 MB
+bool IsChunkHeaderValid(const LeydenJarChunkHeader& chunkHeader);
+
+// Size of one raw record in memory: uint16_t[18][8] levels, uint8_t[18] physical scan or uint32_t[16] logical rows
+size_t GetRecordSize(int stream);
+
+// Appends an encoded chunk (header and payload) of nbRecords raw records to out
+void EncodeRecordingChunk(const LeydenJarRecordingHeader& header, int stream, uint32_t nbRecords, const uint64_t* timestamps, const uint8_t* records, std::vector<uint8_t>& out);
+// Decodes the payload of a chunk into raw records, returns false on corrupted data or invalid chunk header
+bool DecodeRecordingChunk(const LeydenJarRecordingHeader& header, const LeydenJarChunkHeader& chunkHeader, const uint8_t* payload, std::vector<uint64_t>& timestamps, std::vector<uint8_t>& records);
@@ -0,0 +1,149 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+
+#include "LeydenJarSessionManager.h"
+
+LeydenJarSessionManager::LeydenJarSessionManager()
+{
+}
+
+LeydenJarSessionManager::~LeydenJarSessionManager()
+{
+    CloseAllSessions();
+}
+
+bool LeydenJarSessionManager::RefreshDeviceList()
+{
+    CloseAllSessions();
+
+    m_EnumerationAgent.RequestDeviceEnumeration();
+    bool isSuccess = m_EnumerationAgent.WaitEndRequest();
+
+    m_Sessions.resize(m_EnumerationAgent.GetNbEnumeratedDevices());
+
+    return isSuccess;
+}
+
+int LeydenJarSessionManager::GetNbEnumeratedDevices()
+{
+    return m_EnumerationAgent.GetNbEnumeratedDevices();
+}
+
+struct hid_device_info* LeydenJarSessionManager::GetHidDeviceInfo(int deviceIndex)
+{
+    return m_EnumerationAgent.GetHidDeviceInfo(deviceIndex);
+}
+
+LeydenJarAgent* LeydenJarSessionManager::GetEnumerationAgent()
+{
+    return &m_EnumerationAgent;
+}
+
+void LeydenJarSessionManager::ConnectSessions(const std::vector<int>& deviceIndexes)
+{
+    std::vector<LeydenJarAgent*> agents;
+
+    for (size_t i = 0; i < deviceIndexes.size(); i++)
+    {
+        m_Sessions[deviceIndexes[i]].reset(new LeydenJarAgent());
+        agents.push_back(m_Sessions[deviceIndexes[i]].get());
+    }
+
+    // Each agent has its own enumeration list, HID handles can't be shared between threads
+    for (size_t i = 0; i < agents.size(); i++)
+        agents[i]->RequestDeviceEnumeration();
+    for (size_t i = 0; i < agents.size(); i++)
+        agents[i]->WaitEndRequest();
+
+    // Enumeration order is not guaranteed to be stable, devices are matched by path
+    std::vector<bool> isConnecting(agents.size(), false);
+    for (size_t i = 0; i < agents.size(); i++)
+    {
+        const char* devicePath = m_EnumerationAgent.GetHidDeviceInfo(deviceIndexes[i])->path;
+        for (int agentDeviceIndex = 0; agentDeviceIndex < agents[i]->GetNbEnumeratedDevices(); agentDeviceIndex++)
+        {
+            if (std::strcmp(agents[i]->GetHidDeviceInfo(agentDeviceIndex)->path, devicePath) == 0)
+            {
+                agents[i]->RequestDeviceConnection(agentDeviceIndex);
+                isConnecting[i] = true;
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < agents.size(); i++)
+        if (isConnecting[i] && agents[i]->WaitEndRequest() == false)
+            isConnecting[i] = false;
+
+    // Key outputs are disabled while the device is inspected, like for a single device
+    for (size_t i = 0; i < agents.size(); i++)
+        if (isConnecting[i])
+            agents[i]->RequestDisable();
+    for (size_t i = 0; i < agents.size(); i++)
+        if (isConnecting[i])
+            agents[i]->WaitEndRequest();
+
+    for (size_t i = 0; i < agents.size(); i++)
+        if (agents[i]->IsDeviceOpened() == false)
+            m_Sessions[deviceIndexes[i]].reset();
+}
+
+LeydenJarAgent* LeydenJarSessionManager::OpenSession(int deviceIndex)
+{
+    if (deviceIndex < 0 || deviceIndex >= int(m_Sessions.size()))
+        return nullptr;
+
+    // A session whose device got closed (bootloader, EEPROM erase, unplug) is reconnected
+    if (m_Sessions[deviceIndex] == nullptr || m_Sessions[deviceIndex]->IsDeviceOpened() == false)
+        ConnectSessions(std::vector<int>(1, deviceIndex));
+
+    return m_Sessions[deviceIndex].get();
+}
+
+int LeydenJarSessionManager::OpenAllSessions()
+{
+    std::vector<int> deviceIndexes;
+
+    for (int deviceIndex = 0; deviceIndex < int(m_Sessions.size()); deviceIndex++)
+        if (m_Sessions[deviceIndex] == nullptr || m_Sessions[deviceIndex]->IsDeviceOpened() == false)
+            deviceIndexes.push_back(deviceIndex);
+
+    ConnectSessions(deviceIndexes);
+
+    return GetNbOpenedSessions();
+}
+
+LeydenJarAgent* LeydenJarSessionManager::GetSession(int deviceIndex)
+{
+    if (deviceIndex < 0 || deviceIndex >= int(m_Sessions.size()))
+        return nullptr;
+
+    return m_Sessions[deviceIndex].get();
+}
+
+int LeydenJarSessionManager::GetNbOpenedSessions()
+{
+    int nbOpenedSessions = 0;
+
+    for (size_t i = 0; i < m_Sessions.size(); i++)
+        if (m_Sessions[i] != nullptr && m_Sessions[i]->IsDeviceOpened())
+            nbOpenedSessions++;
+
+    return nbOpenedSessions;
+}
+
+void LeydenJarSessionManager::CloseAllSessions()
+{
+    for (size_t i = 0; i < m_Sessions.size(); i++)
+        if (m_Sessions[i] != nullptr && m_Sessions[i]->IsDeviceOpened())
+            m_Sessions[i]->RequestEnable();
+
+    for (size_t i = 0; i < m_Sessions.size(); i++)
+        if (m_Sessions[i] != nullptr)
+            m_Sessions[i]->WaitEndRequest();
+
+    // Agents destructors stop their daemon threads, which close the devices
+    for (size_t i = 0; i < m_Sessions.size(); i++)
+        m_Sessions[i].reset();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <vector>
+#include <memory>
+
+#include "LeydenJarAgent.h"
+
+// This class keeps several Leyden Jar devices opened at the same time.
+// Each opened device (a session) gets its own LeydenJarAgent, so its own daemon thread, HID handle and data snapshots:
+// sessions never wait for each other and a whole rack of keyboards can be monitored in parallel.
+// A dedicated agent, that never opens any device, is used to enumerate the devices.
+
+class LeydenJarSessionManager
+{
+public:
+
+	LeydenJarSessionManager();
+	~LeydenJarSessionManager();
+
+	// Enumerates HID devices, opened sessions are closed first as device indexes can change
+	bool RefreshDeviceList();
+	// Returns the number of enumerated HID devices
+	int GetNbEnumeratedDevices();
+	// Returns information for the selected HID device
+	struct hid_device_info* GetHidDeviceInfo(int deviceIndex);
+	// Returns the agent used for enumeration, it is never connected to a device
+	LeydenJarAgent* GetEnumerationAgent();
+
+	// Opens a session on a device if not already done, sessions whose device got closed are reconnected.
+	// Returns its agent or nullptr on failure
+	LeydenJarAgent* OpenSession(int deviceIndex);
+	// Opens sessions on all enumerated devices, connections are done in parallel. Returns the number of opened sessions
+	int OpenAllSessions();
+	// Returns the agent of an opened session, nullptr if the device has no opened session
+	LeydenJarAgent* GetSession(int deviceIndex);
+	// Returns the number of sessions whose device is still opened
+	int GetNbOpenedSessions();
+	// Re-enables key outputs of all opened devices and closes their sessions
+	void CloseAllSessions();
+
+private:
+
+	// Connects new agents to a list of devices, each step is sent to all agents before waiting for any of them
+	void ConnectSessions(const std::vector<int>& deviceIndexes);
+
+private:
+
+	LeydenJarAgent m_EnumerationAgent;
+	std::vector< std::unique_ptr<LeydenJarAgent> > m_Sessions;
+};
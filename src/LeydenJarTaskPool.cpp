@@ -0,0 +1,178 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include "LeydenJarTaskPool.h"
+
+// Pool and queue of the current thread when it is a worker, used to keep tasks submitted by a task local
+static thread_local LeydenJarTaskPool* s_pCurrentPool = nullptr;
+static thread_local int s_CurrentWorkerIndex = -1;
+
+LeydenJarTaskGroup::LeydenJarTaskGroup()
+    : m_NbPendingTasks(0)
+{
+}
+
+bool LeydenJarTaskGroup::IsBusy()
+{
+    return m_NbPendingTasks.load(std::memory_order_acquire) != 0;
+}
+
+void LeydenJarTaskGroup::Wait()
+{
+    // Last task decrements the count while holding the mutex, so the group can be destroyed as soon as this returns
+    std::unique_lock<std::mutex> lk(m_Mutex);
+    m_CondVar.wait(lk, [this] { return !IsBusy(); });
+}
+
+LeydenJarTaskPool::LeydenJarTaskPool(int nbWorkers)
+    : m_NbQueuedTasks(0)
+    , m_NextQueue(0)
+    , m_ExitWorkers(false)
+{
+    // Without workers, a single queue holds the tasks until they are waited for
+    if (nbWorkers == kNoWorkers)
+    {
+        m_Queues.push_back(std::unique_ptr<LeydenJarWorkerQueue>(new LeydenJarWorkerQueue()));
+        return;
+    }
+
+    if (nbWorkers <= 0)
+        nbWorkers = int(std::thread::hardware_concurrency());
+    if (nbWorkers <= 0)
+        nbWorkers = 1;
+
+    for (int i = 0; i < nbWorkers; i++)
+        m_Queues.push_back(std::unique_ptr<LeydenJarWorkerQueue>(new LeydenJarWorkerQueue()));
+
+    for (int i = 0; i < nbWorkers; i++)
+        m_Workers.push_back(std::thread(&LeydenJarTaskPool::WorkerLoop, this, i));
+}
+
+LeydenJarTaskPool::~LeydenJarTaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_SleepMutex);
+        m_ExitWorkers = true;
+    }
+    m_SleepCondVar.notify_all();
+
+    for (size_t i = 0; i < m_Workers.size(); i++)
+        m_Workers[i].join();
+}
+
+int LeydenJarTaskPool::GetNbWorkers()
+{
+    return int(m_Workers.size());
+}
+
+void LeydenJarTaskPool::Submit(LeydenJarTaskGroup& group, const LeydenJarTask& task)
+{
+    group.m_NbPendingTasks.fetch_add(1, std::memory_order_relaxed);
+
+    int queueIndex;
+    if (s_pCurrentPool == this)
+        queueIndex = s_CurrentWorkerIndex;
+    else
+        queueIndex = int(m_NextQueue.fetch_add(1, std::memory_order_relaxed) % m_Queues.size());
+
+    {
+        std::lock_guard<std::mutex> lk(m_Queues[queueIndex]->mutex);
+        m_Queues[queueIndex]->tasks.push_back(std::make_pair(task, &group));
+    }
+
+    // Count is raised once the task can be popped, taking the sleep mutex makes sure a worker about to sleep sees it.
+    // Another thread can pop the task before, so the count can be briefly negative
+    {
+        std::lock_guard<std::mutex> lk(m_SleepMutex);
+        m_NbQueuedTasks.fetch_add(1, std::memory_order_release);
+    }
+    m_SleepCondVar.notify_one();
+}
+
+void LeydenJarTaskPool::Wait(LeydenJarTaskGroup& group)
+{
+    int workerIndex = (s_pCurrentPool == this) ? s_CurrentWorkerIndex : 0;
+
+    while (group.IsBusy())
+    {
+        LeydenJarTask task;
+        LeydenJarTaskGroup* pGroup;
+
+        if (PopTask(workerIndex, task, pGroup) == false)
+            break;
+
+        RunTask(task, pGroup);
+    }
+
+    // Nothing left to help with, remaining tasks of the group are running on workers
+    group.Wait();
+}
+
+bool LeydenJarTaskPool::PopTask(int workerIndex, LeydenJarTask& task, LeydenJarTaskGroup*& pGroup)
+{
+    if (m_NbQueuedTasks.load(std::memory_order_acquire) <= 0)
+        return false;
+
+    int nbQueues = int(m_Queues.size());
+
+    for (int i = 0; i < nbQueues; i++)
+    {
+        LeydenJarWorkerQueue& queue = *m_Queues[(workerIndex + i) % nbQueues];
+        std::lock_guard<std::mutex> lk(queue.mutex);
+
+        if (queue.tasks.empty())
+            continue;
+
+        // Own queue is used as a stack to stay cache friendly, other queues are stolen from the opposite end
+        if (i == 0)
+        {
+            task = queue.tasks.back().first;
+            pGroup = queue.tasks.back().second;
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = queue.tasks.front().first;
+            pGroup = queue.tasks.front().second;
+            queue.tasks.pop_front();
+        }
+
+        m_NbQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+void LeydenJarTaskPool::RunTask(const LeydenJarTask& task, LeydenJarTaskGroup* pGroup)
+{
+    task();
+
+    std::lock_guard<std::mutex> lk(pGroup->m_Mutex);
+    if (pGroup->m_NbPendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        pGroup->m_CondVar.notify_all();
+}
+
+void LeydenJarTaskPool::WorkerLoop(int workerIndex)
+{
+    s_pCurrentPool = this;
+    s_CurrentWorkerIndex = workerIndex;
+
+    for (;;)
+    {
+        LeydenJarTask task;
+        LeydenJarTaskGroup* pGroup;
+
+        if (PopTask(workerIndex, task, pGroup))
+        {
+            RunTask(task, pGroup);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lk(m_SleepMutex);
+        m_SleepCondVar.wait(lk, [this] { return m_ExitWorkers || m_NbQueuedTasks.load(std::memory_order_acquire) > 0; });
+
+        if (m_ExitWorkers)
+            break;
+    }
+}
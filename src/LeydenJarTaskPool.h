@@ -0,0 +1,89 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// A group of tasks that can be waited for as a whole.
+// A group must not be destroyed while some of its tasks are still queued or running.
+
+class LeydenJarTaskGroup
+{
+	friend class LeydenJarTaskPool;
+
+public:
+
+	LeydenJarTaskGroup();
+
+	// Returns true if some tasks of the group are still queued or running
+	bool IsBusy();
+	// Blocks until all tasks of the group are done, without running any of them
+	void Wait();
+
+private:
+
+	std::atomic<int>		m_NbPendingTasks;
+	std::mutex				m_Mutex;
+	std::condition_variable	m_CondVar;
+};
+
+// This class is a small work-stealing thread pool used for analysis jobs.
+// Each worker owns a task queue: it pops its newest tasks first and, once empty, steals the oldest tasks of the other workers.
+// Tasks submitted from a worker go to its own queue, tasks submitted from other threads are spread over all queues.
+
+class LeydenJarTaskPool
+{
+public:
+
+	typedef std::function<void()> LeydenJarTask;
+
+	// Pool without worker threads, tasks are run by the threads waiting for them. Used as a single thread baseline
+	static const int kNoWorkers = -1;
+
+public:
+
+	// 0 workers means one worker per hardware thread
+	explicit LeydenJarTaskPool(int nbWorkers = 0);
+	~LeydenJarTaskPool();
+
+	// Returns the number of worker threads
+	int GetNbWorkers();
+
+	// Queues a task, it will be run by one of the workers, or by Wait if the pool has none
+	void Submit(LeydenJarTaskGroup& group, const LeydenJarTask& task);
+	// Waits for all tasks of a group, the calling thread runs queued tasks while waiting
+	void Wait(LeydenJarTaskGroup& group);
+
+private:
+
+	struct LeydenJarWorkerQueue
+	{
+		std::mutex					mutex;
+		std::deque< std::pair<LeydenJarTask, LeydenJarTaskGroup*> >	tasks;
+	};
+
+private:
+
+	void WorkerLoop(int workerIndex);
+	// Pops a task from the worker own queue, or steals one from the other queues
+	bool PopTask(int workerIndex, LeydenJarTask& task, LeydenJarTaskGroup*& pGroup);
+	void RunTask(const LeydenJarTask& task, LeydenJarTaskGroup* pGroup);
+
+private:
+
+	std::vector< std::unique_ptr<LeydenJarWorkerQueue> >	m_Queues;
+	std::vector<std::thread>	m_Workers;
+	std::atomic<int>			m_NbQueuedTasks;
+	std::atomic<unsigned int>	m_NextQueue;
+	std::mutex					m_SleepMutex;
+	std::condition_variable		m_SleepCondVar;
+	bool						m_ExitWorkers;
+};
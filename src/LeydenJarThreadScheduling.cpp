@@ -0,0 +1,162 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include "LeydenJarThreadScheduling.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+// Priority used above the minimal SCHED_FIFO one, leaves room for kernel threads like USB interrupt handlers
+const int c_FifoPriorityOffset	= 10;
+const int c_NicenessBoost		= -10;
+
+#if defined(_WIN32)
+
+static bool ApplyAffinity(int cpuCore, LeydenJarSchedulingStatus& status)
+{
+    DWORD_PTR processMask;
+    DWORD_PTR systemMask;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) == 0)
+        return false;
+
+    DWORD_PTR threadMask = processMask;
+    if (cpuCore >= 0)
+    {
+        if (cpuCore >= int(sizeof(DWORD_PTR) * 8) || (processMask & (DWORD_PTR(1) << cpuCore)) == 0)
+            return false;
+        threadMask = DWORD_PTR(1) << cpuCore;
+    }
+
+    if (SetThreadAffinityMask(GetCurrentThread(), threadMask) == 0)
+        return false;
+
+    status.cpuCore = cpuCore;
+    return true;
+}
+
+static bool ApplyPriority(bool realTime, LeydenJarSchedulingStatus& status)
+{
+    int priority = realTime ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_NORMAL;
+    if (SetThreadPriority(GetCurrentThread(), priority) == 0)
+        return false;
+
+    status.policy = realTime ? LeydenJarSchedulingPolicyTimeCritical : LeydenJarSchedulingPolicyDefault;
+    status.priority = priority;
+    return true;
+}
+
+#else
+
+static bool ApplyAffinity(int cpuCore, LeydenJarSchedulingStatus& status)
+{
+#if defined(__linux__)
+    long nbCores = sysconf(_SC_NPROCESSORS_CONF);
+    if (cpuCore >= nbCores || cpuCore >= CPU_SETSIZE)
+        return false;
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    if (cpuCore >= 0)
+        CPU_SET(cpuCore, &cpuSet);
+    else
+        for (long i = 0; i < nbCores && i < CPU_SETSIZE; i++)
+            CPU_SET(i, &cpuSet);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0)
+        return false;
+
+    status.cpuCore = cpuCore;
+    return true;
+#else
+    // No portable way to pin a thread on this platform (MacOSX only has affinity hints)
+    return cpuCore < 0;
+#endif
+}
+
+static bool SetNiceness(int niceness)
+{
+#if defined(__linux__)
+    // On Linux niceness is a per thread attribute when addressed with the thread id
+    return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), niceness) == 0;
+#else
+    (void)niceness;
+    return false;
+#endif
+}
+
+static bool ApplyPriority(bool realTime, LeydenJarSchedulingStatus& status)
+{
+    sched_param param;
+
+    if (realTime)
+    {
+        int minPriority = sched_get_priority_min(SCHED_FIFO);
+        int maxPriority = sched_get_priority_max(SCHED_FIFO);
+        param.sched_priority = minPriority + c_FifoPriorityOffset;
+        if (param.sched_priority > maxPriority)
+            param.sched_priority = maxPriority;
+
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+        {
+            status.policy = LeydenJarSchedulingPolicyFifo;
+            status.priority = param.sched_priority;
+            return true;
+        }
+
+        // Not permitted (no CAP_SYS_NICE or RLIMIT_RTPRIO), fall back to a niceness boost
+        if (SetNiceness(c_NicenessBoost))
+        {
+            status.policy = LeydenJarSchedulingPolicyNiceness;
+            status.priority = c_NicenessBoost;
+            return true;
+        }
+
+        return false;
+    }
+
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    SetNiceness(0);
+
+    status.policy = LeydenJarSchedulingPolicyDefault;
+    status.priority = 0;
+    return true;
+}
+
+#endif
+
+bool ApplyThreadScheduling(bool realTime, int cpuCore, LeydenJarSchedulingStatus& status)
+{
+    bool isSuccess = true;
+
+    if (ApplyAffinity(cpuCore, status) == false)
+        isSuccess = false;
+    if (ApplyPriority(realTime, status) == false)
+        isSuccess = false;
+
+    return isSuccess;
+}
+
+const char* GetSchedulingPolicyName(int policy)
+{
+    switch (policy)
+    {
+    case LeydenJarSchedulingPolicyFifo:
+        return "SCHED_FIFO";
+    case LeydenJarSchedulingPolicyNiceness:
+        return "Niceness boost";
+    case LeydenJarSchedulingPolicyTimeCritical:
+        return "Time critical";
+    default:
+        return "Default";
+    }
+}
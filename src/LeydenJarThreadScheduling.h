@@ -0,0 +1,33 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+// Set of helper functions to tune the scheduling of the calling thread.
+// They hide the platform specific APIs (Win32, POSIX/Linux) used to get a lower and more stable latency for the agent thread.
+
+// Scheduling policies that can be achieved by ApplyThreadScheduling()
+enum LeydenJarSchedulingPolicy
+{
+	LeydenJarSchedulingPolicyDefault = 0,
+	LeydenJarSchedulingPolicyFifo,
+	LeydenJarSchedulingPolicyNiceness,
+	LeydenJarSchedulingPolicyTimeCritical
+};
+
+// What was really achieved, the OS may refuse some requests when the process does not have enough privileges
+struct LeydenJarSchedulingStatus
+{
+	int policy;
+	int priority;
+	int cpuCore;
+};
+
+// Applies scheduling options to the calling thread.
+// When realTime is true SCHED_FIFO is tried first, then a niceness boost, on Windows the thread is set time critical.
+// cpuCore pins the thread to a core, -1 restores the affinity to all cores.
+// Returns false if at least one of the requested options could not be applied.
+bool ApplyThreadScheduling(bool realTime, int cpuCore, LeydenJarSchedulingStatus& status);
+
+// Returns a printable name for a LeydenJarSchedulingPolicy value
+const char* GetSchedulingPolicyName(int policy);
@@ -0,0 +1,183 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "LeydenJarThresholdAdvisor.h"
+#include "LeydenJarLevelCompare.h"
+
+// Standard deviation of the quantization noise of 1 LSB, no population can be narrower
+const double c_MinStdDev = 0.2887;
+
+LeydenJarThresholdAdvisor::LeydenJarThresholdAdvisor()
+    : m_IsBeamSpring(false)
+{
+    std::memset(m_Thresholds, 0, sizeof(m_Thresholds));
+    std::memset(m_BinningMap, 255, sizeof(m_BinningMap));
+    Reset();
+}
+
+void LeydenJarThresholdAdvisor::SetLayout(bool isBeamSpring, const uint16_t thresholds[18][8], const uint8_t binningMap[18][8])
+{
+    m_IsBeamSpring = isBeamSpring;
+    std::memcpy(m_Thresholds, thresholds, sizeof(m_Thresholds));
+    std::memcpy(m_BinningMap, binningMap, sizeof(m_BinningMap));
+    Reset();
+}
+
+void LeydenJarThresholdAdvisor::Reset()
+{
+    std::memset(m_Unpressed, 0, sizeof(m_Unpressed));
+    std::memset(m_Pressed, 0, sizeof(m_Pressed));
+}
+
+void LeydenJarThresholdAdvisor::AddToAccumulator(LeydenJarLevelAccumulator& accumulator, uint16_t level, bool isPressed)
+{
+    if (accumulator.nbSamples == 0)
+        accumulator.worstLevel = level;
+    else if (isPressed != m_IsBeamSpring)
+        accumulator.worstLevel = std::min(accumulator.worstLevel, level);
+    else
+        accumulator.worstLevel = std::max(accumulator.worstLevel, level);
+
+    accumulator.nbSamples++;
+    double delta = level - accumulator.mean;
+    accumulator.mean += delta / accumulator.nbSamples;
+    accumulator.m2 += delta * (level - accumulator.mean);
+}
+
+void LeydenJarThresholdAdvisor::AddSample(int col, int row, uint16_t level, uint16_t levelPrev1, uint16_t levelPrev2)
+{
+    uint16_t threshold = m_Thresholds[col][row];
+    bool isPressed0 = IsLevelPressed(level, threshold, m_IsBeamSpring);
+    bool isPressed1 = IsLevelPressed(levelPrev1, threshold, m_IsBeamSpring);
+    bool isPressed2 = IsLevelPressed(levelPrev2, threshold, m_IsBeamSpring);
+
+    // Only samples whose last 3 levels agree on the key state are accumulated
+    if (isPressed0 && isPressed1 && isPressed2)
+        AddToAccumulator(m_Pressed[col * 8 + row], level, true);
+    else if (isPressed0 == false && isPressed1 == false && isPressed2 == false)
+        AddToAccumulator(m_Unpressed[col * 8 + row], level, false);
+}
+
+void LeydenJarThresholdAdvisor::MergeAccumulator(LeydenJarLevelAccumulator& merged, const LeydenJarLevelAccumulator& accumulator, bool isPressed)
+{
+    if (accumulator.nbSamples == 0)
+        return;
+
+    if (merged.nbSamples == 0)
+    {
+        merged = accumulator;
+        return;
+    }
+
+    // Parallel variant of Welford's update (Chan et al.)
+    uint64_t nbSamples = merged.nbSamples + accumulator.nbSamples;
+    double delta = accumulator.mean - merged.mean;
+
+    merged.mean += delta * accumulator.nbSamples / nbSamples;
+    merged.m2 += accumulator.m2 + delta * delta * (double(merged.nbSamples) * accumulator.nbSamples / nbSamples);
+    merged.nbSamples = nbSamples;
+
+    if (isPressed != m_IsBeamSpring)
+        merged.worstLevel = std::min(merged.worstLevel, accumulator.worstLevel);
+    else
+        merged.worstLevel = std::max(merged.worstLevel, accumulator.worstLevel);
+}
+
+void LeydenJarThresholdAdvisor::ComputePopulation(const LeydenJarLevelAccumulator& accumulator, LeydenJarLevelPopulation& population)
+{
+    population.nbSamples = accumulator.nbSamples;
+    population.mean = float(accumulator.mean);
+    population.stdDev = 0.f;
+    population.worstLevel = accumulator.worstLevel;
+
+    if (accumulator.nbSamples > 1)
+        population.stdDev = float(std::sqrt(accumulator.m2 / (accumulator.nbSamples - 1)));
+}
+
+void LeydenJarThresholdAdvisor::ComputeErrorRates(const LeydenJarBinRecommendation& recommendation, double threshold, double& falsePressRate, double& missedPressRate)
+{
+    // Capacitive keys are pressed for level >= threshold, beam spring keys for level <= threshold.
+    // Half a level of continuity correction is applied as levels are integers
+    double polarity = m_IsBeamSpring ? -1.0 : 1.0;
+    double unpressedStdDev = std::max(double(recommendation.unpressed.stdDev), c_MinStdDev);
+    double pressedStdDev = std::max(double(recommendation.pressed.stdDev), c_MinStdDev);
+
+    double unpressedZ = (polarity * (threshold - recommendation.unpressed.mean) - 0.5) / unpressedStdDev;
+    double pressedZ = (polarity * (recommendation.pressed.mean - threshold) + 0.5) / pressedStdDev;
+
+    falsePressRate = 0.5 * std::erfc(unpressedZ / std::sqrt(2.0));
+    missedPressRate = 0.5 * std::erfc(pressedZ / std::sqrt(2.0));
+}
+
+void LeydenJarThresholdAdvisor::ComputeRecommendations(int nbCols, int nbRows, LeydenJarBinRecommendation recommendations[kNbBins])
+{
+    LeydenJarLevelAccumulator unpressed[kNbBins];
+    LeydenJarLevelAccumulator pressed[kNbBins];
+
+    std::memset(recommendations, 0, kNbBins * sizeof(LeydenJarBinRecommendation));
+    std::memset(unpressed, 0, sizeof(unpressed));
+    std::memset(pressed, 0, sizeof(pressed));
+
+    for (int col = 0; col < nbCols; col++)
+    {
+        for (int row = 0; row < nbRows; row++)
+        {
+            int bin = m_BinningMap[col][row];
+            if (bin >= kNbBins)
+                continue;
+
+            recommendations[bin].nbKeys++;
+            recommendations[bin].currentThreshold = m_Thresholds[col][row];
+            MergeAccumulator(unpressed[bin], m_Unpressed[col * 8 + row], false);
+            MergeAccumulator(pressed[bin], m_Pressed[col * 8 + row], true);
+        }
+    }
+
+    for (int bin = 0; bin < kNbBins; bin++)
+    {
+        LeydenJarBinRecommendation& recommendation = recommendations[bin];
+
+        ComputePopulation(unpressed[bin], recommendation.unpressed);
+        ComputePopulation(pressed[bin], recommendation.pressed);
+
+        if (recommendation.unpressed.nbSamples < kMinSamples || recommendation.pressed.nbSamples < kMinSamples)
+            continue;
+
+        double polarity = m_IsBeamSpring ? -1.0 : 1.0;
+        double unpressedStdDev = std::max(double(recommendation.unpressed.stdDev), c_MinStdDev);
+        double pressedStdDev = std::max(double(recommendation.pressed.stdDev), c_MinStdDev);
+        double separation = polarity * (recommendation.pressed.mean - recommendation.unpressed.mean);
+
+        if (separation <= 0.0)
+            continue;
+
+        // Threshold at equal distance in standard deviations maximizes the smallest margin of both populations
+        double threshold = (recommendation.unpressed.mean * pressedStdDev + recommendation.pressed.mean * unpressedStdDev) / (unpressedStdDev + pressedStdDev);
+
+        recommendation.isValid = true;
+        recommendation.recommendedThreshold = uint16_t(std::min(std::max(std::floor(threshold + 0.5), 0.0), 65535.0));
+        recommendation.marginSigma = float(separation / (unpressedStdDev + pressedStdDev));
+
+        ComputeErrorRates(recommendation, recommendation.currentThreshold, recommendation.currentFalsePressRate, recommendation.currentMissedPressRate);
+        ComputeErrorRates(recommendation, recommendation.recommendedThreshold, recommendation.falsePressRate, recommendation.missedPressRate);
+    }
+}
+
+void LeydenJarThresholdAdvisor::Merge(LeydenJarThresholdAdvisor& advisor)
+{
+    for (int key = 0; key < kNbKeys; key++)
+    {
+        MergeAccumulator(m_Unpressed[key], advisor.m_Unpressed[key], false);
+        MergeAccumulator(m_Pressed[key], advisor.m_Pressed[key], true);
+    }
+}
+
+void LeydenJarThresholdAdvisor::GetKeyPopulations(int col, int row, LeydenJarLevelPopulation& unpressed, LeydenJarLevelPopulation& pressed)
+{
+    ComputePopulation(m_Unpressed[col * 8 + row], unpressed);
+    ComputePopulation(m_Pressed[col * 8 + row], pressed);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+
+// This class recommends a DAC threshold for every bin of a matrix from the levels seen while keys are exercised.
+// A key sample is unpressed when its last 3 levels are all on the unpressed side of the current threshold, pressed when
+// they are all on the pressed side, samples in between are transitions and are ignored.
+// Per key mean and variance of both populations are updated incrementally (Welford), keys of a bin are merged on demand.
+// The recommended threshold of a bin sits at the same number of standard deviations from both population means,
+// predicted error rates come from a gaussian model of each population.
+// Different keys can be updated from different threads, a given key must always be updated by a single thread at a time.
+
+class LeydenJarThresholdAdvisor
+{
+public:
+
+	static const int kNbKeys = 18 * 8;
+	static const int kNbBins = 16;
+	// Samples needed in each population of a bin before a threshold is recommended
+	static const int kMinSamples = 16;
+
+	struct LeydenJarLevelPopulation
+	{
+		uint64_t	nbSamples;
+		float		mean;
+		float		stdDev;
+		// Extreme level on the side of the threshold (max of unpressed levels, min of pressed levels for capacitive keys)
+		uint16_t	worstLevel;
+	};
+
+	struct LeydenJarBinRecommendation
+	{
+		uint8_t		nbKeys;
+		bool		isValid;
+		uint16_t	currentThreshold;
+		uint16_t	recommendedThreshold;
+		// Distance from recommended threshold to both population means, in standard deviations
+		float		marginSigma;
+		LeydenJarLevelPopulation unpressed;
+		LeydenJarLevelPopulation pressed;
+		// Predicted probabilities for a single key sample
+		double		currentFalsePressRate;
+		double		currentMissedPressRate;
+		double		falsePressRate;
+		double		missedPressRate;
+	};
+
+public:
+
+	LeydenJarThresholdAdvisor();
+
+	// Sets the matrix description, thresholds are already resolved per key. Accumulated samples are cleared
+	void SetLayout(bool isBeamSpring, const uint16_t thresholds[18][8], const uint8_t binningMap[18][8]);
+	void Reset();
+
+	void AddSample(int col, int row, uint16_t level, uint16_t levelPrev1, uint16_t levelPrev2);
+
+	// Merges the keys of every bin, must not run while keys are updated
+	void ComputeRecommendations(int nbCols, int nbRows, LeydenJarBinRecommendation recommendations[kNbBins]);
+	// Adds the samples of another advisor with the same layout, used to combine advisors fed from separate parts of a recording
+	void Merge(LeydenJarThresholdAdvisor& advisor);
+	void GetKeyPopulations(int col, int row, LeydenJarLevelPopulation& unpressed, LeydenJarLevelPopulation& pressed);
+
+private:
+
+	struct LeydenJarLevelAccumulator
+	{
+		uint64_t	nbSamples;
+		double		mean;
+		double		m2;
+		uint16_t	worstLevel;
+	};
+
+	void AddToAccumulator(LeydenJarLevelAccumulator& accumulator, uint16_t level, bool isPressed);
+	void MergeAccumulator(LeydenJarLevelAccumulator& merged, const LeydenJarLevelAccumulator& accumulator, bool isPressed);
+	void ComputePopulation(const LeydenJarLevelAccumulator& accumulator, LeydenJarLevelPopulation& population);
+	void ComputeErrorRates(const LeydenJarBinRecommendation& recommendation, double threshold, double& falsePressRate, double& missedPressRate);
+
+private:
+
+	bool						m_IsBeamSpring;
+	uint16_t					m_Thresholds[18][8];
+	uint8_t						m_BinningMap[18][8];
+	LeydenJarLevelAccumulator	m_Unpressed[kNbKeys];
+	LeydenJarLevelAccumulator	m_Pressed[kNbKeys];
+};
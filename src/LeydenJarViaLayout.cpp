@@ -0,0 +1,234 @@
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <cfloat>
+#include <algorithm>
+
+#include "LeydenJarViaLayout.h"
+#include "json/json.h"
+
+// Position of the first key of a layout option choice
+struct LeydenJarViaPosition
+{
+    float x;
+    float y;
+
+    LeydenJarViaPosition() : x(0.f), y(0.f) {}
+};
+
+void DecodeViaKeyboardLayout(const char* pJsonData, size_t jsonSize, std::vector<LeydenJarViaLayoutOption>& layoutOptions, std::vector< std::vector<LeydenJarViaKey> >& keys)
+{
+    Json::Reader jsonReader;
+    Json::Value root;
+
+    // Decode decompressed json data
+    bool ret = jsonReader.parse(pJsonData, pJsonData + jsonSize, root, false);
+    if (ret == true)
+    {
+        // Read all possible layout options
+        Json::Value labels = root["layouts"]["labels"];
+        if (labels.isArray())
+        {
+            Json::ArrayIndex nbLabels = labels.size();
+            layoutOptions.resize(nbLabels);
+
+            for (Json::ArrayIndex i = 0; i < nbLabels; i++)
+            {
+                Json::Value label = root["layouts"]["labels"][i];
+                if (label.isArray())
+                {
+                    Json::ArrayIndex nbLabelItems = label.size();
+                    layoutOptions[i].listboxItems.resize(nbLabelItems - 1);
+                    layoutOptions[i].isCheckbox = false;
+                    layoutOptions[i].isChecked = false;
+                    layoutOptions[i].selectionIndex = 0;
+
+                    for (Json::ArrayIndex j = 0; j < nbLabels; j++)
+                    {
+                        Json::Value labelElem = root["layouts"]["labels"][i][j];
+                        if (labelElem.isString())
+                        {
+                            Json::String str = labelElem.asString();
+                            if (j == 0)
+                                layoutOptions[i].layoutName = str;
+                            else
+                                layoutOptions[i].listboxItems[j - 1] = str;
+                        }
+                    }
+                }
+                else if (label.isString())
+                {
+                    Json::String str = label.asString();
+                    layoutOptions[i].layoutName = str;
+                    layoutOptions[i].isCheckbox = true;
+                    layoutOptions[i].isChecked = false;
+                    layoutOptions[i].selectionIndex = 0;
+                }
+            }
+        }
+
+        // Read keymap
+        Json::Value keymap = root["layouts"]["keymap"];
+        if (keymap.isArray())
+        {
+            Json::ArrayIndex nbRows = keymap.size();
+            keys.resize(nbRows);
+
+            for (Json::ArrayIndex row = 0; row < nbRows; row++)
+            {
+                Json::Value rowArray = root["layouts"]["keymap"][row];
+                if (rowArray.isArray())
+                {
+                    LeydenJarViaKey key;
+                    key.SetDefaultVals();
+
+                    Json::ArrayIndex nbRowElems = rowArray.size();
+
+                    for (Json::ArrayIndex rowElem = 0; rowElem < nbRowElems; rowElem++)
+                    {
+                        Json::Value elem = root["layouts"]["keymap"][row][rowElem];
+                        if (elem.isObject())
+                        {
+                            Json::Value elem = root["layouts"]["keymap"][row][rowElem]["x"];
+                            if (elem.isNumeric())
+                                key.x = elem.asFloat();
+                            elem = root["layouts"]["keymap"][row][rowElem]["y"];
+                            if (elem.isNumeric())
+                                key.y = elem.asFloat();
+                            elem = root["layouts"]["keymap"][row][rowElem]["w"];
+                            if (elem.isNumeric())
+                                key.w = key.w2 = elem.asFloat();
+                            elem = root["layouts"]["keymap"][row][rowElem]["h"];
+                            if (elem.isNumeric())
+                                key.h = key.h2 = elem.asFloat();
+                            elem = root["layouts"]["keymap"][row][rowElem]["x2"];
+                            if (elem.isNumeric())
+                                key.x2 = elem.asFloat();
+                            elem = root["layouts"]["keymap"][row][rowElem]["y2"];
+                            if (elem.isNumeric())
+                                key.y2 = elem.asFloat();
+                            elem = root["layouts"]["keymap"][row][rowElem]["w2"];
+                            if (elem.isNumeric())
+                                key.w2 = elem.asFloat();
+                            elem = root["layouts"]["keymap"][row][rowElem]["h2"];
+                            if (elem.isNumeric())
+                                key.h2 = elem.asFloat();
+                        }
+                        else if (elem.isString())
+                        {
+                            std::string::size_type rS;
+                            key.row = std::stoi(elem.asString(), &rS);
+                            std::string::size_type cS;
+                            key.col = std::stoi(elem.asString().substr(rS + 1), &cS);
+
+                            if (elem.asString().length() > rS + 1 + cS)
+                            {
+                                std::string::size_type gnS;
+                                key.groupNum = std::stoi(elem.asString().substr(rS + 1 + cS + 3), &gnS);
+                                key.groupIdx = std::stoi(elem.asString().substr(rS + 1 + cS + 3 + gnS + 1));
+                            }
+
+                            keys[row].push_back(key);
+                            key.SetDefaultVals();
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    //Rework keymap to be usable for rendering keys
+    std::vector< std::vector<LeydenJarViaPosition> > layoutPositions;
+    layoutPositions.resize(layoutOptions.size());
+    for (size_t i = 0; i < layoutOptions.size(); i++)
+    {
+        size_t nbOptions;
+        if (layoutOptions[i].isCheckbox)
+            nbOptions = 2;
+        else
+            nbOptions = layoutOptions[i].listboxItems.size();
+        for (size_t j = 0; j < nbOptions; j++)
+            layoutPositions[i].push_back(LeydenJarViaPosition());
+    }
+
+    //All keys positions are relative, we translate them to absolute positions
+    for (size_t row = 0; row < keys.size(); row++)
+    {
+        for (size_t col = 0; col < keys[row].size(); col++)
+        {
+            if (row > 0)
+            {
+                if (col == 0)
+                    keys[row][col].y += keys[row - 1][0].y + keys[row - 1][0].h;
+                else
+                    keys[row][col].y = keys[row][col - 1].y;
+            }
+            if (col > 0)
+            {
+                keys[row][col].x += keys[row][col - 1].x + keys[row][col - 1].w;
+            }
+
+            if (keys[row][col].groupNum != -1)
+            {
+                int groupNum = keys[row][col].groupNum;
+                int groupIdx = keys[row][col].groupIdx;
+
+                if (layoutPositions[groupNum][groupIdx].x == 0.f && layoutPositions[groupNum][groupIdx].y == 0.f)
+                {
+                    layoutPositions[groupNum][groupIdx].x = keys[row][col].x + keys[row][col].x2;
+                    layoutPositions[groupNum][groupIdx].y = keys[row][col].y;
+                }
+            }
+        }
+    }
+
+    //Align all optional layouts to their default layout
+    for (size_t row = 0; row < keys.size(); row++)
+    {
+        for (size_t col = 0; col < keys[row].size(); col++)
+        {
+            if (keys[row][col].groupNum != -1)
+            {
+                int groupNum = keys[row][col].groupNum;
+                int groupIdx = keys[row][col].groupIdx;
+
+                if (groupIdx > 0)
+                {
+                    if (layoutPositions[groupNum][groupIdx].x == layoutPositions[groupNum][0].x)
+                    {
+                        float offsetY = layoutPositions[groupNum][groupIdx].y - layoutPositions[groupNum][0].y;
+                        keys[row][col].y -= offsetY;
+                    }
+                    else if (layoutPositions[groupNum][groupIdx].y == layoutPositions[groupNum][0].y)
+                    {
+                        float offsetX = layoutPositions[groupNum][groupIdx].x - layoutPositions[groupNum][0].x;
+                        keys[row][col].x -= offsetX;
+                    }
+                }
+            }
+        }
+    }
+
+    //Find minimal X and Y positions for the layouts
+    float minX = FLT_MAX;
+    float minY = FLT_MAX;
+
+    for (size_t row = 0; row < keys.size(); row++)
+    {
+        for (size_t col = 0; col < keys[row].size(); col++)
+        {
+            minX = std::min(minX, keys[row][col].x);
+            minY = std::min(minY, keys[row][col].y);
+        }
+    }
+
+    //Translate layouts to zero
+    for (size_t row = 0; row < keys.size(); row++)
+    {
+        for (size_t col = 0; col < keys[row].size(); col++)
+        {
+            keys[row][col].x -= minX;
+            keys[row][col].y -= minY;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// SPDX-FileCopyrightText: 2024 Eric Becourt <rico@mymakercorner.com>
+// SPDX-License-Identifier: MIT
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Decoding of the "layouts" object of VIA/VIAL keyboard definitions, once they are decompressed.
+// Keys are returned per keymap row, with absolute positions and sizes in key units, translated so that the layout starts
+// at 0. Keys of optional layouts are aligned on the default choice of their layout option.
+
+struct LeydenJarViaKey
+{
+	float x;
+	float y;
+	float w;
+	float h;
+	float x2;
+	float y2;
+	float w2;
+	float h2;
+	int row;
+	int col;
+	int groupNum;
+	int groupIdx;
+
+	void SetDefaultVals() 
+	{
+		x = 0.f;
+		y = 0.f;
+		w = 1.f;
+		h = 1.f;
+		x2 = 0.f;
+		y2 = 0.f;
+		w2 = 1.f;
+		h2 = 1.f;
+		row = -1;
+		col = -1;
+		groupNum = -1;
+		groupIdx = -1;
+	}
+};
+
+struct LeydenJarViaLayoutOption
+{
+	bool isCheckbox;
+	bool isChecked;
+	std::string layoutName;
+	std::vector<std::string> listboxItems;
+	int selectionIndex;
+};
+
+// Decodes a JSON keyboard definition into empty option and key lists, they stay empty when it can not be parsed
+void DecodeViaKeyboardLayout(const char* pJsonData, size_t jsonSize, std::vector<LeydenJarViaLayoutOption>& layoutOptions, std::vector< std::vector<LeydenJarViaKey> >& keys);
@@ -11,7 +11,30 @@
 #include "SDL_main.h"
 #include <SDL.h>
 #include <SDL_opengl.h>
+#include <atomic>
 #include "LeydenJarDiagnosticTool.h"
+#include "LeydenJarProfiler.h"
+
+// Without any event the frame is still refreshed at this period, for ImGui timers (tooltips, text cursor)
+static const Uint32 kIdleRefreshMs = 1000;
+
+// Agents wake the main loop up through this user event when they complete a request
+static Uint32 s_AgentEventType = (Uint32)-1;
+static std::atomic<bool> s_IsAgentEventQueued(false);
+
+static void OnAgentRequestCompleted(void* pUserData)
+{
+    (void)pUserData;
+
+    // One queued event is enough, the main loop then checks the data generation of the displayed agent
+    if (s_IsAgentEventQueued.exchange(true) == false)
+    {
+        SDL_Event event;
+        SDL_zero(event);
+        event.type = s_AgentEventType;
+        SDL_PushEvent(&event);
+    }
+}
 
 int main(int argc, char* argv[])
 {
@@ -72,11 +95,18 @@ int main(int argc, char* argv[])
 
     LeydenJarDiagnosticTool diagTool;
 
-    if (diagTool.Initialize() == false)
+    if (diagTool.Initialize(glsl_version) == false)
         return -1;
 
-    // Main loop
+    s_AgentEventType = SDL_RegisterEvents(1);
+    LeydenJarAgent::SetCompletionCallback(OnAgentRequestCompleted, NULL);
+
+    // Main loop, event driven: it sleeps in SDL_WaitEventTimeout() and renders a frame only on inputs, window events
+    // or new data from the agent. Live monitors send a request every frame, its completion triggers the next frame.
     bool done = false;
+    int nbPendingFrames = 1;
+    uint32_t dataGeneration = diagTool.GetDataGeneration();
+    Uint32 lastFrameTicks = SDL_GetTicks();
     while (!done)
     {
         // Poll and handle events (inputs, window resize, etc.)
@@ -85,15 +115,56 @@ int main(int argc, char* argv[])
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application, or clear/overwrite your copy of the keyboard data.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
         SDL_Event event;
-        while (SDL_PollEvent(&event))
+        bool hasEvent;
+        if (nbPendingFrames > 0)
+            hasEvent = SDL_PollEvent(&event) != 0;
+        else
         {
-            ImGui_ImplSDL2_ProcessEvent(&event);
+            hasEvent = SDL_WaitEventTimeout(&event, int(kIdleRefreshMs)) != 0;
+            if (!hasEvent)
+                nbPendingFrames = 1;
+        }
+
+        while (hasEvent)
+        {
+            if (event.type == s_AgentEventType)
+                s_IsAgentEventQueued.store(false);
+            else
+            {
+                ImGui_ImplSDL2_ProcessEvent(&event);
+                // ImGui needs a second frame to settle after an input (hovering, popups, focus)
+                nbPendingFrames = 2;
+            }
             if (event.type == SDL_QUIT)
                 done = true;
             if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE && event.window.windowID == SDL_GetWindowID(window))
                 done = true;
+
+            hasEvent = SDL_PollEvent(&event) != 0;
+        }
+
+        // Completions of other agents also wake the loop up, only the displayed one matters
+        uint32_t newDataGeneration = diagTool.GetDataGeneration();
+        if (newDataGeneration != dataGeneration)
+        {
+            dataGeneration = newDataGeneration;
+            if (nbPendingFrames == 0)
+                nbPendingFrames = 1;
         }
 
+        if (nbPendingFrames == 0 || done)
+            continue;
+        nbPendingFrames--;
+
+        // Live monitors are limited to their maximum refresh rate, events arriving meanwhile are handled by the next frame
+        Uint32 minFramePeriodMs = diagTool.GetMinFramePeriodMs();
+        Uint32 elapsedMs = SDL_GetTicks() - lastFrameTicks;
+        if (elapsedMs < minFramePeriodMs)
+            SDL_Delay(minFramePeriodMs - elapsedMs);
+        lastFrameTicks = SDL_GetTicks();
+
+        LeydenJarProfileScope profileScope(LeydenJarProfiler::ProfileZoneFrame);
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame();
@@ -110,6 +181,7 @@ int main(int argc, char* argv[])
         SDL_GL_SwapWindow(window);
     }
 
+    LeydenJarAgent::SetCompletionCallback(NULL, NULL);
     diagTool.Finalize();
 
     // Cleanup